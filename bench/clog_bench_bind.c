@@ -0,0 +1,35 @@
+/*
+ * clog_bench_bind.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include <stdio.h>
+
+#include "clog_bench_common.h"
+
+/* A block of chained locals, var x1 = x0 + 1; ... so every name is looked up once.
+ * Name resolution is linear if the time per local stays flat as the block doubles */
+
+static size_t write_source(char* src, unsigned int locals)
+{
+	size_t len = sprintf(src,"{\n\tvar x0 = 0;\n");
+	unsigned int i;
+	for (i = 1; i < locals; ++i)
+		len += sprintf(src + len,"\tvar x%u = x%u + 1;\n",i,i-1);
+
+	len += sprintf(src + len,"}\n");
+	return len;
+}
+
+static int measure(const struct clog_diagnostics* diag, const char* src, size_t len, size_t* image_len)
+{
+	(void)image_len;
+	return clog_parse_buffer(NULL,diag,(const unsigned char*)src,len);
+}
+
+int main(int argc, char* argv[])
+{
+	static const struct clog_bench bench = { "locals", "local", 20, 40, 0, &write_source, &measure };
+	return clog_bench_run(&bench,argc,argv);
+}
@@ -0,0 +1,77 @@
+/*
+ * clog_bench_common.c
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#include "clog_bench_common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+static void quiet(void* param, unsigned long line, const char* msg)
+{
+	(void)line;
+	(void)msg;
+	++*(unsigned int*)param;
+}
+
+int clog_bench_run(const struct clog_bench* bench, int argc, char* argv[])
+{
+	static const unsigned int sizes[] = { 1250, 2500, 5000, 10000 };
+	unsigned int repeat = (argc > 1 ? (unsigned int)atoi(argv[1]) : bench->repeat);
+	char per_unit[32];
+	unsigned int s;
+
+	if (!repeat)
+		repeat = 1;
+
+	sprintf(per_unit,"ns/%.28s",bench->unit);
+	printf("%10s %12s %14s",bench->units,"ms/compile",per_unit);
+	if (bench->show_image)
+		printf(" %10s","image");
+	printf("\n");
+
+	for (s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s)
+	{
+		struct clog_diagnostics diag;
+		unsigned int errors = 0;
+		size_t len = 0;
+		size_t image_len = 0;
+		char* src = malloc(sizes[s] * bench->unit_bytes + 64);
+		clock_t start;
+		double secs;
+		unsigned int r;
+
+		if (!src)
+		{
+			fprintf(stderr,"Out of memory\n");
+			return EXIT_FAILURE;
+		}
+		len = (*bench->write_source)(src,sizes[s]);
+
+		diag.diag_fn = &quiet;
+		diag.param = &errors;
+
+		start = clock();
+		for (r = 0; r < repeat; ++r)
+		{
+			if ((*bench->measure)(&diag,src,len,&image_len) != 1)
+			{
+				fprintf(stderr,"Compilation of %u %s failed\n",sizes[s],bench->units);
+				free(src);
+				return EXIT_FAILURE;
+			}
+		}
+		secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		printf("%10u %12.3f %14.1f",sizes[s],secs * 1000.0 / repeat,secs * 1e9 / repeat / sizes[s]);
+		if (bench->show_image)
+			printf(" %10lu",(unsigned long)image_len);
+		printf("\n");
+		free(src);
+	}
+
+	return EXIT_SUCCESS;
+}
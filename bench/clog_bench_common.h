@@ -0,0 +1,34 @@
+/*
+ * clog_bench_common.h
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#ifndef CLOG_BENCH_COMMON_H_
+#define CLOG_BENCH_COMMON_H_
+
+#include <stddef.h>
+
+#include <lib/clog.h>
+
+/* Times one pass of the compiler over programs that double in size.
+ * The pass is linear if the time per unit stays flat as the program grows */
+struct clog_bench
+{
+	const char*  units;       /* Plural, heads the size column */
+	const char*  unit;        /* Singular, for the time per unit */
+	unsigned int repeat;      /* Compilations per size, unless one is given on the command line */
+	size_t       unit_bytes;  /* The most source one unit takes */
+	int          show_image;  /* Whether measure sets the image size */
+
+	/* Writes a program of count units to src, and returns its length */
+	size_t (*write_source)(char* src, unsigned int count);
+
+	/* The measured call, returns 1 on success */
+	int (*measure)(const struct clog_diagnostics* diag, const char* src, size_t len, size_t* image_len);
+};
+
+/* Runs bench at each size and prints the table, returns the exit status */
+int clog_bench_run(const struct clog_bench* bench, int argc, char* argv[]);
+
+#endif /* CLOG_BENCH_COMMON_H_ */
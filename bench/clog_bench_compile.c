@@ -0,0 +1,43 @@
+/*
+ * clog_bench_compile.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "clog_bench_common.h"
+
+/* A block of constant locals, each computed from the one before, with an if on every one
+ * that constant propagation decides, so the whole block folds to its return value.
+ * The propagation is a single worklist pass if the time per statement stays flat as the block doubles.
+ * Everything folds, so the image stays the same size however long the block */
+
+static size_t write_source(char* src, unsigned int statements)
+{
+	size_t len = sprintf(src,"{\n\tvar y = 0;\n\tvar x0 = 1;\n");
+	unsigned int i;
+	for (i = 1; i < statements / 2; ++i)
+	{
+		len += sprintf(src + len,"\tvar x%u = x%u * 3 %% 1000 + 1;\n",i,i-1);
+		len += sprintf(src + len,"\tif (x%u %% 2 == 0) y = y + x%u; else y = y - 1;\n",i,i);
+	}
+
+	len += sprintf(src + len,"\treturn y;\n}\n");
+	return len;
+}
+
+static int measure(const struct clog_diagnostics* diag, const char* src, size_t len, size_t* image_len)
+{
+	void* image = NULL;
+	int ok = clog_compile_buffer(NULL,diag,(const unsigned char*)src,len,&image,image_len);
+	free(image);
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	static const struct clog_bench bench = { "statements", "statement", 10, 80, 1, &write_source, &measure };
+	return clog_bench_run(&bench,argc,argv);
+}
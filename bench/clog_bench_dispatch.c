@@ -0,0 +1,138 @@
+/*
+ * clog_bench_dispatch.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <lib/clog.h>
+
+/* Time per dispatched instruction for arithmetic loops.
+ * Built once with computed goto and once with the switch, both linking a copy of
+ * clog_dispatch.c built with CLOG_DISPATCH_COUNT, which reports how many
+ * instructions each run fetched. Built again with a copy of clog_codegen.c that
+ * selects no superinstructions, so ops/run shows how many dispatches they save */
+
+#if defined(CLOG_COMPUTED_GOTO) && defined(__GNUC__)
+#define BENCH_MODE "goto"
+#else
+#define BENCH_MODE "switch"
+#endif
+
+#if defined(CLOG_NO_SUPERINSTRUCTIONS)
+#define BENCH_SUPER "no"
+#else
+#define BENCH_SUPER "yes"
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BENCH_CYCLES() ((double)__builtin_ia32_rdtsc())
+#else
+#define BENCH_CYCLES() 0.0
+#endif
+
+static const struct
+{
+	const char* name;
+	const char* src;
+} programs[] =
+{
+	{
+		"sum",
+		"var x = 0;\n"
+		"for (var i = 0; i < 1000000; ++i)\n"
+		"\tx += i & 7;\n"
+		"return x;\n"
+	},
+	{
+		"fib",
+		"var a = 1, b = 0, i = 0;\n"
+		"while (i < 1000000) { var t = a + b; a = b; b = t % 1000; ++i; }\n"
+		"return b;\n"
+	},
+	{
+		"branch",
+		"var n = 0;\n"
+		"for (var i = 0; i < 1000000; ++i)\n"
+		"\tif (i % 3 == 0) n = n + 2; else n = n - 1;\n"
+		"return n;\n"
+	}
+};
+
+struct counts
+{
+	unsigned long dispatched;
+	int           failed;
+};
+
+static void count_fn(void* param, unsigned long line, const char* msg)
+{
+	struct counts* c = param;
+	if (sscanf(msg,"Dispatched %lu instructions",&c->dispatched) != 1)
+	{
+		fprintf(stderr,"%lu: %s\n",line,msg);
+		c->failed = 1;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int repeat = (argc > 1 ? (unsigned int)atoi(argv[1]) : 5);
+	unsigned int p;
+
+	if (!repeat)
+		repeat = 1;
+
+	printf("%-8s %-6s %-8s %12s %10s %10s\n","mode","super","program","ops/run","ns/op","cycles/op");
+	for (p = 0; p < sizeof(programs)/sizeof(programs[0]); ++p)
+	{
+		struct clog_diagnostics diag;
+		struct counts c = {0};
+		double best_ns = 0.0;
+		double best_cycles = 0.0;
+		void* image = NULL;
+		size_t len = 0;
+		unsigned int r;
+
+		diag.diag_fn = &count_fn;
+		diag.param = &c;
+
+		if (clog_compile_buffer(NULL,&diag,(const unsigned char*)programs[p].src,strlen(programs[p].src),&image,&len) != 1)
+		{
+			fprintf(stderr,"Failed to compile %s\n",programs[p].name);
+			return EXIT_FAILURE;
+		}
+
+		/* Best of repeat, the least disturbed run is the closest to the dispatch cost */
+		for (r = 0; r < repeat; ++r)
+		{
+			clock_t start = clock();
+			double cycles = BENCH_CYCLES();
+			double ns;
+
+			if (clog_run(NULL,&diag,image,len) != 1 || c.failed || !c.dispatched)
+			{
+				fprintf(stderr,"Failed to run %s\n",programs[p].name);
+				free(image);
+				return EXIT_FAILURE;
+			}
+
+			cycles = BENCH_CYCLES() - cycles;
+			ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC;
+			if (r == 0 || ns < best_ns)
+			{
+				best_ns = ns;
+				best_cycles = cycles;
+			}
+		}
+
+		printf("%-8s %-6s %-8s %12lu %10.2f %10.2f\n",BENCH_MODE,BENCH_SUPER,programs[p].name,c.dispatched,best_ns / c.dispatched,best_cycles / c.dispatched);
+		free(image);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,23 +1,90 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
 
-int clog_parse(int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param);
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#endif
+
+#include <lib/clog.h>
+
+#include "clog_cache.h"
 
-void* clog_malloc(size_t s)
+/* One input file, its diagnostics are buffered so they can be printed in argument order */
+struct clog_job
 {
-	return malloc(s);
+	char*  fname;
+	char*  diag;
+	size_t diag_len;
+	size_t diag_alloc;
+	int    result;
+};
+
+struct clog_jobs
+{
+	struct clog_job* jobs;
+	size_t           count;
+	size_t           alloc;
+	size_t           next;
+
+	const char*      cache_dir;
+	int              emit_c;
+	int              compile_only;
+
+#if !defined(_WIN32)
+	pthread_mutex_t  lock;
+#endif
+};
+
+static void job_append(struct clog_job* job, const char* str)
+{
+	size_t len = strlen(str);
+	if (job->diag_len + len + 1 > job->diag_alloc)
+	{
+		size_t new_size = (job->diag_alloc == 0 ? 256 : job->diag_alloc * 2);
+		char* new_diag;
+		while (new_size < job->diag_len + len + 1)
+			new_size *= 2;
+
+		new_diag = realloc(job->diag,new_size);
+		if (!new_diag)
+			return;
+
+		job->diag = new_diag;
+		job->diag_alloc = new_size;
+	}
+
+	memcpy(job->diag + job->diag_len,str,len+1);
+	job->diag_len += len;
 }
 
-void* clog_realloc(void* p, size_t s)
+static void diag_fn(void* param, unsigned long line, const char* msg)
 {
-	return realloc(p,s);
+	struct clog_job* job = param;
+	job_append(job,job->fname);
+	job_append(job,": ");
+	job_append(job,msg);
+	job_append(job,"\n");
 }
 
-void clog_free(void* p)
+/* Runs what compiled, unless only checking */
+static int run_compiled(const struct clog_jobs* jobs, const struct clog_diagnostics* diagnostics, int result, const void* image, size_t len)
 {
-	free(p);
+	if (result == 1 && !jobs->compile_only)
+		result = clog_run(NULL,diagnostics,image,len);
+
+	return result;
 }
 
 static int read_fn(void* p, unsigned char* buf, size_t* len)
@@ -29,18 +96,495 @@ static int read_fn(void* p, unsigned char* buf, size_t* len)
 	return 1;
 }
 
-int main(int argc, char* argv[])
+#if !defined(_WIN32)
+/* Compiles and runs src, which may be mmapped */
+static int compile_buffer(const struct clog_jobs* jobs, const struct clog_diagnostics* diagnostics, const unsigned char* src, size_t len)
+{
+	void* image = NULL;
+	size_t image_len = 0;
+	int result = clog_compile_buffer(NULL,diagnostics,src,len,&image,&image_len);
+	if (result == 1)
+	{
+		result = run_compiled(jobs,diagnostics,result,image,image_len);
+		free(image);
+	}
+	return result;
+}
+
+/* Passes diagnostics through to the job, keeping a copy for the cache entry */
+struct clog_cache_diag
 {
-	FILE* f = fopen(argv[1],"r");
+	struct clog_job*         job;
+	struct clog_cache_record rec;
+};
+
+static void cache_diag_fn(void* param, unsigned long line, const char* msg)
+{
+	struct clog_cache_diag* cd = param;
+	diag_fn(cd->job,line,msg);
+	clog_cache_record(&cd->rec,line,msg);
+}
+
+static int compile_cached(struct clog_job* job, const struct clog_jobs* jobs, const struct clog_diagnostics* diagnostics, const unsigned char* src, size_t len)
+{
+	struct clog_cache_key key;
+	struct clog_cache_entry entry = {0};
+	struct clog_cache_diag cd = {0};
+	struct clog_diagnostics cache_diagnostics;
+	void* image = NULL;
+	size_t image_len = 0;
+	int result;
+
+	clog_cache_key(&key,src,len);
+	if (clog_cache_lookup(jobs->cache_dir,&key,diagnostics,&result,&entry))
+	{
+		result = run_compiled(jobs,diagnostics,result,entry.image,entry.image_len);
+		clog_cache_release(&entry);
+		return result;
+	}
+
+	cd.job = job;
+	cache_diagnostics.diag_fn = &cache_diag_fn;
+	cache_diagnostics.param = &cd;
+
+	result = clog_compile_buffer(NULL,&cache_diagnostics,src,len,&image,&image_len);
+
+	/* Out of memory isn't a property of the source */
+	if (result == 0 || result == 1)
+		clog_cache_store(jobs->cache_dir,&key,result,&cd.rec,image,(result == 1 ? image_len : 0));
+
+	clog_cache_record_free(&cd.rec);
+
+	/* Only compilation is cached, a run reports straight to the job */
+	if (result == 1)
+	{
+		result = run_compiled(jobs,diagnostics,result,image,image_len);
+		free(image);
+	}
+	return result;
+}
+
+/* Returns 0 if the file can't be mapped, and the caller should fall back to reading it */
+static int compile_mapped(struct clog_job* job, const struct clog_jobs* jobs, const struct clog_diagnostics* diagnostics)
+{
+	struct stat st;
+	void* addr;
+	int mapped = 0;
+	int fd = open(job->fname,O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	if (fstat(fd,&st) == 0 && S_ISREG(st.st_mode))
+	{
+		if (st.st_size == 0)
+		{
+			if (jobs->cache_dir)
+				job->result = compile_cached(job,jobs,diagnostics,(const unsigned char*)"",0);
+			else
+				job->result = compile_buffer(jobs,diagnostics,(const unsigned char*)"",0);
+			mapped = 1;
+		}
+		else
+		{
+			addr = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+			if (addr != MAP_FAILED)
+			{
+				if (jobs->cache_dir)
+					job->result = compile_cached(job,jobs,diagnostics,addr,st.st_size);
+				else
+					job->result = compile_buffer(jobs,diagnostics,addr,st.st_size);
+				mapped = 1;
+
+				munmap(addr,st.st_size);
+			}
+		}
+	}
+
+	close(fd);
+
+	return mapped;
+}
+#endif
+
+static void open_failed(struct clog_job* job, const char* fname)
+{
+	job_append(job,"Failed to open ");
+	job_append(job,fname);
+	job_append(job,": ");
+	job_append(job,strerror(errno));
+	job_append(job,"\n");
+	job->result = 0;
+}
+
+/* Translates the file to <file>.c, defining clog_program_<basename> */
+static void emit_c_job(struct clog_job* job, const struct clog_diagnostics* diagnostics, FILE* f)
+{
+	const char* base = job->fname;
+	char* name;
+	char* out;
+	char* src = NULL;
+	size_t len = 0;
+	size_t i;
+	FILE* o;
+
+	for (i = 0; job->fname[i]; ++i)
+	{
+		if (job->fname[i] == '/' || job->fname[i] == '\\')
+			base = job->fname + i + 1;
+	}
+
+	name = malloc(strlen("clog_program_") + strlen(base) + 1);
+	out = malloc(strlen(job->fname) + 3);
+	if (!name || !out)
+	{
+		job_append(job,"Out of memory\n");
+		job->result = -1;
+		free(name);
+		free(out);
+		return;
+	}
+
+	/* The basename up to its extension, as an identifier */
+	strcpy(name,"clog_program_");
+	for (i = strlen(name); *base && *base != '.'; ++base)
+	{
+		if ((*base >= 'a' && *base <= 'z') || (*base >= 'A' && *base <= 'Z') || (*base >= '0' && *base <= '9'))
+			name[i++] = *base;
+		else
+			name[i++] = '_';
+	}
+	name[i] = '\0';
+
+	strcpy(out,job->fname);
+	strcat(out,".c");
+
+	job->result = clog_compile_c(NULL,diagnostics,&read_fn,f,name,&src,&len);
+	if (job->result == 1)
+	{
+		o = fopen(out,"w");
+		if (!o)
+			open_failed(job,out);
+		else
+		{
+			if (fwrite(src,1,len,o) != len)
+				job->result = 0;
+			if (fclose(o) != 0)
+				job->result = 0;
+
+			if (!job->result)
+			{
+				job_append(job,"Failed to write ");
+				job_append(job,out);
+				job_append(job,"\n");
+			}
+		}
+	}
+
+	free(src);
+	free(name);
+	free(out);
+}
+
+static void compile_job(struct clog_job* job, const struct clog_jobs* jobs)
+{
+	struct clog_diagnostics diagnostics;
+	FILE* f;
+
+	diagnostics.diag_fn = &diag_fn;
+	diagnostics.param = job;
+
+#if !defined(_WIN32)
+	/* C translations aren't cached */
+	if (!jobs->emit_c && compile_mapped(job,jobs,&diagnostics))
+		return;
+#endif
+
+	/* Pipes and anything else we can't map go through the read callback */
+	f = fopen(job->fname,"r");
 	if (!f)
 	{
-		printf("Failed to open %s: %s\n",argv[1],strerror(errno));
-		return -1;
+		open_failed(job,job->fname);
+		return;
 	}
 
-	clog_parse(&read_fn,f);
+	if (jobs->emit_c)
+		emit_c_job(job,&diagnostics,f);
+	else
+	{
+		void* image = NULL;
+		size_t image_len = 0;
+		job->result = clog_compile(NULL,&diagnostics,&read_fn,f,&image,&image_len);
+		if (job->result == 1)
+		{
+			job->result = run_compiled(jobs,&diagnostics,job->result,image,image_len);
+			free(image);
+		}
+	}
 
 	fclose(f);
+}
+
+static int add_job(struct clog_jobs* jobs, const char* fname)
+{
+	struct clog_job* job;
+
+	if (jobs->count == jobs->alloc)
+	{
+		/* Resize array */
+		size_t new_size = (jobs->alloc == 0 ? 16 : jobs->alloc * 2);
+		struct clog_job* new = realloc(jobs->jobs,new_size * sizeof(struct clog_job));
+		if (!new)
+			return 0;
+
+		jobs->alloc = new_size;
+		jobs->jobs = new;
+	}
+
+	job = &jobs->jobs[jobs->count];
+	memset(job,0,sizeof(struct clog_job));
+	job->fname = malloc(strlen(fname) + 1);
+	if (!job->fname)
+		return 0;
+
+	strcpy(job->fname,fname);
+	++jobs->count;
+	return 1;
+}
+
+#if !defined(_WIN32)
+static int compare_names(const void* p1, const void* p2)
+{
+	return strcmp(*(char* const*)p1,*(char* const*)p2);
+}
+
+/* Adds every regular file under dname, sorted by name so the job order doesn't depend on the filesystem */
+static int add_directory(struct clog_jobs* jobs, const char* dname)
+{
+	char** names = NULL;
+	size_t count = 0;
+	size_t alloc = 0;
+	size_t i;
+	int ret = 1;
+	struct dirent* entry;
+	DIR* dir = opendir(dname);
+	if (!dir)
+		return add_job(jobs,dname);
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		char* name;
+
+		if (strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
+			continue;
+
+		if (count == alloc)
+		{
+			size_t new_size = (alloc == 0 ? 16 : alloc * 2);
+			char** new = realloc(names,new_size * sizeof(char*));
+			if (!new)
+			{
+				ret = 0;
+				break;
+			}
+
+			alloc = new_size;
+			names = new;
+		}
+
+		name = malloc(strlen(dname) + strlen(entry->d_name) + 2);
+		if (!name)
+		{
+			ret = 0;
+			break;
+		}
+
+		sprintf(name,"%s/%s",dname,entry->d_name);
+		names[count++] = name;
+	}
+
+	closedir(dir);
+
+	if (count)
+		qsort(names,count,sizeof(char*),&compare_names);
+
+	for (i = 0; i < count; ++i)
+	{
+		struct stat st;
+		if (ret && stat(names[i],&st) == 0)
+		{
+			if (S_ISDIR(st.st_mode))
+				ret = add_directory(jobs,names[i]);
+			else if (S_ISREG(st.st_mode))
+				ret = add_job(jobs,names[i]);
+		}
+		free(names[i]);
+	}
+	free(names);
+
+	return ret;
+}
+
+static int add_path(struct clog_jobs* jobs, const char* path)
+{
+	struct stat st;
+	if (stat(path,&st) == 0 && S_ISDIR(st.st_mode))
+		return add_directory(jobs,path);
+
+	return add_job(jobs,path);
+}
+
+static void* worker_fn(void* param)
+{
+	struct clog_jobs* jobs = param;
+	for (;;)
+	{
+		struct clog_job* job = NULL;
+
+		pthread_mutex_lock(&jobs->lock);
+		if (jobs->next < jobs->count)
+			job = &jobs->jobs[jobs->next++];
+		pthread_mutex_unlock(&jobs->lock);
+
+		if (!job)
+			break;
+
+		compile_job(job,jobs);
+	}
+	return NULL;
+}
+
+static void run_jobs(struct clog_jobs* jobs, unsigned long threads)
+{
+	pthread_t* workers = NULL;
+	unsigned long started = 0;
+
+	if (threads > jobs->count)
+		threads = jobs->count;
+
+	if (threads > 1)
+		workers = malloc(threads * sizeof(pthread_t));
+
+	if (workers && pthread_mutex_init(&jobs->lock,NULL) == 0)
+	{
+		/* The main thread is the last worker */
+		for (; started < threads - 1; ++started)
+		{
+			if (pthread_create(&workers[started],NULL,&worker_fn,jobs) != 0)
+				break;
+		}
+
+		/* Whatever the pool didn't pick up, and everything if no threads started */
+		worker_fn(jobs);
+
+		while (started-- > 0)
+			pthread_join(workers[started],NULL);
+
+		pthread_mutex_destroy(&jobs->lock);
+	}
+	else
+	{
+		for (; jobs->next < jobs->count; ++jobs->next)
+			compile_job(&jobs->jobs[jobs->next],jobs);
+	}
+
+	free(workers);
+}
+
+static unsigned long default_threads(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > 0)
+		return n;
+#endif
+	return 1;
+}
+#else
+static int add_path(struct clog_jobs* jobs, const char* path)
+{
+	return add_job(jobs,path);
+}
+
+static void run_jobs(struct clog_jobs* jobs, unsigned long threads)
+{
+	for (; jobs->next < jobs->count; ++jobs->next)
+		compile_job(&jobs->jobs[jobs->next],jobs);
+}
+
+static unsigned long default_threads(void)
+{
+	return 1;
+}
+#endif
+
+static void usage(const char* argv0)
+{
+	printf("Usage: %s [-j threads] [-C cachedir] [-c] [--emit-c] file|directory...\n",argv0);
+	printf("Compiles and runs each file\n");
+	printf("  -c        compile only, don't run\n");
+	printf("  --emit-c  translate each file to ANSI C, written to <file>.c\n");
+}
+
+int main(int argc, char* argv[])
+{
+	struct clog_jobs jobs = {0};
+	unsigned long threads = default_threads();
+	int retval = 0;
+	int i;
+	size_t j;
+
+	for (i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i],"-j") == 0)
+		{
+			char* end = NULL;
+			if (++i == argc || (threads = strtoul(argv[i],&end,10)) == 0 || *end != '\0')
+			{
+				usage(argv[0]);
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i],"-C") == 0)
+		{
+			if (++i == argc)
+			{
+				usage(argv[0]);
+				return -1;
+			}
+			jobs.cache_dir = argv[i];
+		}
+		else if (strcmp(argv[i],"-c") == 0)
+			jobs.compile_only = 1;
+		else if (strcmp(argv[i],"--emit-c") == 0)
+			jobs.emit_c = 1;
+		else if (!add_path(&jobs,argv[i]))
+		{
+			printf("Out of memory\n");
+			return -1;
+		}
+	}
+
+	if (!jobs.count)
+	{
+		usage(argv[0]);
+		return -1;
+	}
+
+	run_jobs(&jobs,threads);
+
+	/* Report in the order the files were given, whatever order they finished in */
+	for (j = 0; j < jobs.count; ++j)
+	{
+		if (jobs.jobs[j].diag_len)
+			fputs(jobs.jobs[j].diag,stdout);
+
+		if (jobs.jobs[j].result != 1)
+			retval = 1;
+
+		free(jobs.jobs[j].diag);
+		free(jobs.jobs[j].fname);
+	}
+	free(jobs.jobs);
 
-	return 0;
+	return retval;
 }
@@ -0,0 +1,327 @@
+/*
+ * clog_cache.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "clog_cache.h"
+
+/* Bump this whenever the entry layout changes */
+#define CLOG_CACHE_FORMAT 2
+
+/* magic, format, h1, h2, len, result, tag length, record length, image length */
+#define CLOG_CACHE_HEADER (9 * 4)
+
+/* The image follows the tag and records, aligned for its constants */
+#define CLOG_CACHE_IMAGE_OFFSET(tag_len,rec_len) ((CLOG_CACHE_HEADER + (tag_len) + (rec_len) + 7) & ~(size_t)7)
+
+static void clog_cache_hash(struct clog_cache_key* key, const unsigned char* p, size_t len)
+{
+	/* Two unrelated 32-bit hashes, FNV-1a and one-at-a-time, make a 64-bit key */
+	unsigned long h1 = key->h1;
+	unsigned long h2 = key->h2;
+	while (len--)
+	{
+		h1 ^= *p;
+		h1 = (h1 * 16777619UL) & 0xFFFFFFFFUL;
+
+		h2 = (h2 + *p++) & 0xFFFFFFFFUL;
+		h2 = (h2 + (h2 << 10)) & 0xFFFFFFFFUL;
+		h2 ^= (h2 >> 6);
+	}
+	key->h1 = h1;
+	key->h2 = h2;
+}
+
+void clog_cache_key(struct clog_cache_key* key, const unsigned char* src, size_t len)
+{
+	const char* tag = clog_version();
+
+	key->h1 = 2166136261UL;
+	key->h2 = 0;
+	key->len = len & 0xFFFFFFFFUL;
+
+	/* The tag's NUL separates it from the source */
+	clog_cache_hash(key,(const unsigned char*)tag,strlen(tag) + 1);
+	clog_cache_hash(key,src,len);
+
+	key->h2 = (key->h2 + (key->h2 << 3)) & 0xFFFFFFFFUL;
+	key->h2 ^= (key->h2 >> 11);
+	key->h2 = (key->h2 + (key->h2 << 15)) & 0xFFFFFFFFUL;
+
+	sprintf(key->name,"%08lx%08lx",key->h1,key->h2);
+}
+
+static void clog_cache_put32(unsigned char* p, unsigned long v)
+{
+	p[0] = (unsigned char)(v & 0xFF);
+	p[1] = (unsigned char)((v >> 8) & 0xFF);
+	p[2] = (unsigned char)((v >> 16) & 0xFF);
+	p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
+static unsigned long clog_cache_get32(const unsigned char* p)
+{
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static int clog_cache_reserve(struct clog_cache_record* rec, size_t len)
+{
+	if (rec->len + len > rec->alloc)
+	{
+		size_t new_size = (rec->alloc == 0 ? 256 : rec->alloc * 2);
+		unsigned char* new_buf;
+		while (new_size < rec->len + len)
+			new_size *= 2;
+
+		new_buf = realloc(rec->buf,new_size);
+		if (!new_buf)
+			return 0;
+
+		rec->buf = new_buf;
+		rec->alloc = new_size;
+	}
+	return 1;
+}
+
+void clog_cache_record(struct clog_cache_record* rec, unsigned long line, const char* msg)
+{
+	/* line, length, then the message with its NUL so a replay can point straight at it */
+	size_t len = strlen(msg) + 1;
+	if (!clog_cache_reserve(rec,8 + len))
+	{
+		/* An incomplete record must never be stored */
+		rec->alloc = (size_t)-1;
+		return;
+	}
+
+	clog_cache_put32(rec->buf + rec->len,line);
+	clog_cache_put32(rec->buf + rec->len + 4,len);
+	memcpy(rec->buf + rec->len + 8,msg,len);
+	rec->len += 8 + len;
+}
+
+void clog_cache_record_free(struct clog_cache_record* rec)
+{
+	free(rec->buf);
+	rec->buf = NULL;
+	rec->len = 0;
+	rec->alloc = 0;
+}
+
+#if !defined(_WIN32)
+static char* clog_cache_path(const char* dir, const struct clog_cache_key* key, const char* suffix)
+{
+	char* path = malloc(strlen(dir) + sizeof(key->name) + strlen(suffix) + 1);
+	if (path)
+		sprintf(path,"%s/%s%s",dir,key->name,suffix);
+	return path;
+}
+
+/* Checks the whole entry before anything is replayed, a damaged entry is just a miss */
+static int clog_cache_validate(const unsigned char* p, size_t size, const struct clog_cache_key* key)
+{
+	const char* tag = clog_version();
+	unsigned long tag_len;
+	unsigned long rec_len;
+	unsigned long image_len;
+	const unsigned char* rec;
+	const unsigned char* end;
+
+	if (size < CLOG_CACHE_HEADER || memcmp(p,"CLGC",4) != 0)
+		return 0;
+
+	if (clog_cache_get32(p + 4) != CLOG_CACHE_FORMAT ||
+			clog_cache_get32(p + 8) != key->h1 ||
+			clog_cache_get32(p + 12) != key->h2 ||
+			clog_cache_get32(p + 16) != key->len)
+	{
+		return 0;
+	}
+
+	tag_len = clog_cache_get32(p + 24);
+	rec_len = clog_cache_get32(p + 28);
+	image_len = clog_cache_get32(p + 32);
+	if (tag_len != strlen(tag) || rec_len > size || image_len > size || size != CLOG_CACHE_IMAGE_OFFSET(tag_len,rec_len) + image_len)
+		return 0;
+
+	if (memcmp(p + CLOG_CACHE_HEADER,tag,tag_len) != 0)
+		return 0;
+
+	rec = p + CLOG_CACHE_HEADER + tag_len;
+	end = rec + rec_len;
+	while (rec != end)
+	{
+		unsigned long len;
+		if (end - rec < 8)
+			return 0;
+
+		len = clog_cache_get32(rec + 4);
+		if (len == 0 || (unsigned long)(end - rec - 8) < len || rec[8 + len - 1] != 0)
+			return 0;
+
+		rec += 8 + len;
+	}
+
+	return 1;
+}
+
+int clog_cache_lookup(const char* dir, const struct clog_cache_key* key, const struct clog_diagnostics* diagnostics, int* result, struct clog_cache_entry* entry)
+{
+	struct stat st;
+	void* addr;
+	int hit = 0;
+	int fd;
+	char* path = clog_cache_path(dir,key,".clc");
+	if (!path)
+		return 0;
+
+	fd = open(path,O_RDONLY);
+	free(path);
+	if (fd == -1)
+		return 0;
+
+	if (fstat(fd,&st) == 0 && S_ISREG(st.st_mode) && st.st_size >= CLOG_CACHE_HEADER)
+	{
+		addr = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		if (addr != MAP_FAILED)
+		{
+			const unsigned char* p = addr;
+			if (clog_cache_validate(p,st.st_size,key))
+			{
+				const unsigned char* rec = p + CLOG_CACHE_HEADER + clog_cache_get32(p + 24);
+				const unsigned char* end = rec + clog_cache_get32(p + 28);
+
+				for (;rec != end;rec += 8 + clog_cache_get32(rec + 4))
+					(*diagnostics->diag_fn)(diagnostics->param,clog_cache_get32(rec),(const char*)rec + 8);
+
+				*result = (int)clog_cache_get32(p + 20);
+
+				/* The image is run straight out of the mapping */
+				entry->addr = addr;
+				entry->size = st.st_size;
+				entry->image = p + CLOG_CACHE_IMAGE_OFFSET(clog_cache_get32(p + 24),clog_cache_get32(p + 28));
+				entry->image_len = clog_cache_get32(p + 32);
+				hit = 1;
+			}
+			else
+				munmap(addr,st.st_size);
+		}
+	}
+
+	close(fd);
+
+	return hit;
+}
+
+static int clog_cache_write(int fd, const void* buf, size_t len)
+{
+	const unsigned char* p = buf;
+	while (len)
+	{
+		ssize_t w = write(fd,p,len);
+		if (w <= 0)
+			return 0;
+
+		p += w;
+		len -= w;
+	}
+	return 1;
+}
+
+void clog_cache_release(struct clog_cache_entry* entry)
+{
+	if (entry->addr)
+		munmap(entry->addr,entry->size);
+
+	entry->addr = NULL;
+	entry->image = NULL;
+}
+
+int clog_cache_store(const char* dir, const struct clog_cache_key* key, int result, const struct clog_cache_record* rec, const void* image, size_t image_len)
+{
+	static const unsigned char zeros[8] = {0};
+	unsigned char header[CLOG_CACHE_HEADER];
+	const char* tag = clog_version();
+	size_t pad;
+	char* tmp;
+	char* path;
+	int ok = 0;
+	int fd;
+
+	if (rec->alloc == (size_t)-1 || image_len > 0xFFFFFFFFUL)
+		return 0;
+
+	pad = CLOG_CACHE_IMAGE_OFFSET(strlen(tag),rec->len) - (CLOG_CACHE_HEADER + strlen(tag) + rec->len);
+
+	memcpy(header,"CLGC",4);
+	clog_cache_put32(header + 4,CLOG_CACHE_FORMAT);
+	clog_cache_put32(header + 8,key->h1);
+	clog_cache_put32(header + 12,key->h2);
+	clog_cache_put32(header + 16,key->len);
+	clog_cache_put32(header + 20,result);
+	clog_cache_put32(header + 24,strlen(tag));
+	clog_cache_put32(header + 28,rec->len);
+	clog_cache_put32(header + 32,image_len);
+
+	tmp = clog_cache_path(dir,key,".XXXXXX");
+	path = clog_cache_path(dir,key,".clc");
+	if (tmp && path)
+	{
+		/* Write a private file and rename it into place, so readers only ever see whole entries */
+		fd = mkstemp(tmp);
+		if (fd != -1)
+		{
+			ok = (clog_cache_write(fd,header,sizeof(header)) &&
+					clog_cache_write(fd,tag,strlen(tag)) &&
+					clog_cache_write(fd,rec->buf,rec->len) &&
+					clog_cache_write(fd,zeros,pad) &&
+					clog_cache_write(fd,image,image_len));
+
+			if (close(fd) != 0)
+				ok = 0;
+
+			if (ok)
+				ok = (rename(tmp,path) == 0);
+
+			if (!ok)
+				unlink(tmp);
+		}
+	}
+
+	free(path);
+	free(tmp);
+
+	return ok;
+}
+#else
+int clog_cache_lookup(const char* dir, const struct clog_cache_key* key, const struct clog_diagnostics* diagnostics, int* result, struct clog_cache_entry* entry)
+{
+	return 0;
+}
+
+void clog_cache_release(struct clog_cache_entry* entry)
+{
+}
+
+int clog_cache_store(const char* dir, const struct clog_cache_key* key, int result, const struct clog_cache_record* rec, const void* image, size_t image_len)
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,51 @@
+/*
+ * clog_cache.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_CACHE_H_
+#define CLOG_CACHE_H_
+
+#include <lib/clog.h>
+
+/* On-disk compilation cache
+ * Entries are named by a hash of the compiler version and the source bytes, and hold
+ * the result, the diagnostics and the code image, so a hit never runs the compiler */
+struct clog_cache_key
+{
+	unsigned long h1;
+	unsigned long h2;
+	unsigned long len;
+	char          name[17];
+};
+
+/* Diagnostics recorded during a compilation, so they can be replayed on a hit */
+struct clog_cache_record
+{
+	unsigned char* buf;
+	size_t         len;
+	size_t         alloc;
+};
+
+void clog_cache_key(struct clog_cache_key* key, const unsigned char* src, size_t len);
+
+void clog_cache_record(struct clog_cache_record* rec, unsigned long line, const char* msg);
+void clog_cache_record_free(struct clog_cache_record* rec);
+
+/* A hit stays mapped, and its image points into the mapping, until it is released */
+struct clog_cache_entry
+{
+	void*       addr;
+	size_t      size;
+	const void* image;
+	size_t      image_len;
+};
+
+/* Returns 1 on a hit, after replaying the diagnostics, 0 on a miss or a damaged entry */
+int clog_cache_lookup(const char* dir, const struct clog_cache_key* key, const struct clog_diagnostics* diagnostics, int* result, struct clog_cache_entry* entry);
+void clog_cache_release(struct clog_cache_entry* entry);
+
+int clog_cache_store(const char* dir, const struct clog_cache_key* key, int result, const struct clog_cache_record* rec, const void* image, size_t image_len);
+
+#endif /* CLOG_CACHE_H_ */
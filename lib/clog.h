@@ -0,0 +1,59 @@
+/*
+ * clog.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_H_
+#define CLOG_H_
+
+#include <stddef.h>
+
+/* The library is built with -fvisibility=hidden, so only what is declared with this is exported */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define CLOG_EXPORT __attribute__((visibility("default")))
+#else
+#define CLOG_EXPORT
+#endif
+
+/* Memory allocation
+ * Every allocation made by a compilation goes through the allocator it was started with */
+struct clog_allocator
+{
+	void* (*alloc_fn)(void* param, size_t s);
+	void* (*realloc_fn)(void* param, void* p, size_t s);
+	void (*free_fn)(void* param, void* p);
+	void* param;
+};
+
+/* Diagnostics
+ * Errors and warnings are reported in the order they are found, line is 0 if there isn't one */
+struct clog_diagnostics
+{
+	void (*diag_fn)(void* param, unsigned long line, const char* msg);
+	void* param;
+};
+
+/* Passing a NULL allocator uses malloc/realloc/free, NULL diagnostics print to stdout
+ * Compilations share no state, so any number may run at once on different threads */
+CLOG_EXPORT int clog_parse(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param);
+CLOG_EXPORT int clog_parse_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len);
+
+/* As clog_parse, and on success returns the program as a code image in one allocation from the allocator */
+CLOG_EXPORT int clog_compile(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param, void** image, size_t* len);
+CLOG_EXPORT int clog_compile_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len, void** image, size_t* image_len);
+
+/* As clog_compile, but translates the program to an ANSI C translation unit defining
+ *   int name(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics);
+ * which runs it as clog_run would. The source is NUL terminated, and builds against clog_rt.h and the library */
+CLOG_EXPORT int clog_compile_c(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param, const char* name, char** src, size_t* len);
+CLOG_EXPORT int clog_compile_c_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len, const char* name, char** src, size_t* src_len);
+
+/* Runs a compiled code image, which may be mmapped read-only
+ * The image is verified first, so a damaged or foreign one is rejected rather than run */
+CLOG_EXPORT int clog_run(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const void* image, size_t len);
+
+/* Identifies the compiler and image versions, anything compiled under different ones must not be reused */
+CLOG_EXPORT const char* clog_version(void);
+
+#endif /* CLOG_H_ */
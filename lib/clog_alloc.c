@@ -0,0 +1,121 @@
+/*
+ * clog_alloc.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_ast.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void* clog_default_alloc(void* param, size_t s)
+{
+	return malloc(s);
+}
+
+static void* clog_default_realloc(void* param, void* p, size_t s)
+{
+	return realloc(p,s);
+}
+
+static void clog_default_free(void* param, void* p)
+{
+	free(p);
+}
+
+static const struct clog_allocator s_default_allocator =
+{
+	&clog_default_alloc,
+	&clog_default_realloc,
+	&clog_default_free,
+	NULL
+};
+
+const struct clog_allocator* clog_default_allocator(void)
+{
+	return &s_default_allocator;
+}
+
+void* clog_malloc(const struct clog_allocator* allocator, size_t s)
+{
+	return (*allocator->alloc_fn)(allocator->param,s);
+}
+
+void* clog_realloc(const struct clog_allocator* allocator, void* p, size_t s)
+{
+	return (*allocator->realloc_fn)(allocator->param,p,s);
+}
+
+void clog_free(const struct clog_allocator* allocator, void* p)
+{
+	if (p)
+		(*allocator->free_fn)(allocator->param,p);
+}
+
+struct clog_arena_chunk
+{
+	struct clog_arena_chunk* next;
+	size_t size;
+	size_t used;
+};
+
+/* Everything handed out is aligned for the strictest of these */
+union clog_arena_align
+{
+	long   l;
+	double d;
+	void*  p;
+};
+
+#define CLOG_ARENA_ALIGN(s) (((s) + sizeof(union clog_arena_align) - 1) & ~(sizeof(union clog_arena_align) - 1))
+#define CLOG_ARENA_HEADER   CLOG_ARENA_ALIGN(sizeof(struct clog_arena_chunk))
+#define CLOG_ARENA_CHUNK    4096
+
+void* clog_arena_alloc(struct clog_arena* arena, size_t s)
+{
+	struct clog_arena_chunk* chunk = arena->chunks;
+	void* p;
+
+	s = CLOG_ARENA_ALIGN(s ? s : 1);
+
+	if (!chunk || chunk->size - chunk->used < s)
+	{
+		size_t size = CLOG_ARENA_CHUNK - CLOG_ARENA_HEADER;
+		if (size < s)
+			size = s;
+
+		chunk = clog_malloc(arena->allocator,CLOG_ARENA_HEADER + size);
+		if (!chunk)
+			return NULL;
+
+		chunk->size = size;
+		chunk->used = 0;
+
+		if (size > CLOG_ARENA_CHUNK - CLOG_ARENA_HEADER && arena->chunks)
+		{
+			/* Oversized requests get their own chunk, keep bumping the current one */
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+		else
+		{
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	p = (unsigned char*)chunk + CLOG_ARENA_HEADER + chunk->used;
+	chunk->used += s;
+	return p;
+}
+
+void clog_arena_free(struct clog_arena* arena)
+{
+	while (arena->chunks)
+	{
+		struct clog_arena_chunk* next = arena->chunks->next;
+		clog_free(arena->allocator,arena->chunks);
+		arena->chunks = next;
+	}
+}
@@ -7,65 +7,122 @@
 
 #include "clog_ast.h"
 #include "clog_parser.h"
+#include "clog_codegen.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
 
 static void __dump(size_t indent, const struct clog_ast_statement_list* list);
 
+void clog_diagnostic(struct clog_parser* parser, unsigned long line, const char* msg)
+{
+	if (parser->diagnostics.diag_fn)
+		(*parser->diagnostics.diag_fn)(parser->diagnostics.param,line,msg);
+	else
+		printf("%s\n",msg);
+}
+
 int clog_ast_out_of_memory(struct clog_parser* parser)
 {
-	printf("Out of memory building AST\n");
+	clog_diagnostic(parser,0,"Out of memory building AST");
 	parser->failed = 1;
 	return 0;
 }
 
 int clog_syntax_error(struct clog_parser* parser, const char* msg, unsigned long line)
 {
-	printf("Syntax error at line %lu: %s\n",line,msg);
+	char buf[256];
+	sprintf(buf,"Syntax error at line %lu: %.200s",line,msg);
+	clog_diagnostic(parser,line,buf);
 	parser->failed = 1;
 	return 0;
 }
 
 void clog_token_free(struct clog_parser* parser, struct clog_token* token)
 {
+	/* Token text belongs to the input or the token arena, so just recycle the token */
 	if (token)
 	{
-		if (token->type == clog_token_string && token->value.string.str)
-			clog_free(token->value.string.str);
+		token->value.next_free = parser->free_tokens;
+		parser->free_tokens = token;
+	}
+}
 
-		clog_free(token);
+static struct clog_token* clog_token_get(struct clog_parser* parser)
+{
+	struct clog_token* token = parser->free_tokens;
+	if (token)
+		parser->free_tokens = token->value.next_free;
+	else
+	{
+		token = clog_arena_alloc(&parser->tokens,sizeof(struct clog_token));
+		if (!token)
+			clog_ast_out_of_memory(parser);
 	}
+	return token;
 }
 
 int clog_token_alloc(struct clog_parser* parser, struct clog_token** token, const unsigned char* sz, size_t len)
 {
-	*token = clog_malloc(sizeof(struct clog_token));
+	*token = clog_token_get(parser);
 	if (!*token)
-		return clog_ast_out_of_memory(parser);
+		return 0;
 
 	(*token)->type = clog_token_string;
+	(*token)->symbol = 0;
 	(*token)->value.string.len = len;
-	(*token)->value.string.str = NULL;
+	(*token)->value.string.str = (unsigned char*)sz;
 
-	if (len)
-	{
-		(*token)->value.string.str = clog_malloc(len+1);
-		if (!(*token)->value.string.str)
-		{
-			clog_free(*token);
-			*token = NULL;
-			return clog_ast_out_of_memory(parser);
-		}
+	return 1;
+}
 
-		memcpy((*token)->value.string.str,sz,len);
-		(*token)->value.string.str[len] = 0;
+int clog_token_alloc_id(struct clog_parser* parser, struct clog_token** token, const unsigned char* sz, size_t len)
+{
+	const struct clog_string* name;
+	unsigned int symbol = clog_symbol_intern(&parser->symbols,sz,len);
+	if (!symbol)
+	{
+		*token = NULL;
+		return clog_ast_out_of_memory(parser);
 	}
 
+	name = clog_symbol_name(&parser->symbols,symbol);
+	if (!clog_token_alloc(parser,token,name->str,name->len))
+		return 0;
+
+	(*token)->symbol = symbol;
 	return 1;
 }
 
-static int clog_token_printf(unsigned int token_id, struct clog_token* token)
+int clog_token_alloc_integer(struct clog_parser* parser, struct clog_token** token, long value)
+{
+	*token = clog_token_get(parser);
+	if (!*token)
+		return 0;
+
+	(*token)->type = clog_token_integer;
+	(*token)->symbol = 0;
+	(*token)->value.integer = value;
+
+	return 1;
+}
+
+int clog_token_alloc_real(struct clog_parser* parser, struct clog_token** token, double value)
+{
+	*token = clog_token_get(parser);
+	if (!*token)
+		return 0;
+
+	(*token)->type = clog_token_real;
+	(*token)->symbol = 0;
+	(*token)->value.real = value;
+
+	return 1;
+}
+
+/* Token text is truncated, buf must hold at least 70 chars */
+static int clog_token_sprintf(char* buf, unsigned int token_id, const struct clog_token* token)
 {
 	switch (token_id)
 	{
@@ -73,161 +130,163 @@ static int clog_token_printf(unsigned int token_id, struct clog_token* token)
 	case CLOG_TOKEN_BASE:
 	case CLOG_TOKEN_ID:
 		if (token && token->type == clog_token_string)
-			return printf("%s",token->value.string.len ? (char*)token->value.string.str : "\"\"");
-		return printf("identifier");
+			return token->value.string.len ? sprintf(buf,"%.*s",(int)(token->value.string.len > 64 ? 64 : token->value.string.len),(char*)token->value.string.str) : sprintf(buf,"\"\"");
+		return sprintf(buf,"identifier");
 
 	case CLOG_TOKEN_STRING:
 		if (token && token->type == clog_token_string)
-			return printf("%s",token->value.string.len ? (char*)token->value.string.str : "\"\"");
-		return printf("(string)");
+			return token->value.string.len ? sprintf(buf,"%.*s",(int)(token->value.string.len > 64 ? 64 : token->value.string.len),(char*)token->value.string.str) : sprintf(buf,"\"\"");
+		return sprintf(buf,"(string)");
 
 	case CLOG_TOKEN_INTEGER:
 		if (token && token->type == clog_token_integer)
-			return printf("%ld",token->value.integer);
-		return printf("(integer)");
+			return sprintf(buf,"%ld",token->value.integer);
+		return sprintf(buf,"(integer)");
 
 	case CLOG_TOKEN_FLOAT:
 		if (token && token->type == clog_token_real)
-			return printf("%g",token->value.real);
-		return printf("(arith)");
+			return sprintf(buf,"%g",token->value.real);
+		return sprintf(buf,"(arith)");
 
 	case CLOG_TOKEN_TRUE:
-		return printf("true");
+		return sprintf(buf,"true");
 	case CLOG_TOKEN_FALSE:
-		return printf("false");
+		return sprintf(buf,"false");
 	case CLOG_TOKEN_NULL:
-		return printf("null");
+		return sprintf(buf,"null");
 	case CLOG_TOKEN_IF:
-		return printf("if");
+		return sprintf(buf,"if");
 	case CLOG_TOKEN_OPEN_PAREN:
-		return printf("(");
+		return sprintf(buf,"(");
 	case CLOG_TOKEN_CLOSE_PAREN:
-		return printf(")");
+		return sprintf(buf,")");
 	case CLOG_TOKEN_ELSE:
-		return printf("else");
+		return sprintf(buf,"else");
 	case CLOG_TOKEN_WHILE:
-		return printf("while");
+		return sprintf(buf,"while");
 	case CLOG_TOKEN_FOR:
-		return printf("for");
+		return sprintf(buf,"for");
 	case CLOG_TOKEN_SEMI_COLON:
-		return printf(";");
+		return sprintf(buf,";");
 	case CLOG_TOKEN_DO:
-		return printf("do");
+		return sprintf(buf,"do");
 	case CLOG_TOKEN_VAR:
-		return printf("var");
+		return sprintf(buf,"var");
 	case CLOG_TOKEN_ASSIGN:
-		return printf("=");
+		return sprintf(buf,"=");
 	case CLOG_TOKEN_OPEN_BRACE:
-		return printf("{");
+		return sprintf(buf,"{");
 	case CLOG_TOKEN_CLOSE_BRACE:
-		return printf("}");
+		return sprintf(buf,"}");
 	case CLOG_TOKEN_TRY:
-		return printf("try");
+		return sprintf(buf,"try");
 	case CLOG_TOKEN_CATCH:
-		return printf("catch");
+		return sprintf(buf,"catch");
 	case CLOG_TOKEN_ELIPSIS:
-		return printf("...");
+		return sprintf(buf,"...");
 	case CLOG_TOKEN_BREAK:
-		return printf("break");
+		return sprintf(buf,"break");
 	case CLOG_TOKEN_CONTINUE:
-		return printf("continue");
+		return sprintf(buf,"continue");
 	case CLOG_TOKEN_RETURN:
-		return printf("return");
+		return sprintf(buf,"return");
 	case CLOG_TOKEN_COMMA:
-		return printf(",");
+		return sprintf(buf,",");
 	case CLOG_TOKEN_STAR_ASSIGN:
-		return printf("*=");
+		return sprintf(buf,"*=");
 	case CLOG_TOKEN_SLASH_ASSIGN:
-		return printf("/=");
+		return sprintf(buf,"/=");
 	case CLOG_TOKEN_PERCENT_ASSIGN:
-		return printf("%%=");
+		return sprintf(buf,"%%=");
 	case CLOG_TOKEN_PLUS_ASSIGN:
-		return printf("+=");
+		return sprintf(buf,"+=");
 	case CLOG_TOKEN_MINUS_ASSIGN:
-		return printf("-=");
+		return sprintf(buf,"-=");
 	case CLOG_TOKEN_RIGHT_SHIFT_ASSIGN:
-		return printf(">>=");
+		return sprintf(buf,">>=");
 	case CLOG_TOKEN_LEFT_SHIFT_ASSIGN:
-		return printf("<<=");
+		return sprintf(buf,"<<=");
 	case CLOG_TOKEN_AMPERSAND_ASSIGN:
-		return printf("&=");
+		return sprintf(buf,"&=");
 	case CLOG_TOKEN_CARET_ASSIGN:
-		return printf("^=");
+		return sprintf(buf,"^=");
 	case CLOG_TOKEN_BAR_ASSIGN:
-		return printf("|=");
+		return sprintf(buf,"|=");
 	case CLOG_TOKEN_THROW:
-		return printf("throw");
+		return sprintf(buf,"throw");
 	case CLOG_TOKEN_QUESTION:
-		return printf("?");
+		return sprintf(buf,"?");
 	case CLOG_TOKEN_COLON:
-		return printf(":");
+		return sprintf(buf,":");
 	case CLOG_TOKEN_OR:
-		return printf("||");
+		return sprintf(buf,"||");
 	case CLOG_TOKEN_AND:
-		return printf("&&");
+		return sprintf(buf,"&&");
 	case CLOG_TOKEN_BAR:
-		return printf("|");
+		return sprintf(buf,"|");
 	case CLOG_TOKEN_CARET:
-		return printf("^");
+		return sprintf(buf,"^");
 	case CLOG_TOKEN_AMPERSAND:
-		return printf("&");
+		return sprintf(buf,"&");
 	case CLOG_TOKEN_EQUALS:
-		return printf("==");
+		return sprintf(buf,"==");
 	case CLOG_TOKEN_NOT_EQUALS:
-		return printf("!=");
+		return sprintf(buf,"!=");
 	case CLOG_TOKEN_LESS_THAN:
-		return printf("<");
+		return sprintf(buf,"<");
 	case CLOG_TOKEN_GREATER_THAN:
-		return printf(">");
+		return sprintf(buf,">");
 	case CLOG_TOKEN_LESS_THAN_EQUALS:
-		return printf("<=");
+		return sprintf(buf,"<=");
 	case CLOG_TOKEN_GREATER_THAN_EQUALS:
-		return printf(">=");
+		return sprintf(buf,">=");
 	case CLOG_TOKEN_IN:
-		return printf("in");
+		return sprintf(buf,"in");
 	case CLOG_TOKEN_LEFT_SHIFT:
-		return printf("<<");
+		return sprintf(buf,"<<");
 	case CLOG_TOKEN_RIGHT_SHIFT:
-		return printf(">>");
+		return sprintf(buf,">>");
 	case CLOG_TOKEN_PLUS:
-		return printf("+");
+		return sprintf(buf,"+");
 	case CLOG_TOKEN_MINUS:
-		return printf("-");
+		return sprintf(buf,"-");
 	case CLOG_TOKEN_STAR:
-		return printf("*");
+		return sprintf(buf,"*");
 	case CLOG_TOKEN_SLASH:
-		return printf("/");
+		return sprintf(buf,"/");
 	case CLOG_TOKEN_PERCENT:
-		return printf("%%");
+		return sprintf(buf,"%%");
 	case CLOG_TOKEN_DOUBLE_PLUS:
-		return printf("++");
+		return sprintf(buf,"++");
 	case CLOG_TOKEN_DOUBLE_MINUS:
-		return printf("--");
+		return sprintf(buf,"--");
 	case CLOG_TOKEN_EXCLAMATION:
-		return printf("!");
+		return sprintf(buf,"!");
 	case CLOG_TOKEN_TILDA:
-		return printf("~");
+		return sprintf(buf,"~");
 	case CLOG_TOKEN_OPEN_BRACKET:
-		return printf("[");
+		return sprintf(buf,"[");
 	case CLOG_TOKEN_CLOSE_BRACKET:
-		return printf("]");
+		return sprintf(buf,"]");
 	case CLOG_TOKEN_DOT:
-		return printf(".");
+		return sprintf(buf,".");
 
 	default:
-		return printf("???");
+		return sprintf(buf,"???");
 	}
 }
 
 int clog_syntax_error_token(struct clog_parser* parser, const char* pre, const char* post, unsigned int token_id, struct clog_token* token, unsigned long line)
 {
-	printf("Syntax error at line %lu: ",line);
+	char buf[256];
+	char* p = buf + sprintf(buf,"Syntax error at line %lu: ",line);
 	if (pre)
-		printf("%s",pre);
-	clog_token_printf(token_id,token);
+		p += sprintf(p,"%.64s",pre);
+	p += clog_token_sprintf(p,token_id,token);
 	if (post)
-		printf("%s",post);
-	printf("\n");
+		sprintf(p,"%.64s",post);
+
+	clog_diagnostic(parser,line,buf);
 	parser->failed = 1;
 	return 0;
 }
@@ -247,13 +306,9 @@ static int clog_ast_string_compare(const struct clog_string* s1, const struct cl
 
 void clog_ast_literal_free(struct clog_parser* parser, struct clog_ast_literal* lit)
 {
-	if (lit)
-	{
-		if (lit->type == clog_ast_literal_string && lit->value.string.str)
-			clog_free(lit->value.string.str);
-
-		clog_free(lit);
-	}
+	/* AST nodes live in the parser's AST arena, and are released with it */
+	(void)parser;
+	(void)lit;
 }
 
 int clog_ast_literal_clone(struct clog_parser* parser, struct clog_ast_literal** new, const struct clog_ast_literal* lit)
@@ -263,12 +318,13 @@ int clog_ast_literal_clone(struct clog_parser* parser, struct clog_ast_literal**
 	if (!lit)
 		return 1;
 
-	*new = clog_malloc(sizeof(struct clog_ast_literal));
+	*new = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_literal));
 	if (!*new)
 		return clog_ast_out_of_memory(parser);
 
 	(*new)->type = lit->type;
 	(*new)->line = lit->line;
+	(*new)->symbol = lit->symbol;
 
 	switch (lit->type)
 	{
@@ -283,21 +339,8 @@ int clog_ast_literal_clone(struct clog_parser* parser, struct clog_ast_literal**
 		break;
 
 	case clog_ast_literal_string:
-		(*new)->value.string.len = lit->value.string.len;
-		(*new)->value.string.str = NULL;
-		if ((*new)->value.string.len)
-		{
-			(*new)->value.string.str = clog_malloc((*new)->value.string.len+1);
-			if (!(*new)->value.string.str)
-			{
-				clog_free(*new);
-				*new = NULL;
-				return clog_ast_out_of_memory(parser);
-			}
-
-			memcpy((*new)->value.string.str,lit->value.string.str,(*new)->value.string.len);
-			(*new)->value.string.str[(*new)->value.string.len] = 0;
-		}
+		/* String text is never changed in place, and lives as long as the AST, so clones share it */
+		(*new)->value.string = lit->value.string;
 		break;
 	}
 
@@ -306,13 +349,15 @@ int clog_ast_literal_clone(struct clog_parser* parser, struct clog_ast_literal**
 
 int clog_ast_literal_alloc(struct clog_parser* parser, struct clog_ast_literal** lit, struct clog_token* token)
 {
-	*lit = clog_malloc(sizeof(struct clog_ast_literal));
+	*lit = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_literal));
 	if (!*lit)
 	{
 		clog_token_free(parser,token);
 		return clog_ast_out_of_memory(parser);
 	}
 
+	(*lit)->symbol = 0;
+
 	if (!token)
 	{
 		(*lit)->type = clog_ast_literal_null;
@@ -330,9 +375,10 @@ int clog_ast_literal_alloc(struct clog_parser* parser, struct clog_ast_literal**
 	}
 	else if (token->type == clog_token_string)
 	{
+		/* The text is in the input or the AST arena, so the literal takes it over */
 		(*lit)->type = clog_ast_literal_string;
+		(*lit)->symbol = token->symbol;
 		(*lit)->value.string = token->value.string;
-		token->value.string.str = NULL;
 	}
 
 	(*lit)->line = parser->line;
@@ -344,12 +390,13 @@ int clog_ast_literal_alloc(struct clog_parser* parser, struct clog_ast_literal**
 
 int clog_ast_literal_alloc_bool(struct clog_parser* parser, struct clog_ast_literal** lit, int value)
 {
-	*lit = clog_malloc(sizeof(struct clog_ast_literal));
+	*lit = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_literal));
 	if (!*lit)
 		return clog_ast_out_of_memory(parser);
 
 	(*lit)->type = clog_ast_literal_bool;
 	(*lit)->line = parser->line;
+	(*lit)->symbol = 0;
 	(*lit)->value.integer = value;
 
 	return 1;
@@ -373,6 +420,22 @@ int clog_ast_literal_int_promote(struct clog_ast_literal* lit)
 	}
 }
 
+/* The integer operators also take a real, truncated the way the VM does */
+static int clog_ast_literal_int_convert(struct clog_ast_literal* lit)
+{
+	clog_value_int i;
+
+	if (!lit || lit->type != clog_ast_literal_real)
+		return clog_ast_literal_int_promote(lit);
+
+	if (!clog_value_real_to_integer(lit->value.real,&i) || (clog_value_int)(long)i != i)
+		return 0;
+
+	lit->value.integer = (long)i;
+	lit->type = clog_ast_literal_integer;
+	return 1;
+}
+
 static int clog_ast_literal_real_promote(struct clog_ast_literal* lit)
 {
 	if (lit && lit->type == clog_ast_literal_real)
@@ -389,6 +452,60 @@ static int clog_ast_literal_real_promote(struct clog_ast_literal* lit)
 	return 0;
 }
 
+/* Evaluates an integer operator the way the VM does, in 48-bit two's complement that wraps.
+ * Returns 0 if the VM would report an error or the result doesn't fit a literal, so it is left to the VM */
+static int clog_ast_int_op(unsigned int type, long a, long b, long* r)
+{
+	clog_value_int i;
+
+	switch (type)
+	{
+	case CLOG_TOKEN_PLUS:
+		i = (clog_value_int)((clog_value)a + (clog_value)b);
+		break;
+
+	case CLOG_TOKEN_MINUS:
+		i = (clog_value_int)((clog_value)a - (clog_value)b);
+		break;
+
+	case CLOG_TOKEN_STAR:
+		i = (clog_value_int)((clog_value)a * (clog_value)b);
+		break;
+
+	case CLOG_TOKEN_SLASH:
+		if (b == 0)
+			return 0;
+		i = (clog_value_int)a / b;
+		break;
+
+	case CLOG_TOKEN_PERCENT:
+		if (b == 0)
+			return 0;
+		i = (clog_value_int)a % b;
+		break;
+
+	case CLOG_TOKEN_LEFT_SHIFT:
+	case CLOG_TOKEN_RIGHT_SHIFT:
+		if (b < 0 || b >= (long)(sizeof(clog_value) * CHAR_BIT))
+			return 0;
+		if (type == CLOG_TOKEN_LEFT_SHIFT)
+			i = (clog_value_int)((clog_value)a << b);
+		else
+			i = (clog_value_int)a >> b;
+		break;
+
+	default:
+		return 0;
+	}
+
+	i = CLOG_VALUE_INT(CLOG_VALUE_INT_BOX(i));
+	if ((clog_value_int)(long)i != i)
+		return 0;
+
+	*r = (long)i;
+	return 1;
+}
+
 int clog_ast_literal_arith_convert(struct clog_ast_literal* lit1, struct clog_ast_literal* lit2)
 {
 	if (lit1 && lit1->type == clog_ast_literal_real)
@@ -421,7 +538,13 @@ int clog_ast_literal_compare(struct clog_ast_literal* lit1, struct clog_ast_lite
 int clog_ast_literal_id_compare(const struct clog_ast_literal* lit1, const struct clog_ast_literal* lit2)
 {
 	if (lit1 && lit2 && lit1->type == clog_ast_literal_string && lit2->type == clog_ast_literal_string)
+	{
+		/* Interned names are equal only if their symbols are, anything else never matches them */
+		if (lit1->symbol || lit2->symbol)
+			return (lit1->symbol == lit2->symbol ? 0 : (lit1->symbol > lit2->symbol ? 1 : -1));
+
 		return clog_ast_string_compare(&lit1->value.string,&lit2->value.string);
+	}
 
 	return -2;
 }
@@ -430,15 +553,15 @@ struct clog_ast_literal* clog_ast_literal_append_string(struct clog_parser* pars
 {
 	if (lit && token && token->value.string.len)
 	{
-		unsigned char* sz = clog_realloc(lit->value.string.str,lit->value.string.len + token->value.string.len);
+		unsigned char* sz = clog_arena_alloc(&parser->ast,lit->value.string.len + token->value.string.len + 1);
 		if (!sz)
 		{
-			clog_ast_literal_free(parser,lit);
 			lit = NULL;
 			clog_ast_out_of_memory(parser);
 		}
 		else
 		{
+			memcpy(sz,lit->value.string.str,lit->value.string.len);
 			memcpy(sz+lit->value.string.len,token->value.string.str,token->value.string.len);
 			lit->value.string.str = sz;
 			lit->value.string.len += token->value.string.len;
@@ -465,8 +588,6 @@ static void clog_ast_literal_bool_promote(struct clog_ast_literal* lit)
 			break;
 
 		case clog_ast_literal_string:
-			if (lit->value.string.str)
-				clog_free(lit->value.string.str);
 			lit->value.integer = (lit->value.string.len == 0 ? 0 : 1);
 			break;
 
@@ -480,43 +601,8 @@ static void clog_ast_literal_bool_promote(struct clog_ast_literal* lit)
 
 void clog_ast_expression_free(struct clog_parser* parser, struct clog_ast_expression* expr)
 {
-	if (expr)
-	{
-		switch (expr->type)
-		{
-		case clog_ast_expression_literal:
-			clog_ast_literal_free(parser,expr->expr.literal);
-			break;
-
-		case clog_ast_expression_identifier:
-			clog_ast_literal_free(parser,expr->expr.identifier);
-			break;
-
-		case clog_ast_expression_variable:
-			break;
-
-		case clog_ast_expression_builtin:
-			if (expr->expr.builtin)
-			{
-				clog_ast_expression_free(parser,expr->expr.builtin->args[0]);
-				clog_ast_expression_free(parser,expr->expr.builtin->args[1]);
-				clog_ast_expression_free(parser,expr->expr.builtin->args[2]);
-				clog_free(expr->expr.builtin);
-			}
-			break;
-
-		case clog_ast_expression_call:
-			if (expr->expr.call)
-			{
-				clog_ast_expression_free(parser,expr->expr.call->expr);
-				clog_ast_expression_list_free(parser,expr->expr.call->params);
-				clog_free(expr->expr.call);
-			}
-			break;
-		}
-
-		clog_free(expr);
-	}
+	(void)parser;
+	(void)expr;
 }
 
 static int clog_ast_expression_list_clone(struct clog_parser* parser, struct clog_ast_expression_list** new, const struct clog_ast_expression_list* list);
@@ -530,7 +616,7 @@ static int clog_ast_expression_clone(struct clog_parser* parser, struct clog_ast
 	if (!expr)
 		return 1;
 
-	*new = clog_malloc(sizeof(struct clog_ast_expression));
+	*new = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression));
 	if (!*new)
 		return clog_ast_out_of_memory(parser);
 
@@ -552,7 +638,7 @@ static int clog_ast_expression_clone(struct clog_parser* parser, struct clog_ast
 		break;
 
 	case clog_ast_expression_builtin:
-		(*new)->expr.builtin = clog_malloc(sizeof(struct clog_ast_expression_builtin));
+		(*new)->expr.builtin = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_builtin));
 		if (!(*new)->expr.builtin)
 		{
 			ok = clog_ast_out_of_memory(parser);
@@ -568,12 +654,10 @@ static int clog_ast_expression_clone(struct clog_parser* parser, struct clog_ast
 		if (ok)
 			ok = clog_ast_expression_clone(parser,&(*new)->expr.builtin->args[2],expr->expr.builtin->args[2]);
 
-		if (!ok)
-			clog_free((*new)->expr.builtin);
 		break;
 
 	case clog_ast_expression_call:
-		(*new)->expr.call = clog_malloc(sizeof(struct clog_ast_expression_call));
+		(*new)->expr.call = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_call));
 		if (!(*new)->expr.call)
 		{
 			ok = clog_ast_out_of_memory(parser);
@@ -584,16 +668,12 @@ static int clog_ast_expression_clone(struct clog_parser* parser, struct clog_ast
 		if (ok)
 			ok = clog_ast_expression_list_clone(parser,&(*new)->expr.call->params,expr->expr.call->params);
 
-		if (!ok)
-			clog_free((*new)->expr.call);
 		break;
 	}
 
 	if (!ok)
-	{
-		clog_free(*new);
 		*new = NULL;
-	}
+
 	return ok;
 }
 
@@ -611,7 +691,7 @@ unsigned long clog_ast_expression_line(const struct clog_ast_expression* expr)
 		return expr->expr.literal->line;
 
 	case clog_ast_expression_variable:
-		return 0;
+		return expr->expr.variable->line;
 
 	case clog_ast_expression_builtin:
 		return expr->expr.builtin->line;
@@ -630,7 +710,7 @@ int clog_ast_expression_alloc_literal(struct clog_parser* parser, struct clog_as
 	if (!lit)
 		return 0;
 
-	*expr = clog_malloc(sizeof(struct clog_ast_expression));
+	*expr = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression));
 	if (!*expr)
 	{
 		clog_ast_literal_free(parser,lit);
@@ -650,7 +730,7 @@ int clog_ast_expression_alloc_id(struct clog_parser* parser, struct clog_ast_exp
 	if (!token)
 		return 0;
 
-	*expr = clog_malloc(sizeof(struct clog_ast_expression));
+	*expr = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression));
 	if (!*expr)
 	{
 		clog_token_free(parser,token);
@@ -661,7 +741,6 @@ int clog_ast_expression_alloc_id(struct clog_parser* parser, struct clog_ast_exp
 
 	if (!clog_ast_literal_alloc(parser,&(*expr)->expr.identifier,token))
 	{
-		clog_free(*expr);
 		*expr = NULL;
 		return 0;
 	}
@@ -671,7 +750,7 @@ int clog_ast_expression_alloc_id(struct clog_parser* parser, struct clog_ast_exp
 
 static int clog_ast_expression_alloc_builtin(struct clog_parser* parser, struct clog_ast_expression** expr, unsigned int type, struct clog_ast_expression* p1, struct clog_ast_expression* p2, struct clog_ast_expression* p3)
 {
-	*expr = clog_malloc(sizeof(struct clog_ast_expression));
+	*expr = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression));
 	if (!*expr)
 	{
 		clog_ast_expression_free(parser,p1);
@@ -681,13 +760,12 @@ static int clog_ast_expression_alloc_builtin(struct clog_parser* parser, struct
 	}
 
 	(*expr)->type = clog_ast_expression_builtin;
-	(*expr)->expr.builtin = clog_malloc(sizeof(struct clog_ast_expression_builtin));
+	(*expr)->expr.builtin = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_builtin));
 	if (!(*expr)->expr.builtin)
 	{
 		clog_ast_expression_free(parser,p1);
 		clog_ast_expression_free(parser,p2);
 		clog_ast_expression_free(parser,p3);
-		clog_free(*expr);
 		*expr = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -762,12 +840,10 @@ int clog_ast_expression_alloc_builtin1(struct clog_parser* parser, struct clog_a
 
 			case clog_ast_literal_bool:
 			case clog_ast_literal_null:
-				p1->expr.literal->value.integer = -p1->expr.literal->value.integer;
-				p1->expr.literal->type = clog_ast_literal_integer;
-				break;
-
 			case clog_ast_literal_integer:
-				p1->expr.literal->value.integer = -p1->expr.literal->value.integer;
+				if (!clog_ast_int_op(CLOG_TOKEN_MINUS,0,p1->expr.literal->value.integer,&p1->expr.literal->value.integer))
+					return clog_ast_expression_alloc_builtin(parser,expr,type,p1,NULL,NULL);
+				p1->expr.literal->type = clog_ast_literal_integer;
 				break;
 
 			case clog_ast_literal_real:
@@ -784,7 +860,7 @@ int clog_ast_expression_alloc_builtin1(struct clog_parser* parser, struct clog_a
 			return 1;
 
 		case CLOG_TOKEN_TILDA:
-			if (!clog_ast_literal_int_promote(p1->expr.literal))
+			if (!clog_ast_literal_int_convert(p1->expr.literal))
 			{
 				clog_ast_expression_free(parser,p1);
 				return clog_syntax_error(parser,"~ requires an integer",p1->expr.literal->line);
@@ -810,12 +886,14 @@ int clog_ast_expression_alloc_builtin1(struct clog_parser* parser, struct clog_a
 				return 1;
 
 			case clog_ast_literal_real:
+				/* Out of range is left for the VM to report */
+				if (clog_ast_literal_int_convert(p1->expr.literal))
 				{
-					long v = p1->expr.literal->value.real;
-					p1->expr.literal->value.integer = v;
 					*expr = p1;
 					return 1;
 				}
+				break;
+
 			default:
 				break;
 			}
@@ -937,7 +1015,7 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 		case CLOG_TOKEN_BAR:
 		case CLOG_TOKEN_CARET:
 		case CLOG_TOKEN_AMPERSAND:
-			if (!clog_ast_literal_int_promote(p1->expr.literal))
+			if (!clog_ast_literal_int_convert(p1->expr.literal))
 			{
 				clog_ast_expression_free(parser,p1);
 				clog_ast_expression_free(parser,p2);
@@ -996,7 +1074,6 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 				{
 				case clog_ast_literal_string:
 					cmp = clog_ast_string_compare(&p1->expr.literal->value.string,&p2->expr.literal->value.string);
-					clog_free(p1->expr.literal->value.string.str);
 					break;
 
 				case clog_ast_literal_bool:
@@ -1034,7 +1111,7 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 
 		case CLOG_TOKEN_LEFT_SHIFT:
 		case CLOG_TOKEN_RIGHT_SHIFT:
-			if (!clog_ast_literal_int_promote(p1->expr.literal))
+			if (!clog_ast_literal_int_convert(p1->expr.literal))
 			{
 				clog_ast_expression_free(parser,p1);
 				clog_ast_expression_free(parser,p2);
@@ -1045,13 +1122,10 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 				clog_ast_expression_free(parser,p1);
 				return 0;
 			}
-			if (p2->type == clog_ast_expression_literal)
+			/* A shift count out of range is left for the VM to report */
+			if (p2->type == clog_ast_expression_literal &&
+					clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
 			{
-				if (type == CLOG_TOKEN_LEFT_SHIFT)
-					p1->expr.literal->value.integer <<= p2->expr.literal->value.integer;
-				else
-					p1->expr.literal->value.integer >>= p2->expr.literal->value.integer;
-
 				clog_ast_expression_free(parser,p2);
 				*expr = p1;
 				return 1;
@@ -1078,8 +1152,6 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 					clog_ast_expression_free(parser,p1);
 					return 0;
 				}
-				if (p2->type != clog_ast_expression_literal)
-					return clog_ast_expression_alloc_builtin(parser,expr,type,p2,p1,NULL);
 				break;
 			}
 			if (p2->type == clog_ast_expression_literal)
@@ -1095,16 +1167,15 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 					}
 					if (p2->expr.literal->value.string.len)
 					{
-						unsigned char* sz = clog_realloc(p1->expr.literal->value.string.str,p1->expr.literal->value.string.len + p2->expr.literal->value.string.len);
+						unsigned char* sz = clog_arena_alloc(&parser->ast,p1->expr.literal->value.string.len + p2->expr.literal->value.string.len + 1);
 						if (!sz)
-						{
-							clog_ast_expression_free(parser,p1);
-							clog_ast_expression_free(parser,p2);
 							return clog_ast_out_of_memory(parser);
-						}
+
+						memcpy(sz,p1->expr.literal->value.string.str,p1->expr.literal->value.string.len);
 						memcpy(sz+p1->expr.literal->value.string.len,p2->expr.literal->value.string.str,p2->expr.literal->value.string.len);
 						p1->expr.literal->value.string.str = sz;
 						p1->expr.literal->value.string.len += p2->expr.literal->value.string.len;
+						sz[p1->expr.literal->value.string.len] = 0;
 					}
 					break;
 
@@ -1115,8 +1186,8 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 					clog_ast_literal_arith_convert(p1->expr.literal,p2->expr.literal);
 					if (p1->expr.literal->type == clog_ast_literal_real)
 						p1->expr.literal->value.real += p2->expr.literal->value.real;
-					else
-						p1->expr.literal->value.integer += p2->expr.literal->value.integer;
+					else if (!clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
+						return clog_ast_expression_alloc_builtin(parser,expr,type,p1,p2,NULL);
 					break;
 				}
 				clog_ast_expression_free(parser,p2);
@@ -1155,15 +1226,15 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 				{
 					if (p1->expr.literal->type == clog_ast_literal_real)
 						p1->expr.literal->value.real -= p2->expr.literal->value.real;
-					else
-						p1->expr.literal->value.integer -= p2->expr.literal->value.integer;
+					else if (!clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
+						return clog_ast_expression_alloc_builtin(parser,expr,type,p1,p2,NULL);
 				}
 				else if (type == CLOG_TOKEN_STAR)
 				{
 					if (p1->expr.literal->type == clog_ast_literal_real)
 						p1->expr.literal->value.real *= p2->expr.literal->value.real;
-					else
-						p1->expr.literal->value.integer *= p2->expr.literal->value.integer;
+					else if (!clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
+						return clog_ast_expression_alloc_builtin(parser,expr,type,p1,p2,NULL);
 				}
 				else
 				{
@@ -1176,8 +1247,8 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 					}
 					if (p1->expr.literal->type == clog_ast_literal_real)
 						p1->expr.literal->value.real /= p2->expr.literal->value.real;
-					else
-						p1->expr.literal->value.integer /= p2->expr.literal->value.integer;
+					else if (!clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
+						return clog_ast_expression_alloc_builtin(parser,expr,type,p1,p2,NULL);
 				}
 				clog_ast_expression_free(parser,p2);
 				*expr = p1;
@@ -1186,27 +1257,27 @@ int clog_ast_expression_alloc_builtin2(struct clog_parser* parser, struct clog_a
 			break;
 
 		case CLOG_TOKEN_PERCENT:
-			switch (p1->expr.literal->type)
+			if (!clog_ast_literal_int_convert(p1->expr.literal))
 			{
-			case clog_ast_literal_string:
-			case clog_ast_literal_real:
 				clog_ast_expression_free(parser,p1);
 				clog_ast_expression_free(parser,p2);
 				return clog_syntax_error(parser,"% requires integers",p1->expr.literal->line);
-
-			case clog_ast_literal_bool:
-			case clog_ast_literal_null:
-			case clog_ast_literal_integer:
-				if (!clog_ast_expression_alloc_builtin1(parser,&p2,CLOG_TOKEN_INTEGER,p2))
-				{
-					clog_ast_expression_free(parser,p1);
-					return 0;
-				}
-				break;
+			}
+			if (!clog_ast_expression_alloc_builtin1(parser,&p2,CLOG_TOKEN_INTEGER,p2))
+			{
+				clog_ast_expression_free(parser,p1);
+				return 0;
 			}
 			if (p2->type == clog_ast_expression_literal)
 			{
-				p1->expr.literal->value.integer %= p2->expr.literal->value.integer;
+				if (p2->expr.literal->value.integer == 0)
+				{
+					clog_ast_expression_free(parser,p1);
+					clog_ast_expression_free(parser,p2);
+					return clog_syntax_error(parser,"Division by zero",p2->expr.literal->line);
+				}
+				if (!clog_ast_int_op(type,p1->expr.literal->value.integer,p2->expr.literal->value.integer,&p1->expr.literal->value.integer))
+					return clog_ast_expression_alloc_builtin(parser,expr,type,p1,p2,NULL);
 				clog_ast_expression_free(parser,p2);
 				*expr = p1;
 				return 1;
@@ -1279,7 +1350,7 @@ int clog_ast_expression_alloc_call(struct clog_parser* parser, struct clog_ast_e
 		return 0;
 	}
 
-	*expr = clog_malloc(sizeof(struct clog_ast_expression));
+	*expr = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression));
 	if (!*expr)
 	{
 		clog_ast_expression_free(parser,call);
@@ -1288,12 +1359,11 @@ int clog_ast_expression_alloc_call(struct clog_parser* parser, struct clog_ast_e
 	}
 
 	(*expr)->type = clog_ast_expression_call;
-	(*expr)->expr.call = clog_malloc(sizeof(struct clog_ast_expression_call));
+	(*expr)->expr.call = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_call));
 	if (!(*expr)->expr.call)
 	{
 		clog_ast_expression_free(parser,call);
 		clog_ast_expression_list_free(parser,list);
-		clog_free(*expr);
 		*expr = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -1306,13 +1376,8 @@ int clog_ast_expression_alloc_call(struct clog_parser* parser, struct clog_ast_e
 
 void clog_ast_expression_list_free(struct clog_parser* parser, struct clog_ast_expression_list* list)
 {
-	if (list)
-	{
-		clog_ast_expression_free(parser,list->expr);
-		clog_ast_expression_list_free(parser,list->next);
-
-		clog_free(list);
-	}
+	(void)parser;
+	(void)list;
 }
 
 int clog_ast_expression_list_alloc(struct clog_parser* parser, struct clog_ast_expression_list** list, struct clog_ast_expression* expr)
@@ -1320,7 +1385,7 @@ int clog_ast_expression_list_alloc(struct clog_parser* parser, struct clog_ast_e
 	if (!expr)
 		return 0;
 
-	*list = clog_malloc(sizeof(struct clog_ast_expression_list));
+	*list = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_list));
 	if (!*list)
 	{
 		clog_ast_expression_free(parser,expr);
@@ -1340,13 +1405,12 @@ static int clog_ast_expression_list_clone(struct clog_parser* parser, struct clo
 	if (!list)
 		return 1;
 
-	*new = clog_malloc(sizeof(struct clog_ast_expression_list));
+	*new = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_list));
 	if (!*new)
 		return clog_ast_out_of_memory(parser);
 
 	if (!clog_ast_expression_clone(parser,&(*new)->expr,list->expr))
 	{
-		clog_free(*new);
 		*new = NULL;
 		return 0;
 	}
@@ -1354,7 +1418,6 @@ static int clog_ast_expression_list_clone(struct clog_parser* parser, struct clo
 	if (!clog_ast_expression_list_clone(parser,&(*new)->next,list->next))
 	{
 		clog_ast_expression_free(parser,(*new)->expr);
-		clog_free(*new);
 		*new = NULL;
 		return 0;
 	}
@@ -1370,98 +1433,21 @@ int clog_ast_expression_list_append(struct clog_parser* parser, struct clog_ast_
 	return clog_ast_expression_list_alloc(parser,list,expr);
 }
 
-static void clog_ast_statement_free_block(struct clog_parser* parser, struct clog_ast_block* block)
-{
-	if (block)
-	{
-		struct clog_ast_variable* v;
-		for (v=block->locals;v;)
-		{
-			struct clog_ast_variable* n = v->next;
-			clog_free(v->id.str);
-			clog_free(v);
-			v = n;
-		}
-		for (v=block->externs;v;)
-		{
-			struct clog_ast_variable* n = v->next;
-			clog_free(v->id.str);
-			clog_free(v);
-			v = n;
-		}
-		clog_ast_statement_list_free(parser,block->stmts);
-		clog_free(block);
-	}
-}
-
-static void clog_ast_statement_free(struct clog_parser* parser, struct clog_ast_statement* stmt)
-{
-	if (stmt)
-	{
-		switch (stmt->type)
-		{
-		case clog_ast_statement_expression:
-		case clog_ast_statement_return:
-		case clog_ast_statement_break:
-		case clog_ast_statement_continue:
-			clog_ast_expression_free(parser,stmt->stmt.expression);
-			break;
-
-		case clog_ast_statement_block:
-			clog_ast_statement_free_block(parser,stmt->stmt.block);
-			break;
-
-		case clog_ast_statement_declaration:
-		case clog_ast_statement_constant:
-			clog_ast_literal_free(parser,stmt->stmt.declaration);
-			break;
-
-		case clog_ast_statement_if:
-			clog_ast_expression_free(parser,stmt->stmt.if_stmt->condition);
-			clog_ast_statement_free_block(parser,stmt->stmt.if_stmt->true_block);
-			clog_ast_statement_free_block(parser,stmt->stmt.if_stmt->false_block);
-			clog_free(stmt->stmt.if_stmt);
-			break;
-
-		case clog_ast_statement_do:
-			clog_ast_expression_free(parser,stmt->stmt.do_stmt->condition);
-			clog_ast_statement_free_block(parser,stmt->stmt.do_stmt->loop_block);
-			clog_free(stmt->stmt.do_stmt);
-			break;
-
-		case clog_ast_statement_while:
-			clog_ast_expression_free(parser,stmt->stmt.while_stmt->condition);
-			clog_ast_statement_free_block(parser,stmt->stmt.while_stmt->loop_block);
-			clog_ast_statement_list_free(parser,stmt->stmt.while_stmt->pre);
-			clog_free(stmt->stmt.while_stmt);
-			break;
-		}
-
-		clog_free(stmt);
-	}
-}
-
 void clog_ast_statement_list_free(struct clog_parser* parser, struct clog_ast_statement_list* list)
 {
-	if (list)
-	{
-		clog_ast_statement_free(parser,list->stmt);
-		clog_ast_statement_list_free(parser,list->next);
-
-		clog_free(list);
-	}
+	(void)parser;
+	(void)list;
 }
 
 int clog_ast_statement_list_alloc(struct clog_parser* parser, struct clog_ast_statement_list** list, enum clog_ast_statement_type type)
 {
-	*list = clog_malloc(sizeof(struct clog_ast_statement_list));
+	*list = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_statement_list));
 	if (!*list)
 		return clog_ast_out_of_memory(parser);
 
-	(*list)->stmt = clog_malloc(sizeof(struct clog_ast_statement));
+	(*list)->stmt = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_statement));
 	if (!(*list)->stmt)
 	{
-		clog_free(*list);
 		*list = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -1474,7 +1460,6 @@ int clog_ast_statement_list_alloc(struct clog_parser* parser, struct clog_ast_st
 		if (!clog_ast_literal_alloc(parser,&lit_null,NULL) ||
 				!clog_ast_expression_alloc_literal(parser,&(*list)->stmt->stmt.expression,lit_null))
 		{
-			clog_free(*list);
 			*list = NULL;
 			return 0;
 		}
@@ -1502,26 +1487,130 @@ int clog_ast_statement_list_alloc_expression(struct clog_parser* parser, struct
 	return 1;
 }
 
-static int clog_ast_variable_alloc(struct clog_parser* parser, struct clog_ast_variable** var, const struct clog_string* str)
+static int clog_ast_bind_error(struct clog_parser* parser, const char* msg, const struct clog_string* id, unsigned long line)
 {
-	*var = clog_malloc(sizeof(struct clog_ast_variable));
+	char buf[256];
+	sprintf(buf,"Error: %.64s%.*s at line %lu",msg,(int)(id->len > 64 ? 64 : id->len),(const char*)id->str,line);
+	clog_diagnostic(parser,line,buf);
+	parser->failed = 1;
+	return 0;
+}
+
+static int clog_ast_variable_alloc(struct clog_parser* parser, struct clog_ast_variable** var, const struct clog_ast_literal* id)
+{
+	*var = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_variable));
 	if (!(*var))
 		return clog_ast_out_of_memory(parser);
 
+	/* The name belongs to the symbol table */
 	memset(*var,0,sizeof(struct clog_ast_variable));
-	(*var)->id.len = str->len;
-	if ((*var)->id.len)
+	(*var)->symbol = id->symbol;
+	(*var)->id = *clog_symbol_name(&parser->symbols,id->symbol);
+	(*var)->line = id->line;
+	(*var)->index = parser->var_count++;
+	return 1;
+}
+
+static struct clog_ast_variable* clog_ast_scope_find(const struct clog_ast_scope* scope, unsigned int symbol)
+{
+	unsigned int i;
+
+	if (!scope->size)
+		return NULL;
+
+	for (i = (symbol * 2654435761UL) & (scope->size - 1); scope->slots[i]; i = (i + 1) & (scope->size - 1))
 	{
-		(*var)->id.str = clog_malloc((*var)->id.len + 1);
-		if (!(*var)->id.str)
-		{
-			clog_free(*var);
-			*var = NULL;
+		if (scope->slots[i]->symbol == symbol)
+			return scope->slots[i];
+	}
+	return NULL;
+}
+
+static void clog_ast_scope_set(struct clog_ast_scope* scope, struct clog_ast_variable* var)
+{
+	unsigned int i = (var->symbol * 2654435761UL) & (scope->size - 1);
+	while (scope->slots[i])
+		i = (i + 1) & (scope->size - 1);
+
+	scope->slots[i] = var;
+	++scope->count;
+}
+
+static int clog_ast_scope_insert(struct clog_parser* parser, struct clog_ast_scope* scope, struct clog_ast_variable* var)
+{
+	/* Keep the load factor under a half */
+	if ((scope->count + 1) * 2 > scope->size)
+	{
+		struct clog_ast_scope new_scope;
+		unsigned int i;
+
+		new_scope.count = 0;
+		new_scope.size = (scope->size == 0 ? 16 : scope->size * 2);
+		new_scope.slots = clog_arena_alloc(&parser->ast,new_scope.size * sizeof(struct clog_ast_variable*));
+		if (!new_scope.slots)
 			return clog_ast_out_of_memory(parser);
+
+		memset(new_scope.slots,0,new_scope.size * sizeof(struct clog_ast_variable*));
+
+		for (i = 0; i < scope->size; ++i)
+		{
+			if (scope->slots[i])
+				clog_ast_scope_set(&new_scope,scope->slots[i]);
 		}
-		memcpy((*var)->id.str,str->str,(*var)->id.len);
-		(*var)->id.str[(*var)->id.len] = 0;
+
+		*scope = new_scope;
 	}
+
+	clog_ast_scope_set(scope,var);
+	return 1;
+}
+
+/* Inner blocks shadow outer ones, and only what has been declared so far is visible */
+static struct clog_ast_variable* clog_ast_block_lookup(const struct clog_ast_block* block, unsigned int symbol)
+{
+	for (;block;block = block->outer)
+	{
+		struct clog_ast_variable* var = clog_ast_scope_find(&block->locals_index,symbol);
+		if (var)
+			return var;
+	}
+	return NULL;
+}
+
+static int clog_ast_block_add_local(struct clog_parser* parser, struct clog_ast_block* block, struct clog_ast_variable* var)
+{
+	if (!clog_ast_scope_insert(parser,&block->locals_index,var))
+		return 0;
+
+	var->next = block->locals;
+	block->locals = var;
+	return 1;
+}
+
+/* Whether block itself declares symbol, usable before binding */
+static int clog_ast_block_declares(const struct clog_ast_block* block, unsigned int symbol)
+{
+	const struct clog_ast_statement_list* l;
+	for (l = block->stmts;l;l = l->next)
+	{
+		if ((l->stmt->type == clog_ast_statement_declaration || l->stmt->type == clog_ast_statement_constant) && l->stmt->stmt.declaration->symbol == symbol)
+			return 1;
+	}
+	return 0;
+}
+
+static int clog_ast_bind_variable(struct clog_parser* parser, struct clog_ast_expression* expr, struct clog_ast_variable* var)
+{
+	struct clog_ast_expression_variable* ref = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_expression_variable));
+	if (!ref)
+		return clog_ast_out_of_memory(parser);
+
+	ref->line = expr->expr.identifier->line;
+	ref->var = var;
+
+	clog_ast_literal_free(parser,expr->expr.identifier);
+	expr->type = clog_ast_expression_variable;
+	expr->expr.variable = ref;
 	return 1;
 }
 
@@ -1534,42 +1623,20 @@ static int clog_ast_bind_expression(struct clog_parser* parser, struct clog_ast_
 	{
 	case clog_ast_expression_identifier:
 		{
-			struct clog_ast_variable* var;
-			for (var = block->locals;var;var = var->next)
-			{
-				if (clog_ast_string_compare(&var->id,&expr->expr.identifier->value.string) == 0)
-					break;
-			}
+			struct clog_ast_variable* var = clog_ast_block_lookup(block,expr->expr.identifier->symbol);
 			if (!var)
-			{
-				for (var = block->externs;var;var = var->next)
-				{
-					if (clog_ast_string_compare(&var->id,&expr->expr.identifier->value.string) == 0)
-						break;
-				}
-				if (!var)
-				{
-					if (!clog_ast_variable_alloc(parser,&var,&expr->expr.identifier->value.string))
-						return 0;
-
-					var->next = block->externs;
-					block->externs = var;
-				}
-			}
+				return clog_ast_bind_error(parser,"Undeclared identifier ",&expr->expr.identifier->value.string,expr->expr.identifier->line);
 
 			if (assignment)
 			{
 				if (var->constant)
-					return clog_syntax_error(parser,"Assignment to constant",expr->expr.identifier->line);
+					return clog_ast_bind_error(parser,"Assignment to constant ",&var->id,expr->expr.identifier->line);
 
 				var->assigned = 1;
 			}
 
-			clog_ast_literal_free(parser,expr->expr.identifier);
-			expr->type = clog_ast_expression_variable;
-			expr->expr.variable = var;
+			return clog_ast_bind_variable(parser,expr,var);
 		}
-		break;
 
 	case clog_ast_expression_literal:
 	case clog_ast_expression_variable:
@@ -1633,49 +1700,16 @@ static int clog_ast_bind_expression(struct clog_parser* parser, struct clog_ast_
 	return 1;
 }
 
+static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* block, struct clog_ast_statement_list** l);
+
 static int clog_ast_bind_block(struct clog_parser* parser, struct clog_ast_block* outer_block, struct clog_ast_block* inner_block)
 {
 	if (!inner_block)
 		return 1;
 
-	/* Match externs to outer_block's locals */
-	struct clog_ast_variable* var1;
-	for (var1 = inner_block->externs; var1; var1 = var1->next)
-	{
-		struct clog_ast_variable* var2;
-		for (var2 = outer_block->locals; var2; var2 = var2->next)
-		{
-			if (clog_ast_string_compare(&var1->id,&var2->id) == 0)
-			{
-				var1->up = var2;
-				break;
-			}
-		}
-		if (!var2)
-		{
-			/* Match to outer_block's externs */
-			for (var2 = outer_block->externs; var2; var2 = var2->next)
-			{
-				if (clog_ast_string_compare(&var1->id,&var2->id) == 0)
-				{
-					var1->up = var2;
-					break;
-				}
-			}
-			if (!var2)
-			{
-				if (!clog_ast_variable_alloc(parser,&var2,&var1->id))
-					return 0;
-
-				var2->next = outer_block->externs;
-				outer_block->externs = var2;
-			}
-		}
-
-		if (var1->assigned)
-			var2->assigned = 1;
-	}
-	return 1;
+	/* Names the block doesn't declare resolve through the blocks around it */
+	inner_block->outer = outer_block;
+	return clog_ast_bind(parser,inner_block,&inner_block->stmts);
 }
 
 static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* block, struct clog_ast_statement_list** l)
@@ -1685,6 +1719,7 @@ static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* bloc
 		switch ((*l)->stmt->type)
 		{
 		case clog_ast_statement_expression:
+		case clog_ast_statement_return:
 			if (!clog_ast_bind_expression(parser,block,(*l)->stmt->stmt.expression,0))
 				return 0;
 			break;
@@ -1692,27 +1727,29 @@ static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* bloc
 		case clog_ast_statement_declaration:
 		case clog_ast_statement_constant:
 			{
+				/* Next statement is the initialiser, id = expr */
+				const struct clog_ast_literal* id = (*l)->stmt->stmt.declaration;
+				struct clog_ast_expression_builtin* init = (*l)->next->stmt->stmt.expression->expr.builtin;
 				struct clog_ast_variable* var;
 
-				/* Next statement is the initialiser, bind it first */
-				if (!clog_ast_bind_expression(parser,block,(*l)->next->stmt->stmt.expression->expr.builtin->args[1],0))
+				/* Bind the value first, so it can't refer to the variable it initialises */
+				if (!clog_ast_bind_expression(parser,block,init->args[1],0))
 					return 0;
 
-				/* Search for a duplicate */
-				for (var = block->locals;var;var = var->next)
-				{
-					if (clog_ast_string_compare(&var->id,&(*l)->stmt->stmt.declaration->value.string) == 0)
-						return clog_syntax_error(parser,"Variable already declared",(*l)->stmt->stmt.declaration->line);
-				}
+				if (clog_ast_scope_find(&block->locals_index,id->symbol))
+					return clog_ast_bind_error(parser,"Duplicate declaration of ",&id->value.string,id->line);
 
-				/* Add to the block's locals */
-				if (!clog_ast_variable_alloc(parser,&var,&(*l)->stmt->stmt.declaration->value.string))
+				if (!clog_ast_variable_alloc(parser,&var,id))
 					return 0;
 
 				var->constant = ((*l)->stmt->type == clog_ast_statement_constant ? 1 : 0);
-				var->next = block->locals;
-				block->locals = var;
+				if (!clog_ast_block_add_local(parser,block,var) ||
+						!clog_ast_bind_variable(parser,init->args[0],var))
+				{
+					return 0;
+				}
 
+				/* Drop the declaration, leaving the bound initialiser to be stepped over below */
 				{
 					struct clog_ast_statement_list* n = (*l)->next;
 					(*l)->next = NULL;
@@ -1747,7 +1784,8 @@ static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* bloc
 		case clog_ast_statement_while:
 			if (!clog_ast_bind(parser,block,&(*l)->stmt->stmt.while_stmt->pre) ||
 					!clog_ast_bind_expression(parser,block,(*l)->stmt->stmt.while_stmt->condition,0) ||
-					!clog_ast_bind_block(parser,block,(*l)->stmt->stmt.while_stmt->loop_block))
+					!clog_ast_bind_block(parser,block,(*l)->stmt->stmt.while_stmt->loop_block) ||
+					((*l)->stmt->stmt.while_stmt->post && !clog_ast_bind_expression(parser,block,(*l)->stmt->stmt.while_stmt->post,0)))
 			{
 				return 0;
 			}
@@ -1755,23 +1793,7 @@ static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* bloc
 
 		case clog_ast_statement_break:
 		case clog_ast_statement_continue:
-			if ((*l)->next)
-			{
-				clog_syntax_error(parser,"Warning: Unreachable code",(*l)->stmt->stmt.expression->expr.literal->line);
-				clog_ast_statement_list_free(parser,(*l)->next);
-			}
-			return 1;
-
-		case clog_ast_statement_return:
-			if (!clog_ast_bind_expression(parser,block,(*l)->stmt->stmt.expression,0))
-				return 0;
-
-			if ((*l)->next)
-			{
-				clog_syntax_error(parser,"Warning: Unreachable code",(*l)->stmt->stmt.expression->expr.literal->line);
-				clog_ast_statement_list_free(parser,(*l)->next);
-			}
-			return 1;
+			break;
 		}
 
 		l = &(*l)->next;
@@ -1780,6 +1802,11 @@ static int clog_ast_bind(struct clog_parser* parser, struct clog_ast_block* bloc
 	return 1;
 }
 
+int clog_ast_bind_program(struct clog_parser* parser, struct clog_ast_block* block)
+{
+	return clog_ast_bind_block(parser,NULL,block);
+}
+
 int clog_ast_statement_list_alloc_block(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* block_list)
 {
 	struct clog_ast_block* block;
@@ -1796,15 +1823,14 @@ int clog_ast_statement_list_alloc_block(struct clog_parser* parser, struct clog_
 		return 1;
 	}
 
-	block = clog_malloc(sizeof(struct clog_ast_block));
+	block = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_block));
 	if (!block)
 	{
 		clog_ast_statement_list_free(parser,block_list);
 		return clog_ast_out_of_memory(parser);
 	}
 
-	block->locals = NULL;
-	block->externs = NULL;
+	memset(block,0,sizeof(struct clog_ast_block));
 	block->stmts = block_list;
 
 	if (!clog_ast_statement_list_alloc(parser,list,clog_ast_statement_block))
@@ -1815,13 +1841,6 @@ int clog_ast_statement_list_alloc_block(struct clog_parser* parser, struct clog_
 
 	(*list)->stmt->stmt.block = block;
 
-/*	if (!clog_ast_bind(parser,block,&block->stmts))
-	{
-		clog_ast_statement_list_free(parser,*list);
-		*list = NULL;
-		return 0;
-	}*/
-
 	return 1;
 }
 
@@ -1841,6 +1860,22 @@ struct clog_ast_statement_list* clog_ast_statement_list_append(struct clog_parse
 	return list;
 }
 
+void clog_ast_statement_list_build(struct clog_ast_statement_list_builder* builder, struct clog_ast_statement_list* next)
+{
+	if (!next)
+		return;
+
+	if (!builder->head)
+		builder->head = next;
+	else
+		builder->last->next = next;
+
+	/* Only the new statements are walked, a declaration may be several */
+	builder->last = next;
+	while (builder->last->next)
+		builder->last = builder->last->next;
+}
+
 int clog_ast_statement_list_alloc_declaration(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_token* id, struct clog_ast_expression* init)
 {
 	struct clog_token* id2 = NULL;
@@ -1874,6 +1909,7 @@ int clog_ast_statement_list_alloc_declaration(struct clog_parser* parser, struct
 		clog_ast_expression_free(parser,init);
 		return 0;
 	}
+	id2->symbol = id->symbol;
 
 	if (!clog_ast_statement_list_alloc(parser,list,clog_ast_statement_declaration))
 	{
@@ -1887,7 +1923,6 @@ int clog_ast_statement_list_alloc_declaration(struct clog_parser* parser, struct
 	{
 		clog_token_free(parser,id2);
 		clog_ast_expression_free(parser,init);
-		clog_free(*list);
 		*list = NULL;
 		return 0;
 	}
@@ -1974,32 +2009,14 @@ int clog_ast_statement_list_alloc_if(struct clog_parser* parser, struct clog_ast
 		struct clog_ast_statement_list* cond2;
 
 		/* We must check to see if an identical declaration occurs in the outermost block of true_stmt and false_stmt */
-		struct clog_ast_variable* v = true_stmt->stmt->stmt.block->locals;
-		for (;v;v = v->next)
+		if ((true_stmt && clog_ast_block_declares(true_stmt->stmt->stmt.block,cond->stmt->stmt.declaration->symbol)) ||
+				(false_stmt && clog_ast_block_declares(false_stmt->stmt->stmt.block,cond->stmt->stmt.declaration->symbol)))
 		{
-			if (clog_ast_string_compare(&v->id,&cond->stmt->stmt.declaration->value.string) == 0)
-			{
-				unsigned long line = cond->stmt->stmt.declaration->line;
-				clog_ast_statement_list_free(parser,cond);
-				clog_ast_statement_list_free(parser,true_stmt);
-				clog_ast_statement_list_free(parser,false_stmt);
-				return clog_syntax_error(parser,"Variable already declared",line);
-			}
-		}
-
-		if (false_stmt)
-		{
-			for (v = false_stmt->stmt->stmt.block->locals;v;v = v->next)
-			{
-				if (clog_ast_string_compare(&v->id,&cond->stmt->stmt.declaration->value.string) == 0)
-				{
-					unsigned long line = cond->stmt->stmt.declaration->line;
-					clog_ast_statement_list_free(parser,cond);
-					clog_ast_statement_list_free(parser,true_stmt);
-					clog_ast_statement_list_free(parser,false_stmt);
-					return clog_syntax_error(parser,"Variable already declared",line);
-				}
-			}
+			unsigned long line = cond->stmt->stmt.declaration->line;
+			clog_ast_statement_list_free(parser,cond);
+			clog_ast_statement_list_free(parser,true_stmt);
+			clog_ast_statement_list_free(parser,false_stmt);
+			return clog_syntax_error(parser,"Variable already declared",line);
 		}
 
 		/* Now rewrite if (var x = 1) ... => { var x = 1; if ((bool)x) ... } */
@@ -2040,14 +2057,12 @@ int clog_ast_statement_list_alloc_if(struct clog_parser* parser, struct clog_ast
 		return 0;
 	}
 
-	(*list)->stmt->stmt.if_stmt = clog_malloc(sizeof(struct clog_ast_statement_if));
+	(*list)->stmt->stmt.if_stmt = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_statement_if));
 	if (!(*list)->stmt->stmt.if_stmt)
 	{
 		clog_ast_statement_list_free(parser,cond);
 		clog_ast_statement_list_free(parser,true_stmt);
 		clog_ast_statement_list_free(parser,false_stmt);
-		clog_free((*list)->stmt);
-		clog_free(*list);
 		*list = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -2058,8 +2073,6 @@ int clog_ast_statement_list_alloc_if(struct clog_parser* parser, struct clog_ast
 		clog_ast_statement_list_free(parser,cond);
 		clog_ast_statement_list_free(parser,true_stmt);
 		clog_ast_statement_list_free(parser,false_stmt);
-		clog_free((*list)->stmt);
-		clog_free(*list);
 		*list = NULL;
 		return 0;
 	}
@@ -2121,13 +2134,11 @@ int clog_ast_statement_list_alloc_do(struct clog_parser* parser, struct clog_ast
 		return 0;
 	}
 
-	(*list)->stmt->stmt.do_stmt = clog_malloc(sizeof(struct clog_ast_statement_do));
+	(*list)->stmt->stmt.do_stmt = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_statement_do));
 	if (!(*list)->stmt->stmt.do_stmt)
 	{
 		clog_ast_expression_free(parser,cond);
 		clog_ast_statement_list_free(parser,loop_stmt);
-		clog_free((*list)->stmt);
-		clog_free(*list);
 		*list = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -2135,8 +2146,6 @@ int clog_ast_statement_list_alloc_do(struct clog_parser* parser, struct clog_ast
 	if (!clog_ast_expression_alloc_builtin1(parser,&(*list)->stmt->stmt.do_stmt->condition,CLOG_TOKEN_TRUE,cond))
 	{
 		clog_ast_statement_list_free(parser,loop_stmt);
-		clog_free((*list)->stmt);
-		clog_free(*list);
 		*list = NULL;
 		return 0;
 	}
@@ -2151,12 +2160,13 @@ int clog_ast_statement_list_alloc_do(struct clog_parser* parser, struct clog_ast
 	return 1;
 }
 
-int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* cond_stmt, struct clog_ast_statement_list* loop_stmt)
+static int clog_ast_statement_list_alloc_loop(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* cond_stmt, struct clog_ast_expression* iter_expr, struct clog_ast_statement_list* loop_stmt)
 {
 	*list = NULL;
 
 	if (!cond_stmt)
 	{
+		clog_ast_expression_free(parser,iter_expr);
 		clog_ast_statement_list_free(parser,loop_stmt);
 		return 0;
 	}
@@ -2178,13 +2188,11 @@ int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_
 		return 0;
 	}
 
-	(*list)->stmt->stmt.while_stmt = clog_malloc(sizeof(struct clog_ast_statement_while));
+	(*list)->stmt->stmt.while_stmt = clog_arena_alloc(&parser->ast,sizeof(struct clog_ast_statement_while));
 	if (!(*list)->stmt->stmt.while_stmt)
 	{
 		clog_ast_statement_list_free(parser,cond_stmt);
 		clog_ast_statement_list_free(parser,loop_stmt);
-		clog_free((*list)->stmt);
-		clog_free(*list);
 		*list = NULL;
 		return clog_ast_out_of_memory(parser);
 	}
@@ -2197,8 +2205,6 @@ int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_
 		{
 			clog_ast_statement_list_free(parser,cond_stmt);
 			clog_ast_statement_list_free(parser,loop_stmt);
-			clog_free((*list)->stmt);
-			clog_free(*list);
 			*list = NULL;
 			return 0;
 		}
@@ -2212,8 +2218,6 @@ int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_
 		{
 			clog_ast_statement_list_free(parser,cond_stmt);
 			clog_ast_statement_list_free(parser,loop_stmt);
-			clog_free((*list)->stmt);
-			clog_free(*list);
 			*list = NULL;
 			return 0;
 		}
@@ -2231,15 +2235,15 @@ int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_
 		if (!(*list)->stmt->stmt.while_stmt->condition->expr.literal->value.integer)
 		{
 			struct clog_ast_statement_list* l = (*list)->stmt->stmt.while_stmt->pre;
+			clog_ast_expression_free(parser,iter_expr);
 			clog_ast_statement_list_free(parser,loop_stmt);
 			clog_ast_expression_free(parser,(*list)->stmt->stmt.while_stmt->condition);
-			clog_free((*list)->stmt);
-			clog_free(*list);
 			return clog_ast_statement_list_alloc_block(parser,list,l);
 		}
 	}
 
 	/* Create the loop */
+	(*list)->stmt->stmt.while_stmt->post = iter_expr;
 	(*list)->stmt->stmt.while_stmt->loop_block = NULL;
 	if (loop_stmt)
 	{
@@ -2252,9 +2256,14 @@ int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_
 	return clog_ast_statement_list_alloc_block(parser,list,*list);
 }
 
+int clog_ast_statement_list_alloc_while(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* cond_stmt, struct clog_ast_statement_list* loop_stmt)
+{
+	return clog_ast_statement_list_alloc_loop(parser,list,cond_stmt,NULL,loop_stmt);
+}
+
 int clog_ast_statement_list_alloc_for(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* init_stmt, struct clog_ast_statement_list* cond_stmt, struct clog_ast_expression* iter_expr, struct clog_ast_statement_list* loop_stmt)
 {
-	/* Translate for (A;B;C) {D}  =>  { A; while (B) { D; C; } } */
+	/* Translate for (A;B;C) {D}  =>  { A; while (B) {D} } with C as the post expression of the loop */
 	*list = NULL;
 
 	if (!cond_stmt)
@@ -2273,23 +2282,8 @@ int clog_ast_statement_list_alloc_for(struct clog_parser* parser, struct clog_as
 		lit_true->line = parser->line;
 	}
 
-	if (iter_expr)
-	{
-		/* Append iter_expr to loop_stmt */
-		struct clog_ast_statement_list* iter_stmt = NULL;
-		if (!clog_ast_statement_list_alloc_expression(parser,&iter_stmt,iter_expr))
-		{
-			clog_ast_statement_list_free(parser,init_stmt);
-			clog_ast_statement_list_free(parser,cond_stmt);
-			clog_ast_statement_list_free(parser,loop_stmt);
-			return 0;
-		}
-
-		loop_stmt = clog_ast_statement_list_append(parser,loop_stmt,iter_stmt);
-	}
-
 	/* Create the while loop */
-	if (!clog_ast_statement_list_alloc_while(parser,list,cond_stmt,loop_stmt))
+	if (!clog_ast_statement_list_alloc_loop(parser,list,cond_stmt,iter_expr,loop_stmt))
 	{
 		clog_ast_statement_list_free(parser,init_stmt);
 		return 0;
@@ -2404,7 +2398,7 @@ static void __dump_expr(const struct clog_ast_expression* expr)
 		break;
 
 	case clog_ast_expression_variable:
-		printf("%.*s",(int)expr->expr.variable->id.len,expr->expr.variable->id.str);
+		printf("%.*s",(int)expr->expr.variable->var->id.len,expr->expr.variable->var->id.str);
 		break;
 
 	case clog_ast_expression_builtin:
@@ -2435,7 +2429,11 @@ static void __dump_expr(const struct clog_ast_expression* expr)
 		default:
 			if (expr->expr.builtin->args[1])
 				printf(" ");
-			clog_token_printf(expr->expr.builtin->type,NULL);
+			{
+				char buf[80];
+				clog_token_sprintf(buf,expr->expr.builtin->type,NULL);
+				printf("%s",buf);
+			}
 			if (expr->expr.builtin->args[1])
 			{
 				printf(" ");
@@ -2464,9 +2462,6 @@ static void __dump_block(size_t indent, const struct clog_ast_block* block)
 	printf("  Locals = [");
 	for (v=block->locals;v;v=v->next)
 		printf("%s%s ",v->id.str,v->constant ? "!" : "");
-	printf("], Externs = [");
-	for (v=block->externs;v;v=v->next)
-		printf("%s%s ",v->id.str,v->assigned ? "*" : "");
 	printf("]");
 	__dump(indent+1,block->stmts);
 	__dump_indent(indent);
@@ -2559,6 +2554,11 @@ static void __dump(size_t indent, const struct clog_ast_statement_list* list)
 			if (list->stmt->stmt.while_stmt->pre)
 				__dump(-1,list->stmt->stmt.while_stmt->pre);
 			__dump_expr(list->stmt->stmt.while_stmt->condition);
+			if (list->stmt->stmt.while_stmt->post)
+			{
+				printf("; ");
+				__dump_expr(list->stmt->stmt.while_stmt->post);
+			}
 			printf(")");
 			if (list->stmt->stmt.while_stmt->loop_block)
 			{
@@ -2582,46 +2582,189 @@ static void __dump(size_t indent, const struct clog_ast_statement_list* list)
 
 
 
-int clog_cfg_construct(const struct clog_ast_block* ast_block);
-
 /* External functions defined by ragel and lemon */
 int clog_tokenize(int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param, struct clog_parser* parser, void* lemon);
-void* clog_parserAlloc(void* (*)(size_t));
-void clog_parserFree(void *p, void (*)(void*));
+int clog_tokenize_buffer(const unsigned char* buffer, size_t len, struct clog_parser* parser, void* lemon);
+void* clog_parser_alloc(struct clog_parser* parser);
+void clog_parser_free(struct clog_parser* parser, void* lemon);
 void clog_parser(void* lemon, int type, struct clog_token* tok, struct clog_parser* parser);
 
-int clog_parse(int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param)
+/* Produces an image, C source named c_name, or neither */
+static int clog_parse_complete(struct clog_parser* parser, void* lemon, int retval, void** image, size_t* image_len, const char* c_name, char** src, size_t* src_len)
 {
-	int retval = 0;
-	struct clog_parser parser = {0};
+	struct clog_image_builder builder;
+
+	clog_parser(lemon,0,NULL,parser);
+
+	clog_parser_free(parser,lemon);
+
+	/* Every token is dead once the parser is done */
+	clog_arena_free(&parser->tokens);
+	parser->free_tokens = NULL;
+
+/*	__dump(0,parser->pgm);*/
+
+	clog_image_builder_init(&builder,&parser->allocator);
+
+	if (retval && !parser->failed)
+	{
+/*		printf("\n\nSuccess!\n"); */
+
+		if (!parser->pgm)
+		{
+			if (c_name)
+				clog_codegen_c(parser,NULL,c_name,src,src_len);
+		}
+		else if (clog_ast_bind_program(parser,parser->pgm->stmt->stmt.block))
+		{
+			struct clog_cfg cfg;
+			if (clog_cfg_construct(parser,parser->pgm->stmt->stmt.block,&cfg))
+			{
+				if (c_name)
+					clog_codegen_c(parser,&cfg,c_name,src,src_len);
+				else
+					clog_codegen(&cfg,&builder);
+			}
+			clog_cfg_free(&cfg);
+		}
+	}
+
+	/* The whole program goes in one release */
+	clog_arena_free(&parser->ast);
+	parser->pgm = NULL;
 
-	parser.line = 1;
-	parser.reduce = 0;
+	clog_symtab_free(&parser->symbols);
 
-	void* lemon = clog_parserAlloc(&clog_malloc);
+	/* An empty program is an empty image */
+	if (retval && !parser->failed && image && !clog_image_finish(&builder,image,image_len))
+	{
+		clog_diagnostic(parser,0,"Out of memory writing code image");
+		clog_image_builder_free(&builder);
+		return -1;
+	}
+
+	clog_image_builder_free(&builder);
+
+	return (retval && !parser->failed);
+}
+
+static void clog_parser_init(struct clog_parser* parser, const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics)
+{
+	memset(parser,0,sizeof(struct clog_parser));
+
+	parser->allocator = *(allocator ? allocator : clog_default_allocator());
+	if (diagnostics)
+		parser->diagnostics = *diagnostics;
+	parser->tokens.allocator = &parser->allocator;
+	parser->symbols.text.allocator = &parser->allocator;
+	parser->ast.allocator = &parser->allocator;
+
+	parser->line = 1;
+	parser->reduce = 0;
+}
+
+int clog_parse(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param)
+{
+	struct clog_parser parser;
+	void* lemon;
+
+	clog_parser_init(&parser,allocator,diagnostics);
+
+	lemon = clog_parser_alloc(&parser);
 	if (!lemon)
 		return -1;
 
 	/*clog_parserTrace(stdout,"lemon: ");*/
 
-	retval = clog_tokenize(rd_fn,rd_param,&parser,lemon);
+	return clog_parse_complete(&parser,lemon,clog_tokenize(rd_fn,rd_param,&parser,lemon),NULL,NULL,NULL,NULL,NULL);
+}
+
+int clog_parse_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len)
+{
+	struct clog_parser parser;
+	void* lemon;
+
+	clog_parser_init(&parser,allocator,diagnostics);
 
-	clog_parser(lemon,0,NULL,&parser);
+	lemon = clog_parser_alloc(&parser);
+	if (!lemon)
+		return -1;
 
-	clog_parserFree(lemon,&clog_free);
+	return clog_parse_complete(&parser,lemon,clog_tokenize_buffer(buffer,len,&parser,lemon),NULL,NULL,NULL,NULL,NULL);
+}
 
-/*	__dump(0,parser.pgm);*/
+int clog_compile(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param, void** image, size_t* len)
+{
+	struct clog_parser parser;
+	void* lemon;
 
-	if (retval && !parser.failed)
-	{
-/*		printf("\n\nSuccess!\n"); */
+	*image = NULL;
+	*len = 0;
 
-		{ void* TODO; /* Check for undeclared externs */ }
+	clog_parser_init(&parser,allocator,diagnostics);
 
-		clog_cfg_construct(parser.pgm->stmt->stmt.block);
-	}
+	lemon = clog_parser_alloc(&parser);
+	if (!lemon)
+		return -1;
+
+	return clog_parse_complete(&parser,lemon,clog_tokenize(rd_fn,rd_param,&parser,lemon),image,len,NULL,NULL,NULL);
+}
+
+int clog_compile_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len, void** image, size_t* image_len)
+{
+	struct clog_parser parser;
+	void* lemon;
 
-	clog_ast_statement_list_free(&parser,parser.pgm);
+	*image = NULL;
+	*image_len = 0;
 
-	return retval;
+	clog_parser_init(&parser,allocator,diagnostics);
+
+	lemon = clog_parser_alloc(&parser);
+	if (!lemon)
+		return -1;
+
+	return clog_parse_complete(&parser,lemon,clog_tokenize_buffer(buffer,len,&parser,lemon),image,image_len,NULL,NULL,NULL);
+}
+
+int clog_compile_c(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*rd_fn)(void* p, unsigned char* buf, size_t* len), void* rd_param, const char* name, char** src, size_t* len)
+{
+	struct clog_parser parser;
+	void* lemon;
+
+	*src = NULL;
+	*len = 0;
+
+	clog_parser_init(&parser,allocator,diagnostics);
+
+	lemon = clog_parser_alloc(&parser);
+	if (!lemon)
+		return -1;
+
+	return clog_parse_complete(&parser,lemon,clog_tokenize(rd_fn,rd_param,&parser,lemon),NULL,NULL,name,src,len);
+}
+
+int clog_compile_c_buffer(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const unsigned char* buffer, size_t len, const char* name, char** src, size_t* src_len)
+{
+	struct clog_parser parser;
+	void* lemon;
+
+	*src = NULL;
+	*src_len = 0;
+
+	clog_parser_init(&parser,allocator,diagnostics);
+
+	lemon = clog_parser_alloc(&parser);
+	if (!lemon)
+		return -1;
+
+	return clog_parse_complete(&parser,lemon,clog_tokenize_buffer(buffer,len,&parser,lemon),NULL,NULL,name,src,src_len);
+}
+
+#define CLOG_VERSION_STR2(v) #v
+#define CLOG_VERSION_STR(v) CLOG_VERSION_STR2(v)
+
+const char* clog_version(void)
+{
+	return "clog 0.0.1 compiler " CLOG_VERSION_STR(CLOG_COMPILER_VERSION) " image " CLOG_VERSION_STR(CLOG_IMAGE_VERSION);
 }
@@ -8,17 +8,23 @@
 #ifndef CLOG_AST_H_
 #define CLOG_AST_H_
 
-#include <stddef.h>
+#include "clog.h"
 
-void* clog_malloc(size_t s);
-void* clog_realloc(void* p, size_t s);
-void clog_free(void* p);
+void* clog_malloc(const struct clog_allocator* allocator, size_t s);
+void* clog_realloc(const struct clog_allocator* allocator, void* p, size_t s);
+void clog_free(const struct clog_allocator* allocator, void* p);
 
-struct clog_parser;
-struct clog_ast_statement_list;
+const struct clog_allocator* clog_default_allocator(void);
 
-int clog_ast_out_of_memory(struct clog_parser* parser);
-int clog_syntax_error(struct clog_parser* parser, const char* msg, unsigned long line);
+/* Bump-pointer region, everything is released at once by clog_arena_free */
+struct clog_arena
+{
+	const struct clog_allocator* allocator;
+	struct clog_arena_chunk*     chunks;
+};
+
+void* clog_arena_alloc(struct clog_arena* arena, size_t s);
+void clog_arena_free(struct clog_arena* arena);
 
 /* Simple string */
 struct clog_string
@@ -27,7 +33,32 @@ struct clog_string
 	unsigned char* str;
 };
 
-/* Token handling */
+/* Identifier interning
+ * Each distinct identifier gets a small non-zero id, so names compare by id */
+struct clog_symtab
+{
+	struct clog_symbol* symbols;
+	unsigned int        count;
+	unsigned int        alloc;
+	unsigned int*       buckets;
+	unsigned int        bucket_count;
+	struct clog_arena   text;
+};
+
+unsigned int clog_symbol_intern(struct clog_symtab* symtab, const unsigned char* sz, size_t len);
+const struct clog_string* clog_symbol_name(const struct clog_symtab* symtab, unsigned int symbol);
+void clog_symtab_free(struct clog_symtab* symtab);
+
+struct clog_parser;
+struct clog_ast_statement_list;
+
+void clog_diagnostic(struct clog_parser* parser, unsigned long line, const char* msg);
+int clog_ast_out_of_memory(struct clog_parser* parser);
+int clog_syntax_error(struct clog_parser* parser, const char* msg, unsigned long line);
+
+/* Token handling
+ * Tokens live in the parser's token arena, and string tokens point at text that lives
+ * as long as the AST: either the input buffer itself or a copy in the AST arena */
 struct clog_token
 {
 	enum etype
@@ -37,16 +68,23 @@ struct clog_token
 		clog_token_real,
 	} type;
 
+	/* Non-zero for identifiers, the text is then the interned copy */
+	unsigned int symbol;
+
 	union clog_token_u
 	{
 		struct clog_string string;
 		long               integer;
 		double             real;
+		struct clog_token* next_free;
 	} value;
 };
 
 void clog_token_free(struct clog_parser* parser, struct clog_token* token);
 int clog_token_alloc(struct clog_parser* parser, struct clog_token** token, const unsigned char* sz, size_t len);
+int clog_token_alloc_id(struct clog_parser* parser, struct clog_token** token, const unsigned char* sz, size_t len);
+int clog_token_alloc_integer(struct clog_parser* parser, struct clog_token** token, long value);
+int clog_token_alloc_real(struct clog_parser* parser, struct clog_token** token, double value);
 int clog_syntax_error_token(struct clog_parser* parser, const char* pre, const char* post, unsigned int token_id, struct clog_token* token, unsigned long line);
 
 /* Literal handling */
@@ -63,6 +101,9 @@ struct clog_ast_literal
 
 	unsigned long line;
 
+	/* Non-zero for identifiers, the string is then owned by the symbol table */
+	unsigned int symbol;
+
 	union clog_ast_literal_u
 	{
 		struct clog_string string;
@@ -83,13 +124,16 @@ int clog_ast_literal_id_compare(const struct clog_ast_literal* lit1, const struc
 
 struct clog_ast_expression_list;
 
+/* A declared name, numbered by index in declaration order across the program */
 struct clog_ast_variable
 {
 	struct clog_string id;
+	unsigned int symbol;
+	unsigned int index;
+	unsigned long line;
 	int assigned;
 	int constant;
 
-	struct clog_ast_variable* up;
 	struct clog_ast_variable* next;
 };
 
@@ -108,7 +152,11 @@ struct clog_ast_expression
 	{
 		struct clog_ast_literal* literal;
 		struct clog_ast_literal* identifier;
-		struct clog_ast_variable* variable;
+		struct clog_ast_expression_variable
+		{
+			unsigned long line;
+			struct clog_ast_variable* var;
+		}* variable;
 
 		struct clog_ast_expression_builtin
 		{
@@ -147,6 +195,14 @@ void clog_ast_expression_list_free(struct clog_parser* parser, struct clog_ast_e
 int clog_ast_expression_list_alloc(struct clog_parser* parser, struct clog_ast_expression_list** list, struct clog_ast_expression* expr);
 int clog_ast_expression_list_append(struct clog_parser* parser, struct clog_ast_expression_list** list, struct clog_ast_expression* expr);
 
+/* Open-addressed index of a block's variables by symbol */
+struct clog_ast_scope
+{
+	struct clog_ast_variable** slots;
+	unsigned int count;
+	unsigned int size;
+};
+
 struct clog_ast_statement
 {
 	enum clog_ast_statement_type
@@ -171,7 +227,8 @@ struct clog_ast_statement
 		struct clog_ast_block
 		{
 			struct clog_ast_variable* locals;
-			struct clog_ast_variable* externs;
+			struct clog_ast_scope locals_index;
+			struct clog_ast_block* outer;
 			struct clog_ast_statement_list* stmts;
 		}* block;
 
@@ -193,6 +250,9 @@ struct clog_ast_statement
 			struct clog_ast_statement_list* pre;
 			struct clog_ast_expression* condition;
 			struct clog_ast_block* loop_block;
+
+			/* The iterator of a for loop, run after the body and by continue */
+			struct clog_ast_expression* post;
 		}* while_stmt;
 	} stmt;
 };
@@ -203,10 +263,18 @@ struct clog_ast_statement_list
 	struct clog_ast_statement_list* next;
 };
 
+/* A list as the parser builds it, a statement at a time, so appending doesn't walk what is already there */
+struct clog_ast_statement_list_builder
+{
+	struct clog_ast_statement_list* head;
+	struct clog_ast_statement_list* last;
+};
+
 void clog_ast_statement_list_free(struct clog_parser* parser, struct clog_ast_statement_list* list);
 int clog_ast_statement_list_alloc_expression(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_expression* expr);
 int clog_ast_statement_list_alloc_block(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* block);
 struct clog_ast_statement_list* clog_ast_statement_list_append(struct clog_parser* parser, struct clog_ast_statement_list* list, struct clog_ast_statement_list* next);
+void clog_ast_statement_list_build(struct clog_ast_statement_list_builder* builder, struct clog_ast_statement_list* next);
 int clog_ast_statement_list_alloc_declaration(struct clog_parser* parser, struct clog_ast_statement_list** stmt, struct clog_token* id, struct clog_ast_expression* init);
 int clog_ast_statement_list_alloc_if(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_statement_list* cond, struct clog_ast_statement_list* true_expr, struct clog_ast_statement_list* false_expr);
 int clog_ast_statement_list_alloc_do(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_expression* cond, struct clog_ast_statement_list* loop);
@@ -215,15 +283,33 @@ int clog_ast_statement_list_alloc_for(struct clog_parser* parser, struct clog_as
 int clog_ast_statement_list_alloc_return(struct clog_parser* parser, struct clog_ast_statement_list** list, struct clog_ast_expression* expr);
 int clog_ast_statement_list_alloc(struct clog_parser* parser, struct clog_ast_statement_list** list, enum clog_ast_statement_type type);
 
-/* Optimization */
-int clog_ast_statement_list_reduce_constants(struct clog_parser* parser, struct clog_ast_statement_list** block);
+/* Resolves every identifier under block to its variable, and drops the declarations.
+ * Afterwards the AST has no identifiers, and initialisers are plain assignments */
+int clog_ast_bind_program(struct clog_parser* parser, struct clog_ast_block* block);
 
 struct clog_parser
 {
+	struct clog_allocator   allocator;
+	struct clog_diagnostics diagnostics;
+
 	int           reduce;
 	int           failed;
 	unsigned long line;
 
+	struct clog_arena  tokens;
+	struct clog_token* free_tokens;
+
+	struct clog_symtab symbols;
+
+	/* Every AST node, the clog_ast_*_free functions are no-ops */
+	struct clog_arena ast;
+
+	/* Set by clog_ast_bind_program */
+	unsigned int var_count;
+
+	/* CFG block numbering */
+	unsigned int cfg_gen;
+
 	struct clog_ast_statement_list* pgm;
 };
 
@@ -5,52 +5,99 @@
  *      Author: taylorr
  */
 
-#include "clog_ast.h"
+#include "clog_cfg.h"
 #include "clog_parser.h"
 
 #include <string.h>
 #include <stdio.h>
 
-struct clog_cfg_block
+struct clog_cfg_builder
 {
-	unsigned int gen;
-
-	struct clog_cfg_block* a_next;
-	unsigned int refcount;
-
-	struct clog_cfg_block* branch;
-	struct clog_cfg_block* fallthru;
+	struct clog_cfg* cfg;
 
+	/* The graph's variable for each bound variable, by its index */
+	unsigned int* vars;
 };
 
 struct clog_cfg_context
 {
+	struct clog_cfg_builder* builder;
+
 	struct clog_cfg_block* break_branch;
 	struct clog_cfg_block* continue_branch;
 };
 
-static void __dump();
+#if defined(CLOG_DUMP_CFG)
+static void __dump(const struct clog_cfg* cfg);
+#endif
+
+void clog_cfg_out_of_memory(struct clog_parser* parser)
+{
+	clog_diagnostic(parser,0,"Out of memory during code generation");
+	parser->failed = 1;
+}
+
+static void clog_cfg_error(struct clog_parser* parser, const char* part1, const unsigned char* part2, unsigned long line)
+{
+	char buf[256];
+	sprintf(buf,"Error: %.64s%.64s at line %lu",part1,part2 ? (const char*)part2 : "",line);
+	clog_diagnostic(parser,line,buf);
+	parser->failed = 1;
+}
+
+static void clog_cfg_warning(struct clog_parser* parser, const char* part1, const unsigned char* part2, unsigned long line)
+{
+	char buf[256];
+	sprintf(buf,"Warning: %.64s%.64s at line %lu",part1,part2 ? (const char*)part2 : "",line);
+	clog_diagnostic(parser,line,buf);
+}
 
-static void clog_cfg_out_of_memory()
+unsigned int clog_cfg_alloc_value(struct clog_cfg* cfg, unsigned int var, const struct clog_ast_variable* id)
 {
-	printf("Out of memory during code generation\n");
+	if (cfg->value_count == cfg->value_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (cfg->value_alloc == 0 ? 64 : cfg->value_alloc * 2);
+		struct clog_cfg_value* new = clog_realloc(&cfg->parser->allocator,cfg->values,new_size * sizeof(struct clog_cfg_value));
+		if (!new)
+		{
+			clog_cfg_out_of_memory(cfg->parser);
+			return CLOG_CFG_NONE;
+		}
+
+		cfg->value_alloc = new_size;
+		cfg->values = new;
+	}
+
+	cfg->values[cfg->value_count].var = var;
+	cfg->values[cfg->value_count].id = id;
+
+	return cfg->value_count++;
 }
 
+unsigned int clog_cfg_alloc_var(struct clog_cfg* cfg, const struct clog_ast_variable* id)
+{
+	unsigned int value = clog_cfg_alloc_value(cfg,cfg->var_count,id);
+	if (value != CLOG_CFG_NONE)
+		++cfg->var_count;
 
-static unsigned int s_gen = 0;
+	return value;
+}
 
-static int clog_cfg_alloc_block(struct clog_cfg_block* from, struct clog_cfg_block** block)
+static int clog_cfg_alloc_block(struct clog_parser* parser, struct clog_cfg_block* from, struct clog_cfg_block** block)
 {
-	*block = clog_malloc(sizeof(struct clog_cfg_block));
+	*block = clog_malloc(&parser->allocator,sizeof(struct clog_cfg_block));
 	if (!(*block))
 	{
-		clog_cfg_out_of_memory();
+		clog_cfg_out_of_memory(parser);
 		return 0;
 	}
 
 	memset(*block,0,sizeof(struct clog_cfg_block));
-	(*block)->refcount = 1;
-	(*block)->gen = ++s_gen;
+	(*block)->gen = ++parser->cfg_gen;
+	(*block)->cond = CLOG_CFG_NONE;
+	(*block)->ret = CLOG_CFG_NONE;
+	(*block)->rpo = CLOG_CFG_NONE;
 
 	if (from)
 	{
@@ -62,290 +109,1080 @@ static int clog_cfg_alloc_block(struct clog_cfg_block* from, struct clog_cfg_blo
 	return 1;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_expression(struct clog_cfg_block* block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+struct clog_cfg_triplet* clog_cfg_append_triplet(struct clog_cfg* cfg, struct clog_cfg_block* block, enum clog_opcode op, unsigned int dest, unsigned long line)
 {
-	return block;
+	struct clog_cfg_triplet* triplet;
+
+	if (dest == CLOG_CFG_NONE)
+		return NULL;
+
+	if (block->triplet_count == block->triplet_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (block->triplet_alloc == 0 ? 8 : block->triplet_alloc * 2);
+		struct clog_cfg_triplet* new = clog_realloc(&cfg->parser->allocator,block->triplets,new_size * sizeof(struct clog_cfg_triplet));
+		if (!new)
+		{
+			clog_cfg_out_of_memory(cfg->parser);
+			return NULL;
+		}
+
+		block->triplet_alloc = new_size;
+		block->triplets = new;
+	}
+
+	triplet = &block->triplets[block->triplet_count++];
+	triplet->op = op;
+	triplet->dest = dest;
+	triplet->val.args[0] = CLOG_CFG_NONE;
+	triplet->val.args[1] = CLOG_CFG_NONE;
+	triplet->line = line;
+
+	return triplet;
 }
 
-static struct clog_cfg_block* clog_cfg_append_fallthru(struct clog_cfg_block* block)
+static unsigned int clog_cfg_emit_L(struct clog_cfg* cfg, struct clog_cfg_block* block, const struct clog_ast_literal* lit)
 {
-	if (!block->fallthru && !clog_cfg_alloc_block(block,&block->fallthru))
-		return NULL;
+	struct clog_cfg_triplet* triplet = clog_cfg_append_triplet(cfg,block,clog_opcode_LOAD,clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,NULL),lit->line);
+	if (!triplet)
+		return CLOG_CFG_NONE;
 
-	return block->fallthru;
+	triplet->val.lit = lit;
+	return triplet->dest;
 }
 
-static struct clog_cfg_block* clog_cfg_insert_fallthru(struct clog_cfg_block* block)
+/* A dest of CLOG_CFG_NONE writes a new temporary */
+static unsigned int clog_cfg_emit_R(struct clog_cfg* cfg, struct clog_cfg_block* block, enum clog_opcode op, unsigned int dest, unsigned int arg, unsigned long line)
 {
-	struct clog_cfg_block* fallthru = block->fallthru;
-	if (!clog_cfg_alloc_block(block,&block->fallthru))
-		return NULL;
+	struct clog_cfg_triplet* triplet;
+
+	if (dest == CLOG_CFG_NONE)
+		dest = clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,NULL);
 
-	block->fallthru->fallthru = fallthru;
-	return block->fallthru;
+	triplet = clog_cfg_append_triplet(cfg,block,op,dest,line);
+	if (!triplet)
+		return CLOG_CFG_NONE;
+
+	triplet->val.args[0] = arg;
+	return triplet->dest;
 }
 
-static void clog_cfg_add_block_reference(struct clog_cfg_block* from, struct clog_cfg_block* to)
+static unsigned int clog_cfg_emit_RR(struct clog_cfg* cfg, struct clog_cfg_block* block, enum clog_opcode op, unsigned int arg0, unsigned int arg1, unsigned long line)
 {
-	/* Add a back pointer to the from block from the to block */
-	void* TODO = from;
+	struct clog_cfg_triplet* triplet = clog_cfg_append_triplet(cfg,block,op,clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,NULL),line);
+	if (!triplet)
+		return CLOG_CFG_NONE;
 
-	++to->fallthru->refcount;
+	triplet->val.args[0] = arg0;
+	triplet->val.args[1] = arg1;
+	return triplet->dest;
 }
 
-static struct clog_cfg_block* clog_cfg_insert_branch(struct clog_cfg_block* block)
+struct clog_ast_literal* clog_cfg_literal(struct clog_cfg* cfg, enum clog_ast_literal_type type, long value, unsigned long line)
 {
-	struct clog_cfg_block* branch = block->branch;
-	if (!clog_cfg_alloc_block(block,&block->branch))
+	struct clog_ast_literal* lit = clog_arena_alloc(&cfg->arena,sizeof(struct clog_ast_literal));
+	if (!lit)
+	{
+		clog_cfg_out_of_memory(cfg->parser);
 		return NULL;
+	}
 
-	block->branch->fallthru = block->fallthru;
-	clog_cfg_add_block_reference(block->branch,block->fallthru);
+	memset(lit,0,sizeof(struct clog_ast_literal));
+	lit->type = type;
+	lit->line = line;
+	lit->value.integer = value;
 
-	block->branch->branch = branch;
-	return block->branch;
+	return lit;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_condition(struct clog_cfg_block* block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+int clog_cfg_literal_truth(const struct clog_ast_literal* lit)
 {
-	switch (ast_expr->type)
+	switch (lit->type)
 	{
-	case clog_ast_expression_identifier:
-		/* Dropped */
+	case clog_ast_literal_real:
+		return (lit->value.real != 0.0);
+
+	case clog_ast_literal_string:
+		return (lit->value.string.len != 0);
+
+	case clog_ast_literal_null:
+		return 0;
+
+	default:
+		return (lit->value.integer != 0);
+	}
+}
+
+/* The binder has checked every use, so the first one seen is the initializer */
+static unsigned int clog_cfg_variable(struct clog_cfg_builder* builder, const struct clog_ast_variable* var)
+{
+	if (builder->vars[var->index] == CLOG_CFG_NONE)
+		builder->vars[var->index] = clog_cfg_alloc_var(builder->cfg,var);
+
+	return builder->vars[var->index];
+}
+
+static struct clog_cfg_block* clog_cfg_construct_condition(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx);
+static unsigned int clog_cfg_construct_value(struct clog_parser* parser, struct clog_cfg_block** block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx);
+
+static unsigned int clog_cfg_construct_assign(struct clog_parser* parser, struct clog_cfg_block** block, const struct clog_ast_expression_builtin* expr, struct clog_cfg_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->builder->cfg;
+	const struct clog_ast_expression* target = (expr->args[0] ? expr->args[0] : expr->args[1]);
+	enum clog_opcode op;
+	unsigned int var;
+	unsigned int prev;
+	unsigned int value;
+	unsigned int result;
+
+	if (target->type != clog_ast_expression_variable)
+	{
+		clog_cfg_error(parser,"Assignment to something other than a variable",NULL,expr->line);
+		return CLOG_CFG_NONE;
+	}
+
+	var = clog_cfg_variable(ctx->builder,target->expr.variable->var);
+	if (var == CLOG_CFG_NONE)
+		return var;
+
+	switch (expr->type)
+	{
+	case CLOG_TOKEN_ASSIGN:
+		result = clog_cfg_construct_value(parser,block,expr->args[1],ctx);
+		if (result == CLOG_CFG_NONE)
+			return result;
+
+		if (clog_cfg_emit_R(cfg,*block,clog_opcode_MOV,var,result,expr->line) == CLOG_CFG_NONE)
+			return CLOG_CFG_NONE;
+
+		return result;
+
+	case CLOG_TOKEN_DOUBLE_PLUS:
+	case CLOG_TOKEN_DOUBLE_MINUS:
+		{
+			const struct clog_ast_literal* one = clog_cfg_literal(cfg,clog_ast_literal_integer,1,expr->line);
+			if (!one)
+				return CLOG_CFG_NONE;
+
+			prev = clog_cfg_emit_R(cfg,*block,clog_opcode_MOV,CLOG_CFG_NONE,var,expr->line);
+			if (prev == CLOG_CFG_NONE)
+				return prev;
+
+			value = clog_cfg_emit_L(cfg,*block,one);
+			if (value == CLOG_CFG_NONE)
+				return value;
+
+			result = clog_cfg_emit_RR(cfg,*block,expr->type == CLOG_TOKEN_DOUBLE_PLUS ? clog_opcode_ADD : clog_opcode_SUB,prev,value,expr->line);
+			if (result == CLOG_CFG_NONE)
+				return result;
+
+			if (clog_cfg_emit_R(cfg,*block,clog_opcode_MOV,var,result,expr->line) == CLOG_CFG_NONE)
+				return CLOG_CFG_NONE;
+
+			/* x++ is the value before, ++x after */
+			return (expr->args[0] ? prev : result);
+		}
+
+	case CLOG_TOKEN_STAR_ASSIGN:
+		op = clog_opcode_MUL;
+		break;
+
+	case CLOG_TOKEN_SLASH_ASSIGN:
+		op = clog_opcode_DIV;
+		break;
+
+	case CLOG_TOKEN_PERCENT_ASSIGN:
+		op = clog_opcode_MOD;
+		break;
+
+	case CLOG_TOKEN_PLUS_ASSIGN:
+		op = clog_opcode_ADD;
+		break;
+
+	case CLOG_TOKEN_MINUS_ASSIGN:
+		op = clog_opcode_SUB;
+		break;
+
+	case CLOG_TOKEN_RIGHT_SHIFT_ASSIGN:
+		op = clog_opcode_RSH;
+		break;
+
+	case CLOG_TOKEN_LEFT_SHIFT_ASSIGN:
+		op = clog_opcode_LSH;
+		break;
+
+	case CLOG_TOKEN_AMPERSAND_ASSIGN:
+		op = clog_opcode_BAND;
+		break;
+
+	case CLOG_TOKEN_CARET_ASSIGN:
+		op = clog_opcode_BXOR;
+		break;
+
+	case CLOG_TOKEN_BAR_ASSIGN:
+		op = clog_opcode_BOR;
 		break;
 
+	default:
+		return CLOG_CFG_NONE;
+	}
+
+	/* x op= y reads x before evaluating y */
+	prev = clog_cfg_emit_R(cfg,*block,clog_opcode_MOV,CLOG_CFG_NONE,var,expr->line);
+	if (prev == CLOG_CFG_NONE)
+		return prev;
+
+	value = clog_cfg_construct_value(parser,block,expr->args[1],ctx);
+	if (value == CLOG_CFG_NONE)
+		return value;
+
+	result = clog_cfg_emit_RR(cfg,*block,op,prev,value,expr->line);
+	if (result == CLOG_CFG_NONE)
+		return result;
+
+	if (clog_cfg_emit_R(cfg,*block,clog_opcode_MOV,var,result,expr->line) == CLOG_CFG_NONE)
+		return CLOG_CFG_NONE;
+
+	return result;
+}
+
+/* a ? b : c, and a && b or a || b used as values rather than tested */
+static unsigned int clog_cfg_construct_select(struct clog_parser* parser, struct clog_cfg_block** block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->builder->cfg;
+	const struct clog_ast_expression_builtin* expr = ast_expr->expr.builtin;
+	struct clog_cfg_block* arms[2];
+	struct clog_cfg_block* join;
+	unsigned int result;
+	int i;
+
+	/* The result is an unnamed variable written on both arms, SSA construction merges them */
+	result = clog_cfg_alloc_var(cfg,NULL);
+	if (result == CLOG_CFG_NONE)
+		return result;
+
+	if (!clog_cfg_alloc_block(parser,*block,&arms[0]) ||
+			!clog_cfg_alloc_block(parser,arms[0],&arms[1]) ||
+			!clog_cfg_alloc_block(parser,arms[1],&join))
+	{
+		return CLOG_CFG_NONE;
+	}
+
+	(*block)->branch = arms[0];
+	(*block)->fallthru = arms[1];
+	if (!clog_cfg_construct_condition(parser,*block,expr->type == CLOG_TOKEN_QUESTION ? expr->args[0] : ast_expr,ctx))
+		return CLOG_CFG_NONE;
+
+	for (i = 0; i < 2; ++i)
+	{
+		unsigned int value;
+		if (expr->type == CLOG_TOKEN_QUESTION)
+			value = clog_cfg_construct_value(parser,&arms[i],expr->args[i+1],ctx);
+		else
+		{
+			const struct clog_ast_literal* lit = clog_cfg_literal(cfg,clog_ast_literal_bool,i == 0,expr->line);
+			value = (lit ? clog_cfg_emit_L(cfg,arms[i],lit) : CLOG_CFG_NONE);
+		}
+
+		if (value == CLOG_CFG_NONE || clog_cfg_emit_R(cfg,arms[i],clog_opcode_MOV,result,value,expr->line) == CLOG_CFG_NONE)
+			return CLOG_CFG_NONE;
+
+		arms[i]->fallthru = join;
+	}
+
+	*block = join;
+	return clog_cfg_emit_R(cfg,join,clog_opcode_MOV,CLOG_CFG_NONE,result,expr->line);
+}
+
+static unsigned int clog_cfg_construct_builtin(struct clog_parser* parser, struct clog_cfg_block** block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+{
+	const struct clog_ast_expression_builtin* expr = ast_expr->expr.builtin;
+	enum clog_opcode op;
+	unsigned int value0;
+	unsigned int value1;
+	int swap = 0;
+
+	switch (expr->type)
+	{
+	case CLOG_TOKEN_COMMA:
+		if (clog_cfg_construct_value(parser,block,expr->args[0],ctx) == CLOG_CFG_NONE)
+			return CLOG_CFG_NONE;
+		return clog_cfg_construct_value(parser,block,expr->args[1],ctx);
+
+	case CLOG_TOKEN_AND:
+	case CLOG_TOKEN_OR:
+	case CLOG_TOKEN_QUESTION:
+		return clog_cfg_construct_select(parser,block,ast_expr,ctx);
+
+	case CLOG_TOKEN_ASSIGN:
+	case CLOG_TOKEN_DOUBLE_PLUS:
+	case CLOG_TOKEN_DOUBLE_MINUS:
+	case CLOG_TOKEN_STAR_ASSIGN:
+	case CLOG_TOKEN_SLASH_ASSIGN:
+	case CLOG_TOKEN_PERCENT_ASSIGN:
+	case CLOG_TOKEN_PLUS_ASSIGN:
+	case CLOG_TOKEN_MINUS_ASSIGN:
+	case CLOG_TOKEN_RIGHT_SHIFT_ASSIGN:
+	case CLOG_TOKEN_LEFT_SHIFT_ASSIGN:
+	case CLOG_TOKEN_AMPERSAND_ASSIGN:
+	case CLOG_TOKEN_CARET_ASSIGN:
+	case CLOG_TOKEN_BAR_ASSIGN:
+		return clog_cfg_construct_assign(parser,block,expr,ctx);
+
+	case CLOG_TOKEN_INTEGER:
+	case CLOG_TOKEN_FLOAT:
+	case CLOG_TOKEN_STRING:
+		/* Only ever wrap an operand of the operator that needs it, and clog_vm_binary
+		 * converts operands by the same rules, so there is nothing to emit */
+		return clog_cfg_construct_value(parser,block,expr->args[0],ctx);
+
+	case CLOG_TOKEN_TRUE:
+		op = clog_opcode_BOOL;
+		break;
+
+	case CLOG_TOKEN_EXCLAMATION:
+		op = clog_opcode_NOT;
+		break;
+
+	case CLOG_TOKEN_TILDA:
+		op = clog_opcode_BNOT;
+		break;
+
+	case CLOG_TOKEN_PLUS:
+		/* Unary + is another conversion */
+		if (!expr->args[1])
+			return clog_cfg_construct_value(parser,block,expr->args[0],ctx);
+		op = clog_opcode_ADD;
+		break;
+
+	case CLOG_TOKEN_MINUS:
+		op = (expr->args[1] ? clog_opcode_SUB : clog_opcode_NEG);
+		break;
+
+	case CLOG_TOKEN_STAR:
+		op = clog_opcode_MUL;
+		break;
+
+	case CLOG_TOKEN_SLASH:
+		op = clog_opcode_DIV;
+		break;
+
+	case CLOG_TOKEN_PERCENT:
+		op = clog_opcode_MOD;
+		break;
+
+	case CLOG_TOKEN_LEFT_SHIFT:
+		op = clog_opcode_LSH;
+		break;
+
+	case CLOG_TOKEN_RIGHT_SHIFT:
+		op = clog_opcode_RSH;
+		break;
+
+	case CLOG_TOKEN_AMPERSAND:
+		op = clog_opcode_BAND;
+		break;
+
+	case CLOG_TOKEN_BAR:
+		op = clog_opcode_BOR;
+		break;
+
+	case CLOG_TOKEN_CARET:
+		op = clog_opcode_BXOR;
+		break;
+
+	case CLOG_TOKEN_EQUALS:
+		op = clog_opcode_EQ;
+		break;
+
+	case CLOG_TOKEN_NOT_EQUALS:
+		op = clog_opcode_NE;
+		break;
+
+	case CLOG_TOKEN_LESS_THAN:
+		op = clog_opcode_LT;
+		break;
+
+	case CLOG_TOKEN_LESS_THAN_EQUALS:
+		op = clog_opcode_LE;
+		break;
+
+	case CLOG_TOKEN_GREATER_THAN:
+		/* a > b is b < a, with a still evaluated first */
+		op = clog_opcode_LT;
+		swap = 1;
+		break;
+
+	case CLOG_TOKEN_GREATER_THAN_EQUALS:
+		op = clog_opcode_LE;
+		swap = 1;
+		break;
+
+	case CLOG_TOKEN_DOT:
+	case CLOG_TOKEN_OPEN_BRACKET:
+	case CLOG_TOKEN_IN:
+		clog_cfg_error(parser,"Objects are not supported",NULL,expr->line);
+		return CLOG_CFG_NONE;
+
+	case CLOG_TOKEN_THROW:
+		clog_cfg_error(parser,"Exceptions are not supported",NULL,expr->line);
+		return CLOG_CFG_NONE;
+
+	default:
+		clog_cfg_error(parser,"Unsupported operator",NULL,expr->line);
+		return CLOG_CFG_NONE;
+	}
+
+	value0 = clog_cfg_construct_value(parser,block,expr->args[0],ctx);
+	if (value0 == CLOG_CFG_NONE)
+		return value0;
+
+	if (!expr->args[1])
+		return clog_cfg_emit_R(ctx->builder->cfg,*block,op,CLOG_CFG_NONE,value0,expr->line);
+
+	value1 = clog_cfg_construct_value(parser,block,expr->args[1],ctx);
+	if (value1 == CLOG_CFG_NONE)
+		return value1;
+
+	if (swap)
+		return clog_cfg_emit_RR(ctx->builder->cfg,*block,op,value1,value0,expr->line);
+
+	return clog_cfg_emit_RR(ctx->builder->cfg,*block,op,value0,value1,expr->line);
+}
+
+/* Lowers ast_expr into *block, which moves on if the expression needs control flow */
+static unsigned int clog_cfg_construct_value(struct clog_parser* parser, struct clog_cfg_block** block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+{
+	unsigned int var;
+
+	switch (ast_expr->type)
+	{
 	case clog_ast_expression_variable:
+		var = clog_cfg_variable(ctx->builder,ast_expr->expr.variable->var);
+		if (var == CLOG_CFG_NONE)
+			return var;
+
+		/* Read into a temporary, so a later assignment in the same expression can't change it */
+		return clog_cfg_emit_R(ctx->builder->cfg,*block,clog_opcode_MOV,CLOG_CFG_NONE,var,ast_expr->expr.variable->line);
+
+	case clog_ast_expression_identifier:
+		/* clog_ast_bind_program leaves none behind */
 		break;
 
 	case clog_ast_expression_literal:
-		break;
+		return clog_cfg_emit_L(ctx->builder->cfg,*block,ast_expr->expr.literal);
+
+	case clog_ast_expression_builtin:
+		return clog_cfg_construct_builtin(parser,block,ast_expr,ctx);
 
 	case clog_ast_expression_call:
+		clog_cfg_error(parser,"Function calls are not supported",NULL,clog_ast_expression_line(ast_expr));
+		break;
+	}
+
+	return CLOG_CFG_NONE;
+}
+
+static struct clog_cfg_block* clog_cfg_construct_expression(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+{
+	switch (ast_expr->type)
+	{
+	case clog_ast_expression_variable:
+		clog_cfg_warning(parser,"Statement with no effect",NULL,ast_expr->expr.variable->line);
+		return block;
+
+	case clog_ast_expression_literal:
+		clog_cfg_warning(parser,"Statement with no effect",NULL,ast_expr->expr.literal->line);
+		return block;
+
+	default:
 		break;
+	}
+
+	if (clog_cfg_construct_value(parser,&block,ast_expr,ctx) == CLOG_CFG_NONE)
+		return NULL;
+
+	return block;
+}
+
+/* block->branch and block->fallthru are where control goes if ast_expr is true or false,
+ * the test is lowered into block, spreading into new blocks to short-circuit && and || */
+static struct clog_cfg_block* clog_cfg_construct_condition(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_expression* ast_expr, struct clog_cfg_context* ctx)
+{
+	struct clog_cfg_block* true_branch = block->branch;
+	struct clog_cfg_block* false_branch = block->fallthru;
+	unsigned int value;
+
+	switch (ast_expr->type)
+	{
+	case clog_ast_expression_literal:
+		/* Known now, so there is nothing to test */
+		block->branch = NULL;
+		block->fallthru = (clog_cfg_literal_truth(ast_expr->expr.literal) ? true_branch : false_branch);
+		return block;
 
 	case clog_ast_expression_builtin:
 		switch (ast_expr->expr.builtin->type)
 		{
+		case CLOG_TOKEN_TRUE:
+			/* Testing converts to bool anyway */
+			return clog_cfg_construct_condition(parser,block,ast_expr->expr.builtin->args[0],ctx);
+
+		case CLOG_TOKEN_EXCLAMATION:
+			block->branch = false_branch;
+			block->fallthru = true_branch;
+			return clog_cfg_construct_condition(parser,block,ast_expr->expr.builtin->args[0],ctx);
+
 		case CLOG_TOKEN_COMMA:
-			block = clog_cfg_construct_expression(block,ast_expr->expr.builtin->args[0],ctx);
-			if (block)
-				block = clog_cfg_construct_condition(block,ast_expr->expr.builtin->args[1],ctx);
-			break;
+			block->branch = NULL;
+			block->fallthru = NULL;
+			if (clog_cfg_construct_value(parser,&block,ast_expr->expr.builtin->args[0],ctx) == CLOG_CFG_NONE)
+				return NULL;
+
+			block->branch = true_branch;
+			block->fallthru = false_branch;
+			return clog_cfg_construct_condition(parser,block,ast_expr->expr.builtin->args[1],ctx);
 
 		case CLOG_TOKEN_OR:
 			{
-				struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
-				struct clog_cfg_block* or_case = clog_cfg_insert_fallthru(block);
-				if (!fallthru || !or_case)
+				struct clog_cfg_block* or_case;
+				if (!clog_cfg_alloc_block(parser,block,&or_case))
 					return NULL;
 
-				or_case->branch = block->branch;
-				clog_cfg_add_block_reference(or_case,block->branch);
+				or_case->branch = true_branch;
+				or_case->fallthru = false_branch;
+				block->fallthru = or_case;
 
-				if (!clog_cfg_construct_condition(block,ast_expr->expr.builtin->args[0],ctx) ||
-						!clog_cfg_construct_condition(or_case,ast_expr->expr.builtin->args[1],ctx))
+				if (!clog_cfg_construct_condition(parser,block,ast_expr->expr.builtin->args[0],ctx) ||
+						!clog_cfg_construct_condition(parser,or_case,ast_expr->expr.builtin->args[1],ctx))
 				{
 					return NULL;
 				}
-				return fallthru;
+				return block;
 			}
 
 		case CLOG_TOKEN_AND:
 			{
-				struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
-				struct clog_cfg_block* and_case = clog_cfg_insert_branch(block);
-
-				if (!fallthru || !and_case)
+				struct clog_cfg_block* and_case;
+				if (!clog_cfg_alloc_block(parser,block,&and_case))
 					return NULL;
 
-				if (!clog_cfg_construct_condition(block,ast_expr->expr.builtin->args[0],ctx) ||
-						!clog_cfg_construct_condition(and_case,ast_expr->expr.builtin->args[1],ctx))
+				and_case->branch = true_branch;
+				and_case->fallthru = false_branch;
+				block->branch = and_case;
+
+				if (!clog_cfg_construct_condition(parser,block,ast_expr->expr.builtin->args[0],ctx) ||
+						!clog_cfg_construct_condition(parser,and_case,ast_expr->expr.builtin->args[1],ctx))
 				{
 					return NULL;
 				}
-				return fallthru;
+				return block;
 			}
 
-		case CLOG_TOKEN_EQUALS:
-		case CLOG_TOKEN_NOT_EQUALS:
-		case CLOG_TOKEN_LESS_THAN:
-		case CLOG_TOKEN_LESS_THAN_EQUALS:
-		case CLOG_TOKEN_GREATER_THAN:
-		case CLOG_TOKEN_GREATER_THAN_EQUALS:
-			break;
-
 		default:
 			break;
 		}
 		break;
+
+	default:
+		break;
 	}
+
+	/* Anything else is evaluated and the result tested, wherever evaluation ends up */
+	block->branch = NULL;
+	block->fallthru = NULL;
+	value = clog_cfg_construct_value(parser,&block,ast_expr,ctx);
+	if (value == CLOG_CFG_NONE)
+		return NULL;
+
+	block->branch = true_branch;
+	block->fallthru = false_branch;
+	block->cond = value;
 	return block;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_block(struct clog_cfg_block* block, const struct clog_ast_block* ast_block, struct clog_cfg_context* ctx);
+static struct clog_cfg_block* clog_cfg_construct_block(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_block* ast_block, struct clog_cfg_context* ctx);
 
-static struct clog_cfg_block* clog_cfg_construct_if(struct clog_cfg_block* block, const struct clog_ast_statement_if* ast_if, struct clog_cfg_context* ctx)
+/* Each construct_* lowers into block and returns the block control continues in */
+static struct clog_cfg_block* clog_cfg_construct_if(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_if* ast_if, struct clog_cfg_context* ctx)
 {
-	struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
-	struct clog_cfg_block* true_branch = clog_cfg_insert_branch(block);
-	struct clog_cfg_block* false_branch;
+	struct clog_cfg_block* true_branch;
+	struct clog_cfg_block* false_branch = NULL;
+	struct clog_cfg_block* fallthru;
 
-	if (!fallthru || !true_branch)
+	if (!clog_cfg_alloc_block(parser,block,&true_branch))
 		return NULL;
 
-	if (ast_if->false_block && !(false_branch = clog_cfg_insert_fallthru(block)))
+	if (ast_if->false_block && !clog_cfg_alloc_block(parser,true_branch,&false_branch))
 		return NULL;
 
-	if (!clog_cfg_construct_condition(block,ast_if->condition,ctx))
+	if (!clog_cfg_alloc_block(parser,false_branch ? false_branch : true_branch,&fallthru))
 		return NULL;
 
-	if (!clog_cfg_construct_block(true_branch,ast_if->true_block,ctx))
+	block->branch = true_branch;
+	block->fallthru = (false_branch ? false_branch : fallthru);
+	if (!clog_cfg_construct_condition(parser,block,ast_if->condition,ctx))
 		return NULL;
 
-	if (ast_if->false_block && !clog_cfg_construct_block(false_branch,ast_if->false_block,ctx))
+	block = clog_cfg_construct_block(parser,true_branch,ast_if->true_block,ctx);
+	if (!block)
 		return NULL;
+	block->fallthru = fallthru;
+
+	if (false_branch)
+	{
+		block = clog_cfg_construct_block(parser,false_branch,ast_if->false_block,ctx);
+		if (!block)
+			return NULL;
+		block->fallthru = fallthru;
+	}
 
 	return fallthru;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_do(struct clog_cfg_block* block, const struct clog_ast_statement_do* ast_do, struct clog_cfg_context* prev_ctx)
+static struct clog_cfg_block* clog_cfg_construct_do(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_do* ast_do, struct clog_cfg_context* prev_ctx)
 {
-	struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
 	struct clog_cfg_block* loop_body;
 	struct clog_cfg_block* condition;
+	struct clog_cfg_block* fallthru;
 
-	struct clog_cfg_context ctx = {0};
+	struct clog_cfg_context ctx = *prev_ctx;
 
-	loop_body = clog_cfg_insert_fallthru(block);
-	if (!loop_body)
+	if (!clog_cfg_alloc_block(parser,block,&loop_body) ||
+			!clog_cfg_alloc_block(parser,loop_body,&condition) ||
+			!clog_cfg_alloc_block(parser,condition,&fallthru))
+	{
 		return NULL;
+	}
 
-	condition = clog_cfg_insert_fallthru(loop_body);
-	if (!!condition)
-		return NULL;
+	block->fallthru = loop_body;
 
-	condition->branch = loop_body;
-	clog_cfg_add_block_reference(condition,loop_body);
+	ctx.break_branch = fallthru;
+	ctx.continue_branch = condition;
 
-	if (!clog_cfg_construct_block(loop_body,ast_do->loop_block,&ctx))
+	block = clog_cfg_construct_block(parser,loop_body,ast_do->loop_block,&ctx);
+	if (!block)
 		return NULL;
+	block->fallthru = condition;
 
-	if (!clog_cfg_construct_condition(condition,ast_do->condition,&ctx))
+	condition->branch = loop_body;
+	condition->fallthru = fallthru;
+	if (!clog_cfg_construct_condition(parser,condition,ast_do->condition,&ctx))
 		return NULL;
 
 	return fallthru;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_while(struct clog_cfg_block* block, const struct clog_ast_statement_while* ast_while, struct clog_cfg_context* prev_ctx)
-{
-	struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
-	struct clog_cfg_block* header = clog_cfg_insert_fallthru(block);
-	struct clog_cfg_block* branch;
+static struct clog_cfg_block* clog_cfg_construct_statements(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_list* list, struct clog_cfg_context* ctx);
 
-	struct clog_cfg_context ctx = {0};
+static struct clog_cfg_block* clog_cfg_construct_while(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_while* ast_while, struct clog_cfg_context* prev_ctx)
+{
+	struct clog_cfg_block* header;
+	struct clog_cfg_block* loop_body;
+	struct clog_cfg_block* post = NULL;
+	struct clog_cfg_block* fallthru;
 
-	if (!fallthru)
-		return NULL;
+	struct clog_cfg_context ctx = *prev_ctx;
 
-	if (ast_while->pre)
+	if (!clog_cfg_alloc_block(parser,block,&header) ||
+			!clog_cfg_alloc_block(parser,header,&loop_body) ||
+			(ast_while->post && !clog_cfg_alloc_block(parser,loop_body,&post)) ||
+			!clog_cfg_alloc_block(parser,post ? post : loop_body,&fallthru))
 	{
-		const struct clog_ast_statement_list* list = ast_while->pre;
-		for (;list && header;list = list->next)
-			header = clog_cfg_construct_expression(header,list->stmt->stmt.expression,&ctx);
+		return NULL;
 	}
 
-	if (!header || !clog_cfg_alloc_block(header,&header->branch))
-		return NULL;
+	block->fallthru = header;
+
+	ctx.break_branch = fallthru;
+	ctx.continue_branch = (post ? post : header);
 
-	branch = header->branch;
-	branch->fallthru = header;
-	clog_cfg_add_block_reference(branch,header);
+	/* The declaration in while (var x = ...) runs every time round, in the enclosing scope */
+	block = clog_cfg_construct_statements(parser,header,ast_while->pre,prev_ctx);
+	if (!block)
+		return NULL;
 
-	if (!clog_cfg_construct_condition(header,ast_while->condition,&ctx))
+	block->branch = loop_body;
+	block->fallthru = fallthru;
+	if (!clog_cfg_construct_condition(parser,block,ast_while->condition,prev_ctx))
 		return NULL;
 
-	if (!clog_cfg_construct_block(branch,ast_while->loop_block,&ctx))
+	block = clog_cfg_construct_block(parser,loop_body,ast_while->loop_block,&ctx);
+	if (!block)
 		return NULL;
 
+	if (post)
+	{
+		/* In the scope the loop is in, after the body and whatever it declared */
+		block->fallthru = post;
+		block = clog_cfg_construct_expression(parser,post,ast_while->post,prev_ctx);
+		if (!block)
+			return NULL;
+	}
+	block->fallthru = header;
+
 	return fallthru;
 }
 
-static struct clog_cfg_block* clog_cfg_construct_block(struct clog_cfg_block* block, const struct clog_ast_block* ast_block, struct clog_cfg_context* ctx)
+/* Control leaves block for good, anything after it lowers into a block nothing reaches */
+static struct clog_cfg_block* clog_cfg_construct_jump(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_list* list, struct clog_cfg_context* ctx)
 {
-	struct clog_cfg_block* fallthru = clog_cfg_append_fallthru(block);
-	struct clog_cfg_block* trailer = NULL;
-	const struct clog_ast_statement_list* list = ast_block->stmts;
+	struct clog_cfg_block* next;
+	unsigned long line;
+
+	if (list->stmt->type == clog_ast_statement_return)
+	{
+		line = (list->stmt->stmt.expression ? clog_ast_expression_line(list->stmt->stmt.expression) : 0);
+		if (list->stmt->stmt.expression)
+		{
+			block->ret = clog_cfg_construct_value(parser,&block,list->stmt->stmt.expression,ctx);
+			if (block->ret == CLOG_CFG_NONE)
+				return NULL;
+		}
+		block->fallthru = NULL;
+	}
+	else
+	{
+		const char* stmt = (list->stmt->type == clog_ast_statement_break ? "break" : "continue");
+		line = list->stmt->stmt.expression->expr.literal->line;
+
+		block->fallthru = (list->stmt->type == clog_ast_statement_break ? ctx->break_branch : ctx->continue_branch);
+		if (!block->fallthru)
+		{
+			clog_cfg_error(parser,stmt,(const unsigned char*)" outside of a loop",line);
+			return NULL;
+		}
+	}
 
-	if (!fallthru)
+	if (list->next)
+		clog_cfg_warning(parser,"Unreachable code",NULL,line);
+
+	if (!clog_cfg_alloc_block(parser,block,&next))
 		return NULL;
 
+	return next;
+}
+
+static struct clog_cfg_block* clog_cfg_construct_statements(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_statement_list* list, struct clog_cfg_context* ctx)
+{
 	for (;list && block;list = list->next)
 	{
 		switch (list->stmt->type)
 		{
 		case clog_ast_statement_declaration:
 		case clog_ast_statement_constant:
+			/* clog_ast_bind_program leaves only the initializer */
 			break;
 
 		case clog_ast_statement_expression:
-			block = clog_cfg_construct_expression(block,list->stmt->stmt.expression,ctx);
+			block = clog_cfg_construct_expression(parser,block,list->stmt->stmt.expression,ctx);
 			break;
 
 		case clog_ast_statement_block:
-			block = clog_cfg_construct_block(block,list->stmt->stmt.block,ctx);
+			block = clog_cfg_construct_block(parser,block,list->stmt->stmt.block,ctx);
 			break;
 
 		case clog_ast_statement_if:
-			block = clog_cfg_construct_if(block,list->stmt->stmt.if_stmt,ctx);
+			block = clog_cfg_construct_if(parser,block,list->stmt->stmt.if_stmt,ctx);
 			break;
 
 		case clog_ast_statement_do:
-			block = clog_cfg_construct_do(block,list->stmt->stmt.do_stmt,ctx);
+			block = clog_cfg_construct_do(parser,block,list->stmt->stmt.do_stmt,ctx);
 			break;
 
 		case clog_ast_statement_while:
-			block = clog_cfg_construct_while(block,list->stmt->stmt.while_stmt,ctx);
+			block = clog_cfg_construct_while(parser,block,list->stmt->stmt.while_stmt,ctx);
 			break;
 
 		case clog_ast_statement_break:
 		case clog_ast_statement_continue:
 		case clog_ast_statement_return:
+			block = clog_cfg_construct_jump(parser,block,list,ctx);
 			break;
 		}
 	}
 
-	return fallthru;
+	return block;
+}
+
+static struct clog_cfg_block* clog_cfg_construct_block(struct clog_parser* parser, struct clog_cfg_block* block, const struct clog_ast_block* ast_block, struct clog_cfg_context* ctx)
+{
+	if (!ast_block)
+		return block;
+
+	return clog_cfg_construct_statements(parser,block,ast_block->stmts,ctx);
+}
+
+int clog_cfg_number(struct clog_cfg* cfg)
+{
+	struct clog_cfg_block** stack;
+	struct clog_cfg_block* block;
+	unsigned int total = 0;
+	unsigned int count = 0;
+	unsigned int top = 0;
+	unsigned int i;
+
+	for (block = cfg->entry; block; block = block->a_next)
+	{
+		/* A test that goes the same way either way isn't a test */
+		if (block->cond == CLOG_CFG_NONE || block->branch == block->fallthru)
+		{
+			block->cond = CLOG_CFG_NONE;
+			block->branch = NULL;
+		}
+
+		block->rpo = CLOG_CFG_NONE;
+		block->preds = NULL;
+		block->pred_count = 0;
+		++total;
+	}
+
+	clog_free(&cfg->parser->allocator,cfg->blocks);
+	cfg->blocks = clog_malloc(&cfg->parser->allocator,total * sizeof(struct clog_cfg_block*));
+	stack = clog_malloc(&cfg->parser->allocator,total * sizeof(struct clog_cfg_block*));
+	if (!cfg->blocks || !stack)
+	{
+		clog_free(&cfg->parser->allocator,stack);
+		clog_cfg_out_of_memory(cfg->parser);
+		return 0;
+	}
+
+	/* Depth first from the entry, a block leaves the stack once all its successors have been seen.
+	 * The rpo field marks blocks already seen until the real numbers go in */
+	cfg->entry->rpo = 0;
+	stack[top++] = cfg->entry;
+	while (top)
+	{
+		block = stack[top-1];
+		if (block->branch && block->branch->rpo == CLOG_CFG_NONE)
+		{
+			block->branch->rpo = 0;
+			stack[top++] = block->branch;
+		}
+		else if (block->fallthru && block->fallthru->rpo == CLOG_CFG_NONE)
+		{
+			block->fallthru->rpo = 0;
+			stack[top++] = block->fallthru;
+		}
+		else
+			cfg->blocks[count++] = stack[--top];
+	}
+
+	clog_free(&cfg->parser->allocator,stack);
+
+	/* Postorder reversed */
+	for (i = 0; i < count / 2; ++i)
+	{
+		block = cfg->blocks[i];
+		cfg->blocks[i] = cfg->blocks[count - 1 - i];
+		cfg->blocks[count - 1 - i] = block;
+	}
+
+	for (i = 0; i < count; ++i)
+		cfg->blocks[i]->rpo = i;
+
+	cfg->block_count = count;
+
+	/* Only reachable blocks count as predecessors. Lists from an earlier numbering are left in the arena */
+	for (i = 0; i < count; ++i)
+	{
+		block = cfg->blocks[i];
+		if (block->branch)
+			++block->branch->pred_count;
+		if (block->fallthru)
+			++block->fallthru->pred_count;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		block = cfg->blocks[i];
+		if (block->pred_count)
+		{
+			block->preds = clog_arena_alloc(&cfg->arena,block->pred_count * sizeof(struct clog_cfg_block*));
+			if (!block->preds)
+			{
+				clog_cfg_out_of_memory(cfg->parser);
+				return 0;
+			}
+			block->pred_count = 0;
+		}
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		block = cfg->blocks[i];
+		if (block->branch)
+			block->branch->preds[block->branch->pred_count++] = block;
+		if (block->fallthru)
+			block->fallthru->preds[block->fallthru->pred_count++] = block;
+	}
+
+	return 1;
 }
 
-static void __dump(struct clog_cfg_block* block)
+void clog_cfg_free(struct clog_cfg* cfg)
 {
-	if (block)
+	/* Every block hangs off the a_next chain of the entry */
+	struct clog_cfg_block* block = cfg->entry;
+	while (block)
 	{
+		struct clog_cfg_block* next = block->a_next;
+		clog_free(&cfg->parser->allocator,block->triplets);
+		clog_free(&cfg->parser->allocator,block->phis);
+		clog_free(&cfg->parser->allocator,block);
+		block = next;
+	}
+
+	clog_free(&cfg->parser->allocator,cfg->blocks);
+	clog_free(&cfg->parser->allocator,cfg->values);
+	clog_arena_free(&cfg->arena);
+
+	cfg->entry = NULL;
+	cfg->blocks = NULL;
+	cfg->block_count = 0;
+	cfg->values = NULL;
+	cfg->value_count = 0;
+	cfg->value_alloc = 0;
+}
+
+#if defined(CLOG_DUMP_CFG)
+static const char* __dump_op(enum clog_opcode op)
+{
+	/* In enum clog_opcode order */
+	static const char* const s_ops[] =
+	{
+		"MOV", "LOAD", "NEG", "ADD", "SUB", "MUL", "DIV", "MOD",
+		"RSH", "LSH", "NOT", "BNOT", "BAND", "BOR", "BXOR",
+		"EQ", "NE", "LT", "LE", "BOOL", "JMP", "JMPT", "JMPF",
+		"RET"
+	};
+	return ((unsigned int)op < sizeof(s_ops) / sizeof(s_ops[0]) ? s_ops[op] : "???");
+}
+
+static void __dump_literal(const struct clog_ast_literal* lit)
+{
+	size_t i;
+	switch (lit->type)
+	{
+	case clog_ast_literal_null:
+		printf("null");
+		break;
+
+	case clog_ast_literal_bool:
+		printf(lit->value.integer ? "true" : "false");
+		break;
+
+	case clog_ast_literal_integer:
+		printf("%ld",lit->value.integer);
+		break;
+
+	case clog_ast_literal_real:
+		printf("%g",lit->value.real);
+		break;
+
+	case clog_ast_literal_string:
+		/* Just enough to recognise it, without having to escape it */
+		printf("'");
+		for (i = 0; i < lit->value.string.len && i < 16; ++i)
+			printf("%c",(lit->value.string.str[i] >= ' ' && lit->value.string.str[i] < 127 && lit->value.string.str[i] != '"' && lit->value.string.str[i] != '\\') ? lit->value.string.str[i] : '?');
+		printf("'");
+		break;
+	}
+}
+
+static void __dump(const struct clog_cfg* cfg)
+{
+	unsigned int i, j, k;
+
+	printf("digraph cfg {\nnode [shape=box];\n");
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		const struct clog_cfg_block* block = cfg->blocks[i];
+
+		printf("%u [label=\"",block->gen);
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			printf("v%u = phi(",block->phis[j].dest);
+			for (k = 0; k < block->pred_count; ++k)
+				printf(k ? ",v%u" : "v%u",block->phis[j].args[k]);
+			printf(")\\l");
+		}
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			printf("v%u = %s ",t->dest,__dump_op(t->op));
+			if (t->op == clog_opcode_LOAD)
+				__dump_literal(t->val.lit);
+			else if (t->val.args[1] == CLOG_CFG_NONE)
+				printf("v%u",t->val.args[0]);
+			else
+				printf("v%u v%u",t->val.args[0],t->val.args[1]);
+			printf("\\l");
+		}
+
+		if (block->cond != CLOG_CFG_NONE)
+			printf("test v%u\\l",block->cond);
+		else if (!block->fallthru)
+			printf(block->ret != CLOG_CFG_NONE ? "ret v%u\\l" : "ret\\l",block->ret);
+		printf("\"];\n");
+
 		if (block->branch)
-			printf("%u -> %u;\n",block->gen,block->branch->gen);
+			printf("%u -> %u [label=T];\n",block->gen,block->branch->gen);
 
 		if (block->fallthru)
 			printf("%u -> %u;\n",block->gen,block->fallthru->gen);
-
-		__dump(block->a_next);
 	}
+	printf("}\n");
 }
+#endif
 
-int clog_cfg_construct(const struct clog_ast_block* ast_block)
+int clog_cfg_construct(struct clog_parser* parser, const struct clog_ast_block* ast_block, struct clog_cfg* cfg)
 {
+	struct clog_cfg_builder builder;
 	struct clog_cfg_context context = {0};
 	struct clog_cfg_block* block;
-	if (!clog_cfg_alloc_block(NULL,&block))
+	unsigned int i;
+	int ok = 0;
+
+	memset(cfg,0,sizeof(struct clog_cfg));
+	cfg->parser = parser;
+	cfg->arena.allocator = &parser->allocator;
+
+	/* One more than needed, so a program without variables still gets an allocation */
+	memset(&builder,0,sizeof(builder));
+	builder.cfg = cfg;
+	builder.vars = clog_malloc(&parser->allocator,(parser->var_count + 1) * sizeof(unsigned int));
+	if (!builder.vars)
+	{
+		clog_cfg_out_of_memory(parser);
 		return 0;
+	}
+
+	for (i = 0; i <= parser->var_count; ++i)
+		builder.vars[i] = CLOG_CFG_NONE;
+
+	context.builder = &builder;
 
-	if (!clog_cfg_construct_block(block,ast_block,&context))
+	if (clog_cfg_alloc_block(parser,NULL,&block))
 	{
-		return 0;
+		cfg->entry = block;
+
+		/* The last block has nowhere to go, which ends the program */
+		ok = (clog_cfg_construct_block(parser,block,ast_block,&context) != NULL);
 	}
 
-	printf("digraph cfg {\n");
-	__dump(block);
-	printf("}");
+	/* Names are resolved, only values matter from here */
+	clog_free(&parser->allocator,builder.vars);
 
-	return 1;
+	if (ok)
+		ok = (clog_cfg_number(cfg) && clog_cfg_ssa(cfg) && clog_cfg_sccp(cfg));
+
+#if defined(CLOG_DUMP_CFG)
+	/* Debug only, the graph goes straight to stdout whichever compilation it belongs to */
+	if (ok)
+		__dump(cfg);
+#endif
+
+	return ok;
 }
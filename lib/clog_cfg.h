@@ -0,0 +1,134 @@
+/*
+ * clog_cfg.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_CFG_H_
+#define CLOG_CFG_H_
+
+#include "clog_ast.h"
+#include "clog_opcodes.h"
+
+#define CLOG_CFG_NONE ((unsigned int)-1)
+
+/* Values are numbered across the whole graph.
+ * Before SSA construction a variable is one value that may be written any number of
+ * times, and var says which variable it is. Afterwards every value is written exactly
+ * once and var is CLOG_CFG_NONE. id is kept on the versions of a variable for diagnostics */
+struct clog_cfg_value
+{
+	unsigned int                    var;
+	const struct clog_ast_variable* id;
+};
+
+/* dest = op args[0], args[1]
+ * LOAD reads lit in place of args, MOV and the unary ops only use args[0].
+ * Blocks hold their triplets by value, so they are kept to three words */
+struct clog_cfg_triplet
+{
+	enum clog_opcode op;
+	unsigned int     dest;
+	union clog_cfg_triplet_val
+	{
+		unsigned int                   args[2];
+		const struct clog_ast_literal* lit;
+	} val;
+	unsigned long line;
+};
+
+/* dest = args[i] when control arrived from preds[i] */
+struct clog_cfg_phi
+{
+	unsigned int  var;
+	unsigned int  dest;
+	unsigned int* args;
+};
+
+struct clog_cfg_block
+{
+	unsigned int gen;
+
+	/* Every block, in allocation order */
+	struct clog_cfg_block* a_next;
+
+	/* If cond is a value, control goes to branch when it is true and to fallthru when it isn't,
+	 * otherwise always to fallthru. No fallthru ends the program, returning ret if it is a value */
+	struct clog_cfg_block* branch;
+	struct clog_cfg_block* fallthru;
+	unsigned int           cond;
+	unsigned int           ret;
+
+	struct clog_cfg_phi*     phis;
+	unsigned int             phi_count;
+	unsigned int             phi_alloc;
+	struct clog_cfg_triplet* triplets;
+	unsigned int             triplet_count;
+	unsigned int             triplet_alloc;
+
+	/* Set by clog_cfg_number, unreachable blocks have no number */
+	struct clog_cfg_block** preds;
+	unsigned int            pred_count;
+	unsigned int            rpo;
+
+	/* Dominator tree, set by clog_cfg_dominators */
+	struct clog_cfg_block* idom;
+	struct clog_cfg_block* dom_child;
+	struct clog_cfg_block* dom_sibling;
+};
+
+struct clog_cfg
+{
+	struct clog_parser*    parser;
+	struct clog_cfg_block* entry;
+
+	/* Reachable blocks in reverse postorder, entry first */
+	struct clog_cfg_block** blocks;
+	unsigned int            block_count;
+
+	struct clog_cfg_value* values;
+	unsigned int           value_count;
+	unsigned int           value_alloc;
+	unsigned int           var_count;
+
+	/* Predecessor lists, phi arguments and made-up literals */
+	struct clog_arena arena;
+};
+
+/* Reports it and marks the parse failed */
+void clog_cfg_out_of_memory(struct clog_parser* parser);
+
+/* Both return CLOG_CFG_NONE when out of memory */
+unsigned int clog_cfg_alloc_value(struct clog_cfg* cfg, unsigned int var, const struct clog_ast_variable* id);
+unsigned int clog_cfg_alloc_var(struct clog_cfg* cfg, const struct clog_ast_variable* id);
+
+/* Only op, dest and line are filled in. NULL when out of memory or dest is CLOG_CFG_NONE */
+struct clog_cfg_triplet* clog_cfg_append_triplet(struct clog_cfg* cfg, struct clog_cfg_block* block, enum clog_opcode op, unsigned int dest, unsigned long line);
+
+/* Constants made up by the passes, they live as long as the graph. NULL when out of memory */
+struct clog_ast_literal* clog_cfg_literal(struct clog_cfg* cfg, enum clog_ast_literal_type type, long value, unsigned long line);
+
+/* The truth of a constant, as the VM tests it */
+int clog_cfg_literal_truth(const struct clog_ast_literal* lit);
+
+/* Orders the reachable blocks and fills in their predecessors, again after any edge changes */
+int clog_cfg_number(struct clog_cfg* cfg);
+
+/* Builds the dominator tree of a numbered graph */
+void clog_cfg_dominators(struct clog_cfg* cfg);
+
+/* Puts a numbered graph into pruned SSA form */
+int clog_cfg_ssa(struct clog_cfg* cfg);
+
+/* Sparse conditional constant propagation over SSA form.
+ * Folds constants, removes branches that can't be taken and the code only they reached,
+ * then drops values nothing uses. Leaves the graph numbered */
+int clog_cfg_sccp(struct clog_cfg* cfg);
+
+void clog_cfg_free(struct clog_cfg* cfg);
+
+/* Builds the graph of a program in SSA form, with constants folded.
+ * cfg is always initialised, and must be freed even when this fails */
+int clog_cfg_construct(struct clog_parser* parser, const struct clog_ast_block* ast_block, struct clog_cfg* cfg);
+
+#endif /* CLOG_CFG_H_ */
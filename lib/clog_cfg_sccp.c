@@ -0,0 +1,903 @@
+/*
+ * clog_cfg_sccp.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_cfg.h"
+#include "clog_value.h"
+
+#include <string.h>
+#include <limits.h>
+
+/* Wegman and Zadeck, "Constant Propagation with Conditional Branches".
+ * Values only move down the lattice, so each is revisited at most twice */
+enum clog_sccp_state
+{
+	clog_sccp_top,      /* Not yet seen to be defined */
+	clog_sccp_const,    /* Always the same constant */
+	clog_sccp_bottom    /* Could be anything */
+};
+
+/* One place a value is read: a phi, a triplet, or the block's test after them */
+struct clog_sccp_use
+{
+	struct clog_cfg_block* block;
+	unsigned int           item;
+};
+
+/* Where a value is written, kept for dead code removal */
+struct clog_sccp_def
+{
+	struct clog_cfg_block* block;
+	unsigned int           item;
+};
+
+struct clog_sccp_context
+{
+	struct clog_cfg*  cfg;
+	struct clog_arena arena;
+
+	/* By value */
+	unsigned char*                  states;
+	const struct clog_ast_literal** consts;
+	unsigned int*                   use_start;
+	struct clog_sccp_use*           uses;
+
+	/* By rpo, edges are rpo * 2 for the branch and rpo * 2 + 1 for the fallthru */
+	unsigned char* block_exec;
+	unsigned char* edge_exec;
+
+	unsigned int* edge_work;
+	unsigned int  edge_top;
+	unsigned int* value_work;
+	unsigned int  value_top;
+};
+
+static void* clog_sccp_alloc(struct clog_sccp_context* ctx, size_t s)
+{
+	/* Never zero length, so NULL always means out of memory */
+	void* p = clog_arena_alloc(&ctx->arena,s ? s : 1);
+	if (!p)
+		clog_cfg_out_of_memory(ctx->cfg->parser);
+	else
+		memset(p,0,s);
+
+	return p;
+}
+
+static int clog_sccp_literal_same(const struct clog_ast_literal* lit1, const struct clog_ast_literal* lit2)
+{
+	if (lit1 == lit2)
+		return 1;
+
+	if (lit1->type != lit2->type)
+		return 0;
+
+	switch (lit1->type)
+	{
+	case clog_ast_literal_null:
+		return 1;
+
+	case clog_ast_literal_real:
+		/* Bitwise, 0.0 and -0.0 are different constants */
+		return (memcmp(&lit1->value.real,&lit2->value.real,sizeof(double)) == 0);
+
+	case clog_ast_literal_string:
+		return (lit1->value.string.len == lit2->value.string.len && memcmp(lit1->value.string.str,lit2->value.string.str,lit1->value.string.len) == 0);
+
+	default:
+		return (lit1->value.integer == lit2->value.integer);
+	}
+}
+
+/* null and bool promote to integer, the same as the VM */
+static int clog_sccp_int_promote(const struct clog_ast_literal* lit, clog_value_int* i)
+{
+	switch (lit->type)
+	{
+	case clog_ast_literal_null:
+		*i = 0;
+		return 1;
+
+	case clog_ast_literal_bool:
+	case clog_ast_literal_integer:
+		*i = lit->value.integer;
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* The integer operators truncate reals, the same as the VM */
+static int clog_sccp_int_convert(const struct clog_ast_literal* lit, clog_value_int* i)
+{
+	if (lit->type == clog_ast_literal_real)
+		return clog_value_real_to_integer(lit->value.real,i);
+
+	return clog_sccp_int_promote(lit,i);
+}
+
+static int clog_sccp_real_promote(const struct clog_ast_literal* lit, double* d)
+{
+	clog_value_int i;
+	if (lit->type == clog_ast_literal_real)
+	{
+		*d = lit->value.real;
+		return 1;
+	}
+
+	if (!clog_sccp_int_promote(lit,&i))
+		return 0;
+
+	*d = (double)i;
+	return 1;
+}
+
+static const struct clog_ast_literal* clog_sccp_bool(struct clog_cfg* cfg, int b, unsigned long line)
+{
+	return clog_cfg_literal(cfg,clog_ast_literal_bool,b ? 1 : 0,line);
+}
+
+static const struct clog_ast_literal* clog_sccp_integer(struct clog_cfg* cfg, clog_value_int i, unsigned long line)
+{
+	/* Integers wrap at 48 bits when they are boxed */
+	i = CLOG_VALUE_INT(CLOG_VALUE_INT_BOX(i));
+	if ((clog_value_int)(long)i != i)
+		return NULL;
+
+	return clog_cfg_literal(cfg,clog_ast_literal_integer,(long)i,line);
+}
+
+static const struct clog_ast_literal* clog_sccp_real(struct clog_cfg* cfg, double d, unsigned long line)
+{
+	struct clog_ast_literal* lit = clog_cfg_literal(cfg,clog_ast_literal_real,0,line);
+	if (lit)
+		lit->value.real = d;
+
+	return lit;
+}
+
+/* Evaluates op the way the VM would. Anything the VM would report as an error, or can't be
+ * known until run time, comes back NULL and is left for the VM */
+static const struct clog_ast_literal* clog_sccp_fold(struct clog_cfg* cfg, const struct clog_cfg_triplet* t, const struct clog_ast_literal* a, const struct clog_ast_literal* b)
+{
+	clog_value_int i1, i2;
+	double d1, d2;
+	int cmp;
+
+	switch (t->op)
+	{
+	case clog_opcode_LOAD:
+		return t->val.lit;
+
+	case clog_opcode_MOV:
+		return a;
+
+	case clog_opcode_NOT:
+		return clog_sccp_bool(cfg,!clog_cfg_literal_truth(a),t->line);
+
+	case clog_opcode_BOOL:
+		return clog_sccp_bool(cfg,clog_cfg_literal_truth(a),t->line);
+
+	case clog_opcode_NEG:
+		if (a->type == clog_ast_literal_real)
+			return clog_sccp_real(cfg,-a->value.real,t->line);
+		if (!clog_sccp_int_promote(a,&i1))
+			return NULL;
+		return clog_sccp_integer(cfg,-i1,t->line);
+
+	case clog_opcode_BNOT:
+		if (!clog_sccp_int_convert(a,&i1))
+			return NULL;
+		return clog_sccp_integer(cfg,~i1,t->line);
+
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+	case clog_opcode_LT:
+	case clog_opcode_LE:
+		if (a->type == clog_ast_literal_string || b->type == clog_ast_literal_string)
+		{
+			/* The other side is converted to a string at run time */
+			size_t len;
+			if (a->type != b->type)
+				return NULL;
+
+			len = (a->value.string.len < b->value.string.len ? a->value.string.len : b->value.string.len);
+			cmp = memcmp(a->value.string.str,b->value.string.str,len);
+			if (cmp == 0 && a->value.string.len != b->value.string.len)
+				cmp = (a->value.string.len < b->value.string.len ? -1 : 1);
+		}
+		else if (a->type == clog_ast_literal_real || b->type == clog_ast_literal_real)
+		{
+			if (!clog_sccp_real_promote(a,&d1) || !clog_sccp_real_promote(b,&d2))
+				return NULL;
+			if (d1 != d1 || d2 != d2)
+				return clog_sccp_bool(cfg,t->op == clog_opcode_NE,t->line);
+			cmp = (d1 > d2 ? 1 : (d1 == d2 ? 0 : -1));
+		}
+		else
+		{
+			if (!clog_sccp_int_promote(a,&i1) || !clog_sccp_int_promote(b,&i2))
+				return NULL;
+			cmp = (i1 > i2 ? 1 : (i1 == i2 ? 0 : -1));
+		}
+
+		if (t->op == clog_opcode_EQ)
+			return clog_sccp_bool(cfg,cmp == 0,t->line);
+		if (t->op == clog_opcode_NE)
+			return clog_sccp_bool(cfg,cmp != 0,t->line);
+		if (t->op == clog_opcode_LT)
+			return clog_sccp_bool(cfg,cmp < 0,t->line);
+		return clog_sccp_bool(cfg,cmp <= 0,t->line);
+
+	case clog_opcode_ADD:
+	case clog_opcode_SUB:
+	case clog_opcode_MUL:
+	case clog_opcode_DIV:
+		/* Strings are built at run time */
+		if (a->type == clog_ast_literal_string || b->type == clog_ast_literal_string)
+			return NULL;
+
+		if (a->type == clog_ast_literal_real || b->type == clog_ast_literal_real)
+		{
+			if (!clog_sccp_real_promote(a,&d1) || !clog_sccp_real_promote(b,&d2))
+				return NULL;
+			if (t->op == clog_opcode_ADD)
+				return clog_sccp_real(cfg,d1 + d2,t->line);
+			if (t->op == clog_opcode_SUB)
+				return clog_sccp_real(cfg,d1 - d2,t->line);
+			if (t->op == clog_opcode_MUL)
+				return clog_sccp_real(cfg,d1 * d2,t->line);
+			if (d2 == 0.0)
+				return NULL;
+			return clog_sccp_real(cfg,d1 / d2,t->line);
+		}
+
+		if (!clog_sccp_int_promote(a,&i1) || !clog_sccp_int_promote(b,&i2))
+			return NULL;
+		if (t->op == clog_opcode_ADD)
+			return clog_sccp_integer(cfg,i1 + i2,t->line);
+		if (t->op == clog_opcode_SUB)
+			return clog_sccp_integer(cfg,i1 - i2,t->line);
+		if (t->op == clog_opcode_MUL)
+			return clog_sccp_integer(cfg,(clog_value_int)((clog_value)i1 * (clog_value)i2),t->line);
+		if (i2 == 0)
+			return NULL;
+		return clog_sccp_integer(cfg,i1 / i2,t->line);
+
+	case clog_opcode_MOD:
+	case clog_opcode_BAND:
+	case clog_opcode_BOR:
+	case clog_opcode_BXOR:
+	case clog_opcode_LSH:
+	case clog_opcode_RSH:
+		if (!clog_sccp_int_convert(a,&i1) || !clog_sccp_int_convert(b,&i2))
+			return NULL;
+
+		if (t->op == clog_opcode_MOD)
+			return (i2 == 0 ? NULL : clog_sccp_integer(cfg,i1 % i2,t->line));
+		if (t->op == clog_opcode_BAND)
+			return clog_sccp_integer(cfg,i1 & i2,t->line);
+		if (t->op == clog_opcode_BOR)
+			return clog_sccp_integer(cfg,i1 | i2,t->line);
+		if (t->op == clog_opcode_BXOR)
+			return clog_sccp_integer(cfg,i1 ^ i2,t->line);
+		if (i2 < 0 || i2 >= (clog_value_int)(sizeof(clog_value) * CHAR_BIT))
+			return NULL;
+		if (t->op == clog_opcode_LSH)
+			return clog_sccp_integer(cfg,(clog_value_int)((clog_value)i1 << i2),t->line);
+		return clog_sccp_integer(cfg,i1 >> i2,t->line);
+
+	default:
+		return NULL;
+	}
+}
+
+static void clog_sccp_lower(struct clog_sccp_context* ctx, unsigned int value, enum clog_sccp_state state, const struct clog_ast_literal* lit)
+{
+	if (state <= ctx->states[value])
+		return;
+
+	ctx->states[value] = (unsigned char)state;
+	ctx->consts[value] = lit;
+	ctx->value_work[ctx->value_top++] = value;
+}
+
+static void clog_sccp_mark_edge(struct clog_sccp_context* ctx, const struct clog_cfg_block* block, unsigned int which)
+{
+	unsigned int edge = block->rpo * 2 + which;
+	if (!ctx->edge_exec[edge])
+	{
+		ctx->edge_exec[edge] = 1;
+		ctx->edge_work[ctx->edge_top++] = edge;
+	}
+}
+
+static int clog_sccp_pred_exec(const struct clog_sccp_context* ctx, const struct clog_cfg_block* block, unsigned int pred)
+{
+	const struct clog_cfg_block* from = block->preds[pred];
+	return ctx->edge_exec[from->rpo * 2 + (from->branch == block ? 0 : 1)];
+}
+
+static int clog_sccp_visit(struct clog_sccp_context* ctx, struct clog_cfg_block* block, unsigned int item)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	const struct clog_ast_literal* args[2];
+	const struct clog_cfg_triplet* t;
+	unsigned int i;
+
+	if (!ctx->block_exec[block->rpo])
+		return 1;
+
+	if (item < block->phi_count)
+	{
+		const struct clog_cfg_phi* phi = &block->phis[item];
+		enum clog_sccp_state state = clog_sccp_top;
+		const struct clog_ast_literal* lit = NULL;
+
+		/* Only what arrives along edges that can be taken */
+		for (i = 0; i < block->pred_count && state != clog_sccp_bottom; ++i)
+		{
+			if (!clog_sccp_pred_exec(ctx,block,i))
+				continue;
+
+			if (phi->args[i] == CLOG_CFG_NONE || ctx->states[phi->args[i]] == clog_sccp_bottom)
+				state = clog_sccp_bottom;
+			else if (ctx->states[phi->args[i]] == clog_sccp_const)
+			{
+				if (state == clog_sccp_top)
+				{
+					state = clog_sccp_const;
+					lit = ctx->consts[phi->args[i]];
+				}
+				else if (!clog_sccp_literal_same(lit,ctx->consts[phi->args[i]]))
+					state = clog_sccp_bottom;
+			}
+		}
+
+		clog_sccp_lower(ctx,phi->dest,state,lit);
+		return 1;
+	}
+
+	item -= block->phi_count;
+	if (item == block->triplet_count)
+	{
+		/* The test */
+		if (block->cond == CLOG_CFG_NONE)
+		{
+			if (block->fallthru)
+				clog_sccp_mark_edge(ctx,block,1);
+		}
+		else if (ctx->states[block->cond] == clog_sccp_const)
+			clog_sccp_mark_edge(ctx,block,clog_cfg_literal_truth(ctx->consts[block->cond]) ? 0 : 1);
+		else if (ctx->states[block->cond] == clog_sccp_bottom)
+		{
+			clog_sccp_mark_edge(ctx,block,0);
+			clog_sccp_mark_edge(ctx,block,1);
+		}
+		return 1;
+	}
+
+	t = &block->triplets[item];
+	for (i = 0; i < 2; ++i)
+	{
+		args[i] = NULL;
+		if (t->op == clog_opcode_LOAD || t->val.args[i] == CLOG_CFG_NONE)
+			continue;
+
+		switch (ctx->states[t->val.args[i]])
+		{
+		case clog_sccp_top:
+			return 1;
+
+		case clog_sccp_bottom:
+			clog_sccp_lower(ctx,t->dest,clog_sccp_bottom,NULL);
+			return 1;
+
+		default:
+			args[i] = ctx->consts[t->val.args[i]];
+			break;
+		}
+	}
+
+	args[0] = clog_sccp_fold(cfg,t,args[0],args[1]);
+	if (!args[0])
+	{
+		if (cfg->parser->failed)
+			return 0;
+		clog_sccp_lower(ctx,t->dest,clog_sccp_bottom,NULL);
+	}
+	else
+		clog_sccp_lower(ctx,t->dest,clog_sccp_const,args[0]);
+
+	return 1;
+}
+
+static void clog_sccp_add_use(struct clog_sccp_context* ctx, unsigned int value, struct clog_cfg_block* block, unsigned int item, int fill)
+{
+	if (value == CLOG_CFG_NONE)
+		return;
+
+	if (!fill)
+		++ctx->use_start[value + 1];
+	else
+	{
+		struct clog_sccp_use* use = &ctx->uses[ctx->use_start[value]++];
+		use->block = block;
+		use->item = item;
+	}
+}
+
+/* Counts uses the first time round, then fills them in */
+static void clog_sccp_scan_uses(struct clog_sccp_context* ctx, int fill)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j, k;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			for (k = 0; k < block->pred_count; ++k)
+				clog_sccp_add_use(ctx,block->phis[j].args[k],block,j,fill);
+		}
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			if (block->triplets[j].op == clog_opcode_LOAD)
+				continue;
+
+			for (k = 0; k < 2; ++k)
+				clog_sccp_add_use(ctx,block->triplets[j].val.args[k],block,block->phi_count + j,fill);
+		}
+
+		clog_sccp_add_use(ctx,block->cond,block,block->phi_count + block->triplet_count,fill);
+	}
+}
+
+static int clog_sccp_propagate(struct clog_sccp_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j;
+
+	ctx->states = clog_sccp_alloc(ctx,cfg->value_count);
+	ctx->consts = clog_sccp_alloc(ctx,cfg->value_count * sizeof(const struct clog_ast_literal*));
+	ctx->use_start = clog_sccp_alloc(ctx,(cfg->value_count + 1) * sizeof(unsigned int));
+	ctx->block_exec = clog_sccp_alloc(ctx,cfg->block_count);
+	ctx->edge_exec = clog_sccp_alloc(ctx,cfg->block_count * 2);
+	ctx->edge_work = clog_sccp_alloc(ctx,cfg->block_count * 2 * sizeof(unsigned int));
+	ctx->value_work = clog_sccp_alloc(ctx,cfg->value_count * 2 * sizeof(unsigned int));
+	if (!ctx->states || !ctx->consts || !ctx->use_start || !ctx->block_exec || !ctx->edge_exec || !ctx->edge_work || !ctx->value_work)
+		return 0;
+
+	/* Def-use chains, packed by value */
+	clog_sccp_scan_uses(ctx,0);
+	for (i = 0; i < cfg->value_count; ++i)
+		ctx->use_start[i + 1] += ctx->use_start[i];
+
+	ctx->uses = clog_sccp_alloc(ctx,ctx->use_start[cfg->value_count] * sizeof(struct clog_sccp_use));
+	if (!ctx->uses)
+		return 0;
+
+	/* Filling moves each start up to the next, so they end up one value along */
+	clog_sccp_scan_uses(ctx,1);
+	for (i = cfg->value_count; i > 0; --i)
+		ctx->use_start[i] = ctx->use_start[i - 1];
+	ctx->use_start[0] = 0;
+
+	/* Entry first, as if reached by an edge */
+	ctx->block_exec[0] = 1;
+	for (i = 0; i <= cfg->entry->phi_count + cfg->entry->triplet_count; ++i)
+	{
+		if (!clog_sccp_visit(ctx,cfg->entry,i))
+			return 0;
+	}
+
+	while (ctx->edge_top || ctx->value_top)
+	{
+		if (ctx->edge_top)
+		{
+			unsigned int edge = ctx->edge_work[--ctx->edge_top];
+			struct clog_cfg_block* from = cfg->blocks[edge / 2];
+			struct clog_cfg_block* block = (edge & 1 ? from->fallthru : from->branch);
+
+			if (ctx->block_exec[block->rpo])
+			{
+				/* Only the phis can see the new edge */
+				for (j = 0; j < block->phi_count; ++j)
+				{
+					if (!clog_sccp_visit(ctx,block,j))
+						return 0;
+				}
+			}
+			else
+			{
+				ctx->block_exec[block->rpo] = 1;
+				for (j = 0; j <= block->phi_count + block->triplet_count; ++j)
+				{
+					if (!clog_sccp_visit(ctx,block,j))
+						return 0;
+				}
+			}
+		}
+		else
+		{
+			unsigned int value = ctx->value_work[--ctx->value_top];
+			for (j = ctx->use_start[value]; j < ctx->use_start[value + 1]; ++j)
+			{
+				if (!clog_sccp_visit(ctx,ctx->uses[j].block,ctx->uses[j].item))
+					return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Turns constant values into loads and fixes the tests that are known */
+static int clog_sccp_rewrite(struct clog_sccp_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+		unsigned int phi_count = 0;
+		unsigned int loads = 0;
+
+		if (!ctx->block_exec[i])
+			continue;
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			if (ctx->states[block->phis[j].dest] == clog_sccp_const)
+				++loads;
+		}
+
+		if (loads)
+		{
+			/* Constant phis become loads at the top of the block */
+			if (block->triplet_count + loads > block->triplet_alloc)
+			{
+				unsigned int new_size = block->triplet_count + loads;
+				struct clog_cfg_triplet* new = clog_realloc(&cfg->parser->allocator,block->triplets,new_size * sizeof(struct clog_cfg_triplet));
+				if (!new)
+				{
+					clog_cfg_out_of_memory(cfg->parser);
+					return 0;
+				}
+
+				block->triplet_alloc = new_size;
+				block->triplets = new;
+			}
+
+			memmove(block->triplets + loads,block->triplets,block->triplet_count * sizeof(struct clog_cfg_triplet));
+			block->triplet_count += loads;
+			loads = 0;
+
+			for (j = 0; j < block->phi_count; ++j)
+			{
+				if (ctx->states[block->phis[j].dest] == clog_sccp_const)
+				{
+					struct clog_cfg_triplet* t = &block->triplets[loads++];
+					t->op = clog_opcode_LOAD;
+					t->dest = block->phis[j].dest;
+					t->val.lit = ctx->consts[t->dest];
+					t->line = t->val.lit->line;
+				}
+				else
+					block->phis[phi_count++] = block->phis[j];
+			}
+			block->phi_count = phi_count;
+		}
+
+		for (j = loads; j < block->triplet_count; ++j)
+		{
+			struct clog_cfg_triplet* t = &block->triplets[j];
+			if (t->op != clog_opcode_LOAD && ctx->states[t->dest] == clog_sccp_const)
+			{
+				t->op = clog_opcode_LOAD;
+				t->val.lit = ctx->consts[t->dest];
+			}
+		}
+
+		if (block->cond != CLOG_CFG_NONE && ctx->states[block->cond] == clog_sccp_const)
+		{
+			if (clog_cfg_literal_truth(ctx->consts[block->cond]))
+				block->fallthru = block->branch;
+			block->branch = NULL;
+			block->cond = CLOG_CFG_NONE;
+		}
+	}
+
+	return 1;
+}
+
+/* Renumbering drops the blocks nothing reaches any more, the phis keep the arguments of the preds that are left */
+static int clog_sccp_renumber(struct clog_sccp_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int old_count = cfg->block_count;
+	struct clog_cfg_block** old_blocks;
+	struct clog_cfg_block*** old_preds;
+	unsigned int* old_pred_counts;
+	unsigned int i, j, k, p;
+
+	old_blocks = clog_sccp_alloc(ctx,old_count * sizeof(struct clog_cfg_block*));
+	old_preds = clog_sccp_alloc(ctx,old_count * sizeof(struct clog_cfg_block**));
+	old_pred_counts = clog_sccp_alloc(ctx,old_count * sizeof(unsigned int));
+	if (!old_blocks || !old_preds || !old_pred_counts)
+		return 0;
+
+	/* The old lists stay in the arena */
+	for (i = 0; i < old_count; ++i)
+	{
+		old_blocks[i] = cfg->blocks[i];
+		old_preds[i] = cfg->blocks[i]->preds;
+		old_pred_counts[i] = cfg->blocks[i]->pred_count;
+	}
+
+	if (!clog_cfg_number(cfg))
+		return 0;
+
+	for (i = 0; i < old_count; ++i)
+	{
+		struct clog_cfg_block* block = old_blocks[i];
+		if (block->rpo == CLOG_CFG_NONE || !block->phi_count)
+			continue;
+
+		/* Same preds in the same order keeps the same columns */
+		if (block->pred_count == old_pred_counts[i] && memcmp(block->preds,old_preds[i],block->pred_count * sizeof(struct clog_cfg_block*)) == 0)
+			continue;
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			unsigned int* args = clog_arena_alloc(&cfg->arena,(block->pred_count ? block->pred_count : 1) * sizeof(unsigned int));
+			if (!args)
+			{
+				clog_cfg_out_of_memory(cfg->parser);
+				return 0;
+			}
+
+			for (k = 0; k < block->pred_count; ++k)
+			{
+				args[k] = CLOG_CFG_NONE;
+				for (p = 0; p < old_pred_counts[i]; ++p)
+				{
+					if (old_preds[i][p] == block->preds[k])
+					{
+						args[k] = block->phis[j].args[p];
+						break;
+					}
+				}
+			}
+			block->phis[j].args = args;
+		}
+	}
+
+	return 1;
+}
+
+static int clog_sccp_pure(enum clog_opcode op)
+{
+	/* Ops that can't fail at run time, so nobody can tell if they are left out */
+	switch (op)
+	{
+	case clog_opcode_LOAD:
+	case clog_opcode_MOV:
+	case clog_opcode_NOT:
+	case clog_opcode_BOOL:
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* Removes values that are never read, and then whatever only they read */
+static int clog_sccp_dead_code(struct clog_sccp_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int* counts;
+	struct clog_sccp_def* defs;
+	unsigned char* dead;
+	unsigned int top = 0;
+	unsigned int i, j, k;
+
+	counts = clog_sccp_alloc(ctx,cfg->value_count * sizeof(unsigned int));
+	defs = clog_sccp_alloc(ctx,cfg->value_count * sizeof(struct clog_sccp_def));
+	dead = clog_sccp_alloc(ctx,cfg->value_count);
+	if (!counts || !defs || !dead)
+		return 0;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			defs[block->phis[j].dest].block = block;
+			defs[block->phis[j].dest].item = j;
+			for (k = 0; k < block->pred_count; ++k)
+			{
+				if (block->phis[j].args[k] != CLOG_CFG_NONE)
+					++counts[block->phis[j].args[k]];
+			}
+		}
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			defs[t->dest].block = block;
+			defs[t->dest].item = block->phi_count + j;
+			for (k = 0; k < 2; ++k)
+			{
+				if (t->op != clog_opcode_LOAD && t->val.args[k] != CLOG_CFG_NONE)
+					++counts[t->val.args[k]];
+			}
+		}
+
+		if (block->cond != CLOG_CFG_NONE)
+			++counts[block->cond];
+		if (block->ret != CLOG_CFG_NONE)
+			++counts[block->ret];
+	}
+
+	/* The propagation worklist is big enough to reuse, each value goes on once at most */
+	for (i = 0; i < cfg->value_count; ++i)
+	{
+		if (defs[i].block && !counts[i])
+			ctx->value_work[top++] = i;
+	}
+
+	while (top)
+	{
+		unsigned int value = ctx->value_work[--top];
+		struct clog_cfg_block* block = defs[value].block;
+		unsigned int item = defs[value].item;
+
+		if (item < block->phi_count)
+		{
+			dead[value] = 1;
+			for (k = 0; k < block->pred_count; ++k)
+			{
+				unsigned int arg = block->phis[item].args[k];
+				if (arg != CLOG_CFG_NONE && --counts[arg] == 0 && !dead[arg])
+					ctx->value_work[top++] = arg;
+			}
+		}
+		else
+		{
+			const struct clog_cfg_triplet* t = &block->triplets[item - block->phi_count];
+			if (!clog_sccp_pure(t->op))
+				continue;
+
+			dead[value] = 1;
+			for (k = 0; k < 2; ++k)
+			{
+				if (t->op != clog_opcode_LOAD && t->val.args[k] != CLOG_CFG_NONE && --counts[t->val.args[k]] == 0 && !dead[t->val.args[k]])
+					ctx->value_work[top++] = t->val.args[k];
+			}
+		}
+	}
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+		unsigned int count = 0;
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			if (!dead[block->phis[j].dest])
+				block->phis[count++] = block->phis[j];
+		}
+		block->phi_count = count;
+
+		count = 0;
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			if (!dead[block->triplets[j].dest])
+				block->triplets[count++] = block->triplets[j];
+		}
+		block->triplet_count = count;
+	}
+
+	return 1;
+}
+
+static unsigned int clog_sccp_map(unsigned int* map, unsigned int* count, unsigned int value)
+{
+	if (value == CLOG_CFG_NONE)
+		return value;
+
+	if (map[value] == CLOG_CFG_NONE)
+		map[value] = (*count)++;
+
+	return map[value];
+}
+
+/* Numbers the values that are left densely, in block order, so passes after this one
+ * size their tables by what survived rather than by everything the lowering made */
+static int clog_sccp_compact(struct clog_sccp_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	struct clog_cfg_value* old_values;
+	unsigned int* map;
+	unsigned int count = 0;
+	unsigned int i, j, k;
+
+	old_values = clog_sccp_alloc(ctx,cfg->value_count * sizeof(struct clog_cfg_value));
+	map = clog_sccp_alloc(ctx,cfg->value_count * sizeof(unsigned int));
+	if (!old_values || !map)
+		return 0;
+
+	if (cfg->value_count)
+		memcpy(old_values,cfg->values,cfg->value_count * sizeof(struct clog_cfg_value));
+	for (i = 0; i < cfg->value_count; ++i)
+		map[i] = CLOG_CFG_NONE;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			block->phis[j].dest = clog_sccp_map(map,&count,block->phis[j].dest);
+			for (k = 0; k < block->pred_count; ++k)
+				block->phis[j].args[k] = clog_sccp_map(map,&count,block->phis[j].args[k]);
+		}
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			struct clog_cfg_triplet* t = &block->triplets[j];
+			t->dest = clog_sccp_map(map,&count,t->dest);
+			if (t->op != clog_opcode_LOAD)
+			{
+				t->val.args[0] = clog_sccp_map(map,&count,t->val.args[0]);
+				t->val.args[1] = clog_sccp_map(map,&count,t->val.args[1]);
+			}
+		}
+
+		block->cond = clog_sccp_map(map,&count,block->cond);
+		block->ret = clog_sccp_map(map,&count,block->ret);
+	}
+
+	for (i = 0; i < cfg->value_count; ++i)
+	{
+		if (map[i] != CLOG_CFG_NONE)
+			cfg->values[map[i]] = old_values[i];
+	}
+	cfg->value_count = count;
+
+	return 1;
+}
+
+int clog_cfg_sccp(struct clog_cfg* cfg)
+{
+	struct clog_sccp_context ctx;
+	int ok;
+
+	memset(&ctx,0,sizeof(ctx));
+	ctx.cfg = cfg;
+	ctx.arena.allocator = &cfg->parser->allocator;
+
+	ok = (clog_sccp_propagate(&ctx) &&
+			clog_sccp_rewrite(&ctx) &&
+			clog_sccp_renumber(&ctx) &&
+			clog_sccp_dead_code(&ctx) &&
+			clog_sccp_compact(&ctx));
+
+	if (ok)
+		clog_cfg_dominators(cfg);
+
+	clog_arena_free(&ctx.arena);
+
+	return ok;
+}
@@ -0,0 +1,514 @@
+/*
+ * clog_cfg_ssa.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_cfg.h"
+
+#include <string.h>
+
+struct clog_ssa_list
+{
+	struct clog_cfg_block* block;
+	struct clog_ssa_list*  next;
+};
+
+struct clog_ssa_undo
+{
+	unsigned int var;
+	unsigned int value;
+};
+
+/* Everything here is only needed while building, and goes in one release */
+struct clog_ssa_context
+{
+	struct clog_cfg*   cfg;
+	struct clog_arena  arena;
+
+	/* By rpo */
+	struct clog_ssa_list** frontiers;
+
+	/* By var */
+	struct clog_ssa_list** def_sites;
+	struct clog_ssa_list** use_sites;
+	unsigned int*          var_values;
+};
+
+static void* clog_ssa_alloc(struct clog_ssa_context* ctx, size_t s)
+{
+	void* p = clog_arena_alloc(&ctx->arena,s);
+	if (!p)
+		clog_cfg_out_of_memory(ctx->cfg->parser);
+	else
+		memset(p,0,s);
+
+	return p;
+}
+
+static struct clog_cfg_block* clog_ssa_intersect(struct clog_cfg_block* b1, struct clog_cfg_block* b2)
+{
+	while (b1 != b2)
+	{
+		while (b1->rpo > b2->rpo)
+			b1 = b1->idom;
+		while (b2->rpo > b1->rpo)
+			b2 = b2->idom;
+	}
+	return b1;
+}
+
+/* Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm" */
+void clog_cfg_dominators(struct clog_cfg* cfg)
+{
+	unsigned int i, j;
+	int changed = 1;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		cfg->blocks[i]->idom = NULL;
+		cfg->blocks[i]->dom_child = NULL;
+		cfg->blocks[i]->dom_sibling = NULL;
+	}
+
+	cfg->entry->idom = cfg->entry;
+	while (changed)
+	{
+		changed = 0;
+		for (i = 1; i < cfg->block_count; ++i)
+		{
+			struct clog_cfg_block* block = cfg->blocks[i];
+			struct clog_cfg_block* idom = NULL;
+
+			for (j = 0; j < block->pred_count; ++j)
+			{
+				if (block->preds[j]->idom)
+					idom = (idom ? clog_ssa_intersect(block->preds[j],idom) : block->preds[j]);
+			}
+
+			if (block->idom != idom)
+			{
+				block->idom = idom;
+				changed = 1;
+			}
+		}
+	}
+
+	/* Backwards, so each list of children comes out in rpo */
+	for (i = cfg->block_count; i-- > 1;)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+		block->dom_sibling = block->idom->dom_child;
+		block->idom->dom_child = block;
+	}
+
+	cfg->entry->idom = NULL;
+}
+
+static int clog_ssa_frontiers(struct clog_ssa_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+		if (block->pred_count < 2)
+			continue;
+
+		for (j = 0; j < block->pred_count; ++j)
+		{
+			struct clog_cfg_block* runner = block->preds[j];
+			while (runner != block->idom)
+			{
+				struct clog_ssa_list* item;
+
+				/* Already walked from another pred, and so were the blocks above it */
+				if (ctx->frontiers[runner->rpo] && ctx->frontiers[runner->rpo]->block == block)
+					break;
+
+				item = clog_ssa_alloc(ctx,sizeof(struct clog_ssa_list));
+				if (!item)
+					return 0;
+
+				item->block = block;
+				item->next = ctx->frontiers[runner->rpo];
+				ctx->frontiers[runner->rpo] = item;
+
+				runner = runner->idom;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Lists a block once, the blocks are scanned in order so a repeat is always at the head */
+static int clog_ssa_add_site(struct clog_ssa_context* ctx, struct clog_ssa_list** sites, struct clog_cfg_block* block)
+{
+	struct clog_ssa_list* item;
+	if (*sites && (*sites)->block == block)
+		return 1;
+
+	item = clog_ssa_alloc(ctx,sizeof(struct clog_ssa_list));
+	if (!item)
+		return 0;
+
+	item->block = block;
+	item->next = *sites;
+	*sites = item;
+	return 1;
+}
+
+static int clog_ssa_use(struct clog_ssa_context* ctx, struct clog_cfg_block* block, unsigned int value)
+{
+	unsigned int var;
+	if (value == CLOG_CFG_NONE)
+		return 1;
+
+	/* Only a read before any write in the block makes the var live on the way in */
+	var = ctx->cfg->values[value].var;
+	if (var == CLOG_CFG_NONE || (ctx->def_sites[var] && ctx->def_sites[var]->block == block))
+		return 1;
+
+	return clog_ssa_add_site(ctx,&ctx->use_sites[var],block);
+}
+
+/* Which blocks write each var, and which read it before writing it */
+static int clog_ssa_sites(struct clog_ssa_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j;
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			unsigned int var;
+
+			if (t->op != clog_opcode_LOAD && (!clog_ssa_use(ctx,block,t->val.args[0]) || !clog_ssa_use(ctx,block,t->val.args[1])))
+				return 0;
+
+			var = cfg->values[t->dest].var;
+			if (var != CLOG_CFG_NONE && !clog_ssa_add_site(ctx,&ctx->def_sites[var],block))
+				return 0;
+		}
+
+		if (!clog_ssa_use(ctx,block,block->cond) || !clog_ssa_use(ctx,block,block->ret))
+			return 0;
+	}
+
+	return 1;
+}
+
+static int clog_ssa_add_phi(struct clog_cfg* cfg, struct clog_cfg_block* block, unsigned int var)
+{
+	struct clog_cfg_phi* phi;
+	unsigned int i;
+
+	if (block->phi_count == block->phi_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (block->phi_alloc == 0 ? 4 : block->phi_alloc * 2);
+		struct clog_cfg_phi* new = clog_realloc(&cfg->parser->allocator,block->phis,new_size * sizeof(struct clog_cfg_phi));
+		if (!new)
+		{
+			clog_cfg_out_of_memory(cfg->parser);
+			return 0;
+		}
+
+		block->phi_alloc = new_size;
+		block->phis = new;
+	}
+
+	phi = &block->phis[block->phi_count];
+	phi->var = var;
+	phi->dest = CLOG_CFG_NONE;
+	phi->args = clog_arena_alloc(&cfg->arena,block->pred_count * sizeof(unsigned int));
+	if (!phi->args)
+	{
+		clog_cfg_out_of_memory(cfg->parser);
+		return 0;
+	}
+
+	for (i = 0; i < block->pred_count; ++i)
+		phi->args[i] = CLOG_CFG_NONE;
+
+	++block->phi_count;
+	return 1;
+}
+
+/* Cytron et al., with a phi only where the var is live.
+ * Each var's liveness is found by walking back from its reads until its writes,
+ * so the work follows the var's live range rather than the whole graph */
+static int clog_ssa_place_phis(struct clog_ssa_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	struct clog_cfg_block** worklist;
+	unsigned int* has_phi;
+	unsigned int* work;
+	unsigned int* live_in;
+	unsigned int* defined;
+	unsigned int var, i;
+
+	worklist = clog_ssa_alloc(ctx,cfg->block_count * sizeof(struct clog_cfg_block*));
+	has_phi = clog_ssa_alloc(ctx,cfg->block_count * sizeof(unsigned int));
+	work = clog_ssa_alloc(ctx,cfg->block_count * sizeof(unsigned int));
+	live_in = clog_ssa_alloc(ctx,cfg->block_count * sizeof(unsigned int));
+	defined = clog_ssa_alloc(ctx,cfg->block_count * sizeof(unsigned int));
+	if (!worklist || !has_phi || !work || !live_in || !defined)
+		return 0;
+
+	/* Stamped with var + 1, so nothing needs clearing between vars */
+	for (var = 0; var < cfg->var_count; ++var)
+	{
+		struct clog_ssa_list* item;
+		unsigned int top = 0;
+
+		for (item = ctx->def_sites[var]; item; item = item->next)
+			defined[item->block->rpo] = var + 1;
+
+		for (item = ctx->use_sites[var]; item; item = item->next)
+		{
+			live_in[item->block->rpo] = var + 1;
+			worklist[top++] = item->block;
+		}
+
+		/* Live out of every pred, and so in too unless the pred writes it first */
+		while (top)
+		{
+			struct clog_cfg_block* block = worklist[--top];
+			for (i = 0; i < block->pred_count; ++i)
+			{
+				unsigned int rpo = block->preds[i]->rpo;
+				if (live_in[rpo] != var + 1 && defined[rpo] != var + 1)
+				{
+					live_in[rpo] = var + 1;
+					worklist[top++] = block->preds[i];
+				}
+			}
+		}
+
+		for (item = ctx->def_sites[var]; item; item = item->next)
+		{
+			work[item->block->rpo] = var + 1;
+			worklist[top++] = item->block;
+		}
+
+		while (top)
+		{
+			struct clog_cfg_block* block = worklist[--top];
+			for (item = ctx->frontiers[block->rpo]; item; item = item->next)
+			{
+				unsigned int rpo = item->block->rpo;
+				if (has_phi[rpo] == var + 1 || live_in[rpo] != var + 1)
+					continue;
+
+				has_phi[rpo] = var + 1;
+				if (!clog_ssa_add_phi(cfg,item->block,var))
+					return 0;
+
+				if (work[rpo] != var + 1)
+				{
+					work[rpo] = var + 1;
+					worklist[top++] = item->block;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+static unsigned int clog_ssa_resolve(struct clog_cfg* cfg, const unsigned int* current, const unsigned int* copies, unsigned int value_limit, unsigned int value)
+{
+	if (value == CLOG_CFG_NONE || value >= value_limit)
+		return value;
+
+	if (cfg->values[value].var != CLOG_CFG_NONE)
+		return current[cfg->values[value].var];
+
+	if (copies[value] != CLOG_CFG_NONE)
+		return copies[value];
+
+	return value;
+}
+
+/* Walks the dominator tree giving every write of a var a value of its own.
+ * Reads of a var were always copied into a temporary, so those copies become aliases and go,
+ * as do copies into a var, which just make the var mean the copied value from there on */
+static int clog_ssa_rename(struct clog_ssa_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int value_limit = cfg->value_count;
+	struct clog_ssa_undo* undo;
+	unsigned int undo_count = 0;
+	unsigned int undo_alloc = 0;
+	unsigned int* current;
+	unsigned int* copies;
+	struct clog_cfg_block** stack;
+	unsigned int* marks;
+	unsigned int top = 0;
+	unsigned int i, j, k;
+
+	for (i = 0; i < cfg->block_count; ++i)
+		undo_alloc += cfg->blocks[i]->phi_count + cfg->blocks[i]->triplet_count;
+
+	undo = clog_ssa_alloc(ctx,(undo_alloc ? undo_alloc : 1) * sizeof(struct clog_ssa_undo));
+	current = clog_ssa_alloc(ctx,(cfg->var_count ? cfg->var_count : 1) * sizeof(unsigned int));
+	copies = clog_ssa_alloc(ctx,(value_limit ? value_limit : 1) * sizeof(unsigned int));
+	stack = clog_ssa_alloc(ctx,cfg->block_count * sizeof(struct clog_cfg_block*));
+	marks = clog_ssa_alloc(ctx,cfg->block_count * sizeof(unsigned int));
+	if (!undo || !current || !copies || !stack || !marks)
+		return 0;
+
+	for (i = 0; i < cfg->var_count; ++i)
+		current[i] = CLOG_CFG_NONE;
+	for (i = 0; i < value_limit; ++i)
+		copies[i] = CLOG_CFG_NONE;
+
+	/* A block stays on the stack until its dominator subtree is done, marks[] says where its undo starts */
+	marks[0] = CLOG_CFG_NONE;
+	stack[top++] = cfg->entry;
+	while (top)
+	{
+		struct clog_cfg_block* block = stack[top-1];
+		struct clog_cfg_block* succs[2];
+		struct clog_cfg_block* child;
+		unsigned int count = 0;
+
+		if (marks[top-1] != CLOG_CFG_NONE)
+		{
+			/* Done with everything it dominates */
+			while (undo_count > marks[top-1])
+			{
+				--undo_count;
+				current[undo[undo_count].var] = undo[undo_count].value;
+			}
+			--top;
+			continue;
+		}
+
+		marks[top-1] = undo_count;
+
+		for (i = 0; i < block->phi_count; ++i)
+		{
+			struct clog_cfg_phi* phi = &block->phis[i];
+			phi->dest = clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,cfg->values[ctx->var_values[phi->var]].id);
+			if (phi->dest == CLOG_CFG_NONE)
+				return 0;
+
+			undo[undo_count].var = phi->var;
+			undo[undo_count++].value = current[phi->var];
+			current[phi->var] = phi->dest;
+		}
+
+		for (i = 0; i < block->triplet_count; ++i)
+		{
+			struct clog_cfg_triplet t = block->triplets[i];
+			unsigned int var = cfg->values[t.dest].var;
+
+			if (t.op != clog_opcode_LOAD)
+			{
+				t.val.args[0] = clog_ssa_resolve(cfg,current,copies,value_limit,t.val.args[0]);
+				t.val.args[1] = clog_ssa_resolve(cfg,current,copies,value_limit,t.val.args[1]);
+			}
+
+			if (var != CLOG_CFG_NONE)
+			{
+				undo[undo_count].var = var;
+				undo[undo_count++].value = current[var];
+
+				if (t.op == clog_opcode_MOV)
+				{
+					current[var] = t.val.args[0];
+					continue;
+				}
+
+				t.dest = clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,cfg->values[t.dest].id);
+				if (t.dest == CLOG_CFG_NONE)
+					return 0;
+
+				current[var] = t.dest;
+			}
+			else if (t.op == clog_opcode_MOV)
+			{
+				copies[t.dest] = t.val.args[0];
+				continue;
+			}
+
+			block->triplets[count++] = t;
+		}
+		block->triplet_count = count;
+
+		block->cond = clog_ssa_resolve(cfg,current,copies,value_limit,block->cond);
+		block->ret = clog_ssa_resolve(cfg,current,copies,value_limit,block->ret);
+
+		/* This block's column of each successor's phis */
+		succs[0] = block->branch;
+		succs[1] = block->fallthru;
+		for (i = 0; i < 2; ++i)
+		{
+			if (!succs[i])
+				continue;
+
+			for (j = 0; j < succs[i]->pred_count && succs[i]->preds[j] != block; ++j)
+				;
+
+			for (k = 0; k < succs[i]->phi_count; ++k)
+				succs[i]->phis[k].args[j] = current[succs[i]->phis[k].var];
+		}
+
+		for (child = block->dom_child; child; child = child->dom_sibling)
+		{
+			marks[top] = CLOG_CFG_NONE;
+			stack[top++] = child;
+		}
+	}
+
+	/* The vars are all gone */
+	for (i = 0; i < value_limit; ++i)
+		cfg->values[i].var = CLOG_CFG_NONE;
+	cfg->var_count = 0;
+
+	return 1;
+}
+
+int clog_cfg_ssa(struct clog_cfg* cfg)
+{
+	struct clog_ssa_context ctx;
+	unsigned int i;
+	int ok = 0;
+
+	memset(&ctx,0,sizeof(ctx));
+	ctx.cfg = cfg;
+	ctx.arena.allocator = &cfg->parser->allocator;
+
+	ctx.frontiers = clog_ssa_alloc(&ctx,cfg->block_count * sizeof(struct clog_ssa_list*));
+	ctx.def_sites = clog_ssa_alloc(&ctx,(cfg->var_count ? cfg->var_count : 1) * sizeof(struct clog_ssa_list*));
+	ctx.use_sites = clog_ssa_alloc(&ctx,(cfg->var_count ? cfg->var_count : 1) * sizeof(struct clog_ssa_list*));
+	ctx.var_values = clog_ssa_alloc(&ctx,(cfg->var_count ? cfg->var_count : 1) * sizeof(unsigned int));
+
+	if (ctx.frontiers && ctx.def_sites && ctx.use_sites && ctx.var_values)
+	{
+		for (i = 0; i < cfg->value_count; ++i)
+		{
+			if (cfg->values[i].var != CLOG_CFG_NONE)
+				ctx.var_values[cfg->values[i].var] = i;
+		}
+
+		clog_cfg_dominators(cfg);
+
+		ok = (clog_ssa_frontiers(&ctx) &&
+				clog_ssa_sites(&ctx) &&
+				clog_ssa_place_phis(&ctx) &&
+				clog_ssa_rename(&ctx));
+	}
+
+	clog_arena_free(&ctx.arena);
+
+	return ok;
+}
@@ -5,663 +5,940 @@
  *      Author: rick
  */
 
-#include "clog_ast.h"
-#include "clog_parser.h"
-#include "clog_opcodes.h"
+#include "clog_codegen.h"
 
 #include <string.h>
 #include <stdio.h>
 
-#define CLOG_CG_ERROR -1
+#define CLOG_CG_BITS        (sizeof(unsigned long) * 8)
+#define CLOG_CG_WORDS(n)    (((n) + CLOG_CG_BITS - 1) / CLOG_CG_BITS)
+#define CLOG_CG_TEST(set,i) ((set)[(i) / CLOG_CG_BITS] & (1UL << ((i) % CLOG_CG_BITS)))
+#define CLOG_CG_SET(set,i)  ((set)[(i) / CLOG_CG_BITS] |= (1UL << ((i) % CLOG_CG_BITS)))
 
-struct clog_cg_triplet;
-
-struct clog_cg_register
+/* Live interval of a value, in positions, and the VM register it was given */
+struct clog_cg_interval
 {
-	struct clog_cg_triplet* prev;
-	struct clog_cg_triplet* next;
-	unsigned int refcount;
+	unsigned int start;
+	unsigned int end;
+	unsigned int reg;
 };
 
-struct clog_cg_block;
-
-struct clog_cg_triplet
+/* A block's test fused into a compare immediate, cond is then the value compared */
+struct clog_cg_test
 {
-	enum
-	{
-		clog_cg_triplet_expr,
-		clog_cg_triplet_jmp,
-		clog_cg_triplet_phi,
-	} type;
-
 	enum clog_opcode op;
-
-	union clog_cg_triplet_u0
-	{
-		struct clog_cg_triplet_expr
-		{
-			struct clog_cg_register* result;
-			union clog_cg_triplet_u1
-			{
-				unsigned int reg[2];
-				const struct clog_ast_literal* lit;
-			} expr;
-		} expr;
-		struct clog_cg_block* jmp;
-		struct clog_cg_triplet_phi
-		{
-			unsigned int regs[2];
-		} phi;
-	} val;
+	long             imm;
+	int              negate;
+	unsigned long    line;
 };
 
-struct clog_cg_block_register
+/* A jump emitted before its target's address is known */
+struct clog_cg_fixup
 {
-	struct clog_ast_literal* id;
-	struct clog_cg_triplet* first;
-	struct clog_cg_triplet* last;
+	unsigned int           pc;
+	enum clog_opcode       op;
+	unsigned int           reg;
+	struct clog_cfg_block* target;
 };
 
-struct clog_cg_block
+/* Everything here is only needed while generating, and goes in one release */
+struct clog_cg_context
 {
-	struct clog_cg_block* next;
-	struct clog_cg_block* prev;
-
-	struct clog_cg_triplet** triplets;
-	unsigned int triplet_count;
-	unsigned int triplet_alloc;
-
-	struct clog_cg_block_register* registers;
-	unsigned int register_count;
-	unsigned int register_alloc;
-
-	unsigned int temp_counter;
+	struct clog_cfg*           cfg;
+	struct clog_parser*        parser;
+	struct clog_image_builder* builder;
+	struct clog_arena          arena;
+	unsigned int               words;
+
+	/* Blocks in emission order */
+	struct clog_cfg_block** order;
+
+	/* By rpo */
+	unsigned long** live_in;
+	unsigned long** live_out;
+	unsigned int*   pcs;
+
+	/* By value */
+	struct clog_cg_interval* intervals;
+	unsigned int             positions;
+	long*                    imms;
+
+	/* Values from here on are phi copies, written in more than one place */
+	unsigned int copies;
+
+	/* By rpo */
+	struct clog_cg_test* tests;
+
+	struct clog_cg_fixup* fixups;
+	unsigned int          fixup_count;
+	unsigned int          fixup_alloc;
 };
 
-static unsigned int clog_cg_out_of_memory()
+static int clog_cg_out_of_memory(struct clog_parser* parser)
 {
-	printf("Out of memory during code generation\n");
-	return CLOG_CG_ERROR;
+	clog_diagnostic(parser,0,"Out of memory during code generation");
+	parser->failed = 1;
+	return 0;
 }
 
-static unsigned int clog_cg_error(const char* part1, const unsigned char* part2, unsigned long line)
+static int clog_cg_error(struct clog_parser* parser, const char* msg, unsigned long line)
 {
-	printf("Error: %s",part1);
-	if (part2)
-		printf("%s",part2);
-
-	printf(" at line %lu\n",line);
-	return CLOG_CG_ERROR;
+	char buf[256];
+	sprintf(buf,"Error: %.128s at line %lu",msg,line);
+	clog_diagnostic(parser,line,buf);
+	parser->failed = 1;
+	return 0;
 }
 
-static void clog_cg_warning(const char* part1, const unsigned char* part2, unsigned long line)
+static void* clog_cg_alloc(struct clog_cg_context* ctx, size_t s)
 {
-	printf("Warning: %s",part1);
-	if (part2)
-		printf("%s",part2);
+	void* p = clog_arena_alloc(&ctx->arena,s);
+	if (!p)
+		clog_cg_out_of_memory(ctx->parser);
+	else
+		memset(p,0,s);
 
-	printf(" at line %lu\n",line);
+	return p;
 }
 
-static int clog_cg_alloc_triplet(struct clog_cg_block* block, struct clog_cg_triplet** triplet)
+static unsigned long** clog_cg_alloc_sets(struct clog_cg_context* ctx)
 {
-	struct clog_cg_triplet* new_triplet = clog_malloc(sizeof(struct clog_cg_triplet));
-	if (!new_triplet)
+	unsigned long** sets = clog_cg_alloc(ctx,ctx->cfg->block_count * sizeof(unsigned long*));
+	unsigned int i;
+	for (i = 0; sets && i < ctx->cfg->block_count; ++i)
 	{
-		clog_cg_out_of_memory();
-		return 0;
+		/* Never zero length, so NULL always means out of memory */
+		sets[i] = clog_cg_alloc(ctx,(ctx->words + 1) * sizeof(unsigned long));
+		if (!sets[i])
+			return NULL;
 	}
+	return sets;
+}
 
-	memset(new_triplet,0,sizeof(struct clog_cg_triplet));
+/* Each phi gets a fresh value, copied into at the end of every predecessor and out of
+ * at the start of the block. The copies in are dead along any other edge out of a
+ * predecessor, so critical edges don't need splitting, and as every phi reads its own
+ * copy the phis of a block never overwrite each other's arguments */
+static int clog_cg_out_of_ssa(struct clog_cg_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i, j, k;
 
-	if (block->triplet_count == block->triplet_alloc)
+	for (i = 0; i < cfg->block_count; ++i)
 	{
-		/* Resize array */
-		unsigned int new_size = (block->triplet_alloc == 0 ? 4 : block->triplet_alloc * 2);
-		struct clog_cg_triplet** new = clog_realloc(block->triplets,new_size * sizeof(struct clog_cg_triplet*));
-		if (!new)
+		struct clog_cfg_block* block = cfg->blocks[i];
+		struct clog_cfg_triplet* triplets;
+		unsigned int first = cfg->value_count;
+
+		if (!block->phi_count)
+			continue;
+
+		for (j = 0; j < block->phi_count; ++j)
 		{
-			clog_cg_out_of_memory();
-			return 0;
+			const struct clog_cfg_phi* phi = &block->phis[j];
+
+			/* Values are numbered consecutively, so the copy of phi j is first + j */
+			unsigned int tmp = clog_cfg_alloc_value(cfg,CLOG_CFG_NONE,cfg->values[phi->dest].id);
+			if (tmp == CLOG_CFG_NONE)
+				return 0;
+
+			for (k = 0; k < block->pred_count; ++k)
+			{
+				struct clog_cfg_triplet* t;
+				if (phi->args[k] == CLOG_CFG_NONE)
+				{
+					/* Never assigned along this edge */
+					const struct clog_ast_literal* lit = clog_cfg_literal(cfg,clog_ast_literal_null,0,0);
+					t = (lit ? clog_cfg_append_triplet(cfg,block->preds[k],clog_opcode_LOAD,tmp,0) : NULL);
+					if (t)
+						t->val.lit = lit;
+				}
+				else
+				{
+					t = clog_cfg_append_triplet(cfg,block->preds[k],clog_opcode_MOV,tmp,0);
+					if (t)
+						t->val.args[0] = phi->args[k];
+				}
+
+				if (!t)
+					return 0;
+			}
 		}
 
-		block->triplet_alloc = new_size;
-		block->triplets = new;
-	}
+		/* A block may be its own predecessor, so only now is its own triplet count final */
+		triplets = clog_malloc(&ctx->parser->allocator,(block->phi_count + block->triplet_count) * sizeof(struct clog_cfg_triplet));
+		if (!triplets)
+			return clog_cg_out_of_memory(ctx->parser);
 
-	block->triplets[block->triplet_count++] = new_triplet;
-	*triplet = new_triplet;
+		for (j = 0; j < block->phi_count; ++j)
+		{
+			triplets[j].op = clog_opcode_MOV;
+			triplets[j].dest = block->phis[j].dest;
+			triplets[j].val.args[0] = first + j;
+			triplets[j].val.args[1] = CLOG_CFG_NONE;
+			triplets[j].line = 0;
+		}
+
+		if (block->triplet_count)
+			memcpy(triplets + block->phi_count,block->triplets,block->triplet_count * sizeof(struct clog_cfg_triplet));
+
+		clog_free(&ctx->parser->allocator,block->triplets);
+		clog_free(&ctx->parser->allocator,block->phis);
+		block->triplets = triplets;
+		block->triplet_count += block->phi_count;
+		block->triplet_alloc = block->triplet_count;
+		block->phis = NULL;
+		block->phi_count = 0;
+		block->phi_alloc = 0;
+	}
 
 	return 1;
 }
 
-static void clog_cg_free_triplet(struct clog_cg_block* block, struct clog_cg_triplet* triplet)
+static void clog_cg_use(unsigned long* uses, const unsigned long* defs, unsigned int value)
 {
-	unsigned int i = block->triplet_count;
-	while (i-- > 0)
+	if (value != CLOG_CFG_NONE && !CLOG_CG_TEST(defs,value))
+		CLOG_CG_SET(uses,value);
+}
+
+/* Iterative backwards dataflow, visiting in postorder so most blocks see their successors first */
+static int clog_cg_liveness(struct clog_cg_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned long** uses;
+	unsigned long** defs;
+	unsigned int i, j, w;
+	int changed;
+
+	ctx->live_in = clog_cg_alloc_sets(ctx);
+	ctx->live_out = clog_cg_alloc_sets(ctx);
+	uses = clog_cg_alloc_sets(ctx);
+	defs = clog_cg_alloc_sets(ctx);
+	if (!ctx->live_in || !ctx->live_out || !uses || !defs)
+		return 0;
+
+	for (i = 0; i < cfg->block_count; ++i)
 	{
-		if (triplet == block->triplets[i])
+		const struct clog_cfg_block* block = cfg->blocks[i];
+		for (j = 0; j < block->triplet_count; ++j)
 		{
-			if (triplet->type == clog_cg_triplet_expr)
-				clog_free(triplet->val.expr.result);
-
-			--block->triplet_count;
-			if (i < block->triplet_count)
-				memmove(&block->triplets[i],&block->triplets[i+1],(block->triplet_count - i) * sizeof(struct clog_cg_triplet*));
-			break;
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			if (t->op != clog_opcode_LOAD)
+			{
+				clog_cg_use(uses[i],defs[i],t->val.args[0]);
+				clog_cg_use(uses[i],defs[i],t->val.args[1]);
+			}
+			CLOG_CG_SET(defs[i],t->dest);
 		}
+
+		clog_cg_use(uses[i],defs[i],block->cond);
+		clog_cg_use(uses[i],defs[i],block->ret);
+
+		memcpy(ctx->live_in[i],uses[i],ctx->words * sizeof(unsigned long));
 	}
-}
 
-static unsigned int clog_cg_alloc_register(struct clog_cg_block* block, const struct clog_ast_literal* id)
-{
-	if (block->register_count == block->register_alloc)
+	do
 	{
-		/* Resize array */
-		unsigned int new_size = (block->register_alloc == 0 ? 4 : block->register_alloc * 2);
-		struct clog_cg_block_register* new = clog_realloc(block->registers,new_size * sizeof(struct clog_cg_block_register));
-		if (!new)
-			return clog_cg_out_of_memory();
+		changed = 0;
+		for (i = cfg->block_count; i-- > 0;)
+		{
+			const struct clog_cfg_block* block = cfg->blocks[i];
+			unsigned long* out = ctx->live_out[i];
 
-		block->register_alloc = new_size;
-		block->registers = new;
+			for (w = 0; w < ctx->words; ++w)
+			{
+				unsigned long in;
+				if (block->branch)
+					out[w] |= ctx->live_in[block->branch->rpo][w];
+				if (block->fallthru)
+					out[w] |= ctx->live_in[block->fallthru->rpo][w];
+
+				in = uses[i][w] | (out[w] & ~defs[i][w]);
+				if (in != ctx->live_in[i][w])
+				{
+					ctx->live_in[i][w] = in;
+					changed = 1;
+				}
+			}
+		}
 	}
+	while (changed);
 
-	block->registers[block->register_count].first = NULL;
-	block->registers[block->register_count].last = NULL;
+	return 1;
+}
 
-	if (!clog_ast_literal_clone(NULL,&block->registers[block->register_count].id,id))
-		return CLOG_CG_ERROR;
+/* The signed 8-bit integer constant a value was loaded from, if it was.
+ * Built with CLOG_NO_SUPERINSTRUCTIONS nothing is, so nothing fuses, to measure what fusing saves */
+static int clog_cg_immediate(const struct clog_ast_literal** loads, unsigned int value, long* imm)
+{
+#if defined(CLOG_NO_SUPERINSTRUCTIONS)
+	(void)loads;
+	(void)value;
+	(void)imm;
+	return 0;
+#else
+	if (value == CLOG_CFG_NONE || !loads[value] || loads[value]->type != clog_ast_literal_integer ||
+			loads[value]->value.integer < -128 || loads[value]->value.integer > 127)
+	{
+		return 0;
+	}
 
-	return block->register_count++;
+	*imm = loads[value]->value.integer;
+	return 1;
+#endif
 }
 
-static unsigned int clog_cg_alloc_temp_register(struct clog_cg_block* block)
+/* Picks superinstructions from the triplets: ADD and SUB of a small constant on the right become
+ * ADDI and SUBI (not on the left, + of a string doesn't commute), a test of a compare with a small
+ * constant becomes a compare immediate and branch, and a MOV of a loaded constant becomes a LOAD of it.
+ * Loads left with no uses are dropped */
+static int clog_cg_select(struct clog_cg_context* ctx)
 {
-	unsigned int retval;
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int* uses = clog_cg_alloc(ctx,(cfg->value_count + 1) * sizeof(unsigned int));
+	const struct clog_ast_literal** loads = clog_cg_alloc(ctx,(cfg->value_count + 1) * sizeof(struct clog_ast_literal*));
+	unsigned int i, j, k;
+
+	ctx->imms = clog_cg_alloc(ctx,(cfg->value_count + 1) * sizeof(long));
+	ctx->tests = clog_cg_alloc(ctx,(cfg->block_count + 1) * sizeof(struct clog_cg_test));
+	if (!uses || !loads || !ctx->imms || !ctx->tests)
+		return 0;
 
-	struct clog_ast_literal* lit;
-	char szBuf[sizeof(block->temp_counter) * 2 + 2] = {0};
-	sprintf(szBuf,"$%x",block->temp_counter);
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		const struct clog_cfg_block* block = cfg->blocks[i];
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			if (t->op == clog_opcode_LOAD)
+			{
+				if (t->dest < ctx->copies)
+					loads[t->dest] = t->val.lit;
+			}
+			else
+			{
+				for (k = 0; k < 2; ++k)
+				{
+					if (t->val.args[k] != CLOG_CFG_NONE)
+						++uses[t->val.args[k]];
+				}
+			}
+		}
 
-	lit = clog_malloc(sizeof(struct clog_ast_literal));
-	if (!lit)
-		return clog_cg_out_of_memory();
+		if (block->cond != CLOG_CFG_NONE)
+			++uses[block->cond];
+		if (block->ret != CLOG_CFG_NONE)
+			++uses[block->ret];
+	}
 
-	lit->line = 0;
-	lit->type = clog_ast_literal_string;
-	lit->value.string.len = strlen(szBuf);
-	lit->value.string.str = clog_malloc(lit->value.string.len+1);
-	if (!lit->value.string.str)
+	for (i = 0; i < cfg->block_count; ++i)
 	{
-		clog_free(lit);
-		return clog_cg_out_of_memory();
-	}
+		struct clog_cfg_block* block = cfg->blocks[i];
+		struct clog_cfg_triplet* cmp = NULL;
+		unsigned int count = 0;
 
-	memcpy(lit->value.string.str,szBuf,lit->value.string.len);
-	lit->value.string.str[lit->value.string.len] = 0;
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			struct clog_cfg_triplet* t = &block->triplets[j];
+			long imm;
 
-	retval = clog_cg_alloc_register(block,lit);
-	if (retval == CLOG_CG_ERROR)
-	{
-		clog_free(lit->value.string.str);
-		clog_free(lit);
-	}
-	else
-		++block->temp_counter;
+			if (t->op == clog_opcode_MOV && loads[t->val.args[0]])
+			{
+				--uses[t->val.args[0]];
+				t->op = clog_opcode_LOAD;
+				t->val.lit = loads[t->val.args[0]];
+				if (t->dest < ctx->copies)
+					loads[t->dest] = t->val.lit;
+			}
+			else if ((t->op == clog_opcode_ADD || t->op == clog_opcode_SUB) && clog_cg_immediate(loads,t->val.args[1],&imm))
+			{
+				--uses[t->val.args[1]];
+				t->op = (t->op == clog_opcode_ADD ? clog_opcode_ADDI : clog_opcode_SUBI);
+				t->val.args[1] = CLOG_CFG_NONE;
+				ctx->imms[t->dest] = imm;
+			}
+			else if (t->dest == block->cond)
+				cmp = t;
+		}
 
-	return retval;
-}
+		ctx->tests[i].op = clog_opcode_MAX;
+		if (cmp && uses[cmp->dest] == 1)
+		{
+			static const enum clog_opcode s_imm_ops[2][4] =
+			{
+				/* EQ, NE, LT, LE with the constant on the right, then on the left */
+				{ clog_opcode_EQI, clog_opcode_EQI, clog_opcode_LTI, clog_opcode_LEI },
+				{ clog_opcode_EQI, clog_opcode_EQI, clog_opcode_GTI, clog_opcode_GEI }
+			};
+			long imm;
 
-static unsigned int clog_cg_find_register(struct clog_cg_block* block, const struct clog_ast_literal* id, int recursive)
-{
-	unsigned int i = 0;
-	for (;i < block->register_count;++i)
-	{
-		if (clog_ast_literal_id_compare(block->registers[i].id,id) == 0)
-			return i;
+			for (k = 0; k < 2 && ctx->tests[i].op == clog_opcode_MAX; ++k)
+			{
+				if ((cmp->op == clog_opcode_EQ || cmp->op == clog_opcode_NE || cmp->op == clog_opcode_LT || cmp->op == clog_opcode_LE) &&
+						clog_cg_immediate(loads,cmp->val.args[1 - k],&imm))
+				{
+					/* The compare goes, and the branch tests what it compared */
+					ctx->tests[i].op = s_imm_ops[k][cmp->op - clog_opcode_EQ];
+					ctx->tests[i].imm = imm;
+					ctx->tests[i].negate = (cmp->op == clog_opcode_NE);
+					ctx->tests[i].line = cmp->line;
+					--uses[cmp->val.args[1 - k]];
+					--uses[cmp->dest];
+					block->cond = cmp->val.args[k];
+					cmp->op = clog_opcode_MAX;
+				}
+			}
+		}
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			if (block->triplets[j].op != clog_opcode_MAX)
+				block->triplets[count++] = block->triplets[j];
+		}
+		block->triplet_count = count;
 	}
 
-	if (recursive && block->prev)
-		return clog_cg_find_register(block->prev,id,1);
+	/* A constant is only used by the instructions it was folded into, or not at all */
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		struct clog_cfg_block* block = cfg->blocks[i];
+		unsigned int count = 0;
+
+		for (j = 0; j < block->triplet_count; ++j)
+		{
+			if (block->triplets[j].op != clog_opcode_LOAD || uses[block->triplets[j].dest])
+				block->triplets[count++] = block->triplets[j];
+		}
+		block->triplet_count = count;
+	}
 
-	return CLOG_CG_ERROR;
+	return 1;
 }
 
-static unsigned int clog_cg_alloc_result(struct clog_cg_block* block, const struct clog_ast_literal* id, struct clog_cg_triplet* triplet)
+/* Loop nesting depth of each block, by rpo. The language only has structured loops, so the
+ * graph is reducible and every edge to a block no later in reverse postorder is a back edge */
+static unsigned int* clog_cg_loop_depths(struct clog_cg_context* ctx)
 {
-	unsigned int reg_idx;
-	struct clog_cg_register* result = clog_malloc(sizeof(struct clog_cg_register));
-	if (!result)
-		return clog_cg_out_of_memory();
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int* depths = clog_cg_alloc(ctx,(cfg->block_count + 1) * sizeof(unsigned int));
+	unsigned int* stamps = clog_cg_alloc(ctx,(cfg->block_count + 1) * sizeof(unsigned int));
+	struct clog_cfg_block** stack = clog_cg_alloc(ctx,(cfg->block_count + 1) * sizeof(struct clog_cfg_block*));
+	unsigned int h, i, k;
 
-	memset(result,0,sizeof(struct clog_cg_register));
+	if (!depths || !stamps || !stack)
+		return NULL;
 
-	if (id)
-	{
-		reg_idx = clog_cg_find_register(block,id,1);
-		if (reg_idx == CLOG_CG_ERROR)
-			clog_cg_error("Undeclared identifier ",id->value.string.str,id->line);
-	}
-	else
-		reg_idx = clog_cg_alloc_temp_register(block);
-	if (reg_idx == CLOG_CG_ERROR)
+	for (i = 0; i < cfg->block_count; ++i)
+		stamps[i] = CLOG_CFG_NONE;
+
+	/* Every back edge into a header adds its natural loop, each block counted once per header */
+	for (h = 0; h < cfg->block_count; ++h)
 	{
-		clog_free(result);
-		return CLOG_CG_ERROR;
-	}
+		const struct clog_cfg_block* header = cfg->blocks[h];
+		for (k = 0; k < header->pred_count; ++k)
+		{
+			unsigned int top = 0;
 
-	result->prev = block->registers[reg_idx].last;
-	result->next = NULL;
-	result->refcount = 0;
+			if (header->preds[k]->rpo < h)
+				continue;
 
-	if (block->registers[reg_idx].last)
-		result->next = triplet;
+			if (stamps[h] != h)
+			{
+				stamps[h] = h;
+				++depths[h];
+			}
 
-	block->registers[reg_idx].last = triplet;
+			stack[top++] = header->preds[k];
+			while (top)
+			{
+				struct clog_cfg_block* block = stack[--top];
+				if (stamps[block->rpo] == h)
+					continue;
+
+				stamps[block->rpo] = h;
+				++depths[block->rpo];
+
+				for (i = 0; i < block->pred_count; ++i)
+				{
+					if (stamps[block->preds[i]->rpo] != h)
+						stack[top++] = block->preds[i];
+				}
+			}
+		}
+	}
 
-	if (!block->registers[reg_idx].first)
-		block->registers[reg_idx].first = triplet;
+	return depths;
+}
 
-	triplet->type = clog_cg_triplet_expr;
-	triplet->val.expr.result = result;
+/* A candidate to fall through */
+struct clog_cg_edge
+{
+	struct clog_cfg_block* from;
+	struct clog_cfg_block* to;
+};
 
-	return reg_idx;
-}
+/* An edge weighs as much as the deepest loop both its ends are in, past a point it makes no odds */
+#define CLOG_CG_MAX_WEIGHT 7
 
-static struct clog_cg_register* clog_cg_get_register(struct clog_cg_block* block, unsigned int reg_idx)
+static unsigned int clog_cg_edge_weight(const unsigned int* depths, const struct clog_cfg_block* from, const struct clog_cfg_block* to)
 {
-	return block->registers[reg_idx].last->val.expr.result;
+	unsigned int weight = (depths[from->rpo] < depths[to->rpo] ? depths[from->rpo] : depths[to->rpo]);
+	return (weight < CLOG_CG_MAX_WEIGHT ? weight : CLOG_CG_MAX_WEIGHT);
 }
 
-static const char* ___dump_op(enum clog_opcode op)
+/* Pettis & Hansen block placement, with loop depth standing in for a profile.
+ * Blocks are joined into chains along the heaviest edges first, so every joined edge falls
+ * through, then chains are placed so the heaviest edge into each one comes from code already placed.
+ * Back edges are joined before the edges out of their loop's header, rotating the test to the bottom */
+static int clog_cg_layout(struct clog_cg_context* ctx)
 {
-	switch (op)
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int n = cfg->block_count;
+	unsigned int keys = (CLOG_CG_MAX_WEIGHT + 1) * 4;
+	unsigned int* depths = clog_cg_loop_depths(ctx);
+	unsigned int* counts = clog_cg_alloc(ctx,(keys + 1) * sizeof(unsigned int));
+	struct clog_cg_edge* edges = clog_cg_alloc(ctx,(2 * n + 1) * sizeof(struct clog_cg_edge));
+	unsigned int* next = clog_cg_alloc(ctx,(n + 1) * sizeof(unsigned int));
+	unsigned int* head = clog_cg_alloc(ctx,(n + 1) * sizeof(unsigned int));
+	unsigned int* score = clog_cg_alloc(ctx,(n + 1) * sizeof(unsigned int));
+	unsigned char* placed = clog_cg_alloc(ctx,n + 1);
+	unsigned int i, j, k, count, chain;
+
+	ctx->order = clog_cg_alloc(ctx,(n + 1) * sizeof(struct clog_cfg_block*));
+	if (!depths || !counts || !edges || !next || !head || !score || !placed || !ctx->order)
+		return 0;
+
+	/* Counting sort of the edges, heaviest first, then back edges, then fallthrus */
+	for (k = 0; k < 2; ++k)
 	{
-	case clog_opcode_MOV:
-		return "MOV";
-	case clog_opcode_LOAD:
-		return "LOAD";
-	case clog_opcode_NEG:
-		return "NEG";
-	case clog_opcode_ADD:
-		return "ADD";
-	case clog_opcode_SUB:
-		return "SUB";
-	case clog_opcode_MUL:
-		return "MUL";
-	case clog_opcode_DIV:
-		return "DIV";
-	case clog_opcode_MOD:
-		return "MOD";
-	case clog_opcode_RSH:
-		return "RSH";
-	case clog_opcode_LSH:
-		return "LSH";
-	case clog_opcode_NOT:
-		return "NOT";
-	default:
-		return "???";
-	}
-}
+		for (i = 0; i < n; ++i)
+		{
+			struct clog_cfg_block* block = cfg->blocks[i];
+			for (j = 0; j < 2; ++j)
+			{
+				struct clog_cfg_block* to = (j ? block->branch : block->fallthru);
+				unsigned int key;
+				if (!to)
+					continue;
+
+				key = (CLOG_CG_MAX_WEIGHT - clog_cg_edge_weight(depths,block,to)) * 4 + (to->rpo <= i ? 0 : 2) + j;
+				if (k == 0)
+					++counts[key + 1];
+				else
+				{
+					edges[counts[key]].from = block;
+					edges[counts[key]++].to = to;
+				}
+			}
+		}
 
-static unsigned int clog_cg_emit_triplet_op_L(struct clog_cg_block* block, const struct clog_ast_literal* id, enum clog_opcode op, const struct clog_ast_literal* lit)
-{
-	unsigned int retval;
-	struct clog_cg_triplet* triplet;
+		for (i = 0; k == 0 && i < keys; ++i)
+			counts[i + 1] += counts[i];
+	}
+	count = counts[keys - 1];
 
-	if (!clog_cg_alloc_triplet(block,&triplet))
-		return CLOG_CG_ERROR;
+	for (i = 0; i < n; ++i)
+	{
+		next[i] = CLOG_CFG_NONE;
+		head[i] = i;
+	}
 
-	retval = clog_cg_alloc_result(block,id,triplet);
-	if (retval == CLOG_CG_ERROR)
-		clog_cg_free_triplet(block,triplet);
-	else
+	for (i = 0; i < count; ++i)
 	{
-		triplet->op = op;
-		triplet->val.expr.expr.lit = lit;
+		unsigned int u = edges[i].from->rpo;
+		unsigned int v = edges[i].to->rpo;
+		unsigned int b;
 
-		printf("#%d = %s ",retval,___dump_op(op));
-		switch (lit->type)
-		{
-		case clog_ast_literal_null:
-			printf("null\n");
-			break;
+		/* Only the end of one chain can fall into the start of another, and nothing comes before the entry */
+		if (next[u] != CLOG_CFG_NONE || head[v] != v || head[u] == v || v == 0)
+			continue;
 
-		case clog_ast_literal_bool:
-			if (lit->value.integer)
-				printf("true\n");
-			else
-				printf("false\n");
-			break;
+		next[u] = v;
+		for (b = v; b != CLOG_CFG_NONE; b = next[b])
+			head[b] = head[u];
+	}
 
-		case clog_ast_literal_integer:
-			printf("%ld\n",lit->value.integer);
-			break;
+	/* The entry is never joined onto, so it starts the first chain */
+	for (count = 0, chain = 0; chain != CLOG_CFG_NONE;)
+	{
+		unsigned int b;
 
-		case clog_ast_literal_real:
-			printf("%g\n",lit->value.real);
-			break;
+		placed[chain] = 1;
+		for (b = chain; b != CLOG_CFG_NONE; b = next[b])
+		{
+			const struct clog_cfg_block* block = cfg->blocks[b];
+			ctx->order[count++] = cfg->blocks[b];
 
-		case clog_ast_literal_string:
-			printf("%s\n",lit->value.string.str);
-			break;
+			for (j = 0; j < 2; ++j)
+			{
+				const struct clog_cfg_block* to = (j ? block->branch : block->fallthru);
+				unsigned int weight;
+				if (!to || placed[head[to->rpo]])
+					continue;
+
+				weight = clog_cg_edge_weight(depths,block,to) + 1;
+				if (score[head[to->rpo]] < weight)
+					score[head[to->rpo]] = weight;
+			}
+		}
+
+		/* Ties, and chains nothing placed leads to, go in reverse postorder */
+		chain = CLOG_CFG_NONE;
+		for (i = 0; i < n; ++i)
+		{
+			if (head[i] == i && !placed[i] && (chain == CLOG_CFG_NONE || score[i] > score[chain]))
+				chain = i;
 		}
 	}
-	return retval;
+
+	return 1;
 }
 
-static unsigned int clog_cg_emit_triplet_op_R(struct clog_cg_block* block, const struct clog_ast_literal* id, enum clog_opcode op, unsigned int reg_idx)
+static void clog_cg_extend(struct clog_cg_interval* interval, unsigned int pos)
 {
-	unsigned int retval;
-	struct clog_cg_triplet* triplet;
-	if (!clog_cg_alloc_triplet(block,&triplet))
-		return CLOG_CG_ERROR;
-
-	retval = clog_cg_alloc_result(block,id,triplet);
-	if (retval == CLOG_CG_ERROR)
-		clog_cg_free_triplet(block,triplet);
-	else
-	{
-		triplet->op = op;
-		triplet->val.expr.expr.reg[0] = reg_idx;
-		triplet->val.expr.expr.reg[1] = -1;
-
-		++clog_cg_get_register(block,reg_idx)->refcount;
-
-		printf("#%d = %s #%d\n",retval,___dump_op(op),reg_idx);
-	}
-	return retval;
+	if (interval->start == CLOG_CFG_NONE || pos < interval->start)
+		interval->start = pos;
+	if (interval->end < pos)
+		interval->end = pos;
 }
 
-static unsigned int clog_cg_emit_triplet_op_RR(struct clog_cg_block* block, const struct clog_ast_literal* id, enum clog_opcode op, unsigned int reg_idx0, unsigned int reg_idx1)
+static void clog_cg_extend_set(struct clog_cg_context* ctx, const unsigned long* set, unsigned int pos)
 {
-	unsigned int retval;
-	struct clog_cg_triplet* triplet;
-	if (!clog_cg_alloc_triplet(block,&triplet))
-		return CLOG_CG_ERROR;
-
-	retval = clog_cg_alloc_result(block,id,triplet);
-	if (retval == CLOG_CG_ERROR)
-		clog_cg_free_triplet(block,triplet);
-	else
+	unsigned int w, b;
+	for (w = 0; w < ctx->words; ++w)
 	{
-		triplet->op = op;
-		triplet->val.expr.expr.reg[0] = reg_idx0;
-		triplet->val.expr.expr.reg[1] = reg_idx1;
-
-		++clog_cg_get_register(block,reg_idx0)->refcount;
-		++clog_cg_get_register(block,reg_idx1)->refcount;
+		if (!set[w])
+			continue;
 
-		printf("#%d = #%d %s #%d\n",retval,reg_idx0,___dump_op(op),reg_idx1);
+		for (b = 0; b < CLOG_CG_BITS; ++b)
+		{
+			if (set[w] & (1UL << b))
+				clog_cg_extend(&ctx->intervals[w * CLOG_CG_BITS + b],pos);
+		}
 	}
-	return retval;
 }
 
-static int clog_cg_alloc_block(struct clog_cg_block** block)
+/* Each block in emission order takes a position for its label, one per triplet and one for its
+ * terminator. A value's interval is a single range from its first to its last position, covering
+ * every block it is live into or out of, which is conservative around loops but never too short */
+static int clog_cg_intervals(struct clog_cg_context* ctx)
 {
-	*block = clog_malloc(sizeof(struct clog_cg_block));
-	if (!*block)
-	{
-		clog_cg_out_of_memory();
-		return 0;
-	}
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int pos = 0;
+	unsigned int i, j;
 
-	memset(*block,0,sizeof(struct clog_cg_block));
-
-	return 1;
-}
+	ctx->intervals = clog_cg_alloc(ctx,(cfg->value_count + 1) * sizeof(struct clog_cg_interval));
+	if (!ctx->intervals)
+		return 0;
 
-static unsigned int clog_cg_emit_builtin(struct clog_cg_block* block, struct clog_ast_expression_builtin* expr);
-static unsigned int clog_cg_emit_call(struct clog_cg_block* block, struct clog_ast_expression_call* call);
+	for (i = 0; i < cfg->value_count; ++i)
+	{
+		ctx->intervals[i].start = CLOG_CFG_NONE;
+		ctx->intervals[i].end = 0;
+		ctx->intervals[i].reg = CLOG_CFG_NONE;
+	}
 
-static unsigned int clog_cg_emit_expression_arg(struct clog_cg_block* block, struct clog_ast_expression* arg)
-{
-	switch (arg->type)
+	for (i = 0; i < cfg->block_count; ++i)
 	{
-	case clog_ast_expression_builtin:
-		return clog_cg_emit_builtin(block,arg->expr.builtin);
+		const struct clog_cfg_block* block = ctx->order[i];
 
-	case clog_ast_expression_call:
-		return clog_cg_emit_call(block,arg->expr.call);
+		clog_cg_extend_set(ctx,ctx->live_in[block->rpo],pos++);
 
-	case clog_ast_expression_identifier:
+		for (j = 0; j < block->triplet_count; ++j, ++pos)
 		{
-			unsigned int reg_idx = clog_cg_find_register(block,arg->expr.identifier,1);
-			if (reg_idx == CLOG_CG_ERROR)
-				return clog_cg_error("Undeclared identifier ",arg->expr.identifier->value.string.str,arg->expr.identifier->line);
-			return reg_idx;
+			const struct clog_cfg_triplet* t = &block->triplets[j];
+			if (t->op != clog_opcode_LOAD)
+			{
+				if (t->val.args[0] != CLOG_CFG_NONE)
+					clog_cg_extend(&ctx->intervals[t->val.args[0]],pos);
+				if (t->val.args[1] != CLOG_CFG_NONE)
+					clog_cg_extend(&ctx->intervals[t->val.args[1]],pos);
+			}
+			clog_cg_extend(&ctx->intervals[t->dest],pos);
 		}
 
-	case clog_ast_expression_literal:
-		return clog_cg_emit_triplet_op_L(block,NULL,clog_opcode_LOAD,arg->expr.literal);
+		if (block->cond != CLOG_CFG_NONE)
+			clog_cg_extend(&ctx->intervals[block->cond],pos);
+		if (block->ret != CLOG_CFG_NONE)
+			clog_cg_extend(&ctx->intervals[block->ret],pos);
+		clog_cg_extend_set(ctx,ctx->live_out[block->rpo],pos++);
 	}
 
-	return CLOG_CG_ERROR;
+	ctx->positions = pos;
+	return 1;
 }
 
-static unsigned int clog_cg_emit_builtin(struct clog_cg_block* block, struct clog_ast_expression_builtin* expr)
+/* Linear scan (Poletto & Sarkar): walk the intervals by start, keep the live ones
+ * ordered by end, and hand each new one the lowest register nothing live holds */
+static int clog_cg_linear_scan(struct clog_cg_context* ctx)
 {
-	unsigned int reg_idx0;
-	unsigned int reg_idx1;
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned char in_use[CLOG_MAX_REGISTERS] = {0};
+	unsigned int active[CLOG_MAX_REGISTERS];
+	unsigned int active_count = 0;
+	unsigned int* counts;
+	unsigned int* order;
+	unsigned int i, n = 0;
+
+	ctx->builder->registers = 0;
+
+	/* Counting sort by start, several intervals can start at one block's label */
+	counts = clog_cg_alloc(ctx,(ctx->positions + 1) * sizeof(unsigned int));
+	order = clog_cg_alloc(ctx,(cfg->value_count + 1) * sizeof(unsigned int));
+	if (!counts || !order)
+		return 0;
 
-	switch (expr->type)
+	/* A value that is never written needs no home */
+	for (i = 0; i < cfg->value_count; ++i)
 	{
-	case CLOG_TOKEN_DOT:
-	case CLOG_TOKEN_IN:
-	case CLOG_TOKEN_OPEN_BRACKET:
-		/* Ummm...? */
-		{ void* TODO; }
-		break;
-
-	case CLOG_TOKEN_AND:
-	case CLOG_TOKEN_OR:
-	case CLOG_TOKEN_QUESTION:
-		reg_idx0 = clog_cg_emit_expression_arg(block,expr->args[0]);
-		if (reg_idx0 == CLOG_CG_ERROR)
-			return reg_idx0;
-		break;
-
-	default:
-		reg_idx0 = clog_cg_emit_expression_arg(block,expr->args[0]);
-		if (reg_idx0 == CLOG_CG_ERROR)
-			return reg_idx0;
-		if (expr->args[1])
-		{
-			reg_idx1 = clog_cg_emit_expression_arg(block,expr->args[1]);
-			if (reg_idx1 == CLOG_CG_ERROR)
-				return reg_idx1;
-		}
-		break;
+		if (ctx->intervals[i].start != CLOG_CFG_NONE)
+			++counts[ctx->intervals[i].start];
 	}
 
-	switch (expr->type)
+	for (i = 0; i < ctx->positions; ++i)
 	{
-	case CLOG_TOKEN_COMMA:
-		/* Just return the left-most register */
-		return reg_idx1;
+		unsigned int c = counts[i];
+		counts[i] = n;
+		n += c;
+	}
 
-	case CLOG_TOKEN_DOT:
-	case CLOG_TOKEN_IN:
-	case CLOG_TOKEN_OPEN_BRACKET:
+	for (i = 0; i < cfg->value_count; ++i)
+	{
+		if (ctx->intervals[i].start != CLOG_CFG_NONE)
+			order[counts[ctx->intervals[i].start]++] = i;
+	}
 
-	case CLOG_TOKEN_TILDA:
-		break;
+	for (i = 0; i < n; ++i)
+	{
+		struct clog_cg_interval* v = &ctx->intervals[order[i]];
+		unsigned int j, k;
 
-	case CLOG_TOKEN_PLUS:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_ADD,reg_idx0,reg_idx1);
+		/* Expire everything that dies at or before this starts, an instruction reads before it writes */
+		for (j = 0, k = 0; j < active_count; ++j)
+		{
+			if (ctx->intervals[active[j]].end <= v->start)
+				in_use[ctx->intervals[active[j]].reg] = 0;
+			else
+				active[k++] = active[j];
+		}
+		active_count = k;
+
+		for (j = 0; j < CLOG_MAX_REGISTERS && in_use[j]; ++j)
+			;
 
-	case CLOG_TOKEN_MINUS:
-		if (!expr->args[1])
+		/* The VM has no memory to spill to */
+		if (j == CLOG_MAX_REGISTERS)
 		{
-			/* Unary - */
-			return clog_cg_emit_triplet_op_R(block,NULL,clog_opcode_NEG,reg_idx0);
+			char buf[128];
+			unsigned long line = (cfg->values[order[i]].id ? cfg->values[order[i]].id->line : 0);
+			sprintf(buf,"Error: Expression too complex, more than %d values live at line %lu",CLOG_MAX_REGISTERS,line);
+			clog_diagnostic(ctx->parser,line,buf);
+			ctx->parser->failed = 1;
+			return 0;
 		}
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_SUB,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_STAR:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_MUL,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_SLASH:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_DIV,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_PERCENT:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_MOD,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_RIGHT_SHIFT:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_RSH,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_LEFT_SHIFT:
-		return clog_cg_emit_triplet_op_RR(block,NULL,clog_opcode_LSH,reg_idx0,reg_idx1);
-
-	case CLOG_TOKEN_BAR:
-	case CLOG_TOKEN_CARET:
-	case CLOG_TOKEN_AMPERSAND:
-
-	case CLOG_TOKEN_EXCLAMATION:
-		return clog_cg_emit_triplet_op_R(block,NULL,clog_opcode_NOT,reg_idx0);
-
-	case CLOG_TOKEN_LESS_THAN:
-	case CLOG_TOKEN_LESS_THAN_EQUALS:
-	case CLOG_TOKEN_GREATER_THAN:
-	case CLOG_TOKEN_GREATER_THAN_EQUALS:
-	case CLOG_TOKEN_EQUALS:
-	case CLOG_TOKEN_AND:
-	case CLOG_TOKEN_OR:
-
-	case CLOG_TOKEN_QUESTION:
-
-
-	case CLOG_TOKEN_ASSIGN:
-	case CLOG_TOKEN_DOUBLE_PLUS:
-	case CLOG_TOKEN_DOUBLE_MINUS:
-	case CLOG_TOKEN_STAR_ASSIGN:
-	case CLOG_TOKEN_SLASH_ASSIGN:
-	case CLOG_TOKEN_PERCENT_ASSIGN:
-	case CLOG_TOKEN_PLUS_ASSIGN:
-	case CLOG_TOKEN_MINUS_ASSIGN:
-	case CLOG_TOKEN_RIGHT_SHIFT_ASSIGN:
-	case CLOG_TOKEN_LEFT_SHIFT_ASSIGN:
-	case CLOG_TOKEN_AMPERSAND_ASSIGN:
-	case CLOG_TOKEN_CARET_ASSIGN:
-	case CLOG_TOKEN_BAR_ASSIGN:
-		break;
+
+		in_use[j] = 1;
+		v->reg = j;
+		if (ctx->builder->registers <= j)
+			ctx->builder->registers = j + 1;
+
+		/* Keep active ordered by end */
+		for (k = active_count; k > 0 && ctx->intervals[active[k-1]].end > v->end; --k)
+			active[k] = active[k-1];
+		active[k] = order[i];
+		++active_count;
 	}
 
-	return CLOG_CG_ERROR;
+	return 1;
 }
 
-static unsigned int clog_cg_emit_call(struct clog_cg_block* block, struct clog_ast_expression_call* call)
+static int clog_cg_emit(struct clog_cg_context* ctx, unsigned int insn, unsigned long line)
 {
-	return CLOG_CG_ERROR;
+	if (!clog_image_emit(ctx->builder,insn,line))
+		return clog_cg_out_of_memory(ctx->parser);
+
+	return 1;
 }
 
-static int clog_cg_emit_statement(struct clog_cg_block* block, struct clog_ast_statement_list** list);
+static int clog_cg_emit_jump(struct clog_cg_context* ctx, enum clog_opcode op, unsigned int cond, struct clog_cfg_block* target)
+{
+	if (ctx->fixup_count == ctx->fixup_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (ctx->fixup_alloc == 0 ? 16 : ctx->fixup_alloc * 2);
+		struct clog_cg_fixup* new = clog_realloc(&ctx->parser->allocator,ctx->fixups,new_size * sizeof(struct clog_cg_fixup));
+		if (!new)
+			return clog_cg_out_of_memory(ctx->parser);
+
+		ctx->fixup_alloc = new_size;
+		ctx->fixups = new;
+	}
+
+	ctx->fixups[ctx->fixup_count].pc = ctx->builder->code_count;
+	ctx->fixups[ctx->fixup_count].op = op;
+	ctx->fixups[ctx->fixup_count].reg = (cond == CLOG_CFG_NONE ? 0 : ctx->intervals[cond].reg);
+	ctx->fixups[ctx->fixup_count].target = target;
+	++ctx->fixup_count;
 
-static int clog_cg_emit_block(struct clog_cg_block* block, struct clog_ast_statement_list* list)
+	/* Patched once every block has an address */
+	return clog_cg_emit(ctx,CLOG_INSN_ABX(op,0,0),0);
+}
+
+/* Jumps to target when the block's test comes out as sense */
+static int clog_cg_emit_test(struct clog_cg_context* ctx, const struct clog_cfg_block* block, int sense, struct clog_cfg_block* target)
 {
-	struct clog_cg_block* block2;
-	if (!clog_cg_alloc_block(&block2))
-		return 0;
+	const struct clog_cg_test* test = &ctx->tests[block->rpo];
+	if (test->op == clog_opcode_MAX)
+		return clog_cg_emit_jump(ctx,sense ? clog_opcode_JMPT : clog_opcode_JMPF,block->cond,target);
 
-	if (block)
-		block->next = block2;
+	/* A compare immediate takes the JMP after it itself */
+	return (clog_cg_emit(ctx,CLOG_INSN_ABC(test->op,ctx->intervals[block->cond].reg,test->imm & 0xFF,sense != test->negate),test->line) &&
+			clog_cg_emit_jump(ctx,clog_opcode_JMP,CLOG_CFG_NONE,target));
+}
 
-	block2->prev = block;
+static int clog_cg_emit_load(struct clog_cg_context* ctx, const struct clog_cfg_triplet* t)
+{
+	unsigned int idx;
+	clog_value v;
 
-	for (;list;list = list->next)
+	if (!clog_image_constant(ctx->builder,t->val.lit,&idx))
 	{
-		if (!clog_cg_emit_statement(block2,&list))
-			return 0;
+		if (t->val.lit->type == clog_ast_literal_integer && !clog_value_from_integer(t->val.lit->value.integer,&v))
+			return clog_cg_error(ctx->parser,"Integer constant out of range",t->line);
 
-		/* Ensure we append to the last block */
-		while (block2->next)
-			block2 = block2->next;
+		if (ctx->builder->constant_count >= CLOG_MAX_CONSTANTS)
+			return clog_cg_error(ctx->parser,"Too many constants",t->line);
+
+		return clog_cg_out_of_memory(ctx->parser);
 	}
 
-	return 1;
+	return clog_cg_emit(ctx,CLOG_INSN_ABX(clog_opcode_LOAD,ctx->intervals[t->dest].reg,idx),t->line);
 }
 
-static int clog_cg_emit_statement(struct clog_cg_block* block, struct clog_ast_statement_list** list)
+static int clog_cg_emit_block(struct clog_cg_context* ctx, const struct clog_cfg_block* block, const struct clog_cfg_block* next)
 {
-	switch ((*list)->stmt->type)
+	unsigned int j;
+
+	ctx->pcs[block->rpo] = ctx->builder->code_count;
+
+	for (j = 0; j < block->triplet_count; ++j)
 	{
-	case clog_ast_statement_expression:
-		switch ((*list)->stmt->stmt.expression->type)
-		{
-		case clog_ast_expression_identifier:
-			if (clog_cg_find_register(block,(*list)->stmt->stmt.expression->expr.identifier,1) == CLOG_CG_ERROR)
-				return clog_cg_error("Undeclared identifier ",(*list)->stmt->stmt.expression->expr.identifier->value.string.str,(*list)->stmt->stmt.expression->expr.identifier->line);
+		const struct clog_cfg_triplet* t = &block->triplets[j];
+		unsigned int a = ctx->intervals[t->dest].reg;
+		int ok;
 
-			clog_cg_warning("Statement with no effect",NULL,(*list)->stmt->stmt.expression->expr.identifier->line);
-			return 1;
+		switch (t->op)
+		{
+		case clog_opcode_LOAD:
+			ok = clog_cg_emit_load(ctx,t);
+			break;
 
-		case clog_ast_expression_literal:
-			clog_cg_warning("Statement with no effect",NULL,(*list)->stmt->stmt.expression->expr.literal->line);
-			return 1;
+		case clog_opcode_MOV:
+			/* Coalesced by the allocator */
+			if (a == ctx->intervals[t->val.args[0]].reg)
+				continue;
+
+			/* Fall through */
+		case clog_opcode_NEG:
+		case clog_opcode_NOT:
+		case clog_opcode_BNOT:
+		case clog_opcode_BOOL:
+			ok = clog_cg_emit(ctx,CLOG_INSN_ABC(t->op,a,ctx->intervals[t->val.args[0]].reg,0),t->line);
+			break;
 
-		case clog_ast_expression_builtin:
-			return (clog_cg_emit_builtin(block,(*list)->stmt->stmt.expression->expr.builtin) != CLOG_CG_ERROR);
+		case clog_opcode_ADDI:
+		case clog_opcode_SUBI:
+			ok = clog_cg_emit(ctx,CLOG_INSN_ABC(t->op,a,ctx->intervals[t->val.args[0]].reg,ctx->imms[t->dest] & 0xFF),t->line);
+			break;
 
-		case clog_ast_expression_call:
-			return (clog_cg_emit_call(block,(*list)->stmt->stmt.expression->expr.call) != CLOG_CG_ERROR);
+		default:
+			ok = clog_cg_emit(ctx,CLOG_INSN_ABC(t->op,a,ctx->intervals[t->val.args[0]].reg,ctx->intervals[t->val.args[1]].reg),t->line);
+			break;
 		}
-		return 0;
 
-	case clog_ast_statement_block:
-		return clog_cg_emit_block(block,(*list)->stmt->stmt.block);
+		if (!ok)
+			return 0;
+	}
 
-	case clog_ast_statement_declaration:
-		{
-			unsigned int assign_idx;
-			unsigned int reg_idx = clog_cg_find_register(block,(*list)->stmt->stmt.declaration,0);
-			if (reg_idx != CLOG_CG_ERROR)
-				return clog_cg_error("Duplicate declaration of ",(*list)->stmt->stmt.declaration->value.string.str,(*list)->stmt->stmt.declaration->line);
-
-			assign_idx = clog_cg_emit_expression_arg(block,(*list)->next->stmt->stmt.expression->expr.builtin->args[1]);
-			if (assign_idx == CLOG_CG_ERROR)
-				return assign_idx;
-
-			reg_idx = clog_cg_alloc_register(block,(*list)->stmt->stmt.declaration);
-			if (reg_idx == CLOG_CG_ERROR)
-				return reg_idx;
-
-			reg_idx = clog_cg_emit_triplet_op_R(block,(*list)->stmt->stmt.declaration,clog_opcode_MOV,assign_idx);
-			if (reg_idx != CLOG_CG_ERROR)
-				*list = (*list)->next;
-			return reg_idx;
-		}
+	if (block->cond != CLOG_CFG_NONE)
+	{
+		/* Fall into whichever successor comes next */
+		if (block->branch == next)
+			return clog_cg_emit_test(ctx,block,0,block->fallthru);
+
+		if (!clog_cg_emit_test(ctx,block,1,block->branch))
+			return 0;
+	}
+
+	if (!block->fallthru)
+	{
+		if (block->ret == CLOG_CFG_NONE)
+			return clog_cg_emit(ctx,CLOG_INSN_ABC(clog_opcode_RET,0,0,0),0);
 
-	case clog_ast_statement_if:
-	case clog_ast_statement_do:
-	case clog_ast_statement_break:
-	case clog_ast_statement_continue:
-	case clog_ast_statement_return:
-		break;
+		return clog_cg_emit(ctx,CLOG_INSN_ABC(clog_opcode_RET,ctx->intervals[block->ret].reg,1,0),0);
 	}
 
+	if (block->fallthru != next)
+		return clog_cg_emit_jump(ctx,clog_opcode_JMP,CLOG_CFG_NONE,block->fallthru);
+
 	return 1;
 }
 
-
-int clog_codegen(struct clog_ast_statement_list* list)
+static int clog_cg_patch(struct clog_cg_context* ctx)
 {
-	struct clog_cg_block* block;
-	struct clog_cg_block* block2;
-	if (!clog_cg_alloc_block(&block))
-		return 0;
-
-	for (block2 = block;list;list = list->next)
+	unsigned int i;
+	for (i = 0; i < ctx->fixup_count; ++i)
 	{
-		if (!clog_cg_emit_statement(block2,&list))
+		const struct clog_cg_fixup* f = &ctx->fixups[i];
+		long offset = (long)ctx->pcs[f->target->rpo] - (long)(f->pc + 1);
+
+		if (offset < -CLOG_INSN_SBX_BIAS || offset > 0xFFFF - CLOG_INSN_SBX_BIAS)
+		{
+			clog_diagnostic(ctx->parser,0,"Error: Program too large, a jump is out of range");
+			ctx->parser->failed = 1;
 			return 0;
+		}
 
-		/* Ensure we append to the last block */
-		while (block2->next)
-			block2 = block2->next;
+		clog_image_patch(ctx->builder,f->pc,CLOG_INSN_ASBX(f->op,f->reg,offset));
 	}
 
-	/* Now do something with block! */
-
 	return 1;
 }
+
+int clog_codegen(struct clog_cfg* cfg, struct clog_image_builder* builder)
+{
+	struct clog_cg_context ctx;
+	unsigned int i;
+	int ok;
+
+	memset(&ctx,0,sizeof(ctx));
+	ctx.cfg = cfg;
+	ctx.parser = cfg->parser;
+	ctx.builder = builder;
+	ctx.arena.allocator = &cfg->parser->allocator;
+
+	ctx.copies = cfg->value_count;
+	ok = clog_cg_out_of_ssa(&ctx) && clog_cg_select(&ctx);
+	if (ok)
+	{
+		ctx.words = CLOG_CG_WORDS(cfg->value_count);
+		ctx.pcs = clog_cg_alloc(&ctx,(cfg->block_count + 1) * sizeof(unsigned int));
+
+		ok = (ctx.pcs &&
+				clog_cg_layout(&ctx) &&
+				clog_cg_liveness(&ctx) &&
+				clog_cg_intervals(&ctx) &&
+				clog_cg_linear_scan(&ctx));
+	}
+
+	for (i = 0; ok && i < cfg->block_count; ++i)
+		ok = clog_cg_emit_block(&ctx,ctx.order[i],i + 1 < cfg->block_count ? ctx.order[i+1] : NULL);
+
+	if (ok)
+		ok = clog_cg_patch(&ctx) && clog_codegen_peephole(ctx.parser,builder);
+
+	clog_free(&cfg->parser->allocator,ctx.fixups);
+	clog_arena_free(&ctx.arena);
+
+	return ok;
+}
@@ -0,0 +1,40 @@
+/*
+ * clog_codegen.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_CODEGEN_H_
+#define CLOG_CODEGEN_H_
+
+#include "clog_cfg.h"
+#include "clog_image.h"
+
+/* Bump whenever the same source would compile to different code, see clog_version */
+#define CLOG_COMPILER_VERSION 1
+
+/* Takes a graph out of SSA form, allocates registers and emits it into builder.
+ * The phis are replaced by copies, so the graph is no longer in SSA form afterwards */
+int clog_codegen(struct clog_cfg* cfg, struct clog_image_builder* builder);
+
+/* Translates a graph in SSA form to C source defining name, see clog_compile_c.
+ * A NULL cfg is the empty program. On success src is allocated from the parser's allocator */
+int clog_codegen_c(struct clog_parser* parser, struct clog_cfg* cfg, const char* name, char** src, size_t* len);
+
+enum clog_peephole
+{
+	clog_peephole_mov_chain,
+	clog_peephole_dead_store,
+	clog_peephole_not_branch,
+	clog_peephole_jump_thread,
+	clog_peephole_jump_next,
+	clog_peephole_unreachable,
+
+	clog_peephole_MAX
+};
+
+/* Rewrites the emitted code in place, until none of its patterns match.
+ * Built with CLOG_PEEPHOLE_COUNT, reports how many instructions each pattern took out as diagnostics */
+int clog_codegen_peephole(struct clog_parser* parser, struct clog_image_builder* builder);
+
+#endif /* CLOG_CODEGEN_H_ */
@@ -0,0 +1,442 @@
+/*
+ * clog_codegen_c.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_codegen.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/* Growable text, failing once stays failed */
+struct clog_ec_text
+{
+	const struct clog_allocator* allocator;
+	char*                        str;
+	size_t                       len;
+	size_t                       alloc;
+	int                          failed;
+};
+
+struct clog_ec_context
+{
+	struct clog_cfg*    cfg;
+	struct clog_parser* parser;
+	struct clog_ec_text body;
+
+	/* By rpo: the first slot of the block's phi copies, and whether anything jumps to it */
+	unsigned int* phi_slots;
+	unsigned char* labels;
+	unsigned int   slots;
+
+	/* String literals, indexed as the program loads them */
+	const struct clog_ast_literal** strings;
+	unsigned int                    string_count;
+	unsigned int                    string_alloc;
+};
+
+static void clog_ec_append(struct clog_ec_text* text, const char* str, size_t len)
+{
+	if (text->failed)
+		return;
+
+	if (text->len + len + 1 > text->alloc)
+	{
+		/* Resize array */
+		size_t new_size = (text->alloc == 0 ? 4096 : text->alloc * 2);
+		char* new;
+		while (new_size < text->len + len + 1)
+			new_size *= 2;
+
+		new = clog_realloc(text->allocator,text->str,new_size);
+		if (!new)
+		{
+			text->failed = 1;
+			return;
+		}
+
+		text->alloc = new_size;
+		text->str = new;
+	}
+
+	memcpy(text->str + text->len,str,len);
+	text->len += len;
+	text->str[text->len] = '\0';
+}
+
+static void clog_ec_puts(struct clog_ec_text* text, const char* str)
+{
+	clog_ec_append(text,str,strlen(str));
+}
+
+/* No format here is longer than this, and none takes more than three numbers */
+#define CLOG_EC_FORMAT_MAX 128
+
+/* The digits of the largest 64-bit unsigned long */
+#define CLOG_EC_DIGITS_MAX 20
+
+static void clog_ec_printf(struct clog_ec_text* text, const char* fmt, unsigned long a, unsigned long b, unsigned long c)
+{
+	char buf[CLOG_EC_FORMAT_MAX + 3 * CLOG_EC_DIGITS_MAX];
+	sprintf(buf,fmt,a,b,c);
+	clog_ec_puts(text,buf);
+}
+
+/* A C string literal, with anything that isn't plainly printable escaped */
+static void clog_ec_quote(struct clog_ec_text* text, const unsigned char* str, size_t len)
+{
+	size_t i;
+	clog_ec_puts(text,"\"");
+	for (i = 0; i < len; ++i)
+	{
+		char buf[8];
+		if (str[i] >= 0x20 && str[i] < 0x7F && str[i] != '"' && str[i] != '\\' && str[i] != '?')
+		{
+			buf[0] = (char)str[i];
+			clog_ec_append(text,buf,1);
+		}
+		else
+		{
+			/* Always three digits, so a following digit can't join it */
+			sprintf(buf,"\\%03o",str[i]);
+			clog_ec_puts(text,buf);
+		}
+	}
+	clog_ec_puts(text,"\"");
+}
+
+static int clog_ec_error(struct clog_parser* parser, const char* msg, unsigned long line)
+{
+	char buf[256];
+	sprintf(buf,"Error: %.128s at line %lu",msg,line);
+	clog_diagnostic(parser,line,buf);
+	parser->failed = 1;
+	return 0;
+}
+
+static const char* clog_ec_op(enum clog_opcode op)
+{
+	/* In enum clog_opcode order, the IR only uses those up to RET */
+	static const char* const s_ops[] =
+	{
+		"clog_opcode_MOV", "clog_opcode_LOAD", "clog_opcode_NEG", "clog_opcode_ADD",
+		"clog_opcode_SUB", "clog_opcode_MUL", "clog_opcode_DIV", "clog_opcode_MOD",
+		"clog_opcode_RSH", "clog_opcode_LSH", "clog_opcode_NOT", "clog_opcode_BNOT",
+		"clog_opcode_BAND", "clog_opcode_BOR", "clog_opcode_BXOR", "clog_opcode_EQ",
+		"clog_opcode_NE", "clog_opcode_LT", "clog_opcode_LE", "clog_opcode_BOOL"
+	};
+
+	return (op < sizeof(s_ops) / sizeof(s_ops[0]) ? s_ops[op] : "clog_opcode_MAX");
+}
+
+static int clog_ec_load(struct clog_ec_context* ctx, const struct clog_cfg_triplet* t)
+{
+	const struct clog_ast_literal* lit = t->val.lit;
+	clog_value v;
+
+	switch (lit->type)
+	{
+	case clog_ast_literal_string:
+		if (ctx->string_count == ctx->string_alloc)
+		{
+			/* Resize array */
+			unsigned int new_size = (ctx->string_alloc == 0 ? 16 : ctx->string_alloc * 2);
+			const struct clog_ast_literal** new = clog_realloc(&ctx->parser->allocator,ctx->strings,new_size * sizeof(struct clog_ast_literal*));
+			if (!new)
+			{
+				ctx->body.failed = 1;
+				return 0;
+			}
+
+			ctx->string_alloc = new_size;
+			ctx->strings = new;
+		}
+		ctx->strings[ctx->string_count] = lit;
+
+		/* Literals are uncounted, so there is no reference to take */
+		clog_ec_printf(&ctx->body,"\tCLOG_RT_SET(rt,v[%lu],clog_rt_literal(rt,%lu));\n",t->dest,ctx->string_count++,0);
+		return 1;
+
+	case clog_ast_literal_integer:
+		if (!clog_value_from_integer(lit->value.integer,&v))
+			return clog_ec_error(ctx->parser,"Integer constant out of range",t->line);
+		break;
+
+	case clog_ast_literal_real:
+		v = clog_value_from_real(lit->value.real);
+		break;
+
+	case clog_ast_literal_bool:
+		v = CLOG_VALUE_BOOL(lit->value.integer);
+		break;
+
+	default:
+		v = CLOG_VALUE_NULL;
+		break;
+	}
+
+	/* The boxed bits, so reals come out exactly */
+	clog_ec_printf(&ctx->body,"\tCLOG_RT_SET(rt,v[%lu],CLOG_VALUE_C(0x%08lXUL,0x%08lXUL));\n",t->dest,(unsigned long)(v >> 32),(unsigned long)(v & 0xFFFFFFFFUL));
+	return 1;
+}
+
+/* The runtime call, which stops the program if it reports an error */
+static void clog_ec_call(struct clog_ec_context* ctx, const struct clog_cfg_triplet* t, const char* prefix)
+{
+	clog_ec_puts(&ctx->body,prefix);
+	clog_ec_puts(&ctx->body,"if (!clog_rt_");
+	clog_ec_puts(&ctx->body,t->val.args[1] == CLOG_CFG_NONE ? "unary(rt," : "binary(rt,");
+	clog_ec_puts(&ctx->body,clog_ec_op(t->op));
+	clog_ec_printf(&ctx->body,",&v[%lu],v[%lu]",t->dest,t->val.args[0],0);
+	if (t->val.args[1] != CLOG_CFG_NONE)
+		clog_ec_printf(&ctx->body,",v[%lu]",t->val.args[1],0,0);
+	clog_ec_printf(&ctx->body,",%luUL))\n\t\tgoto done;\n",t->line,0,0);
+}
+
+/* The same integer paths the interpreter has inline, then the runtime for the rest */
+static int clog_ec_triplet(struct clog_ec_context* ctx, const struct clog_cfg_triplet* t)
+{
+	unsigned long d = t->dest, a = t->val.args[0], b = t->val.args[1];
+	const char* expr = NULL;
+
+	switch (t->op)
+	{
+	case clog_opcode_MOV:
+		clog_ec_printf(&ctx->body,"\tCLOG_RT_COPY(rt,v[%lu],v[%lu]);\n",d,a,0);
+		return 1;
+
+	case clog_opcode_LOAD:
+		return clog_ec_load(ctx,t);
+
+	case clog_opcode_NOT:
+		clog_ec_printf(&ctx->body,"\tCLOG_RT_SET(rt,v[%lu],CLOG_VALUE_BOOL(!CLOG_RT_TRUTH(v[%lu])));\n",d,a,0);
+		return 1;
+
+	case clog_opcode_BOOL:
+		clog_ec_printf(&ctx->body,"\tCLOG_RT_SET(rt,v[%lu],CLOG_VALUE_BOOL(CLOG_RT_TRUTH(v[%lu])));\n",d,a,0);
+		return 1;
+
+	case clog_opcode_NEG:
+	case clog_opcode_BNOT:
+		clog_ec_call(ctx,t,"\t");
+		return 1;
+
+	case clog_opcode_ADD:
+		expr = "CLOG_VALUE_INT_BOX(v[%lu] + v[%lu])";
+		break;
+
+	case clog_opcode_SUB:
+		expr = "CLOG_VALUE_INT_BOX(v[%lu] - v[%lu])";
+		break;
+
+	case clog_opcode_MUL:
+		expr = "CLOG_VALUE_INT_BOX(v[%lu] * v[%lu])";
+		break;
+
+	case clog_opcode_LT:
+		expr = "CLOG_VALUE_BOOL(CLOG_VALUE_INT_KEY(v[%lu]) < CLOG_VALUE_INT_KEY(v[%lu]))";
+		break;
+
+	case clog_opcode_LE:
+		expr = "CLOG_VALUE_BOOL(CLOG_VALUE_INT_KEY(v[%lu]) <= CLOG_VALUE_INT_KEY(v[%lu]))";
+		break;
+
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+		/* Integers, bools and null are canonical, so equal bits means equal values */
+		clog_ec_printf(&ctx->body,"\tif (!CLOG_VALUE_IS_REAL(v[%lu]) && !CLOG_VALUE_IS(v[%lu],clog_value_string) && ",a,a,0);
+		clog_ec_printf(&ctx->body,"CLOG_VALUE_TYPE(v[%lu]) == CLOG_VALUE_TYPE(v[%lu]))\n",a,b,0);
+		clog_ec_printf(&ctx->body,t->op == clog_opcode_EQ ? "\t\tCLOG_RT_SET(rt,v[%lu],CLOG_VALUE_BOOL(v[%lu] == v[%lu]));\n" : "\t\tCLOG_RT_SET(rt,v[%lu],CLOG_VALUE_BOOL(v[%lu] != v[%lu]));\n",d,a,b);
+		clog_ec_call(ctx,t,"\telse ");
+		return 1;
+
+	default:
+		clog_ec_call(ctx,t,"\t");
+		return 1;
+	}
+
+	clog_ec_printf(&ctx->body,"\tif (CLOG_VALUE_IS(v[%lu],clog_value_integer) && CLOG_VALUE_IS(v[%lu],clog_value_integer))\n",a,b,0);
+	clog_ec_printf(&ctx->body,"\t\tCLOG_RT_SET(rt,v[%lu],",d,0,0);
+	clog_ec_printf(&ctx->body,expr,a,b,0);
+	clog_ec_puts(&ctx->body,");\n");
+	clog_ec_call(ctx,t,"\telse ");
+	return 1;
+}
+
+/* The phi copies for the edge from block to succ */
+static void clog_ec_edge(struct clog_ec_context* ctx, const struct clog_cfg_block* block, const struct clog_cfg_block* succ, const char* indent)
+{
+	unsigned int j, k;
+
+	for (k = 0; k < succ->pred_count && succ->preds[k] != block; ++k)
+		;
+
+	for (j = 0; j < succ->phi_count; ++j)
+	{
+		unsigned int arg = succ->phis[j].args[k];
+
+		clog_ec_puts(&ctx->body,indent);
+		if (arg == CLOG_CFG_NONE)
+			clog_ec_printf(&ctx->body,"CLOG_RT_SET(rt,v[%lu],CLOG_VALUE_NULL);\n",ctx->phi_slots[succ->rpo] + j,0,0);
+		else
+			clog_ec_printf(&ctx->body,"CLOG_RT_COPY(rt,v[%lu],v[%lu]);\n",ctx->phi_slots[succ->rpo] + j,arg,0);
+	}
+}
+
+static int clog_ec_block(struct clog_ec_context* ctx, unsigned int i)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	const struct clog_cfg_block* block = cfg->blocks[i];
+	const struct clog_cfg_block* next = (i + 1 < cfg->block_count ? cfg->blocks[i+1] : NULL);
+	unsigned int j;
+
+	if (ctx->labels[i])
+		clog_ec_printf(&ctx->body,"\nb%lu: ;\n",i,0,0);
+
+	/* The copies made on the way in become the phis, passing their references on */
+	for (j = 0; j < block->phi_count; ++j)
+	{
+		clog_ec_printf(&ctx->body,"\tCLOG_RT_SET(rt,v[%lu],v[%lu]);\n",block->phis[j].dest,ctx->phi_slots[i] + j,0);
+		clog_ec_printf(&ctx->body,"\tv[%lu] = CLOG_VALUE_NULL;\n",ctx->phi_slots[i] + j,0,0);
+	}
+
+	for (j = 0; j < block->triplet_count; ++j)
+	{
+		if (!clog_ec_triplet(ctx,&block->triplets[j]))
+			return 0;
+	}
+
+	if (block->cond != CLOG_CFG_NONE)
+	{
+		clog_ec_printf(&ctx->body,"\tif (CLOG_RT_TRUTH(v[%lu]))\n\t{\n",block->cond,0,0);
+		clog_ec_edge(ctx,block,block->branch,"\t\t");
+		clog_ec_printf(&ctx->body,"\t\tgoto b%lu;\n\t}\n",block->branch->rpo,0,0);
+	}
+
+	if (!block->fallthru)
+		clog_ec_puts(&ctx->body,"\tret = 1;\n\tgoto done;\n");
+	else
+	{
+		clog_ec_edge(ctx,block,block->fallthru,"\t");
+		if (block->fallthru != next)
+			clog_ec_printf(&ctx->body,"\tgoto b%lu;\n",block->fallthru->rpo,0,0);
+	}
+
+	return 1;
+}
+
+static int clog_ec_program(struct clog_ec_context* ctx)
+{
+	struct clog_cfg* cfg = ctx->cfg;
+	unsigned int i;
+
+	ctx->slots = cfg->value_count;
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		const struct clog_cfg_block* block = cfg->blocks[i];
+
+		ctx->phi_slots[i] = ctx->slots;
+		ctx->slots += block->phi_count;
+
+		/* Only label what is jumped to, unused labels are warnings */
+		if (block->cond != CLOG_CFG_NONE)
+			ctx->labels[block->branch->rpo] = 1;
+		if (block->fallthru && (i + 1 == cfg->block_count || block->fallthru != cfg->blocks[i+1]))
+			ctx->labels[block->fallthru->rpo] = 1;
+	}
+
+	if (!ctx->slots)
+		ctx->slots = 1;
+
+	clog_ec_printf(&ctx->body,"\tclog_value v[%lu];\n\tunsigned int i;\n\tint ret = 0;\n\n",ctx->slots,0,0);
+	clog_ec_printf(&ctx->body,"\tfor (i = 0; i < %luU; ++i)\n\t\tv[i] = CLOG_VALUE_NULL;\n",ctx->slots,0,0);
+
+	for (i = 0; i < cfg->block_count; ++i)
+	{
+		if (!clog_ec_block(ctx,i))
+			return 0;
+	}
+
+	clog_ec_printf(&ctx->body,"\ndone:\n\tfor (i = 0; i < %luU; ++i)\n\t\tCLOG_RT_SET(rt,v[i],CLOG_VALUE_NULL);\n\treturn ret;\n",ctx->slots,0,0);
+	return 1;
+}
+
+int clog_codegen_c(struct clog_parser* parser, struct clog_cfg* cfg, const char* name, char** src, size_t* len)
+{
+	struct clog_ec_context ctx;
+	struct clog_ec_text text;
+	unsigned int i;
+	int ok = 1;
+
+	memset(&ctx,0,sizeof(ctx));
+	ctx.cfg = cfg;
+	ctx.parser = parser;
+	ctx.body.allocator = &parser->allocator;
+
+	if (cfg && cfg->block_count)
+	{
+		ctx.phi_slots = clog_malloc(&parser->allocator,cfg->block_count * sizeof(unsigned int));
+		ctx.labels = clog_malloc(&parser->allocator,cfg->block_count);
+		if (!ctx.phi_slots || !ctx.labels)
+			ctx.body.failed = 1;
+		else
+		{
+			memset(ctx.labels,0,cfg->block_count);
+			ok = clog_ec_program(&ctx);
+		}
+	}
+	else
+		clog_ec_puts(&ctx.body,"\t(void)rt;\n\treturn 1;\n");
+
+	memset(&text,0,sizeof(text));
+	text.allocator = &parser->allocator;
+	if (ok)
+	{
+		clog_ec_puts(&text,"/* Generated by clog, do not edit */\n\n#include \"clog_rt.h\"\n\n");
+		if (ctx.string_count)
+		{
+			clog_ec_puts(&text,"static const struct clog_rt_literal s_literals[] =\n{\n");
+			for (i = 0; i < ctx.string_count; ++i)
+			{
+				clog_ec_puts(&text,"\t{ ");
+				clog_ec_quote(&text,ctx.strings[i]->value.string.str,ctx.strings[i]->value.string.len);
+				clog_ec_printf(&text,", %lu }",ctx.strings[i]->value.string.len,0,0);
+				clog_ec_puts(&text,i + 1 < ctx.string_count ? ",\n" : "\n");
+			}
+			clog_ec_puts(&text,"};\n\n");
+		}
+
+		clog_ec_puts(&text,"static int clog_program(struct clog_rt* rt)\n{\n");
+		clog_ec_append(&text,ctx.body.str ? ctx.body.str : "",ctx.body.len);
+		clog_ec_puts(&text,"}\n\nint ");
+		clog_ec_puts(&text,name);
+		clog_ec_puts(&text,"(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics)\n{\n");
+		if (ctx.string_count)
+			clog_ec_printf(&text,"\treturn clog_rt_run(allocator,diagnostics,&clog_program,s_literals,%luU);\n}\n",ctx.string_count,0,0);
+		else
+			clog_ec_puts(&text,"\treturn clog_rt_run(allocator,diagnostics,&clog_program,NULL,0);\n}\n");
+
+		if (ctx.body.failed || text.failed)
+		{
+			clog_diagnostic(parser,0,"Out of memory during code generation");
+			parser->failed = 1;
+			ok = 0;
+		}
+	}
+
+	clog_free(&parser->allocator,ctx.body.str);
+	clog_free(&parser->allocator,ctx.strings);
+	clog_free(&parser->allocator,ctx.labels);
+	clog_free(&parser->allocator,ctx.phi_slots);
+
+	if (!ok)
+	{
+		clog_free(&parser->allocator,text.str);
+		return 0;
+	}
+
+	*src = text.str;
+	*len = text.len;
+	return 1;
+}
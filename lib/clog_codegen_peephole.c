@@ -0,0 +1,560 @@
+/*
+ * clog_codegen_peephole.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_codegen.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#define CLOG_PH_BITS        (sizeof(unsigned long) * 8)
+#define CLOG_PH_WORDS       ((CLOG_MAX_REGISTERS + CLOG_PH_BITS - 1) / CLOG_PH_BITS)
+#define CLOG_PH_TEST(set,i) ((set)[(i) / CLOG_PH_BITS] & (1UL << ((i) % CLOG_PH_BITS)))
+#define CLOG_PH_SET(set,i)  ((set)[(i) / CLOG_PH_BITS] |= (1UL << ((i) % CLOG_PH_BITS)))
+
+/* Per instruction state, by pc */
+struct clog_ph_insn
+{
+	unsigned long live_out[CLOG_PH_WORDS];
+	unsigned char removed;
+	unsigned char leader;
+};
+
+struct clog_ph_context
+{
+	struct clog_parser*        parser;
+	struct clog_image_builder* builder;
+	struct clog_ph_insn*       insns;
+	unsigned int               count;
+};
+
+/* A pattern looks at the window starting at win[0], and rewrites it if it matches.
+ * win[1] is the next instruction still in the stream, and is never a jump target.
+ * Returns the number of instructions removed, or -1 if the window didn't match */
+struct clog_ph_pattern
+{
+	const char*  name;
+	unsigned int window;
+	int (*fn)(struct clog_ph_context* ctx, const unsigned int* win);
+};
+
+static int clog_ph_is_jump(unsigned int insn)
+{
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_JMP:
+	case clog_opcode_JMPT:
+	case clog_opcode_JMPF:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+static int clog_ph_is_compare(unsigned int insn)
+{
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_EQI:
+	case clog_opcode_LTI:
+	case clog_opcode_LEI:
+	case clog_opcode_GTI:
+	case clog_opcode_GEI:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* The JMP a compare immediate skips over can't be moved or removed on its own */
+static int clog_ph_is_follower(const struct clog_ph_context* ctx, unsigned int pc)
+{
+	return (pc > 0 && clog_ph_is_compare(ctx->builder->code[pc-1]));
+}
+
+/* Writes A, and has no effect other than writing A, so can go if A is dead */
+static int clog_ph_is_pure(unsigned int insn)
+{
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_MOV:
+	case clog_opcode_LOAD:
+	case clog_opcode_NOT:
+	case clog_opcode_BOOL:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* Returns the register written, or CLOG_MAX_REGISTERS, and the registers read in uses */
+static unsigned int clog_ph_regs(unsigned int insn, unsigned int uses[2], unsigned int* use_count)
+{
+	*use_count = 0;
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_LOAD:
+		return CLOG_INSN_A(insn);
+
+	case clog_opcode_MOV:
+	case clog_opcode_NEG:
+	case clog_opcode_NOT:
+	case clog_opcode_BNOT:
+	case clog_opcode_BOOL:
+	case clog_opcode_ADDI:
+	case clog_opcode_SUBI:
+		uses[(*use_count)++] = CLOG_INSN_B(insn);
+		return CLOG_INSN_A(insn);
+
+	case clog_opcode_JMP:
+		return CLOG_MAX_REGISTERS;
+
+	case clog_opcode_JMPT:
+	case clog_opcode_JMPF:
+	case clog_opcode_EQI:
+	case clog_opcode_LTI:
+	case clog_opcode_LEI:
+	case clog_opcode_GTI:
+	case clog_opcode_GEI:
+		uses[(*use_count)++] = CLOG_INSN_A(insn);
+		return CLOG_MAX_REGISTERS;
+
+	case clog_opcode_RET:
+		if (CLOG_INSN_B(insn))
+			uses[(*use_count)++] = CLOG_INSN_A(insn);
+		return CLOG_MAX_REGISTERS;
+
+	default:
+		uses[(*use_count)++] = CLOG_INSN_B(insn);
+		uses[(*use_count)++] = CLOG_INSN_C(insn);
+		return CLOG_INSN_A(insn);
+	}
+}
+
+/* The first instruction at or after pc still in the stream, count if there is none */
+static unsigned int clog_ph_next(const struct clog_ph_context* ctx, unsigned int pc)
+{
+	while (pc < ctx->count && ctx->insns[pc].removed)
+		++pc;
+
+	return pc;
+}
+
+/* The last instruction before pc still in the stream, count if there is none */
+static unsigned int clog_ph_prev(const struct clog_ph_context* ctx, unsigned int pc)
+{
+	while (pc--)
+	{
+		if (!ctx->insns[pc].removed)
+			return pc;
+	}
+
+	return ctx->count;
+}
+
+static unsigned int clog_ph_target(const struct clog_ph_context* ctx, unsigned int pc)
+{
+	return clog_ph_next(ctx,(unsigned int)((long)pc + 1 + CLOG_INSN_SBX(ctx->builder->code[pc])));
+}
+
+static int clog_ph_in_range(long offset)
+{
+	return (offset >= -CLOG_INSN_SBX_BIAS && offset <= 0xFFFF - CLOG_INSN_SBX_BIAS);
+}
+
+static void clog_ph_live_in(const struct clog_ph_context* ctx, unsigned int pc, unsigned long* live)
+{
+	unsigned int uses[2];
+	unsigned int use_count;
+	unsigned int def;
+
+	if (pc == ctx->count)
+	{
+		memset(live,0,sizeof(ctx->insns[0].live_out));
+		return;
+	}
+
+	memcpy(live,ctx->insns[pc].live_out,sizeof(ctx->insns[0].live_out));
+
+	def = clog_ph_regs(ctx->builder->code[pc],uses,&use_count);
+	if (def < CLOG_MAX_REGISTERS)
+		live[def / CLOG_PH_BITS] &= ~(1UL << (def % CLOG_PH_BITS));
+
+	while (use_count--)
+		CLOG_PH_SET(live,uses[use_count]);
+}
+
+/* Register liveness and jump targets over what is left of the stream */
+static void clog_ph_analyse(struct clog_ph_context* ctx)
+{
+	unsigned long live[CLOG_PH_WORDS];
+	unsigned int pc;
+	int changed;
+
+	for (pc = 0; pc < ctx->count; ++pc)
+	{
+		memset(ctx->insns[pc].live_out,0,sizeof(ctx->insns[pc].live_out));
+		ctx->insns[pc].leader = 0;
+	}
+
+	for (pc = 0; pc < ctx->count; ++pc)
+	{
+		unsigned int insn = ctx->builder->code[pc];
+		if (ctx->insns[pc].removed)
+			continue;
+
+		if (clog_ph_is_jump(insn))
+		{
+			unsigned int target = clog_ph_target(ctx,pc);
+			if (target < ctx->count)
+				ctx->insns[target].leader = 1;
+		}
+		else if (clog_ph_is_compare(insn))
+		{
+			/* Skipping the JMP lands after it */
+			unsigned int target = clog_ph_next(ctx,pc + 2);
+			if (target < ctx->count)
+				ctx->insns[target].leader = 1;
+		}
+	}
+
+	do
+	{
+		changed = 0;
+		pc = ctx->count;
+		while (pc--)
+		{
+			unsigned int insn = ctx->builder->code[pc];
+			unsigned int succs[2];
+			unsigned int succ_count = 0;
+			unsigned int i;
+
+			if (ctx->insns[pc].removed)
+				continue;
+
+			switch (CLOG_INSN_OP(insn))
+			{
+			case clog_opcode_RET:
+				break;
+
+			case clog_opcode_JMP:
+				succs[succ_count++] = clog_ph_target(ctx,pc);
+				break;
+
+			case clog_opcode_JMPT:
+			case clog_opcode_JMPF:
+				succs[succ_count++] = clog_ph_target(ctx,pc);
+				succs[succ_count++] = clog_ph_next(ctx,pc + 1);
+				break;
+
+			default:
+				succs[succ_count++] = clog_ph_next(ctx,pc + 1);
+				if (clog_ph_is_compare(insn))
+					succs[succ_count++] = clog_ph_next(ctx,pc + 2);
+				break;
+			}
+
+			while (succ_count--)
+			{
+				clog_ph_live_in(ctx,succs[succ_count],live);
+				for (i = 0; i < CLOG_PH_WORDS; ++i)
+				{
+					if (live[i] & ~ctx->insns[pc].live_out[i])
+					{
+						ctx->insns[pc].live_out[i] |= live[i];
+						changed = 1;
+					}
+				}
+			}
+		}
+	}
+	while (changed);
+}
+
+/* X a,...; MOV b,a with a dead => X b,... */
+static int clog_ph_mov_chain(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	unsigned int* code = ctx->builder->code;
+	unsigned int uses[2];
+	unsigned int use_count;
+	unsigned int def = clog_ph_regs(code[win[0]],uses,&use_count);
+
+	if (def == CLOG_MAX_REGISTERS ||
+			CLOG_INSN_OP(code[win[1]]) != clog_opcode_MOV ||
+			CLOG_INSN_B(code[win[1]]) != def ||
+			CLOG_PH_TEST(ctx->insns[win[1]].live_out,def))
+	{
+		return -1;
+	}
+
+	code[win[0]] = (code[win[0]] & ~0xFF00U) | (CLOG_INSN_A(code[win[1]]) << 8);
+	ctx->insns[win[1]].removed = 1;
+	return 1;
+}
+
+/* A pure instruction whose result is overwritten or never read */
+static int clog_ph_dead_store(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	unsigned int insn = ctx->builder->code[win[0]];
+
+	if (!clog_ph_is_pure(insn))
+		return -1;
+
+	if (CLOG_PH_TEST(ctx->insns[win[0]].live_out,CLOG_INSN_A(insn)) &&
+			(CLOG_INSN_OP(insn) != clog_opcode_MOV || CLOG_INSN_A(insn) != CLOG_INSN_B(insn)))
+	{
+		return -1;
+	}
+
+	ctx->insns[win[0]].removed = 1;
+	return 1;
+}
+
+/* NOT a,b; JMPT a with a dead => JMPF b, and BOOL the same without inverting */
+static int clog_ph_not_branch(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	unsigned int* code = ctx->builder->code;
+	unsigned int op = CLOG_INSN_OP(code[win[0]]);
+	unsigned int jmp = CLOG_INSN_OP(code[win[1]]);
+
+	if ((op != clog_opcode_NOT && op != clog_opcode_BOOL) ||
+			(jmp != clog_opcode_JMPT && jmp != clog_opcode_JMPF) ||
+			CLOG_INSN_A(code[win[1]]) != CLOG_INSN_A(code[win[0]]) ||
+			CLOG_PH_TEST(ctx->insns[win[1]].live_out,CLOG_INSN_A(code[win[0]])))
+	{
+		return -1;
+	}
+
+	if (op == clog_opcode_NOT)
+		jmp = (jmp == clog_opcode_JMPT ? clog_opcode_JMPF : clog_opcode_JMPT);
+
+	code[win[1]] = CLOG_INSN_ABX(jmp,CLOG_INSN_B(code[win[0]]),CLOG_INSN_BX(code[win[1]]));
+	ctx->insns[win[0]].removed = 1;
+	return 1;
+}
+
+/* A jump to a JMP goes straight to where that JMP goes */
+static int clog_ph_jump_thread(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	unsigned int* code = ctx->builder->code;
+	unsigned int target, hops;
+
+	if (!clog_ph_is_jump(code[win[0]]))
+		return -1;
+
+	target = clog_ph_target(ctx,win[0]);
+	for (hops = 0; target < ctx->count && hops < ctx->count; ++hops)
+	{
+		unsigned int next;
+		if (CLOG_INSN_OP(code[target]) != clog_opcode_JMP)
+			break;
+
+		next = clog_ph_target(ctx,target);
+		if (next == target)
+			break;
+
+		target = next;
+	}
+
+	if (target == clog_ph_target(ctx,win[0]) || target == ctx->count ||
+			!clog_ph_in_range((long)target - (long)(win[0] + 1)))
+	{
+		return -1;
+	}
+
+	code[win[0]] = CLOG_INSN_ASBX(CLOG_INSN_OP(code[win[0]]),CLOG_INSN_A(code[win[0]]),(long)target - (long)(win[0] + 1));
+	return 0;
+}
+
+/* A jump to the next instruction */
+static int clog_ph_jump_next(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	if (!clog_ph_is_jump(ctx->builder->code[win[0]]) ||
+			clog_ph_is_follower(ctx,win[0]) ||
+			clog_ph_target(ctx,win[0]) != clog_ph_next(ctx,win[0] + 1))
+	{
+		return -1;
+	}
+
+	ctx->insns[win[0]].removed = 1;
+	return 1;
+}
+
+/* Nothing jumps to it and control can't fall into it, like the JMP left behind a JMP when
+ * everything that jumped to it has been threaded past */
+static int clog_ph_unreachable(struct clog_ph_context* ctx, const unsigned int* win)
+{
+	unsigned int prev;
+
+	if (ctx->insns[win[0]].leader)
+		return -1;
+
+	prev = clog_ph_prev(ctx,win[0]);
+	if (prev == ctx->count ||
+			(CLOG_INSN_OP(ctx->builder->code[prev]) != clog_opcode_JMP && CLOG_INSN_OP(ctx->builder->code[prev]) != clog_opcode_RET))
+	{
+		return -1;
+	}
+
+	ctx->insns[win[0]].removed = 1;
+	return 1;
+}
+
+/* Tried in order at each instruction, the first to match wins */
+static const struct clog_ph_pattern s_patterns[clog_peephole_MAX] =
+{
+	{ "mov chain",   2, &clog_ph_mov_chain },
+	{ "dead store",  1, &clog_ph_dead_store },
+	{ "not branch",  2, &clog_ph_not_branch },
+	{ "jump thread", 1, &clog_ph_jump_thread },
+	{ "jump next",   1, &clog_ph_jump_next },
+	{ "unreachable", 1, &clog_ph_unreachable }
+};
+
+static int clog_ph_sweep(struct clog_ph_context* ctx, unsigned int* counts)
+{
+	unsigned int pc;
+	int changed = 0;
+
+	clog_ph_analyse(ctx);
+
+	for (pc = clog_ph_next(ctx,0); pc < ctx->count; pc = clog_ph_next(ctx,pc + 1))
+	{
+		unsigned int win[2];
+		unsigned int len = 1;
+		unsigned int p;
+
+		win[0] = pc;
+		win[1] = clog_ph_next(ctx,pc + 1);
+		if (win[1] < ctx->count && !ctx->insns[win[1]].leader)
+			len = 2;
+
+		for (p = 0; p < clog_peephole_MAX; ++p)
+		{
+			int n;
+			if (s_patterns[p].window > len)
+				continue;
+
+			n = (*s_patterns[p].fn)(ctx,win);
+			if (n >= 0)
+			{
+				counts[p] += n;
+
+				/* Anything that jumped to a removed instruction now lands on the next one */
+				if (ctx->insns[pc].removed && ctx->insns[pc].leader)
+				{
+					unsigned int next = clog_ph_next(ctx,pc + 1);
+					if (next < ctx->count)
+						ctx->insns[next].leader = 1;
+				}
+
+				/* Each rewrite only leaves liveness too big, never too small,
+				 * so the sweep carries on and the next one sees what it enabled */
+				changed = 1;
+				break;
+			}
+		}
+	}
+
+	return changed;
+}
+
+/* Squeezes out the removed instructions, moving jumps and line runs to match */
+static void clog_ph_compact(struct clog_ph_context* ctx, unsigned int* new_pc)
+{
+	struct clog_image_builder* builder = ctx->builder;
+	unsigned int pc, count = 0, i, line_count = 0;
+
+	for (pc = 0; pc < ctx->count; ++pc)
+	{
+		new_pc[pc] = count;
+		if (!ctx->insns[pc].removed)
+			++count;
+	}
+	new_pc[ctx->count] = count;
+
+	for (pc = 0; pc < ctx->count; ++pc)
+	{
+		unsigned int insn = builder->code[pc];
+		if (ctx->insns[pc].removed)
+			continue;
+
+		if (clog_ph_is_jump(insn))
+		{
+			long offset = (long)new_pc[clog_ph_target(ctx,pc)] - (long)(new_pc[pc] + 1);
+			insn = CLOG_INSN_ASBX(CLOG_INSN_OP(insn),CLOG_INSN_A(insn),offset);
+		}
+
+		builder->code[new_pc[pc]] = insn;
+	}
+	builder->code_count = count;
+
+	for (i = 0; i < builder->line_count; ++i)
+	{
+		unsigned int end = (i + 1 < builder->line_count ? builder->lines[i+1].pc : ctx->count);
+		unsigned int start = clog_ph_next(ctx,builder->lines[i].pc);
+
+		/* Drop runs that lost all their instructions, and merge runs that now meet */
+		if (start >= end || (line_count && builder->lines[line_count-1].line == builder->lines[i].line))
+			continue;
+
+		builder->lines[line_count].pc = new_pc[start];
+		builder->lines[line_count].line = builder->lines[i].line;
+		++line_count;
+	}
+	builder->line_count = line_count;
+}
+
+int clog_codegen_peephole(struct clog_parser* parser, struct clog_image_builder* builder)
+{
+	struct clog_ph_context ctx;
+	unsigned int counts[clog_peephole_MAX];
+	unsigned int* new_pc;
+
+	if (!builder->code_count)
+		return 1;
+
+	ctx.parser = parser;
+	ctx.builder = builder;
+	ctx.count = builder->code_count;
+	ctx.insns = clog_malloc(&parser->allocator,ctx.count * sizeof(struct clog_ph_insn));
+	new_pc = clog_malloc(&parser->allocator,(ctx.count + 1) * sizeof(unsigned int));
+	if (!ctx.insns || !new_pc)
+	{
+		clog_free(&parser->allocator,ctx.insns);
+		clog_free(&parser->allocator,new_pc);
+		clog_diagnostic(parser,0,"Out of memory during code generation");
+		parser->failed = 1;
+		return 0;
+	}
+
+	memset(ctx.insns,0,ctx.count * sizeof(struct clog_ph_insn));
+	memset(counts,0,sizeof(counts));
+
+	while (clog_ph_sweep(&ctx,counts))
+		;
+
+	clog_ph_compact(&ctx,new_pc);
+
+#if defined(CLOG_PEEPHOLE_COUNT)
+	/* The counts go out as diagnostics, so the public interface doesn't carry them */
+	{
+		unsigned int p;
+		for (p = 0; p < clog_peephole_MAX; ++p)
+		{
+			char buf[64];
+			sprintf(buf,"Peephole %s: removed %u instructions",s_patterns[p].name,counts[p]);
+			clog_diagnostic(parser,0,buf);
+		}
+	}
+#endif
+
+	clog_free(&parser->allocator,new_pc);
+	clog_free(&parser->allocator,ctx.insns);
+	return 1;
+}
@@ -5,42 +5,923 @@
  *      Author: rick
  */
 
-
+#include "clog_image.h"
 #include "clog_opcodes.h"
+#include "clog_vm_string.h"
+#include "clog_jit.h"
+#include "clog_rt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+struct clog_vm_state
+{
+	struct clog_allocator   allocator;
+	struct clog_diagnostics diagnostics;
+
+	struct clog_image      image;
+	clog_value*            regs;
+	clog_value*            constants;
+	struct clog_vm_heap    heap;
+	struct clog_vm_string* literals;
+
+#if defined(CLOG_JIT)
+	/* Loop iterations left before compiling, 0 once that has been tried */
+	struct clog_jit* jit;
+	unsigned int     jit_countdown;
+#endif
+
+#if defined(CLOG_DISPATCH_COUNT)
+	unsigned long dispatched;
+#endif
+
+#if defined(CLOG_RUN_RESULT)
+	clog_value result;
+#endif
+};
+
+#define CLOG_VM_STRING(v) ((struct clog_vm_string*)CLOG_VALUE_PTR(v))
 
+/* Every register write drops the old value, which may be the last reference to a string.
+ * v is evaluated before the register changes, so it may read the old value */
+#define CLOG_VM_SET(x,v) \
+	do { \
+		clog_value old_ = (x); \
+		(x) = (v); \
+		if (CLOG_VALUE_IS(old_,clog_value_string)) \
+			clog_vm_string_release(&state->heap,CLOG_VM_STRING(old_)); \
+	} while (0)
 
+static int clog_vm_report(struct clog_vm_state* state, unsigned long line, const char* msg)
+{
+	char buf[256];
+	sprintf(buf,"Runtime error: %.200s at line %lu",msg,line);
+
+	if (state->diagnostics.diag_fn)
+		(*state->diagnostics.diag_fn)(state->diagnostics.param,line,buf);
+	else
+		printf("%s\n",buf);
+
+	return 0;
+}
 
-#define DISPATCH() \
-	switch ((enum clog_opcode)(code[ip] % clog_opcode_MAX)) \
-	{ \
-	case clog_opcode_MAX: \
-	case clog_opcode_NOP: goto NOP; \
-	case clog_opcode_ARITH: goto ARITH; \
+static int clog_vm_error(struct clog_vm_state* state, const unsigned int* pc, const char* msg)
+{
+	/* pc has already moved past the failing instruction */
+	return clog_vm_report(state,clog_image_line(&state->image,(pc - 1) - state->image.code),msg);
+}
+
+static int clog_vm_truth(clog_value v)
+{
+	switch (CLOG_VALUE_TYPE(v))
+	{
+	case clog_value_bool:
+	case clog_value_integer:
+		return ((v & CLOG_VALUE_PAYLOAD) != 0);
+
+	case clog_value_real:
+		return (clog_value_to_real(v) != 0.0);
+
+	case clog_value_string:
+		return (CLOG_VM_STRING(v)->len != 0);
+
+	default:
+		return 0;
 	}
+}
 
-struct clog_vm_string
+/* null and bool promote to integer, the same as the constant folder */
+static int clog_vm_int_promote(clog_value v, clog_value_int* i)
 {
-	unsigned int refcount;
+	switch (CLOG_VALUE_TYPE(v))
+	{
+	case clog_value_null:
+	case clog_value_bool:
+		*i = (clog_value_int)(v & CLOG_VALUE_PAYLOAD);
+		return 1;
 
-};
+	case clog_value_integer:
+		*i = CLOG_VALUE_INT(v);
+		return 1;
 
-struct clog_vm_value
+	default:
+		*i = 0;
+		return 0;
+	}
+}
+
+static int clog_vm_real_promote(clog_value v, double* d)
 {
+	clog_value_int i;
+	if (CLOG_VALUE_IS_REAL(v))
+	{
+		*d = clog_value_to_real(v);
+		return 1;
+	}
 
-};
+	if (!clog_vm_int_promote(v,&i))
+	{
+		*d = 0.0;
+		return 0;
+	}
+
+	*d = (double)i;
+	return 1;
+}
 
-enum clog_vm_value_type
+/* The integer operators also take reals, truncated, as the constant folder converts them */
+static const char* clog_vm_int_convert(clog_value v, clog_value_int* i)
 {
-	clog_vm_value_string,
-	clog_vm_value_integer,
-	clog_vm_value_real,
-	clog_vm_value_pointer,
-};
+	if (CLOG_VALUE_IS_REAL(v))
+		return clog_value_real_to_integer(clog_value_to_real(v),i) ? NULL : "Real out of integer range";
 
-struct clog_vm_state
+	return clog_vm_int_promote(v,i) ? NULL : "Operator requires integers";
+}
+
+/* Beside a string, the other side of + or a comparison is converted to one. Returns a new reference */
+static struct clog_vm_string* clog_vm_to_string(struct clog_vm_state* state, clog_value v)
 {
-	struct clog_vm_value* accum;
-	enum clog_vm_value_type accum_type;
+	struct clog_vm_string* s;
+	unsigned char* buf;
+	char text[CLOG_VALUE_FORMAT_MAX];
+	size_t len;
+
+	if (CLOG_VALUE_IS(v,clog_value_string))
+	{
+		s = CLOG_VM_STRING(v);
+		CLOG_VM_STRING_ADDREF(s);
+		return s;
+	}
+
+	len = clog_value_format(v,text);
+	s = clog_vm_string_alloc(&state->heap,len,&buf);
+	if (s)
+		memcpy(buf,text,len);
+	return s;
+}
+
+/* Everything the fast paths in the loop don't handle, returns an error message or NULL */
+static const char* clog_vm_binary(struct clog_vm_state* state, unsigned int op, clog_value* r, clog_value a, clog_value b)
+{
+	struct clog_vm_string* s1;
+	struct clog_vm_string* s2;
+	clog_value_int i1, i2;
+	double d1, d2;
+	const char* err;
+	int cmp;
+
+	switch (op)
+	{
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+	case clog_opcode_LT:
+	case clog_opcode_LE:
+		if (CLOG_VALUE_IS(a,clog_value_string) || CLOG_VALUE_IS(b,clog_value_string))
+		{
+			s1 = clog_vm_to_string(state,a);
+			s2 = (s1 ? clog_vm_to_string(state,b) : NULL);
+			if (!s2 || !clog_vm_string_flatten(&state->heap,s1) || !clog_vm_string_flatten(&state->heap,s2))
+				cmp = 2;
+			else if (op == clog_opcode_EQ || op == clog_opcode_NE)
+				cmp = !clog_vm_string_equal(s1,s2);
+			else
+				cmp = clog_vm_string_compare(s1,s2);
+
+			clog_vm_string_release(&state->heap,s1);
+			clog_vm_string_release(&state->heap,s2);
+			if (cmp == 2)
+				return "Out of memory";
+		}
+		else if (CLOG_VALUE_IS_REAL(a) || CLOG_VALUE_IS_REAL(b))
+		{
+			clog_vm_real_promote(a,&d1);
+			clog_vm_real_promote(b,&d2);
+
+			/* NaN is unordered: not equal, not less, not less or equal */
+			if (d1 != d1 || d2 != d2)
+			{
+				*r = CLOG_VALUE_BOOL(op == clog_opcode_NE);
+				return NULL;
+			}
+			cmp = (d1 > d2 ? 1 : (d1 == d2 ? 0 : -1));
+		}
+		else
+		{
+			clog_vm_int_promote(a,&i1);
+			clog_vm_int_promote(b,&i2);
+			cmp = (i1 > i2 ? 1 : (i1 == i2 ? 0 : -1));
+		}
+
+		if (op == clog_opcode_EQ)
+			*r = CLOG_VALUE_BOOL(cmp == 0);
+		else if (op == clog_opcode_NE)
+			*r = CLOG_VALUE_BOOL(cmp != 0);
+		else if (op == clog_opcode_LT)
+			*r = CLOG_VALUE_BOOL(cmp < 0);
+		else
+			*r = CLOG_VALUE_BOOL(cmp <= 0);
+		return NULL;
+
+	case clog_opcode_ADD:
+	case clog_opcode_SUB:
+	case clog_opcode_MUL:
+	case clog_opcode_DIV:
+		if (CLOG_VALUE_IS(a,clog_value_string) || CLOG_VALUE_IS(b,clog_value_string))
+		{
+			struct clog_vm_string* s;
+
+			if (op != clog_opcode_ADD)
+				return "Arithmetic on a string";
+
+			/* + with a string on either side converts the other side */
+			s1 = clog_vm_to_string(state,a);
+			s2 = (s1 ? clog_vm_to_string(state,b) : NULL);
+			if (!s2)
+				s = NULL;
+			else if (s1->len == 0 || s2->len == 0)
+			{
+				/* Adding nothing shares the other string */
+				s = (s1->len ? s1 : s2);
+				CLOG_VM_STRING_ADDREF(s);
+			}
+			else
+				s = clog_vm_string_concat(&state->heap,s1,s2);
+
+			clog_vm_string_release(&state->heap,s1);
+			clog_vm_string_release(&state->heap,s2);
+			if (!s)
+				return "Out of memory";
+
+			*r = CLOG_VALUE_PTR_BOX(clog_value_string,s);
+			return NULL;
+		}
+
+		if (CLOG_VALUE_IS_REAL(a) || CLOG_VALUE_IS_REAL(b))
+		{
+			clog_vm_real_promote(a,&d1);
+			clog_vm_real_promote(b,&d2);
+
+			if (op == clog_opcode_ADD)
+				*r = clog_value_from_real(d1 + d2);
+			else if (op == clog_opcode_SUB)
+				*r = clog_value_from_real(d1 - d2);
+			else if (op == clog_opcode_MUL)
+				*r = clog_value_from_real(d1 * d2);
+			else if (d2 == 0.0)
+				return "Division by zero";
+			else
+				*r = clog_value_from_real(d1 / d2);
+			return NULL;
+		}
+
+		clog_vm_int_promote(a,&i1);
+		clog_vm_int_promote(b,&i2);
+
+		/* 48-bit operands can't overflow 64 bits, boxing wraps the result */
+		if (op == clog_opcode_ADD)
+			*r = CLOG_VALUE_INT_BOX(i1 + i2);
+		else if (op == clog_opcode_SUB)
+			*r = CLOG_VALUE_INT_BOX(i1 - i2);
+		else if (op == clog_opcode_MUL)
+			*r = CLOG_VALUE_INT_BOX((clog_value)i1 * (clog_value)i2);
+		else if (i2 == 0)
+			return "Division by zero";
+		else
+			*r = CLOG_VALUE_INT_BOX(i1 / i2);
+		return NULL;
+
+	case clog_opcode_MOD:
+	case clog_opcode_BAND:
+	case clog_opcode_BOR:
+	case clog_opcode_BXOR:
+	case clog_opcode_LSH:
+	case clog_opcode_RSH:
+		if ((err = clog_vm_int_convert(a,&i1)) != NULL || (err = clog_vm_int_convert(b,&i2)) != NULL)
+			return err;
+
+		if (op == clog_opcode_MOD)
+		{
+			if (i2 == 0)
+				return "Division by zero";
+			*r = CLOG_VALUE_INT_BOX(i1 % i2);
+		}
+		else if (op == clog_opcode_BAND)
+			*r = CLOG_VALUE_INT_BOX(i1 & i2);
+		else if (op == clog_opcode_BOR)
+			*r = CLOG_VALUE_INT_BOX(i1 | i2);
+		else if (op == clog_opcode_BXOR)
+			*r = CLOG_VALUE_INT_BOX(i1 ^ i2);
+		else if (i2 < 0 || i2 >= (clog_value_int)(sizeof(clog_value) * CHAR_BIT))
+			return "Shift count out of range";
+		else if (op == clog_opcode_LSH)
+			*r = CLOG_VALUE_INT_BOX((clog_value)i1 << i2);
+		else
+			*r = CLOG_VALUE_INT_BOX(i1 >> i2);
+		return NULL;
+
+	default:
+		return "Invalid instruction";
+	}
+}
+
+static const char* clog_vm_unary(unsigned int op, clog_value* r, clog_value a)
+{
+	clog_value_int i;
+
+	switch (op)
+	{
+	case clog_opcode_NEG:
+		if (CLOG_VALUE_IS_REAL(a))
+		{
+			*r = clog_value_from_real(-clog_value_to_real(a));
+			return NULL;
+		}
+		if (!clog_vm_int_promote(a,&i))
+			return "Unary - applied to string";
+
+		*r = CLOG_VALUE_INT_BOX(-i);
+		return NULL;
+
+	case clog_opcode_BNOT:
+		if (CLOG_VALUE_IS_REAL(a) ? !clog_value_real_to_integer(clog_value_to_real(a),&i) : !clog_vm_int_promote(a,&i))
+			return "~ requires an integer";
+
+		*r = CLOG_VALUE_INT_BOX(~i);
+		return NULL;
+
+	case clog_opcode_NOT:
+		*r = CLOG_VALUE_BOOL(!clog_vm_truth(a));
+		return NULL;
+
+	case clog_opcode_BOOL:
+		*r = CLOG_VALUE_BOOL(clog_vm_truth(a));
+		return NULL;
+
+	default:
+		return "Invalid instruction";
+	}
+}
+
+/* The slow path of a compare immediate, as the compare it replaced with the constant on the same side */
+static const char* clog_vm_compare_imm(struct clog_vm_state* state, unsigned int insn, clog_value a, int* test)
+{
+	clog_value k = CLOG_VALUE_INT_BOX(CLOG_INSN_SB(insn));
+	clog_value r = CLOG_VALUE_FALSE;
+	const char* err;
+
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_EQI:
+		err = clog_vm_binary(state,clog_opcode_EQ,&r,a,k);
+		break;
+
+	case clog_opcode_LTI:
+		err = clog_vm_binary(state,clog_opcode_LT,&r,a,k);
+		break;
+
+	case clog_opcode_LEI:
+		err = clog_vm_binary(state,clog_opcode_LE,&r,a,k);
+		break;
+
+	case clog_opcode_GTI:
+		err = clog_vm_binary(state,clog_opcode_LT,&r,k,a);
+		break;
+
+	default:
+		err = clog_vm_binary(state,clog_opcode_LE,&r,k,a);
+		break;
+	}
+
+	*test = (r == CLOG_VALUE_TRUE);
+	return err;
+}
+
+/* Benchmark builds count every instruction fetched */
+#if defined(CLOG_DISPATCH_COUNT)
+#define CLOG_VM_COUNT() (++state->dispatched)
+#else
+#define CLOG_VM_COUNT() ((void)0)
+#endif
+
+/* Dispatch is either threaded through a table of label addresses, or a switch in a loop */
+#if defined(CLOG_COMPUTED_GOTO) && defined(__GNUC__)
+#define CLOG_VM_OP(op) op_##op:
+#define CLOG_VM_NEXT() do { CLOG_VM_COUNT(); insn = *pc++; goto *s_labels[CLOG_INSN_OP(insn)]; } while (0)
+#else
+#undef CLOG_COMPUTED_GOTO
+#define CLOG_VM_OP(op) case clog_opcode_##op:
+#define CLOG_VM_NEXT() continue
+#endif
+
+#define R(x) (regs[CLOG_INSN_##x(insn)])
+
+#if defined(CLOG_JIT)
+/* CLOG_JIT_THRESHOLD in the environment overrides the default, and 0 turns the JIT off */
+static unsigned int clog_vm_jit_threshold(void)
+{
+	const char* env = getenv("CLOG_JIT_THRESHOLD");
+	unsigned long n;
+	char* end;
+
+	if (!env || !*env)
+		return CLOG_JIT_THRESHOLD;
+
+	n = strtoul(env,&end,10);
+	return (*end == '\0' && n <= UINT_MAX ? (unsigned int)n : CLOG_JIT_THRESHOLD);
+}
+
+static int clog_vm_jit_compile(struct clog_vm_state* state)
+{
+	state->jit = clog_jit_compile(&state->allocator,state->image.code,state->image.header->code.count,state->constants);
+	return (state->jit != NULL);
+}
+
+/* A taken backward jump is a loop iteration: once there have been enough, carry on in native code */
+#define CLOG_VM_LOOP() \
+	do { \
+		if (state->jit || (state->jit_countdown && !--state->jit_countdown && clog_vm_jit_compile(state))) \
+			pc = state->image.code + clog_jit_enter(state->jit,regs,(unsigned int)(pc - state->image.code)); \
+	} while (0)
+#else
+#define CLOG_VM_LOOP() do { } while (0)
+#endif
+
+static int clog_vm_execute(struct clog_vm_state* state)
+{
+	clog_value* regs = state->regs;
+	const clog_value* constants = state->constants;
+	const unsigned int* pc = state->image.code;
+	clog_value r;
+	unsigned int insn;
+	const char* err;
+	int test;
+
+#if defined(CLOG_COMPUTED_GOTO)
+	/* In enum clog_opcode order */
+	static const void* const s_labels[] =
+	{
+		&&op_MOV, &&op_LOAD, &&op_NEG, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD,
+		&&op_RSH, &&op_LSH, &&op_NOT, &&op_BNOT, &&op_BAND, &&op_BOR, &&op_BXOR,
+		&&op_EQ, &&op_NE, &&op_LT, &&op_LE, &&op_BOOL, &&op_JMP, &&op_JMPT, &&op_JMPF,
+		&&op_RET, &&op_ADDI, &&op_SUBI, &&op_EQI, &&op_LTI, &&op_LEI, &&op_GTI, &&op_GEI
+	};
+	typedef char clog_vm_labels_check[(sizeof(s_labels) / sizeof(s_labels[0]) == clog_opcode_MAX) ? 1 : -1];
+	(void)sizeof(clog_vm_labels_check);
+
+	CLOG_VM_NEXT();
+#else
+	for (;;)
+	{
+		CLOG_VM_COUNT();
+		insn = *pc++;
+		switch (CLOG_INSN_OP(insn))
+		{
+#endif
+		CLOG_VM_OP(MOV)
+			r = R(B);
+			if (CLOG_VALUE_IS(r,clog_value_string))
+				CLOG_VM_STRING_ADDREF(CLOG_VM_STRING(r));
+			CLOG_VM_SET(R(A),r);
+			CLOG_VM_NEXT();
 
+		CLOG_VM_OP(LOAD)
+			CLOG_VM_SET(R(A),constants[CLOG_INSN_BX(insn)]);
+			CLOG_VM_NEXT();
 
+		CLOG_VM_OP(ADD)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer) && CLOG_VALUE_IS(R(C),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_INT_BOX(R(B) + R(C)));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(SUB)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer) && CLOG_VALUE_IS(R(C),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_INT_BOX(R(B) - R(C)));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(MUL)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer) && CLOG_VALUE_IS(R(C),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_INT_BOX(R(B) * R(C)));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(LT)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer) && CLOG_VALUE_IS(R(C),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_BOOL(CLOG_VALUE_INT_KEY(R(B)) < CLOG_VALUE_INT_KEY(R(C))));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(LE)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer) && CLOG_VALUE_IS(R(C),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_BOOL(CLOG_VALUE_INT_KEY(R(B)) <= CLOG_VALUE_INT_KEY(R(C))));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(EQ)
+		CLOG_VM_OP(NE)
+			/* Integers, bools and null are canonical, so equal bits means equal values */
+			if (!CLOG_VALUE_IS_REAL(R(B)) && !CLOG_VALUE_IS(R(B),clog_value_string) && CLOG_VALUE_TYPE(R(B)) == CLOG_VALUE_TYPE(R(C)))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_BOOL((R(B) == R(C)) == (CLOG_INSN_OP(insn) == clog_opcode_EQ)));
+				CLOG_VM_NEXT();
+			}
+			goto binary;
+
+		CLOG_VM_OP(DIV)
+		CLOG_VM_OP(MOD)
+		CLOG_VM_OP(RSH)
+		CLOG_VM_OP(LSH)
+		CLOG_VM_OP(BAND)
+		CLOG_VM_OP(BOR)
+		CLOG_VM_OP(BXOR)
+		binary:
+			/* Slow path, the result is built aside in case A is also an operand */
+			if ((err = clog_vm_binary(state,CLOG_INSN_OP(insn),&r,R(B),R(C))) != NULL)
+				return clog_vm_error(state,pc,err);
+			CLOG_VM_SET(R(A),r);
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(NEG)
+		CLOG_VM_OP(NOT)
+		CLOG_VM_OP(BNOT)
+		CLOG_VM_OP(BOOL)
+			if ((err = clog_vm_unary(CLOG_INSN_OP(insn),&r,R(B))) != NULL)
+				return clog_vm_error(state,pc,err);
+			CLOG_VM_SET(R(A),r);
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(JMP)
+			pc += CLOG_INSN_SBX(insn);
+			if (CLOG_INSN_SBX(insn) < 0)
+				CLOG_VM_LOOP();
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(JMPT)
+			if (R(A) == CLOG_VALUE_TRUE || (R(A) != CLOG_VALUE_FALSE && clog_vm_truth(R(A))))
+			{
+				pc += CLOG_INSN_SBX(insn);
+				if (CLOG_INSN_SBX(insn) < 0)
+					CLOG_VM_LOOP();
+			}
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(JMPF)
+			if (R(A) == CLOG_VALUE_FALSE || (R(A) != CLOG_VALUE_TRUE && !clog_vm_truth(R(A))))
+			{
+				pc += CLOG_INSN_SBX(insn);
+				if (CLOG_INSN_SBX(insn) < 0)
+					CLOG_VM_LOOP();
+			}
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(ADDI)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_INT_BOX(R(B) + (clog_value)CLOG_INSN_SC(insn)));
+				CLOG_VM_NEXT();
+			}
+			goto binary_imm;
+
+		CLOG_VM_OP(SUBI)
+			if (CLOG_VALUE_IS(R(B),clog_value_integer))
+			{
+				CLOG_VM_SET(R(A),CLOG_VALUE_INT_BOX(R(B) - (clog_value)CLOG_INSN_SC(insn)));
+				CLOG_VM_NEXT();
+			}
+		binary_imm:
+			if ((err = clog_vm_binary(state,CLOG_INSN_OP(insn) == clog_opcode_ADDI ? clog_opcode_ADD : clog_opcode_SUB,&r,R(B),CLOG_VALUE_INT_BOX(CLOG_INSN_SC(insn)))) != NULL)
+				return clog_vm_error(state,pc,err);
+			CLOG_VM_SET(R(A),r);
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(EQI)
+			if (CLOG_VALUE_IS(R(A),clog_value_integer))
+			{
+				test = (CLOG_VALUE_INT(R(A)) == CLOG_INSN_SB(insn));
+				goto compare_jmp;
+			}
+			goto compare_imm;
+
+		CLOG_VM_OP(LTI)
+			if (CLOG_VALUE_IS(R(A),clog_value_integer))
+			{
+				test = (CLOG_VALUE_INT(R(A)) < CLOG_INSN_SB(insn));
+				goto compare_jmp;
+			}
+			goto compare_imm;
+
+		CLOG_VM_OP(LEI)
+			if (CLOG_VALUE_IS(R(A),clog_value_integer))
+			{
+				test = (CLOG_VALUE_INT(R(A)) <= CLOG_INSN_SB(insn));
+				goto compare_jmp;
+			}
+			goto compare_imm;
+
+		CLOG_VM_OP(GTI)
+			if (CLOG_VALUE_IS(R(A),clog_value_integer))
+			{
+				test = (CLOG_VALUE_INT(R(A)) > CLOG_INSN_SB(insn));
+				goto compare_jmp;
+			}
+			goto compare_imm;
+
+		CLOG_VM_OP(GEI)
+			if (CLOG_VALUE_IS(R(A),clog_value_integer))
+			{
+				test = (CLOG_VALUE_INT(R(A)) >= CLOG_INSN_SB(insn));
+				goto compare_jmp;
+			}
+		compare_imm:
+			if ((err = clog_vm_compare_imm(state,insn,R(A),&test)) != NULL)
+				return clog_vm_error(state,pc,err);
+		compare_jmp:
+			/* pc is at the JMP that follows, which is taken here rather than dispatched */
+			if (test != (int)CLOG_INSN_C(insn))
+				++pc;
+			else
+			{
+				insn = *pc;
+				pc += 1 + CLOG_INSN_SBX(insn);
+				if (CLOG_INSN_SBX(insn) < 0)
+					CLOG_VM_LOOP();
+			}
+			CLOG_VM_NEXT();
+
+		CLOG_VM_OP(RET)
+#if defined(CLOG_RUN_RESULT)
+			state->result = (CLOG_INSN_B(insn) ? R(A) : CLOG_VALUE_NULL);
+			if (CLOG_VALUE_IS(state->result,clog_value_string))
+				CLOG_VM_STRING_ADDREF(CLOG_VM_STRING(state->result));
+#endif
+			return 1;
+
+#if !defined(CLOG_COMPUTED_GOTO)
+		default:
+			/* The image was verified when it was loaded */
+			return clog_vm_error(state,pc,"Invalid instruction");
+		}
+	}
+#endif
+}
+
+#undef R
+
+#if defined(CLOG_RUN_RESULT)
+/* The value returned goes out as a diagnostic, so tests can compare runs */
+static void clog_vm_report_result(struct clog_vm_state* state)
+{
+	static const char* const s_types[] = { "real", "null", "bool", "integer", "string", "object" };
+	clog_value v = state->result;
+	char* buf;
+	size_t len = CLOG_VALUE_FORMAT_MAX;
+
+	if (CLOG_VALUE_IS(v,clog_value_string))
+	{
+		if (!clog_vm_string_flatten(&state->heap,CLOG_VM_STRING(v)))
+			return;
+		len = CLOG_VM_STRING(v)->len;
+	}
+
+	buf = clog_malloc(&state->allocator,len + 32);
+	if (!buf)
+		return;
+
+	len = sprintf(buf,"Returned %s ",s_types[CLOG_VALUE_TYPE(v)]);
+	if (!CLOG_VALUE_IS(v,clog_value_string))
+		clog_value_format(v,buf + len);
+	else
+	{
+		memcpy(buf + len,CLOG_VM_STRING(v)->str,CLOG_VM_STRING(v)->len);
+		buf[len + CLOG_VM_STRING(v)->len] = '\0';
+	}
+
+	(*state->diagnostics.diag_fn)(state->diagnostics.param,0,buf);
+	clog_free(&state->allocator,buf);
+}
+#endif
+
+int clog_run(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, const void* image, size_t len)
+{
+	struct clog_vm_state state;
+	unsigned int strings = 0;
+	unsigned int i;
+	int ret;
+
+	memset(&state,0,sizeof(state));
+	state.allocator = *(allocator ? allocator : clog_default_allocator());
+	if (diagnostics)
+		state.diagnostics = *diagnostics;
+
+	if (!clog_image_load(&state.image,image,len))
+	{
+		if (state.diagnostics.diag_fn)
+			(*state.diagnostics.diag_fn)(state.diagnostics.param,0,"Invalid code image");
+		else
+			printf("Invalid code image\n");
+		return 0;
+	}
+
+	if (!state.image.header->code.count)
+		return 1;
+
+	/* Registers and a writable copy of the constants, with string offsets turned into pointers */
+	state.regs = clog_malloc(&state.allocator,(state.image.header->registers + 1 + state.image.header->constants.count) * sizeof(clog_value));
+	if (!state.regs)
+		return -1;
+
+	for (i = 0; i < state.image.header->registers; ++i)
+		state.regs[i] = CLOG_VALUE_NULL;
+
+	for (i = 0; i < state.image.header->constants.count; ++i)
+	{
+		if (CLOG_VALUE_IS(state.image.constants[i],clog_value_string))
+			++strings;
+	}
+
+	/* Each literal is one uncounted string, shared by every load of it, with the text left in the image */
+	if (strings)
+	{
+		state.literals = clog_malloc(&state.allocator,strings * sizeof(struct clog_vm_string));
+		if (!state.literals)
+		{
+			clog_free(&state.allocator,state.regs);
+			return -1;
+		}
+	}
+
+	state.constants = state.regs + state.image.header->registers + 1;
+	for (i = 0, strings = 0; i < state.image.header->constants.count; ++i)
+	{
+		clog_value v = state.image.constants[i];
+		if (CLOG_VALUE_IS(v,clog_value_string))
+		{
+			const struct clog_image_string* str = clog_image_get_string(&state.image,v);
+			struct clog_vm_string* lit = &state.literals[strings++];
+			lit->refcount = 0;
+			lit->kind = clog_vm_string_static;
+			lit->len = str->len;
+			lit->hash = str->hash;
+			lit->str = str->str;
+
+			v = CLOG_VALUE_PTR_BOX(clog_value_string,lit);
+		}
+		state.constants[i] = v;
+	}
+
+	clog_vm_heap_init(&state.heap,&state.allocator);
+
+#if defined(CLOG_JIT)
+	state.jit_countdown = clog_vm_jit_threshold();
+#endif
+
+#if defined(CLOG_RUN_RESULT)
+	state.result = CLOG_VALUE_NULL;
+#endif
+
+	ret = clog_vm_execute(&state);
+
+#if defined(CLOG_JIT)
+	clog_jit_free(state.jit);
+#endif
+
+#if defined(CLOG_DISPATCH_COUNT)
+	/* The count goes out as a diagnostic, so the public interface doesn't carry it */
+	if (state.diagnostics.diag_fn)
+	{
+		char buf[64];
+		sprintf(buf,"Dispatched %lu instructions",state.dispatched);
+		(*state.diagnostics.diag_fn)(state.diagnostics.param,0,buf);
+	}
+#endif
+
+#if defined(CLOG_RUN_RESULT)
+	if (ret == 1 && state.diagnostics.diag_fn)
+		clog_vm_report_result(&state);
+	if (CLOG_VALUE_IS(state.result,clog_value_string))
+		clog_vm_string_release(&state.heap,CLOG_VM_STRING(state.result));
+#endif
+
+	for (i = 0; i < state.image.header->registers; ++i)
+	{
+		if (CLOG_VALUE_IS(state.regs[i],clog_value_string))
+			clog_vm_string_release(&state.heap,CLOG_VM_STRING(state.regs[i]));
+	}
+
+	clog_vm_heap_free(&state.heap);
+	clog_free(&state.allocator,state.literals);
+	clog_free(&state.allocator,state.regs);
+
+	return ret;
+}
+
+/* A translated program runs on a VM state with no image, its literals are kept alongside */
+struct clog_rt
+{
+	struct clog_vm_state state;
+	clog_value*          literals;
 };
+
+int clog_rt_run(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*program)(struct clog_rt* rt), const struct clog_rt_literal* literals, unsigned int literal_count)
+{
+	struct clog_rt rt;
+	unsigned int i;
+	int ret;
+
+	memset(&rt,0,sizeof(rt));
+	rt.state.allocator = *(allocator ? allocator : clog_default_allocator());
+	if (diagnostics)
+		rt.state.diagnostics = *diagnostics;
+
+	/* As clog_run does for the image, each literal is one uncounted string */
+	if (literal_count)
+	{
+		rt.literals = clog_malloc(&rt.state.allocator,literal_count * sizeof(clog_value));
+		rt.state.literals = clog_malloc(&rt.state.allocator,literal_count * sizeof(struct clog_vm_string));
+		if (!rt.literals || !rt.state.literals)
+		{
+			clog_free(&rt.state.allocator,rt.state.literals);
+			clog_free(&rt.state.allocator,rt.literals);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < literal_count; ++i)
+	{
+		struct clog_vm_string* lit = &rt.state.literals[i];
+		lit->refcount = 0;
+		lit->kind = clog_vm_string_static;
+		lit->len = literals[i].len;
+		lit->hash = clog_vm_hash((const unsigned char*)literals[i].str,literals[i].len);
+		lit->str = (const unsigned char*)literals[i].str;
+
+		rt.literals[i] = CLOG_VALUE_PTR_BOX(clog_value_string,lit);
+	}
+
+	clog_vm_heap_init(&rt.state.heap,&rt.state.allocator);
+
+	ret = (*program)(&rt);
+
+	clog_vm_heap_free(&rt.state.heap);
+	clog_free(&rt.state.allocator,rt.state.literals);
+	clog_free(&rt.state.allocator,rt.literals);
+
+	return ret;
+}
+
+clog_value clog_rt_literal(const struct clog_rt* rt, unsigned int idx)
+{
+	return rt->literals[idx];
+}
+
+int clog_rt_binary(struct clog_rt* rt, unsigned int op, clog_value* r, clog_value a, clog_value b, unsigned long line)
+{
+	struct clog_vm_state* state = &rt->state;
+	clog_value v;
+	const char* err = clog_vm_binary(state,op,&v,a,b);
+	if (err)
+		return clog_vm_report(state,line,err);
+
+	CLOG_VM_SET(*r,v);
+	return 1;
+}
+
+int clog_rt_unary(struct clog_rt* rt, unsigned int op, clog_value* r, clog_value a, unsigned long line)
+{
+	struct clog_vm_state* state = &rt->state;
+	clog_value v;
+	const char* err = clog_vm_unary(op,&v,a);
+	if (err)
+		return clog_vm_report(state,line,err);
+
+	CLOG_VM_SET(*r,v);
+	return 1;
+}
+
+int clog_rt_truth(clog_value v)
+{
+	return clog_vm_truth(v);
+}
+
+void clog_rt_addref(clog_value v)
+{
+	CLOG_VM_STRING_ADDREF(CLOG_VM_STRING(v));
+}
+
+void clog_rt_release(struct clog_rt* rt, clog_value v)
+{
+	clog_vm_string_release(&rt->state.heap,CLOG_VM_STRING(v));
+}
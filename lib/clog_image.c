@@ -0,0 +1,513 @@
+/*
+ * clog_image.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_image.h"
+#include "clog_opcodes.h"
+#include "clog_vm_string.h"
+
+#include <string.h>
+
+#define CLOG_IMAGE_BYTE_ORDER 0x01020304U
+#define CLOG_IMAGE_ABI        ((unsigned int)(sizeof(long) | (sizeof(double) << 8) | (sizeof(clog_value) << 16)))
+
+/* Sections start on a boundary good enough for the constants */
+#define CLOG_IMAGE_ALIGN(s) (((s) + 7) & ~(size_t)7)
+
+static unsigned long clog_image_hash(unsigned long h, const unsigned char* p, size_t len)
+{
+	/* FNV-1a */
+	while (len--)
+	{
+		h ^= *p++;
+		h = (h * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	return h;
+}
+
+static const struct clog_image_string* clog_image_builder_string(const struct clog_image_builder* builder, clog_value v)
+{
+	return (const struct clog_image_string*)(builder->strings + (size_t)(v & CLOG_VALUE_PAYLOAD));
+}
+
+static unsigned long clog_image_constant_hash(const struct clog_image_builder* builder, clog_value v)
+{
+	if (CLOG_VALUE_IS(v,clog_value_string))
+	{
+		return clog_image_builder_string(builder,v)->hash;
+	}
+
+	/* Bitwise, so 0.0 and -0.0 stay distinct */
+	return clog_image_hash(2166136261UL,(const unsigned char*)&v,sizeof(v));
+}
+
+static int clog_image_constant_equal(const struct clog_image_builder* builder, clog_value v1, clog_value v2)
+{
+	if (CLOG_VALUE_IS(v1,clog_value_string) && CLOG_VALUE_IS(v2,clog_value_string))
+	{
+		const struct clog_image_string* str1 = clog_image_builder_string(builder,v1);
+		const struct clog_image_string* str2 = clog_image_builder_string(builder,v2);
+		return (str1->len == str2->len && str1->hash == str2->hash && memcmp(str1->str,str2->str,str1->len) == 0);
+	}
+
+	return (v1 == v2);
+}
+
+void clog_image_builder_init(struct clog_image_builder* builder, const struct clog_allocator* allocator)
+{
+	memset(builder,0,sizeof(struct clog_image_builder));
+	builder->allocator = allocator;
+}
+
+void clog_image_builder_free(struct clog_image_builder* builder)
+{
+	clog_free(builder->allocator,builder->constants);
+	clog_free(builder->allocator,builder->buckets);
+	clog_free(builder->allocator,builder->code);
+	clog_free(builder->allocator,builder->lines);
+	clog_free(builder->allocator,builder->strings);
+
+	clog_image_builder_init(builder,builder->allocator);
+}
+
+static int clog_image_rehash(struct clog_image_builder* builder)
+{
+	unsigned int i;
+	unsigned int new_size = (builder->bucket_count == 0 ? 64 : builder->bucket_count * 2);
+	unsigned int* new_buckets = clog_malloc(builder->allocator,new_size * sizeof(unsigned int));
+	if (!new_buckets)
+		return 0;
+
+	memset(new_buckets,0,new_size * sizeof(unsigned int));
+
+	for (i = 0; i < builder->constant_count; ++i)
+	{
+		unsigned int b = clog_image_constant_hash(builder,builder->constants[i]) & (new_size - 1);
+		while (new_buckets[b])
+			b = (b + 1) & (new_size - 1);
+
+		new_buckets[b] = i + 1;
+	}
+
+	clog_free(builder->allocator,builder->buckets);
+	builder->buckets = new_buckets;
+	builder->bucket_count = new_size;
+	return 1;
+}
+
+/* Adds v, unless an equal constant is already in the pool */
+static int clog_image_intern(struct clog_image_builder* builder, clog_value v, unsigned int* idx)
+{
+	unsigned long hash = clog_image_constant_hash(builder,v);
+	unsigned int b;
+
+	if (builder->bucket_count)
+	{
+		for (b = hash & (builder->bucket_count - 1); builder->buckets[b]; b = (b + 1) & (builder->bucket_count - 1))
+		{
+			if (clog_image_constant_equal(builder,builder->constants[builder->buckets[b] - 1],v))
+			{
+				*idx = builder->buckets[b] - 1;
+				return 1;
+			}
+		}
+	}
+
+	if (builder->constant_count == CLOG_MAX_CONSTANTS)
+		return 0;
+
+	/* Keep the load factor under a half */
+	if ((builder->constant_count + 1) * 2 > builder->bucket_count)
+	{
+		if (!clog_image_rehash(builder))
+			return 0;
+	}
+
+	if (builder->constant_count == builder->constant_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (builder->constant_alloc == 0 ? 16 : builder->constant_alloc * 2);
+		clog_value* new = clog_realloc(builder->allocator,builder->constants,new_size * sizeof(clog_value));
+		if (!new)
+			return 0;
+
+		builder->constant_alloc = new_size;
+		builder->constants = new;
+	}
+
+	for (b = hash & (builder->bucket_count - 1); builder->buckets[b]; b = (b + 1) & (builder->bucket_count - 1))
+		;
+
+	builder->constants[builder->constant_count] = v;
+	builder->buckets[b] = builder->constant_count + 1;
+	*idx = builder->constant_count++;
+	return 1;
+}
+
+int clog_image_string(struct clog_image_builder* builder, const unsigned char* sz, size_t len, unsigned int* idx)
+{
+	struct clog_image_string* str;
+	unsigned int start = builder->strings_len;
+	size_t size;
+
+	if (len >= 0x7FFFFFFFUL - builder->strings_len - 8)
+		return 0;
+
+	/* Append the text speculatively, a duplicate just rolls it back */
+	size = CLOG_IMAGE_STRING_SIZE(len);
+	if (builder->strings_len + size > builder->strings_alloc)
+	{
+		unsigned int new_size = (builder->strings_alloc == 0 ? 256 : builder->strings_alloc);
+		unsigned char* new_strings;
+		while (new_size < builder->strings_len + size)
+			new_size *= 2;
+
+		new_strings = clog_realloc(builder->allocator,builder->strings,new_size);
+		if (!new_strings)
+			return 0;
+
+		builder->strings = new_strings;
+		builder->strings_alloc = new_size;
+	}
+
+	/* Zero the padding, the same program always gives the same bytes */
+	memset(builder->strings + start,0,size);
+	str = (struct clog_image_string*)(builder->strings + start);
+	str->len = len;
+	str->hash = clog_vm_hash(sz,len);
+	if (len)
+		memcpy(str->str,sz,len);
+
+	if (!clog_image_intern(builder,CLOG_VALUE_PTR_BOX(clog_value_string,start),idx))
+		return 0;
+
+	if (builder->constants[*idx] == CLOG_VALUE_PTR_BOX(clog_value_string,start))
+		builder->strings_len += size;
+
+	return 1;
+}
+
+int clog_image_constant(struct clog_image_builder* builder, const struct clog_ast_literal* lit, unsigned int* idx)
+{
+	clog_value v;
+
+	switch (lit->type)
+	{
+	case clog_ast_literal_string:
+		return clog_image_string(builder,lit->value.string.str,lit->value.string.len,idx);
+
+	case clog_ast_literal_integer:
+		if (!clog_value_from_integer(lit->value.integer,&v))
+			return 0;
+		break;
+
+	case clog_ast_literal_real:
+		v = clog_value_from_real(lit->value.real);
+		break;
+
+	case clog_ast_literal_bool:
+		v = CLOG_VALUE_BOOL(lit->value.integer);
+		break;
+
+	default:
+		v = CLOG_VALUE_NULL;
+		break;
+	}
+
+	return clog_image_intern(builder,v,idx);
+}
+
+int clog_image_emit(struct clog_image_builder* builder, unsigned int insn, unsigned long line)
+{
+	if (builder->code_count == builder->code_alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (builder->code_alloc == 0 ? 64 : builder->code_alloc * 2);
+		unsigned int* new = clog_realloc(builder->allocator,builder->code,new_size * sizeof(unsigned int));
+		if (!new)
+			return 0;
+
+		builder->code_alloc = new_size;
+		builder->code = new;
+	}
+
+	/* Only record where the line changes */
+	if (line && (builder->line_count == 0 || builder->lines[builder->line_count-1].line != line))
+	{
+		if (builder->line_count == builder->line_alloc)
+		{
+			/* Resize array */
+			unsigned int new_size = (builder->line_alloc == 0 ? 16 : builder->line_alloc * 2);
+			struct clog_image_line* new = clog_realloc(builder->allocator,builder->lines,new_size * sizeof(struct clog_image_line));
+			if (!new)
+				return 0;
+
+			builder->line_alloc = new_size;
+			builder->lines = new;
+		}
+
+		builder->lines[builder->line_count].pc = builder->code_count;
+		builder->lines[builder->line_count].line = line;
+		++builder->line_count;
+	}
+
+	builder->code[builder->code_count++] = insn;
+	return 1;
+}
+
+void clog_image_patch(struct clog_image_builder* builder, unsigned int pc, unsigned int insn)
+{
+	builder->code[pc] = insn;
+}
+
+int clog_image_finish(struct clog_image_builder* builder, void** image, size_t* len)
+{
+	struct clog_image_header header;
+	unsigned char* p;
+	size_t size;
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,"CLGI",4);
+	header.version = CLOG_IMAGE_VERSION;
+	header.byte_order = CLOG_IMAGE_BYTE_ORDER;
+	header.abi = CLOG_IMAGE_ABI;
+	header.registers = builder->registers;
+
+	size = CLOG_IMAGE_ALIGN(sizeof(header));
+	header.constants.offset = size;
+	header.constants.count = builder->constant_count;
+
+	size = CLOG_IMAGE_ALIGN(size + builder->constant_count * sizeof(clog_value));
+	header.code.offset = size;
+	header.code.count = builder->code_count;
+
+	size = CLOG_IMAGE_ALIGN(size + builder->code_count * sizeof(unsigned int));
+	header.lines.offset = size;
+	header.lines.count = builder->line_count;
+
+	size = CLOG_IMAGE_ALIGN(size + builder->line_count * sizeof(struct clog_image_line));
+	header.strings.offset = size;
+	header.strings.count = builder->strings_len;
+
+	size += builder->strings_len;
+	if (size > 0xFFFFFFFFUL)
+		return 0;
+
+	header.size = size;
+
+	/* Zero the padding too, the same program always gives the same bytes */
+	p = clog_malloc(builder->allocator,size);
+	if (!p)
+		return 0;
+
+	memset(p,0,size);
+	memcpy(p,&header,sizeof(header));
+	if (builder->constant_count)
+		memcpy(p + header.constants.offset,builder->constants,builder->constant_count * sizeof(clog_value));
+	if (builder->code_count)
+		memcpy(p + header.code.offset,builder->code,builder->code_count * sizeof(unsigned int));
+	if (builder->line_count)
+		memcpy(p + header.lines.offset,builder->lines,builder->line_count * sizeof(struct clog_image_line));
+	if (builder->strings_len)
+		memcpy(p + header.strings.offset,builder->strings,builder->strings_len);
+
+	*image = p;
+	*len = size;
+	return 1;
+}
+
+static int clog_image_section(const struct clog_image_section* section, size_t elem, size_t align, size_t len)
+{
+	if (section->offset > len || section->offset % align)
+		return 0;
+
+	return (section->count <= (len - section->offset) / elem);
+}
+
+static int clog_image_check_insn(const struct clog_image* image, unsigned int pc)
+{
+	unsigned int insn = image->code[pc];
+	unsigned int registers = image->header->registers;
+	long target;
+
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_LOAD:
+		return (CLOG_INSN_A(insn) < registers && CLOG_INSN_BX(insn) < image->header->constants.count);
+
+	case clog_opcode_MOV:
+	case clog_opcode_NEG:
+	case clog_opcode_NOT:
+	case clog_opcode_BNOT:
+	case clog_opcode_BOOL:
+	case clog_opcode_ADDI:
+	case clog_opcode_SUBI:
+		return (CLOG_INSN_A(insn) < registers && CLOG_INSN_B(insn) < registers);
+
+	case clog_opcode_EQI:
+	case clog_opcode_LTI:
+	case clog_opcode_LEI:
+	case clog_opcode_GTI:
+	case clog_opcode_GEI:
+		/* The jump that follows is checked as itself */
+		return (CLOG_INSN_A(insn) < registers && CLOG_INSN_C(insn) <= 1 &&
+				pc + 1 < image->header->code.count && CLOG_INSN_OP(image->code[pc + 1]) == clog_opcode_JMP);
+
+	case clog_opcode_ADD:
+	case clog_opcode_SUB:
+	case clog_opcode_MUL:
+	case clog_opcode_DIV:
+	case clog_opcode_MOD:
+	case clog_opcode_RSH:
+	case clog_opcode_LSH:
+	case clog_opcode_BAND:
+	case clog_opcode_BOR:
+	case clog_opcode_BXOR:
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+	case clog_opcode_LT:
+	case clog_opcode_LE:
+		return (CLOG_INSN_A(insn) < registers && CLOG_INSN_B(insn) < registers && CLOG_INSN_C(insn) < registers);
+
+	case clog_opcode_JMPT:
+	case clog_opcode_JMPF:
+		if (CLOG_INSN_A(insn) >= registers)
+			return 0;
+
+		/* Fall through */
+	case clog_opcode_JMP:
+		target = (long)pc + 1 + CLOG_INSN_SBX(insn);
+		return (target >= 0 && target < (long)image->header->code.count);
+
+	case clog_opcode_RET:
+		return (CLOG_INSN_B(insn) == 0 || (CLOG_INSN_B(insn) == 1 && CLOG_INSN_A(insn) < registers));
+
+	default:
+		return 0;
+	}
+}
+
+static int clog_image_check_string(const struct clog_image* image, clog_value v)
+{
+	const struct clog_image_string* str;
+	clog_value offset = v & CLOG_VALUE_PAYLOAD;
+	unsigned int count = image->header->strings.count;
+
+	if ((offset & 3) || count < offsetof(struct clog_image_string,str) || offset > count - offsetof(struct clog_image_string,str))
+		return 0;
+
+	str = (const struct clog_image_string*)(image->strings + (size_t)offset);
+	if (str->len >= count - offset - offsetof(struct clog_image_string,str) || str->str[str->len] != 0)
+		return 0;
+
+	/* The VM trusts the hash when comparing */
+	return (str->hash == clog_vm_hash(str->str,str->len));
+}
+
+/* Checks every offset and operand once, so nothing that runs the image needs to */
+int clog_image_load(struct clog_image* image, const void* base, size_t len)
+{
+	const unsigned char* p = base;
+	const struct clog_image_header* header = base;
+	unsigned int i;
+
+	if (len < sizeof(struct clog_image_header) || ((size_t)base & 7))
+		return 0;
+
+	if (memcmp(header->magic,"CLGI",4) != 0 ||
+			header->version != CLOG_IMAGE_VERSION ||
+			header->byte_order != CLOG_IMAGE_BYTE_ORDER ||
+			header->abi != CLOG_IMAGE_ABI ||
+			header->size != len ||
+			header->registers > CLOG_MAX_REGISTERS)
+	{
+		return 0;
+	}
+
+	if (!clog_image_section(&header->constants,sizeof(clog_value),8,len) ||
+			!clog_image_section(&header->code,sizeof(unsigned int),sizeof(unsigned int),len) ||
+			!clog_image_section(&header->lines,sizeof(struct clog_image_line),sizeof(unsigned int),len) ||
+			!clog_image_section(&header->strings,1,sizeof(unsigned int),len))
+	{
+		return 0;
+	}
+
+	image->header = header;
+	image->constants = (const clog_value*)(p + header->constants.offset);
+	image->code = (const unsigned int*)(p + header->code.offset);
+	image->lines = (const struct clog_image_line*)(p + header->lines.offset);
+	image->strings = p + header->strings.offset;
+
+	for (i = 0; i < header->constants.count; ++i)
+	{
+		clog_value v = image->constants[i];
+		switch (CLOG_VALUE_TYPE(v))
+		{
+		case clog_value_real:
+		case clog_value_integer:
+			break;
+
+		case clog_value_null:
+		case clog_value_bool:
+			/* Canonical, so equality is just a compare of the bits */
+			if ((v & CLOG_VALUE_PAYLOAD) > (CLOG_VALUE_IS(v,clog_value_bool) ? 1 : 0))
+				return 0;
+			break;
+
+		case clog_value_string:
+			/* Strings must be in the section, and terminated where they say */
+			if (!clog_image_check_string(image,v))
+				return 0;
+			break;
+
+		default:
+			return 0;
+		}
+	}
+
+	for (i = 0; i < header->code.count; ++i)
+	{
+		if (!clog_image_check_insn(image,i))
+			return 0;
+	}
+
+	/* Execution can never run off the end */
+	if (header->code.count &&
+			CLOG_INSN_OP(image->code[header->code.count-1]) != clog_opcode_RET &&
+			CLOG_INSN_OP(image->code[header->code.count-1]) != clog_opcode_JMP)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < header->lines.count; ++i)
+	{
+		if (image->lines[i].pc >= header->code.count || (i && image->lines[i].pc <= image->lines[i-1].pc))
+			return 0;
+	}
+
+	return 1;
+}
+
+unsigned long clog_image_line(const struct clog_image* image, unsigned int pc)
+{
+	/* The last run starting at or before pc */
+	unsigned int lo = 0;
+	unsigned int hi = image->header->lines.count;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (image->lines[mid].pc <= pc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (lo ? image->lines[lo-1].line : 0);
+}
+
+const struct clog_image_string* clog_image_get_string(const struct clog_image* image, clog_value v)
+{
+	return (const struct clog_image_string*)(image->strings + (size_t)(v & CLOG_VALUE_PAYLOAD));
+}
@@ -0,0 +1,112 @@
+/*
+ * clog_image.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_IMAGE_H_
+#define CLOG_IMAGE_H_
+
+#include "clog_ast.h"
+#include "clog_value.h"
+
+/* Compiled code image
+ * One contiguous, read-only block: the header, then the sections it points at.
+ * Everything is addressed by offset from the start, so an image can be mmapped
+ * anywhere and shared between processes without being parsed or copied.
+ * Values are in native byte order, an image from a different ABI is rejected */
+#define CLOG_IMAGE_VERSION 4
+
+struct clog_image_section
+{
+	unsigned int offset;
+	unsigned int count;
+};
+
+struct clog_image_header
+{
+	unsigned char magic[4];
+	unsigned int  version;
+	unsigned int  byte_order;
+	unsigned int  abi;
+	unsigned int  size;
+	unsigned int  registers;
+
+	struct clog_image_section constants;
+	struct clog_image_section code;
+	struct clog_image_section lines;
+	struct clog_image_section strings;
+};
+
+/* Constants are boxed values, except that a string's payload is the offset of
+ * its clog_image_string in the strings section rather than a pointer */
+struct clog_image_string
+{
+	unsigned int  len;
+	unsigned int  hash;
+	unsigned char str[4];
+};
+
+/* A length and hash, then the NUL terminated text, padded so the next one is aligned */
+#define CLOG_IMAGE_STRING_SIZE(len) ((offsetof(struct clog_image_string,str) + (len) + 1 + 3) & ~(size_t)3)
+
+/* Each entry starts a run of instructions from the same source line */
+struct clog_image_line
+{
+	unsigned int pc;
+	unsigned int line;
+};
+
+/* A validated view of an image, pointing straight into it */
+struct clog_image
+{
+	const struct clog_image_header*   header;
+	const clog_value*                 constants;
+	const unsigned int*               code;
+	const struct clog_image_line*     lines;
+	const unsigned char*              strings;
+};
+
+int clog_image_load(struct clog_image* image, const void* base, size_t len);
+unsigned long clog_image_line(const struct clog_image* image, unsigned int pc);
+const struct clog_image_string* clog_image_get_string(const struct clog_image* image, clog_value v);
+
+/* Image construction */
+struct clog_image_builder
+{
+	const struct clog_allocator* allocator;
+
+	clog_value*   constants;
+	unsigned int  constant_count;
+	unsigned int  constant_alloc;
+	unsigned int* buckets;
+	unsigned int  bucket_count;
+
+	unsigned int* code;
+	unsigned int  code_count;
+	unsigned int  code_alloc;
+
+	struct clog_image_line* lines;
+	unsigned int            line_count;
+	unsigned int            line_alloc;
+
+	unsigned char* strings;
+	unsigned int   strings_len;
+	unsigned int   strings_alloc;
+
+	unsigned int registers;
+};
+
+void clog_image_builder_init(struct clog_image_builder* builder, const struct clog_allocator* allocator);
+void clog_image_builder_free(struct clog_image_builder* builder);
+
+/* All return 0 when out of memory or a format limit is hit, integers are limited to 48 bits */
+int clog_image_constant(struct clog_image_builder* builder, const struct clog_ast_literal* lit, unsigned int* idx);
+int clog_image_string(struct clog_image_builder* builder, const unsigned char* sz, size_t len, unsigned int* idx);
+int clog_image_emit(struct clog_image_builder* builder, unsigned int insn, unsigned long line);
+void clog_image_patch(struct clog_image_builder* builder, unsigned int pc, unsigned int insn);
+
+/* The image is a single allocation from the builder's allocator */
+int clog_image_finish(struct clog_image_builder* builder, void** image, size_t* len);
+
+#endif /* CLOG_IMAGE_H_ */
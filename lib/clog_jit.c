@@ -0,0 +1,458 @@
+/*
+ * clog_jit.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#if defined(CLOG_JIT)
+
+/* For MAP_ANONYMOUS */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+
+#include "clog_jit.h"
+#include "clog_opcodes.h"
+
+#include <string.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(__x86_64__)
+#error The JIT only generates x86-64 code
+#endif
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Native code keeps the register file in rbx, false in r10 and the integer tag in r11.
+ * rax, rcx, rdx, r8 and r9 are scratch. Nothing is called, so nothing else is saved */
+#define CLOG_JIT_RAX 0
+#define CLOG_JIT_RCX 1
+
+/* No template is longer than this or has more than 4 fixups, and each exit stub is 7 bytes */
+#define CLOG_JIT_MAX_TEMPLATE 128
+#define CLOG_JIT_STUB 7
+
+/* Condition codes, as the low nibble of Jcc and SETcc */
+#define CLOG_JIT_E  0x4
+#define CLOG_JIT_NE 0x5
+#define CLOG_JIT_L  0xC
+#define CLOG_JIT_GE 0xD
+#define CLOG_JIT_LE 0xE
+#define CLOG_JIT_G  0xF
+
+#define CLOG_JIT_TAG(t) ((unsigned int)(CLOG_VALUE_TAG(t) >> 48))
+
+struct clog_jit
+{
+	const struct clog_allocator* allocator;
+	unsigned char*               code;
+	size_t                       len;
+
+	/* Native offset of each instruction, by pc */
+	unsigned int* entries;
+};
+
+/* A rel32 to patch, to either the code of pc or its exit stub */
+struct clog_jit_fixup
+{
+	unsigned int at;
+	unsigned int pc;
+	int          exit;
+};
+
+struct clog_jit_emitter
+{
+	unsigned char*         base;
+	unsigned char*         p;
+	struct clog_jit_fixup* fixups;
+	unsigned int           fixup_count;
+	unsigned int           pc;
+};
+
+typedef unsigned int (*clog_jit_fn)(clog_value* regs, const unsigned char* entry);
+
+static void clog_jit_bytes(struct clog_jit_emitter* e, const char* b, size_t len)
+{
+	memcpy(e->p,b,len);
+	e->p += len;
+}
+
+static void clog_jit_u32(struct clog_jit_emitter* e, unsigned int v)
+{
+	unsigned int i;
+	for (i = 0; i < 4; ++i)
+		*e->p++ = (unsigned char)(v >> (i * 8));
+}
+
+static void clog_jit_u64(struct clog_jit_emitter* e, clog_value v)
+{
+	clog_jit_u32(e,(unsigned int)(v & 0xFFFFFFFFUL));
+	clog_jit_u32(e,(unsigned int)(v >> 32));
+}
+
+static void clog_jit_rel32(struct clog_jit_emitter* e, unsigned int pc, int exit)
+{
+	struct clog_jit_fixup* f = &e->fixups[e->fixup_count++];
+	f->at = (unsigned int)(e->p - e->base);
+	f->pc = pc;
+	f->exit = exit;
+	clog_jit_u32(e,0);
+}
+
+/* Jcc to the exit stub of the current instruction */
+static void clog_jit_exit_if(struct clog_jit_emitter* e, unsigned int cc)
+{
+	*e->p++ = 0x0F;
+	*e->p++ = (unsigned char)(0x80 | cc);
+	clog_jit_rel32(e,e->pc,1);
+}
+
+/* mov reg,[rbx + reg*8] */
+static void clog_jit_load(struct clog_jit_emitter* e, unsigned int reg, unsigned int r)
+{
+	*e->p++ = 0x48;
+	*e->p++ = 0x8B;
+	*e->p++ = (unsigned char)(0x83 | (reg << 3));
+	clog_jit_u32(e,r * sizeof(clog_value));
+}
+
+/* mov [rbx + r*8],rax */
+static void clog_jit_store(struct clog_jit_emitter* e, unsigned int r)
+{
+	clog_jit_bytes(e,"\x48\x89\x83",3);
+	clog_jit_u32(e,r * sizeof(clog_value));
+}
+
+/* Leaves unless reg holds an integer */
+static void clog_jit_check_int(struct clog_jit_emitter* e, unsigned int reg)
+{
+	/* mov r8,reg; shr r8,48; cmp r8d,tag */
+	*e->p++ = 0x49;
+	*e->p++ = 0x89;
+	*e->p++ = (unsigned char)(0xC0 | (reg << 3));
+	clog_jit_bytes(e,"\x49\xC1\xE8\x30\x41\x81\xF8",7);
+	clog_jit_u32(e,CLOG_JIT_TAG(clog_value_integer));
+	clog_jit_exit_if(e,CLOG_JIT_NE);
+}
+
+/* Writing a register drops its old value, so leave the interpreter to release a string */
+static void clog_jit_check_dest(struct clog_jit_emitter* e, unsigned int r)
+{
+	/* mov r9,[rbx + r*8]; shr r9,48; cmp r9d,tag */
+	clog_jit_bytes(e,"\x4C\x8B\x8B",3);
+	clog_jit_u32(e,r * sizeof(clog_value));
+	clog_jit_bytes(e,"\x49\xC1\xE9\x30\x41\x81\xF9",7);
+	clog_jit_u32(e,CLOG_JIT_TAG(clog_value_string));
+	clog_jit_exit_if(e,CLOG_JIT_E);
+}
+
+/* rax = payload of rax | integer tag */
+static void clog_jit_rebox(struct clog_jit_emitter* e)
+{
+	clog_jit_bytes(e,"\x48\xC1\xE0\x10\x48\xC1\xE8\x10\x4C\x09\xD8",11);
+}
+
+/* rax = false | cc */
+static void clog_jit_setcc(struct clog_jit_emitter* e, unsigned int cc)
+{
+	*e->p++ = 0x0F;
+	*e->p++ = (unsigned char)(0x90 | cc);
+	clog_jit_bytes(e,"\xC0\x0F\xB6\xC0\x4C\x09\xD0",7);
+}
+
+static void clog_jit_jump(struct clog_jit_emitter* e, unsigned int pc)
+{
+	*e->p++ = 0xE9;
+	clog_jit_rel32(e,pc,0);
+}
+
+static void clog_jit_jcc(struct clog_jit_emitter* e, unsigned int cc, unsigned int pc)
+{
+	*e->p++ = 0x0F;
+	*e->p++ = (unsigned char)(0x80 | cc);
+	clog_jit_rel32(e,pc,0);
+}
+
+/* mov eax,pc; pop rbx; ret */
+static void clog_jit_leave(struct clog_jit_emitter* e, unsigned int pc)
+{
+	*e->p++ = 0xB8;
+	clog_jit_u32(e,pc);
+	clog_jit_bytes(e,"\x5B\xC3",2);
+}
+
+static void clog_jit_emit(struct clog_jit_emitter* e, const unsigned int* code, const clog_value* constants)
+{
+	unsigned int insn = code[e->pc];
+	unsigned int target = (unsigned int)((long)e->pc + 1 + CLOG_INSN_SBX(insn));
+	unsigned int cc;
+
+	switch (CLOG_INSN_OP(insn))
+	{
+	case clog_opcode_MOV:
+		/* Copying a string takes a reference */
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_B(insn));
+		clog_jit_bytes(e,"\x49\x89\xC0\x49\xC1\xE8\x30\x41\x81\xF8",10);
+		clog_jit_u32(e,CLOG_JIT_TAG(clog_value_string));
+		clog_jit_exit_if(e,CLOG_JIT_E);
+		clog_jit_check_dest(e,CLOG_INSN_A(insn));
+		clog_jit_store(e,CLOG_INSN_A(insn));
+		break;
+
+	case clog_opcode_LOAD:
+		/* Literals are uncounted, so a string loads like anything else */
+		clog_jit_check_dest(e,CLOG_INSN_A(insn));
+		clog_jit_bytes(e,"\x48\xB8",2);
+		clog_jit_u64(e,constants[CLOG_INSN_BX(insn)]);
+		clog_jit_store(e,CLOG_INSN_A(insn));
+		break;
+
+	case clog_opcode_ADD:
+	case clog_opcode_SUB:
+	case clog_opcode_MUL:
+	case clog_opcode_BAND:
+	case clog_opcode_BOR:
+	case clog_opcode_BXOR:
+		/* The tags are above the low 48 bits, so whole words give the right payload */
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_B(insn));
+		clog_jit_check_int(e,CLOG_JIT_RAX);
+		clog_jit_load(e,CLOG_JIT_RCX,CLOG_INSN_C(insn));
+		clog_jit_check_int(e,CLOG_JIT_RCX);
+		clog_jit_check_dest(e,CLOG_INSN_A(insn));
+		switch (CLOG_INSN_OP(insn))
+		{
+		case clog_opcode_ADD:
+			clog_jit_bytes(e,"\x48\x01\xC8",3);
+			break;
+		case clog_opcode_SUB:
+			clog_jit_bytes(e,"\x48\x29\xC8",3);
+			break;
+		case clog_opcode_MUL:
+			clog_jit_bytes(e,"\x48\x0F\xAF\xC1",4);
+			break;
+		case clog_opcode_BAND:
+			clog_jit_bytes(e,"\x48\x21\xC8",3);
+			break;
+		case clog_opcode_BOR:
+			clog_jit_bytes(e,"\x48\x09\xC8",3);
+			break;
+		default:
+			clog_jit_bytes(e,"\x48\x31\xC8",3);
+			break;
+		}
+		clog_jit_rebox(e);
+		clog_jit_store(e,CLOG_INSN_A(insn));
+		break;
+
+	case clog_opcode_ADDI:
+	case clog_opcode_SUBI:
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_B(insn));
+		clog_jit_check_int(e,CLOG_JIT_RAX);
+		clog_jit_check_dest(e,CLOG_INSN_A(insn));
+		clog_jit_bytes(e,CLOG_INSN_OP(insn) == clog_opcode_ADDI ? "\x48\x05" : "\x48\x2D",2);
+		clog_jit_u32(e,(unsigned int)CLOG_INSN_SC(insn));
+		clog_jit_rebox(e);
+		clog_jit_store(e,CLOG_INSN_A(insn));
+		break;
+
+	case clog_opcode_EQ:
+	case clog_opcode_NE:
+	case clog_opcode_LT:
+	case clog_opcode_LE:
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_B(insn));
+		clog_jit_check_int(e,CLOG_JIT_RAX);
+		clog_jit_load(e,CLOG_JIT_RCX,CLOG_INSN_C(insn));
+		clog_jit_check_int(e,CLOG_JIT_RCX);
+		clog_jit_check_dest(e,CLOG_INSN_A(insn));
+
+		/* shl rax,16; shl rcx,16; cmp rax,rcx orders them as signed */
+		clog_jit_bytes(e,"\x48\xC1\xE0\x10\x48\xC1\xE1\x10\x48\x39\xC8",11);
+		switch (CLOG_INSN_OP(insn))
+		{
+		case clog_opcode_EQ:
+			cc = CLOG_JIT_E;
+			break;
+		case clog_opcode_NE:
+			cc = CLOG_JIT_NE;
+			break;
+		case clog_opcode_LT:
+			cc = CLOG_JIT_L;
+			break;
+		default:
+			cc = CLOG_JIT_LE;
+			break;
+		}
+		clog_jit_setcc(e,cc);
+		clog_jit_store(e,CLOG_INSN_A(insn));
+		break;
+
+	case clog_opcode_JMP:
+		clog_jit_jump(e,target);
+		break;
+
+	case clog_opcode_JMPT:
+	case clog_opcode_JMPF:
+		/* Only bools are tested here: cmp rax,r10 then against r10 + 1 */
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_A(insn));
+		clog_jit_bytes(e,"\x4C\x39\xD0",3);
+		if (CLOG_INSN_OP(insn) == clog_opcode_JMPF)
+			clog_jit_jcc(e,CLOG_JIT_E,target);
+		else
+			clog_jit_jcc(e,CLOG_JIT_E,e->pc + 1);
+		clog_jit_bytes(e,"\x49\x8D\x52\x01\x48\x39\xD0",7);
+		clog_jit_exit_if(e,CLOG_JIT_NE);
+		if (CLOG_INSN_OP(insn) == clog_opcode_JMPT)
+			clog_jit_jump(e,target);
+		break;
+
+	case clog_opcode_EQI:
+	case clog_opcode_LTI:
+	case clog_opcode_LEI:
+	case clog_opcode_GTI:
+	case clog_opcode_GEI:
+		/* Takes the following JMP itself when the test equals C */
+		switch (CLOG_INSN_OP(insn))
+		{
+		case clog_opcode_EQI:
+			cc = CLOG_JIT_E;
+			break;
+		case clog_opcode_LTI:
+			cc = CLOG_JIT_L;
+			break;
+		case clog_opcode_LEI:
+			cc = CLOG_JIT_LE;
+			break;
+		case clog_opcode_GTI:
+			cc = CLOG_JIT_G;
+			break;
+		default:
+			cc = CLOG_JIT_GE;
+			break;
+		}
+		if (!CLOG_INSN_C(insn))
+			cc ^= 1;
+
+		clog_jit_load(e,CLOG_JIT_RAX,CLOG_INSN_A(insn));
+		clog_jit_check_int(e,CLOG_JIT_RAX);
+
+		/* shl rax,16; cmp rax,imm << 16 */
+		clog_jit_bytes(e,"\x48\xC1\xE0\x10\x48\x3D",6);
+		clog_jit_u32(e,(unsigned int)(CLOG_INSN_SB(insn) * 65536L));
+		clog_jit_jcc(e,cc,(unsigned int)((long)e->pc + 2 + CLOG_INSN_SBX(code[e->pc + 1])));
+		clog_jit_jump(e,e->pc + 2);
+		break;
+
+	default:
+		/* The interpreter does the rest */
+		clog_jit_leave(e,e->pc);
+		break;
+	}
+}
+
+struct clog_jit* clog_jit_compile(const struct clog_allocator* allocator, const unsigned int* code, unsigned int count, const clog_value* constants)
+{
+	struct clog_jit* jit;
+	struct clog_jit_emitter e;
+	unsigned int* stubs;
+	unsigned int i;
+	long page = sysconf(_SC_PAGESIZE);
+
+	jit = clog_malloc(allocator,sizeof(struct clog_jit));
+	if (!jit)
+		return NULL;
+
+	jit->allocator = allocator;
+	jit->len = 32 + (size_t)count * (CLOG_JIT_MAX_TEMPLATE + CLOG_JIT_STUB);
+	jit->len = (jit->len + page - 1) & ~(size_t)(page - 1);
+	jit->entries = clog_malloc(allocator,count * 2 * sizeof(unsigned int));
+	e.fixups = clog_malloc(allocator,count * 4 * sizeof(struct clog_jit_fixup));
+	jit->code = mmap(NULL,jit->len,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+	if (!jit->entries || !e.fixups || jit->code == MAP_FAILED)
+	{
+		if (jit->code != MAP_FAILED)
+			munmap(jit->code,jit->len);
+		clog_free(allocator,e.fixups);
+		clog_free(allocator,jit->entries);
+		clog_free(allocator,jit);
+		return NULL;
+	}
+
+	stubs = jit->entries + count;
+	memset(stubs,0,count * sizeof(unsigned int));
+
+	e.base = e.p = jit->code;
+	e.fixup_count = 0;
+
+	/* Entry: push rbx; mov rbx,rdi; mov r10,false; mov r11,integer tag; jmp rsi */
+	clog_jit_bytes(&e,"\x53\x48\x89\xFB\x49\xBA",6);
+	clog_jit_u64(&e,CLOG_VALUE_FALSE);
+	clog_jit_bytes(&e,"\x49\xBB",2);
+	clog_jit_u64(&e,CLOG_VALUE_TAG(clog_value_integer));
+	clog_jit_bytes(&e,"\xFF\xE6",2);
+
+	for (e.pc = 0; e.pc < count; ++e.pc)
+	{
+		jit->entries[e.pc] = (unsigned int)(e.p - e.base);
+		clog_jit_emit(&e,code,constants);
+	}
+
+	for (i = 0; i < e.fixup_count; ++i)
+	{
+		const struct clog_jit_fixup* f = &e.fixups[i];
+		unsigned int to = jit->entries[f->pc];
+		long rel;
+
+		if (f->exit)
+		{
+			/* The interpreter runs the instruction that couldn't be */
+			if (!stubs[f->pc])
+			{
+				stubs[f->pc] = (unsigned int)(e.p - e.base);
+				clog_jit_leave(&e,f->pc);
+			}
+			to = stubs[f->pc];
+		}
+
+		rel = (long)to - (long)(f->at + 4);
+		e.base[f->at] = (unsigned char)(rel & 0xFF);
+		e.base[f->at+1] = (unsigned char)((rel >> 8) & 0xFF);
+		e.base[f->at+2] = (unsigned char)((rel >> 16) & 0xFF);
+		e.base[f->at+3] = (unsigned char)((rel >> 24) & 0xFF);
+	}
+
+	clog_free(allocator,e.fixups);
+
+	/* Never writable and executable at once */
+	if (mprotect(jit->code,jit->len,PROT_READ | PROT_EXEC) != 0)
+	{
+		clog_jit_free(jit);
+		return NULL;
+	}
+
+	return jit;
+}
+
+unsigned int clog_jit_enter(const struct clog_jit* jit, clog_value* regs, unsigned int pc)
+{
+	/* Function pointers can't be cast from data pointers in ANSI C */
+	clog_jit_fn fn;
+	const unsigned char* entry = jit->code;
+	memcpy(&fn,&entry,sizeof(fn));
+
+	return (*fn)(regs,jit->code + jit->entries[pc]);
+}
+
+void clog_jit_free(struct clog_jit* jit)
+{
+	if (jit)
+	{
+		munmap(jit->code,jit->len);
+		clog_free(jit->allocator,jit->entries);
+		clog_free(jit->allocator,jit);
+	}
+}
+
+#endif /* CLOG_JIT */
@@ -0,0 +1,32 @@
+/*
+ * clog_jit.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_JIT_H_
+#define CLOG_JIT_H_
+
+#include "clog_ast.h"
+#include "clog_value.h"
+
+/* Baseline JIT for x86-64, only built with CLOG_JIT
+ * Each instruction is compiled from a fixed template that handles the integer and bool
+ * cases inline. Anything else leaves native code at that instruction, and the interpreter
+ * runs it and carries on until the next loop iteration enters native code again */
+
+/* Loop iterations before compiling. clog_run takes CLOG_JIT_THRESHOLD from the
+ * environment instead, if it is set, and 0 there turns the JIT off */
+#define CLOG_JIT_THRESHOLD 1000
+
+struct clog_jit;
+
+/* NULL when out of memory, or executable memory can't be had */
+struct clog_jit* clog_jit_compile(const struct clog_allocator* allocator, const unsigned int* code, unsigned int count, const clog_value* constants);
+
+/* Runs from pc until an instruction native code doesn't handle, and returns its pc */
+unsigned int clog_jit_enter(const struct clog_jit* jit, clog_value* regs, unsigned int pc);
+
+void clog_jit_free(struct clog_jit* jit);
+
+#endif /* CLOG_JIT_H_ */
@@ -21,6 +21,58 @@ enum clog_opcode
 	clog_opcode_RSH,
 	clog_opcode_LSH,
 	clog_opcode_NOT,
+	clog_opcode_BNOT,
+	clog_opcode_BAND,
+	clog_opcode_BOR,
+	clog_opcode_BXOR,
+	clog_opcode_EQ,
+	clog_opcode_NE,
+	clog_opcode_LT,
+	clog_opcode_LE,
+	clog_opcode_BOOL,
+	clog_opcode_JMP,
+	clog_opcode_JMPT,
+	clog_opcode_JMPF,
+	clog_opcode_RET,
+
+	/* Superinstructions, selected by codegen */
+	clog_opcode_ADDI,
+	clog_opcode_SUBI,
+	clog_opcode_EQI,
+	clog_opcode_LTI,
+	clog_opcode_LEI,
+	clog_opcode_GTI,
+	clog_opcode_GEI,
+
+	clog_opcode_MAX
 };
 
+/* Instructions are 32-bit words, in one of two layouts:
+ *   | C:8 | B:8 | A:8 | op:8 |
+ *   |   Bx:16   | A:8 | op:8 |
+ * A is the destination register, Bx indexes the constant pool.
+ * Jumps hold a biased offset from the next instruction in Bx, and test A.
+ * RET returns A if B is set, otherwise null.
+ * ADDI and SUBI take a signed immediate in C in place of a register.
+ * The compare immediates test A against the signed immediate in B, and are always
+ * followed by a JMP, which is taken if the result equals C and skipped otherwise */
+#define CLOG_INSN_ABC(op,a,b,c) ((unsigned int)(op) | ((unsigned int)(a) << 8) | ((unsigned int)(b) << 16) | ((unsigned int)(c) << 24))
+#define CLOG_INSN_ABX(op,a,bx)  ((unsigned int)(op) | ((unsigned int)(a) << 8) | ((unsigned int)(bx) << 16))
+
+#define CLOG_INSN_OP(i) ((i) & 0xFF)
+#define CLOG_INSN_A(i)  (((i) >> 8) & 0xFF)
+#define CLOG_INSN_B(i)  (((i) >> 16) & 0xFF)
+#define CLOG_INSN_C(i)  (((i) >> 24) & 0xFF)
+#define CLOG_INSN_BX(i) (((i) >> 16) & 0xFFFF)
+
+#define CLOG_INSN_SB(i) (((long)CLOG_INSN_B(i) ^ 0x80) - 0x80)
+#define CLOG_INSN_SC(i) (((long)CLOG_INSN_C(i) ^ 0x80) - 0x80)
+
+#define CLOG_INSN_SBX_BIAS 0x7FFF
+#define CLOG_INSN_SBX(i)   ((long)CLOG_INSN_BX(i) - CLOG_INSN_SBX_BIAS)
+#define CLOG_INSN_ASBX(op,a,sbx) CLOG_INSN_ABX(op,a,(sbx) + CLOG_INSN_SBX_BIAS)
+
+#define CLOG_MAX_REGISTERS 256
+#define CLOG_MAX_CONSTANTS 65536
+
 #endif /* CLOG_OPCODES_H_ */
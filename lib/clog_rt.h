@@ -0,0 +1,58 @@
+/*
+ * clog_rt.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_RT_H_
+#define CLOG_RT_H_
+
+#include "clog.h"
+#include "clog_value.h"
+#include "clog_opcodes.h"
+
+/* Runtime for programs translated to C
+ * A translated program is a function over a local array of values, calling in here for
+ * anything its inline integer paths don't cover. It runs with the same semantics and
+ * errors as the VM, and every value it holds counts as a reference */
+struct clog_rt;
+
+struct clog_rt_literal
+{
+	const char*  str;
+	unsigned int len;
+};
+
+/* Runs program with the string literals it loads by index, returning as clog_run does */
+CLOG_EXPORT int clog_rt_run(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics, int (*program)(struct clog_rt* rt), const struct clog_rt_literal* literals, unsigned int literal_count);
+
+CLOG_EXPORT clog_value clog_rt_literal(const struct clog_rt* rt, unsigned int idx);
+
+/* Both store the result in r, and return 0 after reporting a runtime error at line */
+CLOG_EXPORT int clog_rt_binary(struct clog_rt* rt, unsigned int op, clog_value* r, clog_value a, clog_value b, unsigned long line);
+CLOG_EXPORT int clog_rt_unary(struct clog_rt* rt, unsigned int op, clog_value* r, clog_value a, unsigned long line);
+
+CLOG_EXPORT int clog_rt_truth(clog_value v);
+CLOG_EXPORT void clog_rt_addref(clog_value v);
+CLOG_EXPORT void clog_rt_release(struct clog_rt* rt, clog_value v);
+
+/* As the VM writes registers: v is evaluated before x changes, so it may read the old value */
+#define CLOG_RT_SET(rt,x,v) \
+	do { \
+		clog_value old_ = (x); \
+		(x) = (v); \
+		if (CLOG_VALUE_IS(old_,clog_value_string)) \
+			clog_rt_release((rt),old_); \
+	} while (0)
+
+#define CLOG_RT_COPY(rt,x,v) \
+	do { \
+		clog_value new_ = (v); \
+		if (CLOG_VALUE_IS(new_,clog_value_string)) \
+			clog_rt_addref(new_); \
+		CLOG_RT_SET(rt,x,new_); \
+	} while (0)
+
+#define CLOG_RT_TRUTH(v) ((v) == CLOG_VALUE_TRUE || ((v) != CLOG_VALUE_FALSE && clog_rt_truth(v)))
+
+#endif /* CLOG_RT_H_ */
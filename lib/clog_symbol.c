@@ -0,0 +1,122 @@
+/*
+ * clog_symbol.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_ast.h"
+
+#include <string.h>
+
+struct clog_symbol
+{
+	struct clog_string name;
+	unsigned long hash;
+};
+
+static unsigned long clog_symbol_hash(const unsigned char* sz, size_t len)
+{
+	/* FNV-1a */
+	unsigned long h = 2166136261UL;
+	while (len--)
+	{
+		h ^= *sz++;
+		h = (h * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	return h;
+}
+
+static int clog_symbol_rehash(struct clog_symtab* symtab)
+{
+	unsigned int i;
+	unsigned int new_size = (symtab->bucket_count == 0 ? 64 : symtab->bucket_count * 2);
+	unsigned int* new_buckets = clog_malloc(symtab->text.allocator,new_size * sizeof(unsigned int));
+	if (!new_buckets)
+		return 0;
+
+	memset(new_buckets,0,new_size * sizeof(unsigned int));
+
+	for (i = 0; i < symtab->count; ++i)
+	{
+		unsigned int b = symtab->symbols[i].hash & (new_size - 1);
+		while (new_buckets[b])
+			b = (b + 1) & (new_size - 1);
+
+		new_buckets[b] = i + 1;
+	}
+
+	clog_free(symtab->text.allocator,symtab->buckets);
+	symtab->buckets = new_buckets;
+	symtab->bucket_count = new_size;
+	return 1;
+}
+
+unsigned int clog_symbol_intern(struct clog_symtab* symtab, const unsigned char* sz, size_t len)
+{
+	unsigned long hash = clog_symbol_hash(sz,len);
+	struct clog_symbol* sym;
+	unsigned int b;
+
+	if (symtab->bucket_count)
+	{
+		for (b = hash & (symtab->bucket_count - 1); symtab->buckets[b]; b = (b + 1) & (symtab->bucket_count - 1))
+		{
+			sym = &symtab->symbols[symtab->buckets[b] - 1];
+			if (sym->hash == hash && sym->name.len == len && memcmp(sym->name.str,sz,len) == 0)
+				return symtab->buckets[b];
+		}
+	}
+
+	/* Keep the load factor under a half */
+	if ((symtab->count + 1) * 2 > symtab->bucket_count)
+	{
+		if (!clog_symbol_rehash(symtab))
+			return 0;
+	}
+
+	if (symtab->count == symtab->alloc)
+	{
+		/* Resize array */
+		unsigned int new_size = (symtab->alloc == 0 ? 64 : symtab->alloc * 2);
+		struct clog_symbol* new = clog_realloc(symtab->text.allocator,symtab->symbols,new_size * sizeof(struct clog_symbol));
+		if (!new)
+			return 0;
+
+		symtab->alloc = new_size;
+		symtab->symbols = new;
+	}
+
+	sym = &symtab->symbols[symtab->count];
+	sym->hash = hash;
+	sym->name.len = len;
+	sym->name.str = clog_arena_alloc(&symtab->text,len + 1);
+	if (!sym->name.str)
+		return 0;
+
+	memcpy(sym->name.str,sz,len);
+	sym->name.str[len] = 0;
+
+	for (b = hash & (symtab->bucket_count - 1); symtab->buckets[b]; b = (b + 1) & (symtab->bucket_count - 1))
+		;
+
+	symtab->buckets[b] = ++symtab->count;
+	return symtab->count;
+}
+
+const struct clog_string* clog_symbol_name(const struct clog_symtab* symtab, unsigned int symbol)
+{
+	return &symtab->symbols[symbol - 1].name;
+}
+
+void clog_symtab_free(struct clog_symtab* symtab)
+{
+	clog_free(symtab->text.allocator,symtab->symbols);
+	clog_free(symtab->text.allocator,symtab->buckets);
+	clog_arena_free(&symtab->text);
+
+	symtab->symbols = NULL;
+	symtab->count = 0;
+	symtab->alloc = 0;
+	symtab->buckets = NULL;
+	symtab->bucket_count = 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * clog_value.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_value.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/* Reals are boxed by their bits */
+typedef char clog_value_size_check[(sizeof(clog_value) == 8 && sizeof(double) == 8) ? 1 : -1];
+
+clog_value clog_value_from_real(double d)
+{
+	clog_value v;
+
+	/* Every NaN becomes the one positive quiet NaN, leaving the negative ones for boxing */
+	if (d != d)
+		return CLOG_VALUE_NAN;
+
+	memcpy(&v,&d,sizeof(v));
+	return v;
+}
+
+double clog_value_to_real(clog_value v)
+{
+	double d;
+	memcpy(&d,&v,sizeof(d));
+	return d;
+}
+
+int clog_value_from_integer(clog_value_int i, clog_value* v)
+{
+	*v = CLOG_VALUE_INT_BOX(i);
+	return (CLOG_VALUE_INT(*v) == i);
+}
+
+int clog_value_real_to_integer(double d, clog_value_int* i)
+{
+	/* Both bounds are exact doubles, and NaN fails either test */
+	if (!(d > -140737488355329.0 && d < 140737488355328.0))
+		return 0;
+
+	*i = (clog_value_int)d;
+	return 1;
+}
+
+size_t clog_value_format(clog_value v, char* buf)
+{
+	char digits[24];
+	clog_value u;
+	size_t len = 0;
+	size_t n = 0;
+
+	switch (CLOG_VALUE_TYPE(v))
+	{
+	case clog_value_real:
+		return (size_t)sprintf(buf,"%.14g",clog_value_to_real(v));
+
+	case clog_value_bool:
+		strcpy(buf,(v & 1) ? "true" : "false");
+		return strlen(buf);
+
+	case clog_value_integer:
+		/* By hand, as C89 has no printf length for a 64-bit integer */
+		u = (CLOG_VALUE_INT(v) < 0 ? (clog_value)0 - (clog_value)CLOG_VALUE_INT(v) : (clog_value)CLOG_VALUE_INT(v));
+		if (CLOG_VALUE_INT(v) < 0)
+			buf[len++] = '-';
+		do
+		{
+			digits[n++] = (char)('0' + (int)(u % 10));
+			u /= 10;
+		}
+		while (u);
+
+		while (n)
+			buf[len++] = digits[--n];
+		break;
+
+	default:
+		/* null is the empty string, as the constant folder has it */
+		break;
+	}
+
+	buf[len] = 0;
+	return len;
+}
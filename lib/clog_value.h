@@ -0,0 +1,82 @@
+/*
+ * clog_value.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_VALUE_H_
+#define CLOG_VALUE_H_
+
+#include <stddef.h>
+
+/* NaN-boxed values
+ * Every runtime value is one 64-bit word. A real is stored as its own bits,
+ * anything else is packed into the payload of a negative quiet NaN:
+ *   | 1111111111111 | tag:3 | payload:48 |
+ * Reals are canonicalised as they are boxed, so no real ever has that pattern.
+ * Integers are 48-bit two's complement and wrap, pointers must fit in 48 bits */
+#if defined(_MSC_VER)
+typedef unsigned __int64 clog_value;
+typedef __int64          clog_value_int;
+#elif defined(__GNUC__)
+__extension__ typedef unsigned long long clog_value;
+__extension__ typedef long long          clog_value_int;
+#else
+typedef unsigned long clog_value;
+typedef long          clog_value_int;
+#endif
+
+/* The boxed types are also the tags */
+enum clog_value_type
+{
+	clog_value_real,
+	clog_value_null,
+	clog_value_bool,
+	clog_value_integer,
+	clog_value_string,
+	clog_value_object
+};
+
+#define CLOG_VALUE_C(hi,lo)  (((clog_value)(hi) << 32) | (clog_value)(lo))
+#define CLOG_VALUE_BOXED     CLOG_VALUE_C(0xFFF80000UL,0)
+#define CLOG_VALUE_PAYLOAD   CLOG_VALUE_C(0x0000FFFFUL,0xFFFFFFFFUL)
+#define CLOG_VALUE_NAN       CLOG_VALUE_C(0x7FF80000UL,0)
+#define CLOG_VALUE_TAG(t)    (CLOG_VALUE_BOXED | ((clog_value)(t) << 48))
+
+#define CLOG_VALUE_NULL      CLOG_VALUE_TAG(clog_value_null)
+#define CLOG_VALUE_FALSE     CLOG_VALUE_TAG(clog_value_bool)
+#define CLOG_VALUE_TRUE      (CLOG_VALUE_TAG(clog_value_bool) | 1)
+
+#define CLOG_VALUE_IS_REAL(v) ((v) < CLOG_VALUE_BOXED)
+#define CLOG_VALUE_IS(v,t)    (((v) >> 48) == (CLOG_VALUE_TAG(t) >> 48))
+#define CLOG_VALUE_TYPE(v)    (CLOG_VALUE_IS_REAL(v) ? clog_value_real : (enum clog_value_type)(((v) >> 48) & 7))
+
+#define CLOG_VALUE_BOOL(b)    (CLOG_VALUE_FALSE | ((b) ? 1 : 0))
+
+/* Boxing keeps the low 48 bits, so integer add, subtract and multiply can work on
+ * whole words and rebox the result: the low bits come out the same */
+#define CLOG_VALUE_INT_BOX(v) (((clog_value)(v) & CLOG_VALUE_PAYLOAD) | CLOG_VALUE_TAG(clog_value_integer))
+#define CLOG_VALUE_INT(v)     ((clog_value_int)((v) << 16) >> 16)
+
+/* Orders integers without unboxing them */
+#define CLOG_VALUE_INT_KEY(v) ((clog_value_int)((v) << 16))
+
+#define CLOG_VALUE_PTR_BOX(t,p) ((clog_value)(size_t)(p) | CLOG_VALUE_TAG(t))
+#define CLOG_VALUE_PTR(v)       ((void*)(size_t)((v) & CLOG_VALUE_PAYLOAD))
+
+clog_value clog_value_from_real(double d);
+double clog_value_to_real(clog_value v);
+
+/* Returns 0 if i doesn't fit in 48 bits */
+int clog_value_from_integer(clog_value_int i, clog_value* v);
+
+/* Truncates toward zero, the way the integer operators take a real.
+ * Returns 0 for NaN, infinities and anything outside 48 bits */
+int clog_value_real_to_integer(double d, clog_value_int* i);
+
+/* The text a non-string becomes beside a string, in + or a comparison.
+ * buf needs CLOG_VALUE_FORMAT_MAX bytes, returns the length without the NUL */
+#define CLOG_VALUE_FORMAT_MAX 32
+size_t clog_value_format(clog_value v, char* buf);
+
+#endif /* CLOG_VALUE_H_ */
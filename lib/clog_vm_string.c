@@ -0,0 +1,288 @@
+/*
+ * clog_vm_string.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#include "clog_vm_string.h"
+
+#include <string.h>
+
+void clog_vm_heap_init(struct clog_vm_heap* heap, const struct clog_allocator* allocator)
+{
+	memset(heap,0,sizeof(struct clog_vm_heap));
+	heap->allocator = allocator;
+	heap->cells.allocator = allocator;
+}
+
+void clog_vm_heap_free(struct clog_vm_heap* heap)
+{
+	/* Cells all live in the arena, everything else has been released one by one */
+	clog_arena_free(&heap->cells);
+	clog_free(heap->allocator,heap->stack);
+	heap->free_list = NULL;
+	heap->stack = NULL;
+	heap->stack_alloc = 0;
+}
+
+static struct clog_vm_string* clog_vm_string_cell(struct clog_vm_heap* heap)
+{
+	struct clog_vm_string* s = heap->free_list;
+	if (s)
+		heap->free_list = s->u.next_free;
+	else
+		s = clog_arena_alloc(&heap->cells,sizeof(struct clog_vm_string));
+
+	return s;
+}
+
+struct clog_vm_string* clog_vm_string_alloc(struct clog_vm_heap* heap, size_t len, unsigned char** buf)
+{
+	struct clog_vm_string* s;
+
+	if (len < CLOG_VM_STRING_INLINE)
+	{
+		s = clog_vm_string_cell(heap);
+		if (!s)
+			return NULL;
+
+		s->kind = clog_vm_string_inline;
+	}
+	else
+	{
+		if (len > 0x7FFFFFFFUL)
+			return NULL;
+
+		s = clog_malloc(heap->allocator,offsetof(struct clog_vm_string,u) + len + 1);
+		if (!s)
+			return NULL;
+
+		s->kind = clog_vm_string_tail;
+	}
+
+	s->refcount = 1;
+	s->len = len;
+	s->hash = 0;
+	s->str = s->u.sso;
+	s->u.sso[len] = 0;
+
+	*buf = s->u.sso;
+	return s;
+}
+
+static int clog_vm_heap_push(struct clog_vm_heap* heap, size_t top, struct clog_vm_string* s)
+{
+	if (top == heap->stack_alloc)
+	{
+		/* Resize array */
+		size_t new_size = (heap->stack_alloc == 0 ? 16 : heap->stack_alloc * 2);
+		struct clog_vm_string** new = clog_realloc(heap->allocator,heap->stack,new_size * sizeof(struct clog_vm_string*));
+		if (!new)
+			return 0;
+
+		heap->stack_alloc = new_size;
+		heap->stack = new;
+	}
+
+	heap->stack[top] = s;
+	return 1;
+}
+
+void clog_vm_string_release(struct clog_vm_heap* heap, struct clog_vm_string* s)
+{
+	/* Loop down the left of a rope, the way a chain of appends leans, and keep the right
+	 * sides on the heap's stack, so a rope of any shape needs no C stack.
+	 * If the stack can't grow, the rope cell itself holds the right side until it is popped */
+	struct clog_vm_string* pending = NULL;
+	size_t top = 0;
+
+	for (;;)
+	{
+		struct clog_vm_string* next = NULL;
+
+		if (!s || !s->refcount || --s->refcount != 0)
+		{
+			if (top)
+				s = heap->stack[--top];
+			else if (pending)
+			{
+				s = pending->u.rope.right;
+				next = pending->u.rope.left;
+				pending->u.next_free = heap->free_list;
+				heap->free_list = pending;
+				pending = next;
+			}
+			else
+				break;
+
+			continue;
+		}
+
+		switch (s->kind)
+		{
+		case clog_vm_string_tail:
+			clog_free(heap->allocator,s);
+			s = NULL;
+			continue;
+
+		case clog_vm_string_buffer:
+			clog_free(heap->allocator,(void*)s->str);
+			break;
+
+		case clog_vm_string_rope:
+			next = s->u.rope.left;
+			if (clog_vm_heap_push(heap,top,s->u.rope.right))
+			{
+				++top;
+				break;
+			}
+
+			s->u.rope.left = pending;
+			pending = s;
+			s = next;
+			continue;
+
+		default:
+			break;
+		}
+
+		s->u.next_free = heap->free_list;
+		heap->free_list = s;
+		s = next;
+	}
+}
+
+int clog_vm_string_flatten(struct clog_vm_heap* heap, struct clog_vm_string* s)
+{
+	struct clog_vm_string* n = s;
+	unsigned char* buf;
+	unsigned char* end;
+	size_t top = 0;
+
+	if (s->str)
+		return 1;
+
+	buf = clog_malloc(heap->allocator,(size_t)s->len + 1);
+	if (!buf)
+		return 0;
+
+	/* Fill from the back, right before left, so a left-leaning chain needs almost no stack */
+	end = buf + s->len;
+	*end = 0;
+	for (;;)
+	{
+		if (n->str)
+		{
+			end -= n->len;
+			memcpy(end,n->str,n->len);
+			if (!top)
+				break;
+
+			n = heap->stack[--top];
+		}
+		else
+		{
+			if (!clog_vm_heap_push(heap,top,n->u.rope.left))
+			{
+				clog_free(heap->allocator,buf);
+				return 0;
+			}
+
+			++top;
+			n = n->u.rope.right;
+		}
+	}
+
+	clog_vm_string_release(heap,s->u.rope.left);
+	clog_vm_string_release(heap,s->u.rope.right);
+
+	s->kind = clog_vm_string_buffer;
+	s->str = buf;
+	return 1;
+}
+
+unsigned int clog_vm_hash(const unsigned char* p, size_t len)
+{
+	/* FNV-1a */
+	unsigned long h = 2166136261UL;
+	while (len--)
+	{
+		h ^= *p++;
+		h = (h * 16777619UL) & 0xFFFFFFFFUL;
+	}
+	return (h ? (unsigned int)h : 1);
+}
+
+unsigned int clog_vm_string_hash(struct clog_vm_string* s)
+{
+	if (!s->hash)
+		s->hash = clog_vm_hash(s->str,s->len);
+
+	return s->hash;
+}
+
+int clog_vm_string_compare(const struct clog_vm_string* s1, const struct clog_vm_string* s2)
+{
+	int cmp;
+	if (s1 == s2)
+		return 0;
+
+	cmp = memcmp(s1->str,s2->str,s1->len < s2->len ? s1->len : s2->len);
+	if (cmp == 0 && s1->len != s2->len)
+		cmp = (s1->len < s2->len ? -1 : 1);
+
+	return cmp;
+}
+
+int clog_vm_string_equal(struct clog_vm_string* s1, struct clog_vm_string* s2)
+{
+	if (s1 == s2)
+		return 1;
+
+	if (s1->len != s2->len)
+		return 0;
+
+	/* Only compare the text if the hashes can't tell them apart */
+	if (s1->len >= CLOG_VM_STRING_INLINE && clog_vm_string_hash(s1) != clog_vm_string_hash(s2))
+		return 0;
+
+	return (memcmp(s1->str,s2->str,s1->len) == 0);
+}
+
+struct clog_vm_string* clog_vm_string_concat(struct clog_vm_heap* heap, struct clog_vm_string* s1, struct clog_vm_string* s2)
+{
+	size_t len = (size_t)s1->len + s2->len;
+	struct clog_vm_string* s;
+
+	if (len > 0x7FFFFFFFUL)
+		return NULL;
+
+	if (len < CLOG_VM_STRING_ROPE)
+	{
+		/* Too short for either side to be a rope, copying is cheaper than a node */
+		unsigned char* buf;
+		s = clog_vm_string_alloc(heap,len,&buf);
+		if (s)
+		{
+			memcpy(buf,s1->str,s1->len);
+			memcpy(buf + s1->len,s2->str,s2->len);
+		}
+		return s;
+	}
+
+	s = clog_vm_string_cell(heap);
+	if (s)
+	{
+		s->refcount = 1;
+		s->len = len;
+		s->hash = 0;
+		s->kind = clog_vm_string_rope;
+		s->str = NULL;
+
+		CLOG_VM_STRING_ADDREF(s1);
+		CLOG_VM_STRING_ADDREF(s2);
+		s->u.rope.left = s1;
+		s->u.rope.right = s2;
+	}
+	return s;
+}
@@ -0,0 +1,91 @@
+/*
+ * clog_vm_string.h
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#ifndef CLOG_VM_STRING_H_
+#define CLOG_VM_STRING_H_
+
+#include "clog_ast.h"
+
+/* Up to 15 bytes and the NUL fit in the object, and come from a free list */
+#define CLOG_VM_STRING_INLINE 16
+
+/* Concatenations at least this long make a rope node rather than a copy */
+#define CLOG_VM_STRING_ROPE 64
+
+enum clog_vm_string_kind
+{
+	clog_vm_string_static,  /* Text owned by someone else, never freed */
+	clog_vm_string_inline,  /* Text in u.sso of a free list cell */
+	clog_vm_string_tail,    /* One allocation, the text running on past the end */
+	clog_vm_string_buffer,  /* A flattened rope, the text separately allocated */
+	clog_vm_string_rope     /* left + right, no text until it is flattened */
+};
+
+/* Runtime strings
+ * Immutable once built, so they are shared by reference rather than copied.
+ * A refcount of 0 marks a string that is never counted or freed, such as a literal.
+ * The hash is computed on first use, 0 means not yet.
+ * str is NULL for a rope, which must be flattened before its text is read */
+struct clog_vm_string
+{
+	unsigned int         refcount;
+	unsigned int         len;
+	unsigned int         hash;
+	unsigned int         kind;
+	const unsigned char* str;
+
+	union clog_vm_string_u
+	{
+		unsigned char sso[CLOG_VM_STRING_INLINE];
+
+		struct clog_vm_string_rope
+		{
+			struct clog_vm_string* left;
+			struct clog_vm_string* right;
+		} rope;
+
+		struct clog_vm_string* next_free;
+	} u;
+};
+
+/* Each VM owns its strings, they are never shared between threads */
+struct clog_vm_heap
+{
+	const struct clog_allocator* allocator;
+	struct clog_arena            cells;
+	struct clog_vm_string*       free_list;
+
+	/* Pending sides of ropes while flattening or releasing */
+	struct clog_vm_string** stack;
+	size_t                  stack_alloc;
+};
+
+void clog_vm_heap_init(struct clog_vm_heap* heap, const struct clog_allocator* allocator);
+void clog_vm_heap_free(struct clog_vm_heap* heap);
+
+/* Returns a string with one reference and room for len bytes, which the caller
+ * fills in before anything else sees it. NULL when out of memory */
+struct clog_vm_string* clog_vm_string_alloc(struct clog_vm_heap* heap, size_t len, unsigned char** buf);
+void clog_vm_string_release(struct clog_vm_heap* heap, struct clog_vm_string* s);
+
+#define CLOG_VM_STRING_ADDREF(s) do { if ((s)->refcount) ++(s)->refcount; } while (0)
+
+/* Gives a rope its text, in place. Returns 0 when out of memory */
+int clog_vm_string_flatten(struct clog_vm_heap* heap, struct clog_vm_string* s);
+
+/* Non-zero, the same value the image builder stores for literals */
+unsigned int clog_vm_hash(const unsigned char* p, size_t len);
+
+/* These read the text, so the strings must have been flattened */
+unsigned int clog_vm_string_hash(struct clog_vm_string* s);
+int clog_vm_string_compare(const struct clog_vm_string* s1, const struct clog_vm_string* s2);
+int clog_vm_string_equal(struct clog_vm_string* s1, struct clog_vm_string* s2);
+
+/* Long results share both sides in a rope, so building a string piece by piece
+ * costs one copy of the result when it is finally read */
+struct clog_vm_string* clog_vm_string_concat(struct clog_vm_heap* heap, struct clog_vm_string* s1, struct clog_vm_string* s2);
+
+#endif /* CLOG_VM_STRING_H_ */
@@ -0,0 +1,52 @@
+/*
+ * clog_test_common.c
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#include "clog_test_common.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+void clog_test_collect(void* param, unsigned long line, const char* msg)
+{
+	struct clog_test_diag* d = param;
+	size_t len = strlen(msg) + 32;
+
+	if (d->len + len > d->alloc)
+	{
+		size_t new_size = (d->alloc == 0 ? 256 : d->alloc * 2);
+		char* new_text;
+		while (new_size < d->len + len)
+			new_size *= 2;
+
+		new_text = realloc(d->text,new_size);
+		if (!new_text)
+		{
+			d->oom = 1;
+			return;
+		}
+		d->text = new_text;
+		d->alloc = new_size;
+	}
+
+	d->len += sprintf(d->text + d->len,"%lu: %s\n",line,msg);
+}
+
+int clog_test_diag_same(const struct clog_test_diag* a, const struct clog_test_diag* b)
+{
+	return (a->len == b->len && (!a->len || memcmp(a->text,b->text,a->len) == 0));
+}
+
+const char* clog_test_diag_text(const struct clog_test_diag* d)
+{
+	return (d->text ? d->text : "");
+}
+
+void clog_test_diag_free(struct clog_test_diag* d)
+{
+	free(d->text);
+	memset(d,0,sizeof(struct clog_test_diag));
+}
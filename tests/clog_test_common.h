@@ -0,0 +1,31 @@
+/*
+ * clog_test_common.h
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#ifndef CLOG_TEST_COMMON_H_
+#define CLOG_TEST_COMMON_H_
+
+#include <stddef.h>
+
+/* Diagnostics collected as "line: message" lines, so runs can be compared byte for byte */
+struct clog_test_diag
+{
+	char*  text;
+	size_t len;
+	size_t alloc;
+	int    oom;
+};
+
+/* A diag_fn for struct clog_diagnostics, param is a struct clog_test_diag */
+void clog_test_collect(void* param, unsigned long line, const char* msg);
+
+int clog_test_diag_same(const struct clog_test_diag* a, const struct clog_test_diag* b);
+
+/* What was collected, "" if nothing was */
+const char* clog_test_diag_text(const struct clog_test_diag* d);
+
+void clog_test_diag_free(struct clog_test_diag* d);
+
+#endif /* CLOG_TEST_COMMON_H_ */
@@ -0,0 +1,131 @@
+#! /bin/sh
+#
+# clog_test_emit_c.sh
+#
+#  Created on: 18 Oct 2026
+#
+# Translates programs with clog --emit-c, builds each against the installed headers
+# and the library alone, and runs it. Every program must report what the interpreter
+# reports for it, line for line, and succeed or fail the same way.
+# Run by make check from the build directory, with CC, CFLAGS and srcdir set
+
+: ${CC:=cc}
+: ${srcdir:=.}
+
+tmp=tests/emit_c.$$
+rm -rf $tmp
+mkdir -p $tmp/include || exit 1
+trap 'rm -rf $tmp' 0 1 2 15
+
+# Only what make install puts in includedir
+for h in clog.h clog_rt.h clog_value.h clog_opcodes.h; do
+	cp "$srcdir/lib/$h" $tmp/include/ || exit 1
+done
+
+# A check that fails divides by false, a runtime error at its line
+cat > $tmp/arith.clog <<'EOF'
+var x = 0;
+for (var i = 0; i < 1000; ++i)
+	x += i & 7;
+var c1 = 1 / (x == 3500);
+var w = 1;
+for (var j = 0; j < 60; ++j)
+	w = w * 3 + j;
+var c2 = 1 / (w == 19783552234239);
+var r = 0.5;
+for (var k = 0; k < 10; ++k)
+	r = r * 1.5 - k;
+var c3 = 1 / (r < 0);
+var b = (x << 3) ^ (x >> 5) | 1;
+var c4 = 1 / (b == 27917);
+var m = -7 % 3;
+var c5 = 1 / (m == -1);
+return x;
+EOF
+
+cat > $tmp/strings.clog <<'EOF'
+var s = "";
+for (var i = 0; i < 20; ++i)
+	s = s + i % 10;
+var c1 = 1 / (s == "01234567890123456789");
+var n = "n=" + 5;
+var c2 = 1 / (n == "n=5");
+var c3 = 1 / ("1" == 1);
+var c4 = 1 / ("abc" < "abd");
+var t = "a";
+t = 1 + t;
+var c5 = 1 / (t == "1a");
+return s;
+EOF
+
+# Fails at run time, in the middle of a loop
+cat > $tmp/error.clog <<'EOF'
+var x = 10;
+for (var i = 0; i < 2000; ++i)
+	x = x + 1000 / (1000 - i);
+return x;
+EOF
+
+failures=0
+for p in arith strings error; do
+	src=$tmp/$p.clog
+
+	if ! ./clog --emit-c $src > $tmp/$p.emit 2>&1; then
+		echo "$p: clog --emit-c failed"
+		cat $tmp/$p.emit
+		failures=`expr $failures + 1`
+		continue
+	fi
+
+	# What the interpreter reports after the warnings both print, without the file name clog puts in front
+	./clog $src > $tmp/$p.vm 2>&1
+	vm_status=$?
+	warnings=`wc -l < $tmp/$p.emit`
+	tail -n +`expr $warnings + 1` $tmp/$p.vm | sed -e "s|^$src: ||" > $tmp/$p.expect
+
+	cat > $tmp/${p}_main.c <<EOF
+#include <stdlib.h>
+#include "clog.h"
+
+int clog_program_$p(const struct clog_allocator* allocator, const struct clog_diagnostics* diagnostics);
+
+int main(void)
+{
+	return (clog_program_$p(NULL,NULL) == 1 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+EOF
+
+	if ! $CC $CFLAGS -I$tmp/include -o $tmp/$p $src.c $tmp/${p}_main.c lib/libclog.a > $tmp/$p.cc 2>&1; then
+		echo "$p: the translation doesn't build"
+		cat $tmp/$p.cc
+		failures=`expr $failures + 1`
+		continue
+	fi
+
+	$tmp/$p > $tmp/$p.out 2>&1
+	status=$?
+
+	if [ $status -ne $vm_status ] || ! cmp -s $tmp/$p.expect $tmp/$p.out; then
+		echo "$p: the translation differs from the interpreter"
+		echo "--- interpreter ($vm_status)"
+		cat $tmp/$p.expect
+		echo "--- translation ($status)"
+		cat $tmp/$p.out
+		failures=`expr $failures + 1`
+	fi
+done
+
+# The last must fail, and say why
+if ! grep "Runtime error: Division by zero at line 3" $tmp/error.expect > /dev/null; then
+	echo "error: expected a division by zero at line 3"
+	cat $tmp/error.expect
+	failures=`expr $failures + 1`
+fi
+
+if [ $failures -ne 0 ]; then
+	echo "$failures failures"
+	exit 1
+fi
+
+echo "Translations ran the same as the interpreter"
+exit 0
@@ -0,0 +1,235 @@
+/*
+ * clog_test_jit.c
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lib/clog.h>
+
+#include "clog_test_common.h"
+
+/* Runs the same programs with the JIT off, entering it on the first loop iteration,
+ * and at the default threshold. Links its own copy of clog_dispatch.c built with
+ * CLOG_JIT and CLOG_RUN_RESULT, which reports the value each run returns, so every
+ * run's diagnostics must match the interpreter's line for line */
+
+static const struct
+{
+	const char* name;
+	const char* src;
+	int         ok;
+} programs[] =
+{
+	{
+		"sum",
+		"var x = 0;\n"
+		"for (var i = 0; i < 5000; ++i)\n"
+		"\tx += i & 7;\n"
+		"return x;\n", 1
+	},
+	{
+		/* Multiplies past 48 bits, native code must wrap the same way */
+		"wrap",
+		"var x = 1;\n"
+		"for (var i = 0; i < 60; ++i)\n"
+		"\tx = x * 3 + i;\n"
+		"return x;\n", 1
+	},
+	{
+		"real",
+		"var r = 0.5;\n"
+		"for (var i = 0; i < 100; ++i)\n"
+		"\tr = r * 1.5 - i;\n"
+		"return r;\n", 1
+	},
+	{
+		/* Integer until half way, then real, so native code has to leave */
+		"mixed",
+		"var x = 0;\n"
+		"for (var i = 0; i < 200; ++i) {\n"
+		"\tif (i == 100)\n"
+		"\t\tx = x + 0.25;\n"
+		"\tx = x + i;\n"
+		"}\n"
+		"return x;\n", 1
+	},
+	{
+		"string",
+		"var s = \"\";\n"
+		"for (var i = 0; i < 50; ++i)\n"
+		"\ts = s + i % 10;\n"
+		"return s;\n", 1
+	},
+	{
+		/* A constant on the left of + can't be an immediate, a string doesn't commute */
+		"prepend",
+		"var s = \"a\";\n"
+		"for (var i = 0; i < 20; ++i)\n"
+		"\ts = 1 + s;\n"
+		"var c = 1 / (s == \"11111111111111111111a\");\n"
+		"return s;\n", 1
+	},
+	{
+		/* Compare immediates either side of the 8-bit range */
+		"compare",
+		"var n = 0;\n"
+		"for (var i = -300; i < 300; i += 7) {\n"
+		"\tif (i < -128)\n"
+		"\t\tn += 1;\n"
+		"\telse if (i <= 127)\n"
+		"\t\tn += 2;\n"
+		"\tif (i > 100)\n"
+		"\t\tn -= 3;\n"
+		"\tif (i == 0 || i != 14)\n"
+		"\t\tn += i;\n"
+		"}\n"
+		"return n;\n", 1
+	},
+	{
+		"bool",
+		"var b = false, c = 0;\n"
+		"for (var i = 0; i < 100; ++i) {\n"
+		"\tb = !b;\n"
+		"\tif (b)\n"
+		"\t\t++c;\n"
+		"}\n"
+		"return b == (c == 50);\n", 1
+	},
+	{
+		"bits",
+		"var x = 12345;\n"
+		"for (var i = 0; i < 40; ++i)\n"
+		"\tx = (x << 3) ^ (x >> 5) | i;\n"
+		"return x;\n", 1
+	},
+	{
+		"nested",
+		"var t = 0;\n"
+		"for (var i = 0; i < 50; ++i)\n"
+		"\tfor (var j = 0; j < i; ++j)\n"
+		"\t\tt = t + i * j - (t & 255);\n"
+		"return t;\n", 1
+	},
+	{
+		"while",
+		"var a = 1, b = 0, i = 0;\n"
+		"while (i < 3000) { var t = a + b; a = b; b = t % 1000; ++i; }\n"
+		"do { b -= 7; } while (b > 0);\n"
+		"return b;\n", 1
+	},
+	{
+		/* Fails in the middle of a hot loop, the error must come from the same line */
+		"error",
+		"var x = 10;\n"
+		"for (var i = 0; i < 2000; ++i)\n"
+		"\tx = x + 1000 / (1000 - i);\n"
+		"return x;\n", 0
+	}
+};
+
+#define PROGRAM_COUNT (sizeof(programs)/sizeof(programs[0]))
+
+/* NULL leaves the default */
+static const char* const thresholds[] = { "0", "1", NULL };
+
+#define RUN_COUNT (sizeof(thresholds)/sizeof(thresholds[0]))
+
+struct result
+{
+	int                   ok;
+	struct clog_test_diag diag;
+};
+
+static int run_one(const void* image, size_t len, const char* threshold, struct result* r)
+{
+	struct clog_diagnostics diagnostics;
+
+	memset(r,0,sizeof(struct result));
+	diagnostics.diag_fn = &clog_test_collect;
+	diagnostics.param = &r->diag;
+
+	if (threshold)
+		setenv("CLOG_JIT_THRESHOLD",threshold,1);
+	else
+		unsetenv("CLOG_JIT_THRESHOLD");
+
+	r->ok = clog_run(NULL,&diagnostics,image,len);
+	return !r->diag.oom;
+}
+
+int main(void)
+{
+	unsigned int failures = 0;
+	unsigned int p, t;
+
+	for (p = 0; p < PROGRAM_COUNT; ++p)
+	{
+		struct result results[RUN_COUNT];
+		struct clog_diagnostics diagnostics;
+		struct clog_test_diag compiled;
+		void* image = NULL;
+		size_t len = 0;
+
+		memset(&compiled,0,sizeof(compiled));
+		diagnostics.diag_fn = &clog_test_collect;
+		diagnostics.param = &compiled;
+
+		if (clog_compile_buffer(NULL,&diagnostics,(const unsigned char*)programs[p].src,strlen(programs[p].src),&image,&len) != 1)
+		{
+			fprintf(stderr,"%s: failed to compile\n%s",programs[p].name,clog_test_diag_text(&compiled));
+			clog_test_diag_free(&compiled);
+			++failures;
+			continue;
+		}
+		clog_test_diag_free(&compiled);
+
+		for (t = 0; t < RUN_COUNT; ++t)
+		{
+			if (!run_one(image,len,thresholds[t],&results[t]))
+			{
+				fprintf(stderr,"Out of memory\n");
+				return EXIT_FAILURE;
+			}
+		}
+
+		/* The interpreter alone is the reference */
+		if ((results[0].ok == 1) != programs[p].ok || !results[0].diag.len)
+		{
+			fprintf(stderr,"%s: unexpected result %d without the JIT\n%s",programs[p].name,results[0].ok,clog_test_diag_text(&results[0].diag));
+			++failures;
+		}
+
+		for (t = 1; t < RUN_COUNT; ++t)
+		{
+			if (results[t].ok != results[0].ok || !clog_test_diag_same(&results[t].diag,&results[0].diag))
+			{
+				fprintf(stderr,"%s: CLOG_JIT_THRESHOLD=%s differs from the interpreter\n--- interpreter (%d)\n%s--- JIT (%d)\n%s",
+						programs[p].name,thresholds[t] ? thresholds[t] : "default",
+						results[0].ok,clog_test_diag_text(&results[0].diag),
+						results[t].ok,clog_test_diag_text(&results[t].diag));
+				++failures;
+			}
+		}
+
+		for (t = 0; t < RUN_COUNT; ++t)
+			clog_test_diag_free(&results[t].diag);
+		free(image);
+	}
+
+	if (failures)
+	{
+		fprintf(stderr,"%u failures\n",failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("%u programs ran the same with and without the JIT\n",(unsigned int)PROGRAM_COUNT);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/*
+ * clog_test_peephole.c
+ *
+ *  Created on: 18 Oct 2026
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lib/clog.h>
+
+/* Compiles programs that give the peephole pass something to do, and runs them.
+ * Links its own copy of clog_codegen_peephole.c built with CLOG_PEEPHOLE_COUNT,
+ * which reports how many instructions each pattern removed, so each program can
+ * require the pattern it was written for. Each checks its own result, dividing
+ * by zero if it is wrong, so a bad rewrite fails the run */
+
+static const struct
+{
+	const char* name;
+	const char* pattern;
+	const char* src;
+} programs[] =
+{
+	{
+		/* Each arm's result is copied into the variable the join reads */
+		"nested", "mov chain",
+		"var x = 0;\n"
+		"for (var i = 0; i < 100; ++i) {\n"
+		"\tif (i & 1) {\n"
+		"\t\tif (i & 2) x += 1; else x += 2;\n"
+		"\t} else x += 3;\n"
+		"}\n"
+		"var c = 1 / (x == 225);\n"
+		"return x;\n"
+	},
+	{
+		/* Leaves a JMP after the inner loop's back edge that nothing reaches */
+		"break", "unreachable",
+		"var n = 0;\n"
+		"for (var i = 0; i < 10; ++i)\n"
+		"\tfor (var j = 0; j < 10; ++j) {\n"
+		"\t\tif (j > i) break;\n"
+		"\t\tn += j;\n"
+		"\t}\n"
+		"var c = 1 / (n == 165);\n"
+		"return n;\n"
+	}
+};
+
+#define PROGRAM_COUNT (sizeof(programs)/sizeof(programs[0]))
+
+struct counts
+{
+	const char*   pattern;
+	unsigned long removed;
+	unsigned int  reports;
+	int           failed;
+};
+
+static void count_fn(void* param, unsigned long line, const char* msg)
+{
+	struct counts* c = param;
+	char name[32];
+	unsigned long removed;
+
+	if (sscanf(msg,"Peephole %31[^:]: removed %lu instructions",name,&removed) == 2)
+	{
+		++c->reports;
+		if (strcmp(name,c->pattern) == 0)
+			c->removed += removed;
+	}
+	else
+	{
+		fprintf(stderr,"%lu: %s\n",line,msg);
+		c->failed = 1;
+	}
+}
+
+int main(void)
+{
+	unsigned int failures = 0;
+	unsigned int p;
+
+	for (p = 0; p < PROGRAM_COUNT; ++p)
+	{
+		struct clog_diagnostics diagnostics;
+		struct counts counts;
+		void* image = NULL;
+		size_t len = 0;
+
+		memset(&counts,0,sizeof(counts));
+		counts.pattern = programs[p].pattern;
+		diagnostics.diag_fn = &count_fn;
+		diagnostics.param = &counts;
+
+		if (clog_compile_buffer(NULL,&diagnostics,(const unsigned char*)programs[p].src,strlen(programs[p].src),&image,&len) != 1 || counts.failed)
+		{
+			fprintf(stderr,"%s: failed to compile\n",programs[p].name);
+			free(image);
+			++failures;
+			continue;
+		}
+
+		if (!counts.reports)
+		{
+			fprintf(stderr,"%s: the peephole pass reported nothing\n",programs[p].name);
+			++failures;
+		}
+		else if (!counts.removed)
+		{
+			fprintf(stderr,"%s: %s removed nothing\n",programs[p].name,programs[p].pattern);
+			++failures;
+		}
+
+		if (clog_run(NULL,&diagnostics,image,len) != 1 || counts.failed)
+		{
+			fprintf(stderr,"%s: failed to run\n",programs[p].name);
+			++failures;
+		}
+
+		free(image);
+	}
+
+	if (failures)
+	{
+		fprintf(stderr,"%u failures\n",failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("%u programs ran correctly after their peephole patterns\n",(unsigned int)PROGRAM_COUNT);
+	return EXIT_SUCCESS;
+}
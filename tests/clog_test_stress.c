@@ -0,0 +1,272 @@
+/*
+ * clog_test_stress.c
+ *
+ *  Created on: 17 Oct 2026
+ */
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <lib/clog.h>
+
+#include "clog_test_common.h"
+
+/* Compiles the same programs serially and then on many threads at once.
+ * Compilations share no state, so every parallel result must match the serial one,
+ * image and diagnostics byte for byte, and every allocator must end up empty */
+
+static const struct
+{
+	const char* src;
+	int         ok;
+} sources[] =
+{
+	{
+		"var x = 0;\n"
+		"for (var i = 0; i < 100; ++i)\n"
+		"\tx += i;\n"
+		"if (x != 4950)\n"
+		"\tx = -1;\n"
+		"return x;\n", 1
+	},
+	{
+		"var s = \"a\", i = 0;\n"
+		"while (i < 10) { s = s + \"b\"; ++i; }\n"
+		"return s;\n", 1
+	},
+	{
+		"const k = 7;\n"
+		"var y = k * 6;\n"
+		"do { y -= 1; } while (y > k);\n", 1
+	},
+	{
+		/* Compiles, with a warning */
+		"var w = 1;\n"
+		"w;\n", 1
+	},
+	{
+		"var a = 1;\n"
+		"a = b + 1;\n", 0
+	},
+	{
+		"var = ;\n", 0
+	},
+	{
+		"const c = 1;\n"
+		"c = 2;\n", 0
+	}
+};
+
+#define SOURCE_COUNT (sizeof(sources)/sizeof(sources[0]))
+
+/* Nested deeply enough to grow the parser's stack */
+#define NEST_DEPTH 400
+
+struct result
+{
+	int                   ok;
+	void*                 image;
+	size_t                image_len;
+	struct clog_test_diag diag;
+	long                  live;
+};
+
+/* Counts what is still allocated, so a leak in one compilation shows up in its own result */
+static void* count_alloc(void* param, size_t s)
+{
+	size_t* p = malloc(s + sizeof(size_t) * 2);
+	if (!p)
+		return NULL;
+	*p = s;
+	++((struct result*)param)->live;
+	return p + 2;
+}
+
+static void* count_realloc(void* param, void* ptr, size_t s)
+{
+	size_t* p;
+	if (!ptr)
+		return count_alloc(param,s);
+
+	p = realloc((size_t*)ptr - 2,s + sizeof(size_t) * 2);
+	if (!p)
+		return NULL;
+	*p = s;
+	return p + 2;
+}
+
+static void count_free(void* param, void* ptr)
+{
+	if (ptr)
+	{
+		--((struct result*)param)->live;
+		free((size_t*)ptr - 2);
+	}
+}
+
+static char* nested_source(size_t* len)
+{
+	char* src = malloc(NEST_DEPTH * 2 + 32);
+	size_t i;
+	if (!src)
+		return NULL;
+
+	*len = 0;
+	for (i = 0; i < NEST_DEPTH; ++i)
+		src[(*len)++] = '{';
+	*len += sprintf(src + *len,"var n = 1;");
+	for (i = 0; i < NEST_DEPTH; ++i)
+		src[(*len)++] = '}';
+	src[*len] = '\0';
+	return src;
+}
+
+static const char* nested;
+static size_t nested_len;
+
+static void compile_one(unsigned int n, struct result* r)
+{
+	struct clog_allocator allocator;
+	struct clog_diagnostics diagnostics;
+	const char* src = (n < SOURCE_COUNT ? sources[n].src : nested);
+	size_t len = (n < SOURCE_COUNT ? strlen(src) : nested_len);
+
+	memset(r,0,sizeof(struct result));
+
+	allocator.alloc_fn = &count_alloc;
+	allocator.realloc_fn = &count_realloc;
+	allocator.free_fn = &count_free;
+	allocator.param = r;
+	diagnostics.diag_fn = &clog_test_collect;
+	diagnostics.param = &r->diag;
+
+	r->ok = clog_compile_buffer(&allocator,&diagnostics,(const unsigned char*)src,len,&r->image,&r->image_len);
+	if (r->ok != 1)
+		r->image = NULL;
+
+	/* The image is the one allocation the caller owns */
+	if (r->image)
+		--r->live;
+}
+
+static void result_free(struct result* r)
+{
+	if (r->image)
+		free((size_t*)r->image - 2);
+	clog_test_diag_free(&r->diag);
+}
+
+static int same(const struct result* a, const struct result* b)
+{
+	return (a->ok == b->ok &&
+			a->image_len == b->image_len &&
+			(!a->image_len || memcmp(a->image,b->image,a->image_len) == 0) &&
+			clog_test_diag_same(&a->diag,&b->diag));
+}
+
+#define PROGRAMS   (SOURCE_COUNT + 1)
+#define THREADS    8
+#define ITERATIONS 50
+
+static struct result serial[PROGRAMS];
+
+struct worker
+{
+	pthread_t    thread;
+	unsigned int id;
+	unsigned int failures;
+};
+
+static void* work(void* param)
+{
+	struct worker* w = param;
+	unsigned int i;
+
+	for (i = 0; i < ITERATIONS; ++i)
+	{
+		/* Each thread starts at a different program, so different compilations overlap */
+		unsigned int n = (i + w->id) % PROGRAMS;
+		struct result r;
+
+		compile_one(n,&r);
+		if (r.diag.oom || r.live != 0 || !same(&r,&serial[n]))
+		{
+			if (w->failures++ == 0)
+				fprintf(stderr,"Thread %u: program %u differs from the serial run (%ld allocations live)\n",w->id,n,r.live);
+		}
+		result_free(&r);
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct worker workers[THREADS];
+	unsigned int failures = 0;
+	unsigned int i;
+
+	nested = nested_source(&nested_len);
+	if (!nested)
+	{
+		fprintf(stderr,"Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < PROGRAMS; ++i)
+	{
+		compile_one(i,&serial[i]);
+		if (serial[i].diag.oom || serial[i].live != 0)
+		{
+			fprintf(stderr,"Program %u: %ld allocations live after a serial compilation\n",i,serial[i].live);
+			++failures;
+		}
+	}
+
+	/* The programs that should compile, must, and the ones that shouldn't must say why */
+	for (i = 0; i < PROGRAMS; ++i)
+	{
+		int expect = (i < SOURCE_COUNT ? sources[i].ok : 1);
+		if ((serial[i].ok == 1) != expect || (!expect && !serial[i].diag.len))
+		{
+			fprintf(stderr,"Program %u: unexpected result %d\n%s",i,serial[i].ok,clog_test_diag_text(&serial[i].diag));
+			++failures;
+		}
+	}
+
+	for (i = 0; i < THREADS; ++i)
+	{
+		workers[i].id = i;
+		workers[i].failures = 0;
+		if (pthread_create(&workers[i].thread,NULL,&work,&workers[i]) != 0)
+		{
+			fprintf(stderr,"Failed to start thread %u\n",i);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < THREADS; ++i)
+	{
+		pthread_join(workers[i].thread,NULL);
+		failures += workers[i].failures;
+	}
+
+	for (i = 0; i < PROGRAMS; ++i)
+		result_free(&serial[i]);
+	free((char*)nested);
+
+	if (failures)
+	{
+		fprintf(stderr,"%u failures\n",failures);
+		return EXIT_FAILURE;
+	}
+
+	printf("%u threads x %u compilations matched the serial run\n",THREADS,ITERATIONS);
+	return EXIT_SUCCESS;
+}